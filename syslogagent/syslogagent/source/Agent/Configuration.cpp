@@ -10,6 +10,7 @@ Copyright 2021 Logzilla Corp.
 #include "RecordNumber.h"
 #include "Registry.h"
 #include "SyslogAgentSharedConstants.h"
+#include "Utf8Transcoder.h"
 #include "Util.h"
 #include "WindowsEventLog.h"
 
@@ -21,12 +22,12 @@ namespace {
     size_t local_wstr2str(char* dest, size_t dest_size, const wchar_t* src) {
         if (!dest || !src || dest_size == 0) return 0;
 
-        size_t converted = 0;
-        if (WideCharToMultiByte(CP_UTF8, 0, src, -1, dest, static_cast<int>(dest_size), NULL, NULL)) {
-            converted = strlen(dest);
+        size_t needed = Utf8Transcoder::utf16ToUtf8(src, wcslen(src), dest, dest_size);
+        if (needed >= dest_size) {
+            dest[0] = '\0';
+            return 0;
         }
-        dest[dest_size - 1] = '\0';  // Ensure null termination
-        return converted;
+        return needed;
     }
 }
 
@@ -195,12 +196,52 @@ void Configuration::loadFromRegistry(bool running_from_console, bool override_lo
     tail_program_name_ = registry.readString(SharedConstants::RegistryKey::TAIL_PROGRAM_NAME, L"");
     include_vs_ignore_eventids_ = registry.readBool(SharedConstants::RegistryKey::INCLUDE_VS_IGNORE_EVENT_IDS, false);
     loadFilterIds(registry.readString(SharedConstants::RegistryKey::EVENT_ID_FILTER, L""));
+    event_level_filter_ = registry.readInt(SharedConstants::RegistryKey::EVENT_LEVEL_FILTER,
+        SharedConstants::Defaults::EVENT_LEVEL_FILTER);
+    event_rules_file_ = registry.readString(SharedConstants::RegistryKey::EVENT_RULES_FILE,
+        SharedConstants::Defaults::EVENT_RULES_FILE);
+    dedup_window_ms_ = registry.readInt(SharedConstants::RegistryKey::DEDUP_WINDOW_MS,
+        SharedConstants::Defaults::DEDUP_WINDOW_MS);
+    raw_event_mode_ = registry.readBool(SharedConstants::RegistryKey::RAW_EVENT_MODE,
+        SharedConstants::Defaults::RAW_EVENT_MODE);
+    overload_high_water_ = registry.readInt(SharedConstants::RegistryKey::OVERLOAD_HIGH_WATER,
+        SharedConstants::Defaults::OVERLOAD_HIGH_WATER);
+    aggregate_window_ms_ = registry.readInt(SharedConstants::RegistryKey::AGGREGATE_WINDOW_MS,
+        SharedConstants::Defaults::AGGREGATE_WINDOW_MS);
+    field_projection_file_ = registry.readString(SharedConstants::RegistryKey::FIELD_PROJECTION_FILE,
+        SharedConstants::Defaults::FIELD_PROJECTION_FILE);
+    redaction_file_ = registry.readString(SharedConstants::RegistryKey::REDACTION_FILE,
+        SharedConstants::Defaults::REDACTION_FILE);
+    template_mining_ = registry.readBool(SharedConstants::RegistryKey::TEMPLATE_MINING,
+        SharedConstants::Defaults::TEMPLATE_MINING);
+    skip_message_text_providers_ = registry.readString(SharedConstants::RegistryKey::SKIP_MESSAGE_TEXT_PROVIDERS,
+        SharedConstants::Defaults::SKIP_MESSAGE_TEXT_PROVIDERS);
+    message_text_sample_interval_ = registry.readInt(SharedConstants::RegistryKey::MESSAGE_TEXT_SAMPLE_INTERVAL,
+        SharedConstants::Defaults::MESSAGE_TEXT_SAMPLE_INTERVAL);
+    render_threads_ = registry.readInt(SharedConstants::RegistryKey::RENDER_THREADS,
+        SharedConstants::Defaults::RENDER_THREADS);
+    record_tracking_ = registry.readBool(SharedConstants::RegistryKey::RECORD_TRACKING,
+        SharedConstants::Defaults::RECORD_TRACKING);
+    pipeline_stages_ = registry.readString(SharedConstants::RegistryKey::PIPELINE_STAGES,
+        SharedConstants::Defaults::PIPELINE_STAGES);
+    incremental_batching_ = registry.readBool(SharedConstants::RegistryKey::INCREMENTAL_BATCHING,
+        SharedConstants::Defaults::INCREMENTAL_BATCHING);
 
     // Load batch configuration
     max_batch_size_ = static_cast<uint32_t>(registry.readInt(SharedConstants::RegistryKey::MAX_BATCH_SIZE,
         SharedConstants::Defaults::MAX_BATCH_SIZE));
     max_batch_age_ = static_cast<uint32_t>(registry.readInt(SharedConstants::RegistryKey::MAX_BATCH_AGE,
         SharedConstants::Defaults::MAX_BATCH_AGE));
+    adaptive_batching_ = registry.readBool(SharedConstants::RegistryKey::ADAPTIVE_BATCHING,
+        SharedConstants::Defaults::ADAPTIVE_BATCHING);
+    min_batch_size_ = static_cast<uint32_t>(registry.readInt(SharedConstants::RegistryKey::MIN_BATCH_SIZE,
+        SharedConstants::Defaults::MIN_BATCH_SIZE));
+    target_post_latency_ = static_cast<uint32_t>(registry.readInt(SharedConstants::RegistryKey::TARGET_POST_LATENCY,
+        SharedConstants::Defaults::TARGET_POST_LATENCY));
+    batch_target_bytes_ = static_cast<uint32_t>(registry.readInt(SharedConstants::RegistryKey::BATCH_TARGET_BYTES,
+        SharedConstants::Defaults::BATCH_TARGET_BYTES));
+    compression_level_ = registry.readInt(SharedConstants::RegistryKey::COMPRESSION_LEVEL,
+        SharedConstants::Defaults::COMPRESSION_LEVEL);
 
     auto channels = registry.readChannels();
     logs_.clear();
@@ -219,6 +260,7 @@ void Configuration::loadFromRegistry(bool running_from_console, bool override_lo
     }
 
     registry.close();
+    generation_.fetch_add(1, std::memory_order_release);
 
     logger->debug("Loaded configuration from registry (from console: %s)\n", 
         (running_from_console ? "true" : "false"));
@@ -5,6 +5,7 @@ Copyright 2021 Logzilla Corp.
 
 #pragma once
 
+#include <atomic>
 #include <set>
 #include <vector>
 #include <memory>
@@ -42,6 +43,9 @@ namespace Syslog_agent {
         void loadFromRegistry(bool running_from_console, bool override_log_level, 
             Logger::LogLevel override_log_level_setting);
         void saveToRegistry() const;
+        // Changes every time the configuration is (re)loaded, so anything
+        // built from it can tell when to rebuild
+        uint32_t getGeneration() const { return generation_.load(std::memory_order_acquire); }
 
         // Thread-safe accessors
         bool hasSecondaryHost() const;
@@ -139,6 +143,81 @@ namespace Syslog_agent {
             return include_vs_ignore_eventids_;
         }
 
+        int getEventLevelFilter() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return event_level_filter_;
+        }
+
+        wstring getEventRulesFile() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return event_rules_file_;
+        }
+
+        int getDedupWindowMs() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return dedup_window_ms_;
+        }
+
+        bool getRawEventMode() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return raw_event_mode_;
+        }
+
+        int getOverloadHighWater() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return overload_high_water_;
+        }
+
+        int getAggregateWindowMs() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return aggregate_window_ms_;
+        }
+
+        wstring getFieldProjectionFile() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return field_projection_file_;
+        }
+
+        wstring getRedactionFile() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return redaction_file_;
+        }
+
+        bool getTemplateMining() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return template_mining_;
+        }
+
+        wstring getSkipMessageTextProviders() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return skip_message_text_providers_;
+        }
+
+        int getMessageTextSampleInterval() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return message_text_sample_interval_;
+        }
+
+        int getRenderThreads() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return render_threads_;
+        }
+
+        bool getRecordTracking() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return record_tracking_;
+        }
+
+        wstring getPipelineStages() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return pipeline_stages_;
+        }
+
+        bool getIncrementalBatching() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return incremental_batching_;
+        }
+
         bool getOnlyWhileRunning() const {
             shared_lock<shared_mutex> lock(mutex_);
             return only_while_running_;
@@ -207,6 +286,31 @@ namespace Syslog_agent {
             return max_batch_age_;
         }
 
+        bool getAdaptiveBatching() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return adaptive_batching_;
+        }
+
+        uint32_t getMinBatchCount() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return min_batch_size_;
+        }
+
+        uint32_t getTargetPostLatency() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return target_post_latency_;
+        }
+
+        uint32_t getBatchTargetBytes() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return batch_target_bytes_;
+        }
+
+        int getCompressionLevel() const {
+            shared_lock<shared_mutex> lock(mutex_);
+            return compression_level_;
+        }
+
         // Protected data access for internal use
         class ScopedAccess {
         public:
@@ -259,6 +363,22 @@ namespace Syslog_agent {
         wstring tail_program_name_;
         int utc_offset_minutes_;
         bool include_vs_ignore_eventids_;
+        std::atomic<uint32_t> generation_{ 0 };
+        int event_level_filter_ = SharedConstants::Defaults::EVENT_LEVEL_FILTER;
+        wstring event_rules_file_;
+        int dedup_window_ms_ = SharedConstants::Defaults::DEDUP_WINDOW_MS;
+        bool raw_event_mode_ = SharedConstants::Defaults::RAW_EVENT_MODE;
+        int overload_high_water_ = SharedConstants::Defaults::OVERLOAD_HIGH_WATER;
+        int aggregate_window_ms_ = SharedConstants::Defaults::AGGREGATE_WINDOW_MS;
+        wstring field_projection_file_;
+        wstring redaction_file_;
+        bool template_mining_ = SharedConstants::Defaults::TEMPLATE_MINING;
+        wstring skip_message_text_providers_;
+        int message_text_sample_interval_ = SharedConstants::Defaults::MESSAGE_TEXT_SAMPLE_INTERVAL;
+        int render_threads_ = SharedConstants::Defaults::RENDER_THREADS;
+        bool record_tracking_ = SharedConstants::Defaults::RECORD_TRACKING;
+        wstring pipeline_stages_;
+        bool incremental_batching_ = SharedConstants::Defaults::INCREMENTAL_BATCHING;
         bool only_while_running_;
         string primary_logzilla_version_ = SharedConstants::Defaults::LOGZILLA_VER;
         string secondary_logzilla_version_ = SharedConstants::Defaults::LOGZILLA_VER;
@@ -269,6 +389,11 @@ namespace Syslog_agent {
 		bool use_compression_ = SharedConstants::USE_COMPRESSION;
         uint32_t max_batch_size_ = SharedConstants::Defaults::MAX_BATCH_SIZE;
         uint32_t max_batch_age_ = SharedConstants::Defaults::MAX_BATCH_AGE;
+        bool adaptive_batching_ = SharedConstants::Defaults::ADAPTIVE_BATCHING;
+        uint32_t min_batch_size_ = SharedConstants::Defaults::MIN_BATCH_SIZE;
+        uint32_t target_post_latency_ = SharedConstants::Defaults::TARGET_POST_LATENCY;
+        uint32_t batch_target_bytes_ = SharedConstants::Defaults::BATCH_TARGET_BYTES;
+        int compression_level_ = SharedConstants::Defaults::COMPRESSION_LEVEL;
 
         // Thread synchronization
         mutable shared_mutex mutex_;
@@ -13,7 +13,10 @@ Copyright 2021 Logzilla Corp.
 #include "EventHandlerMessageQueuer.h"
 #include "Logger.h"
 #include "Globals.h"
+#include "Utf8Transcoder.h"
 #include "Util.h"
+#include "AgentStatistics.h"
+#include "FastHash.h"
 #include "OStreamBuf.h"
 #include "SyslogSender.h"
 #include "StatefulLogger.h"
@@ -32,27 +35,26 @@ namespace Syslog_agent {
     void EventHandlerMessageQueuer::EventData::parseFrom(EventLogEvent& event, const Configuration& config) {
         auto logger = LOG_THIS;
 
+        auto system_node = event.getXmlDoc().child("Event").child("System");
+
         // Get provider
-        auto provider_value = event.getXmlDoc().child("Event").child("System")
-            .child("Provider").attribute("Name").value();
-        safeCopyString(provider, MAX_PROVIDER_LEN, provider_value);
+        provider = system_node.child("Provider").attribute("Name").value();
 
         // Get event ID
-        auto event_id_value = event.getXmlDoc().child("Event").child("System")
-            .child("EventID").child_value();
-        safeCopyString(event_id, MAX_EVENT_ID_LEN, event_id_value);
+        event_id = system_node.child("EventID").child_value();
 
         // Get message text
         auto message_value = event.getEventText();
-        safeCopyString(message, MAX_MESSAGE_LEN, message_value);
-        if (!message[0]) {
-            safeCopyString(message, MAX_MESSAGE_LEN, "(no event message given)");
+        if (message_value && message_value[0]) {
+            message = message_value;
+        }
+        else {
+            message = "(no event message given)";
         }
 
         // Get and process timestamp from the event XML.
         // Expected format: "YYYY-MM-DDTHH:MM:SS[.microsecs]Z"
-        auto time_field = event.getXmlDoc().child("Event").child("System")
-            .child("TimeCreated").attribute("SystemTime").value();
+        auto time_field = system_node.child("TimeCreated").attribute("SystemTime").value();
 
         int year, month, day, hour, minute, second;
         int microsecs = 0;
@@ -84,75 +86,94 @@ namespace Syslog_agent {
         }
 
         // Determine severity.
+        auto level = system_node.child("Level").child_value();
+        windows_level = (level && level[0]) ? atoi(level) : 0;
         if (config.getSeverity() == SharedConstants::Severities::DYNAMIC) {
-            auto level = event.getXmlDoc().child("Event").child("System")
-                .child("Level").child_value();
-            char level_char = '\0';
-            if (level && level[0]) {
-                char temp[2] = { 0 };
-                WideCharToMultiByte(CP_UTF8, 0, reinterpret_cast<LPCWCH>(level), 1,
-                    temp, sizeof(temp), nullptr, nullptr);
-                level_char = temp[0];
-            }
-            severity = level_char ? unixSeverityFromWindowsSeverity(level_char)
+            severity = (level && level[0]) ? unixSeverityFromWindowsSeverity(level[0])
                 : SharedConstants::Severities::NOTICE;
         }
         else {
             severity = static_cast<unsigned char>(config.getSeverity());
         }
 
+        // Account the event was logged under.  The lookup never waits: the
+        // first events from a new SID go out with just the SID.
+        user_account[0] = '\0';
+        if (config.getLookupAccounts()) {
+            user_sid = system_node.child("Security").attribute("UserID").value();
+            if (!user_sid.empty()) {
+                Globals::instance()->getSidResolverCache().lookup(user_sid, user_account,
+                    sizeof(user_account));
+            }
+        }
+
         // Parse additional event data fields.
-        event_data_count = 0;
+        event_data.clear();
         pugi::xml_node event_data_node = event.getXmlDoc().child("Event").child("EventData");
         for (pugi::xml_node data_item = event_data_node.first_child(); data_item;
             data_item = data_item.next_sibling())
         {
             auto data_name = data_item.attribute("Name").value();
             if (data_name && data_name[0]) {
-                addEventData(data_name, data_item.child_value());
+                event_data.push_back({ data_name, data_item.child_value() });
             }
         }
     }
 
     size_t EventHandlerMessageQueuer::estimateMessageSize(
-        const EventHandlerMessageQueuer::EventData& data, int logformat) const
+        const EventHandlerMessageQueuer::EventData& data, int logformat)
     {
-        size_t estimated_size = 0;
-
-        // Base JSON structure
-        estimated_size += 2;  // Opening and closing braces
+        auto templates = currentTemplates();
 
-        // Root level fields
-        if (!this->configuration_.getHostName().empty()) {
-            estimated_size += 10 + this->configuration_.getHostName().length();  // "host": ""
-        }
-        estimated_size += 12 + strlen(data.provider);  // "program": ""
-        estimated_size += 12 + strlen(data.message);   // "message": ""
+        // Constant parts (the HTTP prefix is the larger one)
+        size_t estimated_size = templates->http_prefix.length() + templates->suffix.length() + 4;
 
-        // extra_fields object
-        estimated_size += 20;  // ", "extra_fields": {"
-        estimated_size += 50;  // Basic fields (severity, facility, etc)
-        estimated_size += strlen(data.event_id) + log_name_utf8_.length() + 30;
+        // generateJson truncates a long message to fit, so count at most MAX_MESSAGE_ESTIMATE of it
+        estimated_size += 2 * (12 + data.provider.size());  // "program": "", twice for HTTP
+        estimated_size += 2 * (14 + min(data.message.size(), MAX_MESSAGE_ESTIMATE));  // "message": ""
+        estimated_size += 70 + data.event_id.size();        // event_id, severity, sample_rate
 
         if (data.timestamp[0] != '\0') {
             estimated_size += strlen(data.timestamp) + strlen(data.microsec) + 25;
         }
 
         // Event data fields
-        for (size_t i = 0; i < data.event_data_count; i++) {
-            if (data.event_data[i].used) {
-                estimated_size += strlen(data.event_data[i].key) + strlen(data.event_data[i].value) + ESTIMATED_FIELD_OVERHEAD;
-            }
+        for (const auto& pair : data.event_data) {
+            estimated_size += pair.key.size() + pair.value.size() + ESTIMATED_FIELD_OVERHEAD;
         }
-
-        // Suffix if present
-        if (!configuration_.getSuffix().empty()) {
-            estimated_size += suffix_utf8_.length();
+        if (!data.raw_json.empty()) {
+            estimated_size += data.raw_json.size() + 16;
+        }
+        if (!data.user_sid.empty()) {
+            estimated_size += data.user_sid.size() + strlen(data.user_account) + 32;
         }
 
         return estimated_size;
     }
 
+    namespace {
+        // Writes text JSON-escaped, copied straight from the string table when
+        // it can be interned, otherwise escaped into scratch
+        void writeEscaped(std::ostream& out, const char* text, char* scratch, size_t scratch_size) {
+            auto entry = Globals::instance()->getJsonStringTable().intern(text);
+            if (entry != nullptr) {
+                out.write(entry->escaped, entry->escaped_length);
+                return;
+            }
+            size_t length = Util::jsonEscapeString(text, scratch, scratch_size);
+            out.write(scratch, length);
+        }
+
+        struct MessageBufferRelease {
+            char* buffer;
+            ~MessageBufferRelease() {
+                if (buffer != nullptr) {
+                    Globals::instance()->releaseMessageBuffer(buffer);
+                }
+            }
+        };
+    }
+
     void epoch_to_datetime(std::time_t epoch, char* buffer, size_t bufsize) {
         if (bufsize < 20) return;  // Need 19 chars + null terminator
         
@@ -164,12 +185,9 @@ namespace Syslog_agent {
     }
 
     Result EventHandlerMessageQueuer::generateLogMessage(
-        EventLogEvent& event, const int logformat, char* json_buffer, size_t buflen)
+        const EventData& data, const int logformat, char* json_buffer, size_t buflen)
     {
         auto logger = LOG_THIS;
-        EventHandlerMessageQueuer::EventData data;
-        data.parseFrom(event, this->configuration_);
-
         char* end;
         long event_timestamp_value = std::strtol(data.timestamp, &end, 10);
 
@@ -181,15 +199,13 @@ namespace Syslog_agent {
             char buffer[20];  // YYYY-MM-DD HH:MM:SS\0
             epoch_to_datetime(event_timestamp_value, buffer, sizeof(buffer));    
             if (event_timestamp_value < earliest_allowed_timestamp) {
-                if (!skipping_dates_) {
-                    skipping_dates_ = true;
+                if (!skipping_dates_.exchange(true)) {
                     logger->warning("Skipping events starting from %s\n", buffer);
                 }
                 return Result(ERROR_CANCELLED, "generateLogMessage", "Event too old, skipped.");
             }
             else {
-                if (skipping_dates_) {
-                    skipping_dates_ = false;
+                if (skipping_dates_.exchange(false)) {
                     logger->info("End skipping dates starting at %s\n", buffer);
                 }
             }
@@ -208,6 +224,9 @@ namespace Syslog_agent {
         size_t buflen)
     {
         auto logger = LOG_THIS;
+        auto templates = currentTemplates();
+        bool http_format = logformat == SharedConstants::LOGFORMAT_HTTPPORT;
+
         // Use stack-based buffer for stream
         OStreamBuf<char> ostream_buffer(json_buffer, buflen);
         std::ostream json_output(&ostream_buffer);
@@ -222,99 +241,147 @@ namespace Syslog_agent {
             return true;
             };
 
-        // Start JSON object
-        json_output << "{";
-
-        // Add root level fields
-        const string& hostname = configuration_.getHostName();
+        // One scratch buffer for everything that has to be escaped per event,
+        // and one for the message
+        char* escaped_value = Globals::instance()->getMessageBuffer("jsonEscapeValue");
+        MessageBufferRelease scratch_release{ escaped_value };
+        char* msg_buf = Globals::instance()->getMessageBuffer("jsonEscapeMessage");
+        MessageBufferRelease message_release{ msg_buf };
 
-        // http ingestion will accept these at root
-        if (!hostname.empty()) {
-            if (!checkBufferSpace("hostname", hostname.length() + 10)) {
-                return false;
-            }
-            json_output << "\"host\":\"" << hostname << "\",";
-        }
+        // Constant fields, already serialized
+        const string& prefix = http_format ? templates->http_prefix : templates->json_prefix;
+        json_output.write(prefix.data(), prefix.size());
 
-        // Add program and timestamp for HTTP format
-        if (!checkBufferSpace("program", strlen(data.provider) + 20)) {
+        // Per-event fields
+        if (!checkBufferSpace("program", data.provider.size() + data.event_id.size() + 60)) {
             return false;
         }
-        json_output << "\"program\":\"" << data.provider << "\"";
-
-
-        json_output << ", ";
-        // Start extra_fields for HTTP format
-        if (logformat == SharedConstants::LOGFORMAT_HTTPPORT) {
-            json_output << "\"extra_fields\": {";
+        json_output << ", \"program\":\"";
+        writeEscaped(json_output, data.provider.data(), escaped_value, Globals::MESSAGE_BUFFER_SIZE);
+        json_output << "\", \"event_id\":\"" << data.event_id << "\""
+            << ", \"severity\":\"" << static_cast<unsigned int>(data.severity) << "\"";
+        if (data.sample_rate > 1) {
+            json_output << ", \"sample_rate\":\"" << data.sample_rate << "\"";
         }
-        json_output << "\"_source_type\": \"WindowsAgent\""
-            << ", \"_source_tag\":\"windows_agent\""
-            << ", \"_log_type\":\"eventlog\""
-            << ", \"event_id\":\"" << data.event_id << "\""
-            << ", \"event_log\":\"" << log_name_utf8_ << "\"";
-        json_output << ", \"severity\":\"" << static_cast<unsigned int>(data.severity) << "\""
-            << ", \"facility\":\"" << configuration_.getFacility() << "\"";
         if (data.timestamp[0] != '\0') {
            if (!checkBufferSpace("timestamp", strlen(data.timestamp) + strlen(data.microsec) + 40)) {
                return false;
            }
            json_output << ", \"ts\": \"" << data.timestamp << "." << data.microsec << "\"";
         }
-
-        if (logformat == SharedConstants::LOGFORMAT_HTTPPORT) {
-            // rule wants these two inside extra_fields
-            if (!hostname.empty()) {
-                if (!checkBufferSpace("hostname", hostname.length() + 10)) {
-                    return false;
-                }
-                json_output << ", \"host\":\"" << hostname << "\",";
-            }
-
-            // Add program and timestamp for HTTP format
-            if (!checkBufferSpace("program", strlen(data.provider) + 20)) {
+        if (!data.user_sid.empty()) {
+            if (!checkBufferSpace("user", data.user_sid.size() + strlen(data.user_account) * 6 + 32)) {
                 return false;
             }
-            json_output << "\"program\":\"" << data.provider << "\"";
+            json_output << ", \"user_sid\":\"";
+            writeEscaped(json_output, data.user_sid.data(), escaped_value, Globals::MESSAGE_BUFFER_SIZE);
+            json_output << "\"";
+            if (data.user_account[0] != '\0') {
+                json_output << ", \"user\":\"";
+                writeEscaped(json_output, data.user_account, escaped_value, Globals::MESSAGE_BUFFER_SIZE);
+                json_output << "\"";
+            }
         }
 
 #if ONLY_FOR_DEBUGGING_CURRENTLY_DISABLED
-        StatefulLogger::setEventId(data.event_id);
+        StatefulLogger::setEventId(data.event_id.data());
         StatefulLogger::setEventLog(log_name_utf8_.c_str());
         StatefulLogger::setEventDatetime(data.timestamp);
 #endif
 
-        // Add event data fields
-        if (data.event_data_count > 0) {
-            for (size_t i = 0; i < data.event_data_count; i++) {
-                if (!data.event_data[i].used) continue;
+        // Add event data fields, less any the projection leaves out
+        auto& string_table = Globals::instance()->getJsonStringTable();
+        const auto* projection = data.projection;
+        size_t projected_bytes = 0;
+        uint64_t projected_fields = 0;
+        for (const auto& pair : data.event_data) {
+            // key names repeat across events; values mostly don't
+            auto key = string_table.intern(pair.key);
+            if (projection != nullptr && !projection->keeps(key, pair.key)) {
+                projected_bytes += pair.key.size() + pair.value.size() + 8;    // , "":""
+                ++projected_fields;
+                continue;
+            }
 
-                const size_t field_size = strlen(data.event_data[i].key) + strlen(data.event_data[i].value) + ESTIMATED_FIELD_OVERHEAD;
-                if (!checkBufferSpace(data.event_data[i].key, field_size)) {
-                    break;
-                }
+            const size_t field_size = pair.key.size() + pair.value.size() + ESTIMATED_FIELD_OVERHEAD;
+            if (!checkBufferSpace(pair.key.data(), field_size)) {
+                break;
+            }
 
-                char* escaped_name = Globals::instance()->getMessageBuffer("jsonEscapeName");
-                char* escaped_value = Globals::instance()->getMessageBuffer("jsonEscapeValue");
+            json_output << ", \"";
+            if (key != nullptr) {
+                json_output.write(key->escaped, key->escaped_length);
+            }
+            else {
+                size_t key_length = Util::jsonEscapeString(pair.key.data(), escaped_value,
+                    Globals::MESSAGE_BUFFER_SIZE);
+                json_output.write(escaped_value, key_length);
+            }
+            json_output << "\":\"";
+            size_t value_length = Util::jsonEscapeString(pair.value.data(), escaped_value,
+                Globals::MESSAGE_BUFFER_SIZE);
+            json_output.write(escaped_value, value_length);
+            json_output << "\"";
+        }
 
-                Util::jsonEscapeString(data.event_data[i].key, escaped_name, Globals::MESSAGE_BUFFER_SIZE);
-                Util::jsonEscapeString(data.event_data[i].value, escaped_value, Globals::MESSAGE_BUFFER_SIZE);
+        if (!data.raw_json.empty()) {
+            if (!checkBufferSpace("raw_event", data.raw_json.size() + 16)) {
+                return false;
+            }
+            json_output << ", \"raw_event\":";
+            json_output.write(data.raw_json.data(), data.raw_json.size());
+        }
 
-                json_output << ", \"" << escaped_name << "\":\"" << escaped_value << "\"";
+        // Custom suffix key-values, already in ", "key":"value"" form
+        json_output.write(templates->suffix.data(), templates->suffix.size());
 
-                Globals::instance()->releaseMessageBuffer(escaped_name);
-                Globals::instance()->releaseMessageBuffer(escaped_value);
+        // A mined message goes as its template ID and parameters, and the
+        // template itself when the miner says it's due
+        const auto* template_match = data.template_match;
+        if (template_match != nullptr) {
+            if (!checkBufferSpace("template_id", 32)) {
+                return false;
+            }
+            json_output << ", \"template_id\":\"" << template_match->template_id << "\"";
+            if (template_match->announce) {
+                size_t template_length = Util::jsonEscapeString(template_match->template_text.c_str(),
+                    escaped_value, Globals::MESSAGE_BUFFER_SIZE);
+                if (!checkBufferSpace("template", template_length + 16)) {
+                    return false;
+                }
+                json_output << ", \"template\":\"";
+                json_output.write(escaped_value, template_length);
+                json_output << "\"";
             }
+            json_output << ", \"template_params\":[";
+            for (size_t i = 0; i < template_match->params.size(); ++i) {
+                // the parameters are views into the message; msg_buf is free, since it goes empty
+                const auto& param = template_match->params[i];
+                memcpy(msg_buf, param.data(), param.size());
+                msg_buf[param.size()] = '\0';
+                size_t param_length = Util::jsonEscapeString(msg_buf, escaped_value, Globals::MESSAGE_BUFFER_SIZE);
+                if (!checkBufferSpace("template_params", param_length + 8)) {
+                    return false;
+                }
+                json_output << (i > 0 ? ",\"" : "\"");
+                json_output.write(escaped_value, param_length);
+                json_output << "\"";
+            }
+            json_output << "]";
         }
 
-        // Add custom_suffix key-values to extra_fields if present
-        if (!suffix_utf8_.empty()) {
-            json_output << ", " << suffix_utf8_;  // Already in "key":"value" format
+        // Add message field; a projection can strip it when EventData carries the content
+        bool strip_message = projection != nullptr && projection->stripMessage() && !data.event_data.empty();
+        size_t msg_len = strip_message || template_match != nullptr ? 0 : data.message.size();
+        if (strip_message) {
+            projected_bytes += data.message.size() * (http_format ? 2 : 1);
+        }
+        if (projection != nullptr) {
+            auto& stats = AgentStatistics::instance();
+            stats.increment(AgentStatistics::ProjectedMessages);
+            stats.increment(AgentStatistics::ProjectionFieldsDropped, projected_fields);
+            stats.increment(AgentStatistics::ProjectionBytesSaved, projected_bytes);
         }
-
-        // Add message field
-        size_t msg_len = strlen(data.message);
-        char* msg_buf = Globals::instance()->getMessageBuffer("jsonEscapeMessage");
 
         size_t current_pos = static_cast<size_t>(ostream_buffer.pubseekoff(0, ios_base::cur));
         size_t remaining_space = buflen - current_pos;
@@ -323,14 +390,17 @@ namespace Syslog_agent {
         if (remaining_space <= overhead) {
             logger->recoverable_error("No space left for message field - buffer position %zu/%zu\n",
                 current_pos, buflen);
-            Globals::instance()->releaseMessageBuffer(msg_buf);
             return false;
         }
 
         remaining_space -= overhead;
 
-        if (msg_len <= remaining_space) {
-            Util::jsonEscapeString(data.message, msg_buf, Globals::MESSAGE_BUFFER_SIZE);
+        if (strip_message || template_match != nullptr) {
+            // the receivers expect the field, so it stays, empty
+            msg_buf[0] = '\0';
+        }
+        else if (msg_len <= remaining_space) {
+            Util::jsonEscapeString(data.message.data(), msg_buf, Globals::MESSAGE_BUFFER_SIZE);
         }
         else {
             const char* truncation_suffix = " *(message truncated)*";
@@ -339,7 +409,7 @@ namespace Syslog_agent {
 
             if (max_msg_len > 0) {
                 char* temp_buf = Globals::instance()->getMessageBuffer("tempMessage");
-                strncpy_s(temp_buf, Globals::MESSAGE_BUFFER_SIZE, data.message, max_msg_len);
+                strncpy_s(temp_buf, Globals::MESSAGE_BUFFER_SIZE, data.message.data(), max_msg_len);
                 temp_buf[max_msg_len] = '\0';
                 strcat_s(temp_buf, Globals::MESSAGE_BUFFER_SIZE, truncation_suffix);
 
@@ -351,18 +421,18 @@ namespace Syslog_agent {
             else {
                 logger->recoverable_error("No space left for message content - buffer position %zu/%zu\n",
                     current_pos, buflen);
-                Globals::instance()->releaseMessageBuffer(msg_buf);
                 return false;
             }
         }
 
         json_output << ", \"message\":\"" << msg_buf << "\"";
 
-        if (logformat == SharedConstants::LOGFORMAT_HTTPPORT) {
-            // now put message outside extra_fields as well...
+        if (http_format) {
+            // program and message go outside extra_fields as well...
             // i know, this sucks, it's just the way the lz appstore app is written
-            json_output << "}, \"message\":\"" << msg_buf << "\""; 
-            Globals::instance()->releaseMessageBuffer(msg_buf);
+            json_output << "}, \"program\":\"";
+            writeEscaped(json_output, data.provider.data(), escaped_value, Globals::MESSAGE_BUFFER_SIZE);
+            json_output << "\", \"message\":\"" << msg_buf << "\"";
         }
 
         // Close the JSON object
@@ -375,104 +445,628 @@ namespace Syslog_agent {
         Configuration& configuration,
         shared_ptr<MessageQueue> primary_message_queue,
         shared_ptr<MessageQueue> secondary_message_queue,
-        const wchar_t* log_name)
+        const wchar_t* log_name,
+        shared_ptr<const EventRuleEngine> rule_engine,
+        shared_ptr<EventDeduplicator> deduplicator,
+        shared_ptr<OverloadController> overload_controller,
+        shared_ptr<EventAggregator> aggregator,
+        shared_ptr<const FieldProjection> field_projection,
+        shared_ptr<const PiiRedactor> redactor,
+        shared_ptr<TemplateMiner> template_miner,
+        shared_ptr<MessageTextPolicy> text_policy,
+        const string& stage_order)
         : configuration_(configuration),
         primary_message_queue_(primary_message_queue),
-        secondary_message_queue_(secondary_message_queue)
+        secondary_message_queue_(secondary_message_queue),
+        rule_engine_(rule_engine),
+        deduplicator_(deduplicator),
+        overload_controller_(overload_controller),
+        aggregator_(aggregator),
+        field_projection_(field_projection),
+        redactor_(redactor),
+        template_miner_(template_miner),
+        text_policy_(text_policy)
     {
         auto logger = LOG_THIS;
-        DWORD chars_written;
         size_t length = wcslen(log_name);
-        if (length > INT_MAX) {
-            throw std::runtime_error("Log name too long");
+        if (length == 0) {
+            throw std::runtime_error("Failed to convert log name to UTF-8");
         }
 
         log_name_utf8_.resize(SharedConstants::MAX_LOG_NAME_LENGTH + 1);
-        chars_written = WideCharToMultiByte(CP_UTF8, 0, log_name,
-            static_cast<int>(length), log_name_utf8_.data(), log_name_utf8_.size() - 1,
-            NULL, NULL);
+        size_t utf8_length = Utf8Transcoder::utf16ToUtf8(log_name, length,
+            log_name_utf8_.data(), log_name_utf8_.size());
+        if (utf8_length >= log_name_utf8_.size()) {
+            throw std::runtime_error("Log name too long");
+        }
+        log_name_utf8_.resize(utf8_length);
 
-        if (chars_written == 0) {
-            throw std::runtime_error("Failed to convert log name to UTF-8");
+        templates_.store(buildTemplates(configuration_.getGeneration()));
+        buildPipeline(stage_order);
+    }
+
+    void EventHandlerMessageQueuer::buildPipeline(const string& stage_order) {
+        auto logger = LOG_THIS;
+        if (!stage_order.empty()) {
+            Pipeline pipeline;
+            string error;
+            if (!pipeline.assemble(stage_order, stageDefinitions(), error)) {
+                logger->recoverable_error("EventHandlerMessageQueuer::buildPipeline()> %s: %s in \"%s\","
+                    " using the default stages\n", log_name_utf8_.c_str(), error.c_str(), stage_order.c_str());
+            }
+            else if (pipeline.size() < 3 || pipeline.stage(0).name() != "parse"
+                || pipeline.stage(pipeline.size() - 2).name() != "serialize"
+                || pipeline.stage(pipeline.size() - 1).name() != "route") {
+                logger->recoverable_error("EventHandlerMessageQueuer::buildPipeline()> %s: \"%s\" has to start"
+                    " with parse and end with serialize,route, using the default stages\n",
+                    log_name_utf8_.c_str(), stage_order.c_str());
+            }
+            else {
+                pipeline_ = std::move(pipeline);
+                logger->info("EventHandlerMessageQueuer::buildPipeline()> %s: stages %s\n",
+                    log_name_utf8_.c_str(), stage_order.c_str());
+                return;
+            }
         }
-        log_name_utf8_.resize(chars_written);
+        string error;
+        pipeline_.assemble(DEFAULT_STAGE_ORDER, stageDefinitions(), error);
+    }
 
-        if (!configuration_.getSuffix().empty()) {
-            auto suffix = configuration_.getSuffix();
+    vector<EventHandlerMessageQueuer::Pipeline::StageDefinition> EventHandlerMessageQueuer::stageDefinitions() {
+        // a stage whose feature is off isn't built, so costs nothing
+        auto stage = [this](const char* name, StageKind kind, StageResult (EventHandlerMessageQueuer::*process)(EventRecord&),
+            bool needed, vector<string> after = {}, vector<string> needs = {}) {
+            return Pipeline::StageDefinition{ name, [this, name, kind, process, needed]() {
+                std::unique_ptr<Pipeline::Stage> built;
+                if (needed) {
+                    built = std::make_unique<FunctionStage<EventRecord>>(name, kind,
+                        [this, process](EventRecord& record) { return (this->*process)(record); });
+                }
+                return built;
+            }, std::move(after), std::move(needs) };
+        };
+        // aggregation groups by the rule that matched; it, dedup and the
+        // template miner key on values that have to be redacted first
+        return {
+            stage("parse", StageKind::Extract, &EventHandlerMessageQueuer::parseStage, true),
+            stage("rules", StageKind::Filter, &EventHandlerMessageQueuer::rulesStage,
+                rule_engine_ && rule_engine_->ruleCount() > 0),
+            stage("projection", StageKind::Enrich, &EventHandlerMessageQueuer::projectionStage, field_projection_ != nullptr),
+            stage("redaction", StageKind::Transform, &EventHandlerMessageQueuer::redactionStage, redactor_ != nullptr),
+            stage("aggregation", StageKind::Filter, &EventHandlerMessageQueuer::aggregationStage,
+                aggregator_ && rule_engine_ && rule_engine_->ruleCount() > 0, { "redaction" }, { "rules" }),
+            stage("overload", StageKind::Filter, &EventHandlerMessageQueuer::overloadStage, overload_controller_ != nullptr),
+            stage("dedup", StageKind::Filter, &EventHandlerMessageQueuer::dedupStage, deduplicator_ != nullptr,
+                { "redaction" }),
+            stage("templates", StageKind::Transform, &EventHandlerMessageQueuer::templatesStage, template_miner_ != nullptr,
+                { "redaction" }),
+            stage("serialize", StageKind::Serialize, &EventHandlerMessageQueuer::serializeStage, true),
+            stage("route", StageKind::Route, &EventHandlerMessageQueuer::routeStage, true),
+        };
+    }
+
+    std::string EventHandlerMessageQueuer::describeStatistics() const {
+        return pipeline_.describe();
+    }
+
+    shared_ptr<const EventHandlerMessageQueuer::JsonTemplates> EventHandlerMessageQueuer::buildTemplates(
+        uint32_t generation) const
+    {
+        auto templates = make_shared<JsonTemplates>();
+        templates->generation = generation;
+
+        auto escaped = [](const string& text) {
+            string result;
+            char buffer[SharedConstants::MAX_LOG_NAME_LENGTH * 6 + 1];
+            if (text.length() > SharedConstants::MAX_LOG_NAME_LENGTH) {
+                return result;
+            }
+            size_t length = Util::jsonEscapeString(text.c_str(), buffer, sizeof(buffer));
+            return result.assign(buffer, length);
+        };
+
+        const string& hostname = configuration_.getHostName();
+        string host_field = hostname.empty() ? string() : "\"host\":\"" + escaped(hostname) + "\"";
+        string source_fields = "\"_source_type\": \"WindowsAgent\""
+            ", \"_source_tag\":\"windows_agent\""
+            ", \"_log_type\":\"eventlog\""
+            ", \"event_log\":\"" + escaped(log_name_utf8_) + "\""
+            ", \"facility\":\"" + std::to_string(configuration_.getFacility()) + "\"";
+
+        templates->json_prefix = "{" + (host_field.empty() ? string() : host_field + ", ") + source_fields;
+        // http ingestion accepts host at the root, the rule wants it inside extra_fields too
+        templates->http_prefix = "{" + (host_field.empty() ? string() : host_field + ", ")
+            + "\"extra_fields\": {" + source_fields + (host_field.empty() ? string() : ", " + host_field);
+
+        auto suffix = configuration_.getSuffix();
+        if (!suffix.empty()) {
+            string suffix_utf8;
             if (suffix.length() > SharedConstants::MAX_SUFFIX_LENGTH - 1) {
-                suffix_utf8_ = string("\"error_suffix\": \"too long\"");
+                suffix_utf8 = string("\"error_suffix\": \"too long\"");
             }
             else {
-                suffix_utf8_.resize(SharedConstants::MAX_SUFFIX_LENGTH + 1);
-                chars_written = Util::wstr2str_truncate(const_cast<char*>(suffix_utf8_.c_str()), suffix_utf8_.size(), suffix.c_str());
+                suffix_utf8.resize(SharedConstants::MAX_SUFFIX_LENGTH + 1);
+                size_t chars_written = Util::wstr2str_truncate(suffix_utf8.data(), suffix_utf8.size(), suffix.c_str());
                 if (chars_written == 0) {
-                    suffix_utf8_ = string("\"error_suffix\": \"conversion failed\"");
+                    suffix_utf8 = string("\"error_suffix\": \"conversion failed\"");
                 }
                 else {
-                    suffix_utf8_.resize(chars_written);
+                    suffix_utf8.resize(chars_written);
                 }
             }
+            templates->suffix = ", " + suffix_utf8;
         }
+        return templates;
+    }
+
+    shared_ptr<const EventHandlerMessageQueuer::JsonTemplates> EventHandlerMessageQueuer::currentTemplates() {
+        auto templates = templates_.load();
+        auto generation = configuration_.getGeneration();
+        if (templates->generation != generation) {
+            templates = buildTemplates(generation);
+            templates_.store(templates);
+        }
+        return templates;
+    }
+
+    EventRuleEngine::Action EventHandlerMessageQueuer::applyRules(const EventData& data,
+        const EventRuleEngine::Aggregation** aggregation_out) const {
+        *aggregation_out = nullptr;
+        if (!rule_engine_ || rule_engine_->ruleCount() == 0) {
+            return EventRuleEngine::Action::Forward;
+        }
+        SmallVector<EventRuleEngine::Field, EventData::INLINE_EVENT_DATA_PAIRS> fields;
+        for (const auto& pair : data.event_data) {
+            fields.push_back({ pair.key, pair.value });
+        }
+        EventRuleEngine::EventView view;
+        view.provider = data.provider;
+        view.channel = log_name_utf8_;
+        view.event_id = static_cast<uint32_t>(strtoul(data.event_id.data(), nullptr, 10));
+        view.level = data.windows_level;
+        view.fields = fields.data();
+        view.field_count = fields.size();
+        return rule_engine_->evaluate(view, aggregation_out);
+    }
+
+    uint64_t EventHandlerMessageQueuer::dedupKey(const EventData& data) const {
+        // everything that identifies the event's content, but not when it happened
+        FastHasher hasher;
+        hasher.add(log_name_utf8_).add(data.provider).add(data.event_id).add(data.user_sid);
+        for (const auto& pair : data.event_data) {
+            hasher.add(pair.key).add(pair.value);
+        }
+        hasher.add(data.message);
+        return hasher.digest();
+    }
+
+    uint64_t EventHandlerMessageQueuer::aggregateKey(const EventData& data,
+        const EventRuleEngine::Aggregation& aggregation) const {
+        // the rule, what the event is, and the values of the fields it groups by
+        FastHasher hasher;
+        hasher.add(static_cast<uint64_t>(aggregation.rule_line))
+            .add(log_name_utf8_).add(data.provider).add(data.event_id);
+        for (const auto& field : aggregation.group_by) {
+            std::string_view value;
+            for (const auto& pair : data.event_data) {
+                if (pair.key == field) {
+                    value = pair.value;
+                    break;
+                }
+            }
+            hasher.add(value);
+        }
+        return hasher.digest();
+    }
+
+    int64_t EventHandlerMessageQueuer::eventTimeMicroseconds(const EventData& data) {
+        // microsec holds as many digits as the event's SystemTime had; the first six
+        int64_t micros = 0;
+        int digits = 0;
+        for (const char* p = data.microsec; digits < 6; ++digits) {
+            micros *= 10;
+            if (*p >= '0' && *p <= '9') {
+                micros += *p++ - '0';
+            }
+        }
+        return strtoll(data.timestamp, nullptr, 10) * 1000000LL + micros;
+    }
+
+    uint32_t EventHandlerMessageQueuer::overloadSampleRate(const EventData& data) const {
+        if (!overload_controller_) {
+            return 1;
+        }
+        // by the event's own level, whatever severity the configuration sends it as
+        uint64_t key = FastHasher().add(data.provider).add(data.event_id).digest();
+        return overload_controller_->admit(key, OverloadController::severityOfWindowsLevel(data.windows_level));
+    }
+
+    void EventHandlerMessageQueuer::redact(EventData& data, char* arena, size_t arena_size) const {
+        // a value with something to mask is copied into the arena, masked,
+        // and its view repointed at the copy; one that doesn't fit is sent
+        // empty rather than unmasked
+        auto& stats = AgentStatistics::instance();
+        size_t used = 0;
+        auto redactView = [&](std::string_view& value) {
+            size_t length = redactor_->redact(value, arena + used, arena_size - used);
+            if (length == 0) {
+                return;
+            }
+            stats.increment(AgentStatistics::RedactedFields);
+            if (length == PiiRedactor::NO_ROOM) {
+                stats.increment(AgentStatistics::RedactionOverflows);
+                value = std::string_view("", 0);
+                return;
+            }
+            value = std::string_view(arena + used, length);
+            used += length + 1;
+        };
+        redactView(data.message);
+        for (auto& pair : data.event_data) {
+            redactView(pair.value);
+        }
+
+        // the account name is the event's own copy, so it's masked where it is
+        if (data.user_account[0] != '\0') {
+            char account[SidResolverCache::MAX_ACCOUNT_LENGTH];
+            if (redactor_->redact(data.user_account, account, sizeof(account)) > 0) {
+                stats.increment(AgentStatistics::RedactedFields);
+                memcpy(data.user_account, account, sizeof(account));
+            }
+        }
+    }
+
+    bool EventHandlerMessageQueuer::renderMessage(EventLogEvent& event) const {
+        if (!text_policy_) {
+            event.renderMessage();
+            return true;
+        }
+        auto provider = event.getXmlDoc().child("Event").child("System").child("Provider").attribute("Name").value();
+        switch (text_policy_->decide(provider)) {
+        case MessageTextPolicy::Decision::Skip:
+            return false;
+        case MessageTextPolicy::Decision::Sample: {
+            auto started = text_policy_->now();
+            event.renderMessage();
+            text_policy_->renderDone(started);
+            return true;
+        }
+        default:
+            event.renderMessage();
+            return true;
+        }
+    }
+
+    void EventHandlerMessageQueuer::mineTemplate(EventData& data, TemplateMiner::Match& match) const {
+        bool strip_message = data.projection != nullptr && data.projection->stripMessage()
+            && !data.event_data.empty();
+        if (data.message.empty() || strip_message || !template_miner_->mine(data.message, match)) {
+            return;
+        }
+        data.template_match = &match;
+
+        // what generateJson writes instead of the message, roughly
+        auto& stats = AgentStatistics::instance();
+        size_t mined_size = 48;
+        for (const auto& param : match.params) {
+            mined_size += param.size() + 3;
+        }
+        if (match.announce) {
+            mined_size += match.template_text.size() + 16;
+            stats.set(AgentStatistics::TemplateCount, template_miner_->templateCount());
+        }
+        stats.increment(AgentStatistics::TemplateMinedMessages);
+        if (data.message.size() > mined_size) {
+            stats.increment(AgentStatistics::TemplateBytesSaved, data.message.size() - mined_size);
+        }
+    }
+
+    string EventHandlerMessageQueuer::addRepeatCount(const string& json, uint32_t repeat_count) {
+        // generateJson always writes _source_type first in the fields the receiver keeps
+        static constexpr const char* ANCHOR = "\"_source_type\"";
+        auto pos = json.find(ANCHOR);
+        if (pos == string::npos) {
+            return json;
+        }
+        string result;
+        result.reserve(json.size() + 32);
+        result.append(json, 0, pos);
+        result += "\"repeat_count\":\"" + to_string(repeat_count) + "\", ";
+        result.append(json, pos, string::npos);
+        return result;
+    }
+
+    string EventHandlerMessageQueuer::addAggregateFields(const string& json, uint32_t count,
+        int64_t first_time_us, int64_t last_time_us) {
+        // same anchor as addRepeatCount(); the times in the format of "ts"
+        static constexpr const char* ANCHOR = "\"_source_type\"";
+        auto pos = json.find(ANCHOR);
+        if (pos == string::npos) {
+            return json;
+        }
+        char fields[128];
+        int length = snprintf(fields, sizeof(fields),
+            "\"aggregate_count\":\"%u\", \"first_ts\":\"%lld.%06lld\", \"last_ts\":\"%lld.%06lld\", ",
+            count, first_time_us / 1000000, first_time_us % 1000000, last_time_us / 1000000, last_time_us % 1000000);
+        string result;
+        result.reserve(json.size() + length);
+        result.append(json, 0, pos);
+        result.append(fields, length);
+        result.append(json, pos, string::npos);
+        return result;
     }
 
     Result EventHandlerMessageQueuer::handleEvent(
         const wchar_t* subscription_name, EventLogEvent& event)
+    {
+        return handleEvents(subscription_name, std::span<EventLogEvent>(&event, 1));
+    }
+
+    Result EventHandlerMessageQueuer::handleEvents(
+        const wchar_t* subscription_name, std::span<EventLogEvent> events)
     {
         auto logger = LOG_THIS;
-        
-        char* json_buffer = Globals::instance()->getMessageBuffer("eventHandlerMessageQueuer");
 
-        try {
-            // Estimate message size and check buffer capacity
-            EventData data;
-            event.renderEvent();
-            data.parseFrom(event, configuration_);
-            size_t estimated_size = estimateMessageSize(data, SharedConstants::LOGFORMAT_HTTPPORT);
-
-            if (estimated_size > Globals::MESSAGE_BUFFER_SIZE) {
-                logger->recoverable_error("Estimated message size %zu exceeds buffer size %zu\n",
-                    estimated_size, Globals::MESSAGE_BUFFER_SIZE);
-                Globals::instance()->releaseMessageBuffer(json_buffer);
-                return Result(ERROR_INSUFFICIENT_BUFFER, "handleEvent", "Buffer too small");
-            }
-
-            // Generate JSON for primary queue
-			Result generate_result = generateLogMessage(event, configuration_.getPrimaryLogformat(), json_buffer, Globals::MESSAGE_BUFFER_SIZE);
-            if (generate_result.statusCode() != ERROR_SUCCESS) {
-                Globals::instance()->releaseMessageBuffer(json_buffer);
-                if (generate_result.statusCode() != ERROR_CANCELLED) {
-					logger->recoverable_error("Failed to generate JSON for primary queue\n");
-                }
-                return generate_result;
-            }
-
-            // Queue message for primary server
-            primary_message_queue_->enqueue(json_buffer, strlen(json_buffer));
-
-            // Handle secondary server if configured
-            if (configuration_.hasSecondaryHost()) {
-                // Generate JSON for secondary queue
-                generate_result = generateLogMessage(event, configuration_.getSecondaryLogformat(), json_buffer, Globals::MESSAGE_BUFFER_SIZE);
-                if (generate_result.statusCode() != ERROR_SUCCESS) {
-                    Globals::instance()->releaseMessageBuffer(json_buffer);
-					if (generate_result.statusCode() != ERROR_CANCELLED) {
-						logger->recoverable_error("Failed to generate JSON for secondary queue\n");
-					}
-                    return generate_result;
-                }
+        // one JSON buffer for the group, and one lock per queue to enqueue it
+        MessageBufferRelease json_release{ Globals::instance()->getMessageBuffer("eventHandlerMessageQueuer") };
+        Result first_failure;
+        for (auto& event : events) {
+            Result result = queueEvent(event, json_release.buffer, logger, primary_pending_, secondary_pending_);
+            if (!result.isSuccess() && first_failure.isSuccess()) {
+                first_failure = result;
+            }
+            // so a group only ever holds one event's buffers
+            event.releaseBuffers();
+        }
+        enqueuePending(*primary_message_queue_, primary_pending_);
+        if (secondary_message_queue_) {
+            enqueuePending(*secondary_message_queue_, secondary_pending_);
+        }
+        return first_failure;
+    }
+
+    std::unique_ptr<IEventHandler::Prepared> EventHandlerMessageQueuer::prepareEvent(EventLogEvent& event)
+    {
+        auto logger = LOG_THIS;
+        auto prepared = std::make_unique<PreparedMessages>();
+        MessageBufferRelease json_release{ Globals::instance()->getMessageBuffer("eventHandlerMessageQueuer") };
+        prepared->result = queueEvent(event, json_release.buffer, logger, prepared->primary, prepared->secondary);
+        event.releaseBuffers();
+        return prepared;
+    }
+
+    Result EventHandlerMessageQueuer::commitEvent(const wchar_t* subscription_name, EventLogEvent& event,
+        std::unique_ptr<Prepared> prepared)
+    {
+        // only ever given what prepareEvent() returned
+        auto messages = static_cast<PreparedMessages*>(prepared.get());
+        if (messages == nullptr) {
+            return handleEvent(subscription_name, event);
+        }
+        enqueuePending(*primary_message_queue_, messages->primary);
+        if (secondary_message_queue_) {
+            enqueuePending(*secondary_message_queue_, messages->secondary);
+        }
+        return messages->result;
+    }
 
-                // Queue message for secondary server
-                secondary_message_queue_->enqueue(json_buffer, strlen(json_buffer));
+    void EventHandlerMessageQueuer::addPending(MessageQueue& queue, PendingMessages& pending,
+        const char* message, size_t length)
+    {
+        pending.contents.append(message, length);
+        pending.lengths.push_back(static_cast<uint32_t>(length));
+        if (pending.contents.size() >= MAX_PENDING_BYTES) {
+            enqueuePending(queue, pending);
+        }
+    }
+
+    void EventHandlerMessageQueuer::enqueuePending(MessageQueue& queue, PendingMessages& pending)
+    {
+        if (!pending.lengths.empty()) {
+            queue.enqueueBatch(pending.contents.data(), pending.lengths.data(), pending.lengths.size());
+        }
+        pending.contents.clear();
+        pending.lengths.clear();
+    }
+
+    EventHandlerMessageQueuer::EventRecord::~EventRecord() {
+        for (char* buffer : { raw_buffer, redaction_buffer, secondary_buffer }) {
+            if (buffer != nullptr) {
+                Globals::instance()->releaseMessageBuffer(buffer);
             }
+        }
+    }
 
-            Globals::instance()->releaseMessageBuffer(json_buffer);
+    Result EventHandlerMessageQueuer::queueEvent(EventLogEvent& event, char* json_buffer, Logger* logger,
+        PendingMessages& primary_pending, PendingMessages& secondary_pending)
+    {
+        try {
+            EventRecord record(event, json_buffer, logger, primary_pending, secondary_pending);
+            record.to_secondary = configuration_.hasSecondaryHost();
+            if (pipeline_.run(record) == StageResult::Failed) {
+                return record.result;
+            }
             return Result();
         }
         catch (const std::exception& e) {
-            logger->recoverable_error("Exception in handleEvent: %s\n", e.what());
-            Globals::instance()->releaseMessageBuffer(json_buffer);
-            return Result(ERROR_INVALID_DATA, "handleEvent", e.what());
+            logger->recoverable_error("Exception in queueEvent: %s\n", e.what());
+            return Result(ERROR_INVALID_DATA, "queueEvent", e.what());
+        }
+    }
+
+    size_t EventHandlerMessageQueuer::estimatedSize(EventRecord& record) {
+        if (record.estimated_size == 0) {
+            record.estimated_size = estimateMessageSize(record.data, SharedConstants::LOGFORMAT_HTTPPORT);
+        }
+        return record.estimated_size;
+    }
+
+    StageResult EventHandlerMessageQueuer::parseStage(EventRecord& record) {
+        // Parse the event once; everything after works from record.data
+        if (configuration_.getRawEventMode()) {
+            // has to be converted before parseEvent() parses the XML in place;
+            // an event too large to leave room for the rest is sent without it
+            record.raw_buffer = Globals::instance()->getMessageBuffer("rawEventJson");
+            if (record.raw_buffer != nullptr) {
+                size_t raw_length = record.event.renderRawJson(record.raw_buffer, Globals::MESSAGE_BUFFER_SIZE / 2);
+                record.data.raw_json = std::string_view(record.raw_buffer, raw_length);
+            }
+        }
+        record.event.parseEvent();
+        bool has_text = renderMessage(record.event);
+        record.data.parseFrom(record.event, configuration_);
+        if (!has_text) {
+            // structured fields only; the receivers expect the field, so it stays, empty
+            record.data.message = std::string_view("", 0);
+        }
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::rulesStage(EventRecord& record) {
+        switch (applyRules(record.data, &record.aggregation)) {
+        case EventRuleEngine::Action::Drop:
+            AgentStatistics::instance().increment(AgentStatistics::RuleDropped);
+            return StageResult::Done;
+        case EventRuleEngine::Action::PrimaryOnly:
+            AgentStatistics::instance().increment(AgentStatistics::RulePrimaryOnly);
+            record.to_secondary = false;
+            break;
+        case EventRuleEngine::Action::SecondaryOnly:
+            AgentStatistics::instance().increment(AgentStatistics::RuleSecondaryOnly);
+            record.to_primary = false;
+            break;
+        default:
+            break;
+        }
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::projectionStage(EventRecord& record) {
+        record.data.projection = field_projection_->select(record.data.provider,
+            static_cast<uint32_t>(strtoul(record.data.event_id.data(), nullptr, 10)));
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::redactionStage(EventRecord& record) {
+        // Mask PII before anything is escaped, copied for dedup or aggregation, or sent
+        record.redaction_buffer = Globals::instance()->getMessageBuffer("redaction");
+        if (record.redaction_buffer == nullptr) {
+            record.result = Result(ERROR_NOT_ENOUGH_MEMORY, "redactionStage", "No message buffer");
+            return StageResult::Failed;
+        }
+        redact(record.data, record.redaction_buffer, Globals::MESSAGE_BUFFER_SIZE);
+        if (!record.data.raw_json.empty()) {
+            // the raw JSON is already escaped, and in our own buffer
+            AgentStatistics::instance().increment(AgentStatistics::RedactedFields,
+                redactor_->redactJsonInPlace(record.raw_buffer, record.data.raw_json.size()));
+        }
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::aggregationStage(EventRecord& record) {
+        // Events an aggregate rule matched are only counted, except the
+        // first in each group, which is kept as the summary's sample
+        if (record.aggregation == nullptr || estimatedSize(record) > aggregator_->maxSampleBytes()) {
+            return StageResult::Continue;
+        }
+        record.aggregate_key = aggregateKey(record.data, *record.aggregation);
+        if (!aggregator_->add(record.aggregate_key, eventTimeMicroseconds(record.data))) {
+            return StageResult::Done;
+        }
+        record.keep_sample = true;
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::overloadStage(EventRecord& record) {
+        if (record.keep_sample) {
+            return StageResult::Continue;
+        }
+        record.data.sample_rate = overloadSampleRate(record.data);
+        return record.data.sample_rate == 0 ? StageResult::Done : StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::dedupStage(EventRecord& record) {
+        // Repeats of an event already sent in the current window are only counted
+        if (record.keep_sample || estimatedSize(record) > deduplicator_->maxCopyBytes()) {
+            return StageResult::Continue;
+        }
+        record.dedup_key = dedupKey(record.data);
+        if (!deduplicator_->admit(record.dedup_key)) {
+            return StageResult::Done;
+        }
+        record.remember_copy = true;
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::templatesStage(EventRecord& record) {
+        // Aggregate samples go out later as summaries, so they keep the full
+        // message rather than depend on a template announced now
+        if (!record.keep_sample) {
+            mineTemplate(record.data, record.template_match);
+        }
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::serializeStage(EventRecord& record) {
+        // taken again: a stage since the last estimate may have changed the event
+        record.estimated_size = 0;
+        size_t estimated_size = estimatedSize(record);
+        if (estimated_size > Globals::MESSAGE_BUFFER_SIZE) {
+            record.logger->recoverable_error("Estimated message size %zu exceeds buffer size %zu\n",
+                estimated_size, Globals::MESSAGE_BUFFER_SIZE);
+            record.result = Result(ERROR_INSUFFICIENT_BUFFER, "queueEvent", "Buffer too small");
+            return StageResult::Failed;
+        }
+
+        if (record.to_primary) {
+            record.result = generateLogMessage(record.data, configuration_.getPrimaryLogformat(),
+                record.json_buffer, Globals::MESSAGE_BUFFER_SIZE);
+            if (record.result.statusCode() != ERROR_SUCCESS) {
+                if (record.result.statusCode() != ERROR_CANCELLED) {
+                    record.logger->recoverable_error("Failed to generate JSON for primary queue\n");
+                }
+                return StageResult::Failed;
+            }
+            record.primary_json = std::string_view(record.json_buffer, strlen(record.json_buffer));
+        }
+
+        if (record.to_secondary) {
+            record.secondary_buffer = Globals::instance()->getMessageBuffer("secondaryMessage");
+            if (record.secondary_buffer == nullptr) {
+                record.result = Result(ERROR_NOT_ENOUGH_MEMORY, "serializeStage", "No message buffer");
+                return StageResult::Failed;
+            }
+            record.result = generateLogMessage(record.data, configuration_.getSecondaryLogformat(),
+                record.secondary_buffer, Globals::MESSAGE_BUFFER_SIZE);
+            if (record.result.statusCode() != ERROR_SUCCESS) {
+                if (record.result.statusCode() != ERROR_CANCELLED) {
+                    record.logger->recoverable_error("Failed to generate JSON for secondary queue\n");
+                }
+                return StageResult::Failed;
+            }
+            record.secondary_json = std::string_view(record.secondary_buffer, strlen(record.secondary_buffer));
+        }
+        return StageResult::Continue;
+    }
+
+    StageResult EventHandlerMessageQueuer::routeStage(EventRecord& record) {
+        if (!record.keep_sample) {
+            if (record.to_primary) {
+                addPending(*primary_message_queue_, record.primary_pending,
+                    record.primary_json.data(), record.primary_json.size());
+            }
+            if (record.to_secondary) {
+                addPending(*secondary_message_queue_, record.secondary_pending,
+                    record.secondary_json.data(), record.secondary_json.size());
+            }
+        }
+        if (record.keep_sample) {
+            aggregator_->setSample(record.aggregate_key, string(record.primary_json), string(record.secondary_json));
+        }
+        else if (record.remember_copy) {
+            deduplicator_->remember(record.dedup_key, string(record.primary_json), string(record.secondary_json));
         }
+        return StageResult::Continue;
     }
 
     unsigned char EventHandlerMessageQueuer::unixSeverityFromWindowsSeverity(
@@ -1,17 +1,31 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <map>
+#include <span>
 #include <sstream>
+#include <string_view>
 #include <vector>
 #include "IEventHandler.h"
+#include "EventAggregator.h"
+#include "EventDeduplicator.h"
 #include "EventLogEvent.h"
+#include "EventPipeline.h"
+#include "FieldProjection.h"
+#include "MessageTextPolicy.h"
+#include "EventRuleEngine.h"
+#include "OverloadController.h"
+#include "PiiRedactor.h"
 #include "Configuration.h"
 #include "MessageQueue.h"
 #include "Logger.h"
 #include "pugixml.hpp"
+#include "SidResolverCache.h"
+#include "SmallVector.h"
 #include "SyslogAgentSharedConstants.h"
+#include "TemplateMiner.h"
 #include "windows.h"
 
 using std::shared_ptr;
@@ -22,106 +36,216 @@ namespace Syslog_agent {
 
     class EventHandlerMessageQueuer : public IEventHandler {
     public:
+        // What the handler needs from one event.  The strings are views into
+        // the event's own buffers (the parsed XML and the rendered text), so
+        // they're only valid while the EventLogEvent is; nothing is copied
+        // and nothing is truncated.  Each view's data() is null terminated.
         struct EventData {
-            static constexpr size_t MAX_PROVIDER_LEN = 256;
-            static constexpr size_t MAX_EVENT_ID_LEN = 32;
-            static constexpr size_t MAX_MESSAGE_LEN = 32768;
             static constexpr size_t MAX_TIMESTAMP_LEN = 32;
             static constexpr size_t MAX_MICROSEC_LEN = 8;
-            static constexpr size_t MAX_EVENT_DATA_PAIRS = 50;  // Maximum number of event data key-value pairs
+            static constexpr size_t INLINE_EVENT_DATA_PAIRS = 16;  // more than this spills to the heap
 
-            // All buffers are fixed-size to avoid heap allocations
-            char provider[MAX_PROVIDER_LEN];
-            char event_id[MAX_EVENT_ID_LEN];
-            char message[MAX_MESSAGE_LEN];
+            std::string_view provider;
+            std::string_view event_id;
+            std::string_view message;
+            // these two are formatted from the XML, not views into it
             char timestamp[MAX_TIMESTAMP_LEN];
             char microsec[MAX_MICROSEC_LEN];
             unsigned char severity;
+            int windows_level;      // System/Level as logged, 0 if absent
+            uint32_t sample_rate;   // > 1 if this event was kept 1 in sample_rate
 
-            // Structure for event data key-value pairs
             struct EventDataPair {
-                char key[256];    // Fixed size for key
-                char value[1024]; // Fixed size for value
-                bool used;        // Whether this slot is used
+                std::string_view key;
+                std::string_view value;
             };
-            EventDataPair event_data[MAX_EVENT_DATA_PAIRS];
-            size_t event_data_count;  // Number of used pairs
-
-            // Constructor to initialize arrays
-            EventData() : severity(0), event_data_count(0) {
-                provider[0] = '\0';
-                event_id[0] = '\0';
-                message[0] = '\0';
+            SmallVector<EventDataPair, INLINE_EVENT_DATA_PAIRS> event_data;
+            std::string_view raw_json;  // the whole event in raw event mode, else empty
+            // with lookup_accounts on: System/Security UserID, and its account
+            // name once the background resolver has it
+            std::string_view user_sid;
+            char user_account[SidResolverCache::MAX_ACCOUNT_LENGTH];
+            // the EventData fields to send, and whether to send the message; null for all
+            const FieldProjection::Projection* projection;
+            // with template mining on, the message's template ID and parameters,
+            // sent in place of the message; null to send the message
+            const TemplateMiner::Match* template_match;
+
+            EventData() : severity(0), windows_level(0), sample_rate(1), projection(nullptr),
+                template_match(nullptr) {
                 timestamp[0] = '\0';
                 microsec[0] = '\0';
-                for (size_t i = 0; i < MAX_EVENT_DATA_PAIRS; i++) {
-                    event_data[i].used = false;
-                    event_data[i].key[0] = '\0';
-                    event_data[i].value[0] = '\0';
-                }
+                user_account[0] = '\0';
             }
 
             void parseFrom(EventLogEvent& event, const Configuration& config);
-
-            // Helper function to safely copy strings
-            static void safeCopyString(char* dest, size_t destSize, const char* src) {
-                if (!src) {
-                    dest[0] = '\0';
-                    return;
-                }
-                size_t i;
-                for (i = 0; i < destSize - 1 && src[i]; i++) {
-                    dest[i] = src[i];
-                }
-                dest[i] = '\0';
-            }
-
-            // Helper to add event data pair
-            bool addEventData(const char* key, const char* value) {
-                if (event_data_count >= MAX_EVENT_DATA_PAIRS) return false;
-
-                // Find unused slot
-                for (size_t i = 0; i < MAX_EVENT_DATA_PAIRS; i++) {
-                    if (!event_data[i].used) {
-                        safeCopyString(event_data[i].key, sizeof(event_data[i].key), key);
-                        safeCopyString(event_data[i].value, sizeof(event_data[i].value), value);
-                        event_data[i].used = true;
-                        event_data_count++;
-                        return true;
-                    }
-                }
-                return false;
-            }
         };
 
         EventHandlerMessageQueuer(
             Configuration& configuration,
             shared_ptr<MessageQueue> primary_message_queue,
             shared_ptr<MessageQueue> secondary_message_queue,
-            const wchar_t* log_name);
+            const wchar_t* log_name,
+            shared_ptr<const EventRuleEngine> rule_engine = nullptr,
+            shared_ptr<EventDeduplicator> deduplicator = nullptr,
+            shared_ptr<OverloadController> overload_controller = nullptr,
+            shared_ptr<EventAggregator> aggregator = nullptr,
+            shared_ptr<const FieldProjection> field_projection = nullptr,
+            shared_ptr<const PiiRedactor> redactor = nullptr,
+            shared_ptr<TemplateMiner> template_miner = nullptr,
+            shared_ptr<MessageTextPolicy> text_policy = nullptr,
+            const string& stage_order = "");
 
         virtual ~EventHandlerMessageQueuer() = default;
 
+        // A group of one
         Result handleEvent(const wchar_t* subscription_name, EventLogEvent& event) override;
+        // Each event's messages are collected, and each queue gets the
+        // group's in one enqueueBatch()
+        Result handleEvents(const wchar_t* subscription_name, std::span<EventLogEvent> events) override;
+        // Everything up to the enqueue, which commitEvent() does
+        std::unique_ptr<Prepared> prepareEvent(EventLogEvent& event) override;
+        Result commitEvent(const wchar_t* subscription_name, EventLogEvent& event,
+            std::unique_ptr<Prepared> prepared) override;
+        // Each pipeline stage's counters
+        std::string describeStatistics() const override;
+
+        // The stages, in order; a channel's own order may leave out or
+        // reorder any but the first and the last two
+        static constexpr const char* DEFAULT_STAGE_ORDER =
+            "parse,rules,projection,redaction,aggregation,overload,dedup,templates,serialize,route";
+
+        // Copy of a generated message with "repeat_count" added, for dedup summaries
+        static string addRepeatCount(const string& json, uint32_t repeat_count);
+        // Copy of a generated message with "aggregate_count", "first_ts" and
+        // "last_ts" added, for aggregate summaries
+        static string addAggregateFields(const string& json, uint32_t count,
+            int64_t first_time_us, int64_t last_time_us);
 
     private:
         static constexpr double BUFFER_WARNING_THRESHOLD = 0.90;  // 90% as decimal
         static constexpr uint32_t ESTIMATED_FIELD_OVERHEAD = 20;  // Estimated overhead per field in bytes
-        bool skipping_dates_ = false;
+        static constexpr size_t MAX_MESSAGE_ESTIMATE = 32768;     // longer messages get truncated to fit
+        static constexpr size_t MAX_PENDING_BYTES = 1024 * 1024;  // a group's messages are enqueued early past this
+        std::atomic<bool> skipping_dates_{ false };
 
     protected:
+        // The parts of every message that only depend on the configuration and
+        // channel, serialized once rather than per event:
+        //   json_prefix  {"host":..., "_source_type":..., ..., "event_log":..., "facility":...
+        //   http_prefix  the same inside "extra_fields", plus the root-level host
+        //   suffix       , <custom suffix key/values>
+        struct JsonTemplates {
+            uint32_t generation;
+            string json_prefix;
+            string http_prefix;
+            string suffix;
+        };
+        shared_ptr<const JsonTemplates> currentTemplates();
+        shared_ptr<const JsonTemplates> buildTemplates(uint32_t generation) const;
+
         // Estimates final message size before generation
-        size_t estimateMessageSize(const EventData& data, int logformat) const;
-        Result generateLogMessage(EventLogEvent& event, const int logformat, char* json_buffer, size_t buflen);
+        size_t estimateMessageSize(const EventData& data, int logformat);
+        Result generateLogMessage(const EventData& data, const int logformat, char* json_buffer, size_t buflen);
         bool generateJson(const EventData& data, int logformat, char* json_buffer, size_t buflen);
         static unsigned char unixSeverityFromWindowsSeverity(char windows_severity_num);
+        EventRuleEngine::Action applyRules(const EventData& data,
+            const EventRuleEngine::Aggregation** aggregation_out) const;
+        uint64_t dedupKey(const EventData& data) const;
+        uint64_t aggregateKey(const EventData& data, const EventRuleEngine::Aggregation& aggregation) const;
+        static int64_t eventTimeMicroseconds(const EventData& data);
+        uint32_t overloadSampleRate(const EventData& data) const;
+        void redact(EventData& data, char* arena, size_t arena_size) const;
+        void mineTemplate(EventData& data, TemplateMiner::Match& match) const;
+        bool renderMessage(EventLogEvent& event) const;
+
+        // Messages generated for a group of events, end to end, waiting to be
+        // enqueued together
+        struct PendingMessages {
+            string contents;
+            vector<uint32_t> lengths;
+        };
+
+        // One event on its way through the pipeline.  Each stage reads what
+        // the ones before it left here and adds its own part; the strings
+        // are views, into the event or the pool buffers held here, which are
+        // released with the record.
+        struct EventRecord {
+            EventRecord(EventLogEvent& event, char* json_buffer, Logger* logger,
+                PendingMessages& primary_pending, PendingMessages& secondary_pending)
+                : event(event), json_buffer(json_buffer), logger(logger),
+                primary_pending(primary_pending), secondary_pending(secondary_pending) {}
+            ~EventRecord();
+            EventRecord(const EventRecord&) = delete;
+            EventRecord& operator=(const EventRecord&) = delete;
+
+            EventLogEvent& event;
+            char* json_buffer;                  // the primary message is generated here
+            Logger* logger;
+            PendingMessages& primary_pending;
+            PendingMessages& secondary_pending;
+
+            EventData data;
+            char* raw_buffer = nullptr;         // raw event mode's JSON
+            char* redaction_buffer = nullptr;   // redacted values
+            char* secondary_buffer = nullptr;   // the secondary message
+            bool to_primary = true;
+            bool to_secondary = false;
+            const EventRuleEngine::Aggregation* aggregation = nullptr;
+            size_t estimated_size = 0;          // 0 until a stage needs it
+            bool keep_sample = false;           // the first of an aggregate group
+            uint64_t aggregate_key = 0;
+            bool remember_copy = false;         // for the deduplicator
+            uint64_t dedup_key = 0;
+            TemplateMiner::Match template_match;
+            std::string_view primary_json;
+            std::string_view secondary_json;
+            Result result;                      // why, when a stage fails
+        };
+        using Pipeline = EventPipeline<EventRecord>;
+        void buildPipeline(const string& stage_order);
+        vector<Pipeline::StageDefinition> stageDefinitions();
+        size_t estimatedSize(EventRecord& record);
+
+        StageResult parseStage(EventRecord& record);
+        StageResult rulesStage(EventRecord& record);
+        StageResult projectionStage(EventRecord& record);
+        StageResult redactionStage(EventRecord& record);
+        StageResult aggregationStage(EventRecord& record);
+        StageResult overloadStage(EventRecord& record);
+        StageResult dedupStage(EventRecord& record);
+        StageResult templatesStage(EventRecord& record);
+        StageResult serializeStage(EventRecord& record);
+        StageResult routeStage(EventRecord& record);
+        struct PreparedMessages : Prepared {
+            PendingMessages primary;
+            PendingMessages secondary;
+            Result result;
+        };
+        Result queueEvent(EventLogEvent& event, char* json_buffer, Logger* logger,
+            PendingMessages& primary_pending, PendingMessages& secondary_pending);
+        void addPending(MessageQueue& queue, PendingMessages& pending, const char* message, size_t length);
+        static void enqueuePending(MessageQueue& queue, PendingMessages& pending);
 
         Configuration& configuration_;
         shared_ptr<MessageQueue> primary_message_queue_;
         shared_ptr<MessageQueue> secondary_message_queue_;
+        shared_ptr<const EventRuleEngine> rule_engine_;
+        shared_ptr<EventDeduplicator> deduplicator_;
+        shared_ptr<OverloadController> overload_controller_;
+        shared_ptr<EventAggregator> aggregator_;
+        shared_ptr<const FieldProjection> field_projection_;
+        shared_ptr<const PiiRedactor> redactor_;
+        shared_ptr<TemplateMiner> template_miner_;
+        shared_ptr<MessageTextPolicy> text_policy_;
         string log_name_utf8_;
-        string suffix_utf8_;
+        std::atomic<shared_ptr<const JsonTemplates>> templates_;
         uint32_t generated_count_ = 0;
+        Pipeline pipeline_;
+        // only used by handleEvents(), which a subscription calls from one
+        // thread; prepareEvent() collects into its own
+        PendingMessages primary_pending_;
+        PendingMessages secondary_pending_;
     };
 
 } // namespace Syslog_agent
\ No newline at end of file
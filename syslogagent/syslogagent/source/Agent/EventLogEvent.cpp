@@ -5,23 +5,48 @@ Copyright � 2021 Logzilla Corp.
 
 #include "stdafx.h"
 #include "pugixml.hpp"
+#include "AgentStatistics.h"
 #include "EventLogEvent.h"
 #include "Globals.h"
 #include "Logger.h"
+#include "Utf8Transcoder.h"
 #include "Util.h"
+#include "XMLToJsonConverter.h"
 
 #pragma comment(lib, "wevtapi.lib")
 
 namespace Syslog_agent {
     EventLogEvent::EventLogEvent(EVT_HANDLE windows_event_handle)
-        : windows_event_handle_(windows_event_handle), xml_buffer_(nullptr), text_buffer_(nullptr) {
+        : windows_event_handle_(windows_event_handle), xml_buffer_(nullptr), text_buffer_(nullptr),
+        parsed_(false) {
+    }
+
+    EventLogEvent::EventLogEvent()
+        : EventLogEvent(nullptr) {
     }
 
     EventLogEvent::~EventLogEvent() {
-        if (xml_buffer_)
+        releaseBuffers();
+    }
+
+    void EventLogEvent::reset(EVT_HANDLE windows_event_handle) {
+        releaseBuffers();
+        windows_event_handle_ = windows_event_handle;
+    }
+
+    void EventLogEvent::releaseBuffers() {
+        if (parsed_) {
+            xml_doc_.reset();
+            parsed_ = false;
+        }
+        if (xml_buffer_) {
             Globals::instance()->releaseMessageBuffer(xml_buffer_);
-        if (text_buffer_)
+            xml_buffer_ = nullptr;
+        }
+        if (text_buffer_) {
             Globals::instance()->releaseMessageBuffer(text_buffer_);
+            text_buffer_ = nullptr;
+        }
     }
 
     void EventLogEvent::renderXml() {
@@ -48,14 +73,10 @@ namespace Syslog_agent {
             return;
         }
         if (buffer_size_needed < (Globals::MESSAGE_BUFFER_SIZE / sizeof(wchar_t))) {
-            xml_buffer_w[buffer_size_needed] = 0;
-            int utf8_size = WideCharToMultiByte(CP_UTF8, 0, xml_buffer_w, 
-                static_cast<int>(buffer_size_needed), nullptr, 0, nullptr, nullptr);
-            if (utf8_size >= Globals::MESSAGE_BUFFER_SIZE - 1)
-                utf8_size = Globals::MESSAGE_BUFFER_SIZE - 1;
-            WideCharToMultiByte(CP_UTF8, 0, xml_buffer_w, static_cast<int>(buffer_size_needed), 
-                xml_buffer_, utf8_size, nullptr, nullptr);
-            xml_buffer_[utf8_size] = '\0';  // Ensure null termination
+            // EvtRender reports bytes, including the null
+            size_t length = wcsnlen(xml_buffer_w, buffer_size_needed / sizeof(wchar_t));
+            // one pass; anything past the buffer is truncated, as before
+            Utf8Transcoder::utf16ToUtf8(xml_buffer_w, length, xml_buffer_, Globals::MESSAGE_BUFFER_SIZE);
         }
         else {
             xml_buffer_[0] = 0;
@@ -64,12 +85,81 @@ namespace Syslog_agent {
     }
 
     void EventLogEvent::renderEvent() {
-        if (isRendered())
+        parseEvent();
+        renderMessage();
+    }
+
+    void EventLogEvent::parseEvent() {
+        if (parsed_)
             return;
         renderXml();
-        pugi::xml_parse_result xml_parsed = xml_doc_.load_buffer(xml_buffer_, strlen(xml_buffer_));
+        // parse in place: node values point straight into xml_buffer_ rather
+        // than into a second copy of it
+        pugi::xml_parse_result xml_parsed = xml_doc_.load_buffer_inplace(xml_buffer_, strlen(xml_buffer_));
+        parsed_ = true;
+    }
+
+    void EventLogEvent::renderMessage() {
+        if (text_buffer_ != nullptr)
+            return;
+        parseEvent();
         auto provider_name = xml_doc_.child("Event").child("System").child("Provider").attribute("Name").value();
-        renderText(provider_name);
+        if (!renderTextFromTemplate(provider_name)) {
+            AgentStatistics::instance().increment(AgentStatistics::MessageTemplateFallbacks);
+            renderText(provider_name);
+        }
+    }
+
+    size_t EventLogEvent::renderRawJson(char* json_buffer, size_t buflen) {
+        if (isRendered()) {
+            return 0;
+        }
+        renderXml();
+        if (xml_buffer_ == nullptr || xml_buffer_[0] == '\0') {
+            return 0;
+        }
+        return XMLToJSONConverter::convert(xml_buffer_, strlen(xml_buffer_), json_buffer, buflen);
+    }
+
+    bool EventLogEvent::renderTextFromTemplate(const char* publisher_name) {
+        if (text_buffer_ != nullptr)
+            return true;
+        auto event_node = xml_doc_.child("Event");
+        auto system_node = event_node.child("System");
+        auto event_id_node = system_node.child("EventID");
+        // classic events carry their qualifiers, which are part of the message id
+        uint32_t event_id = (event_id_node.attribute("Qualifiers").as_uint() << 16)
+            | (event_id_node.text().as_uint() & 0xFFFF);
+        uint32_t version = system_node.child("Version").text().as_uint();
+
+        auto message_template = Globals::instance()->getMessageTemplateCache().acquire(
+            publisher_name, event_id, version, static_cast<uint32_t>(GetThreadLocale()));
+        if (!message_template)
+            return false;
+
+        // inserts are the EventData values in order; UserData events only
+        // work here if their message doesn't use any
+        std::string_view inserts[MessageTemplate::MAX_INSERTS];
+        size_t insert_count = 0;
+        for (auto data_node : event_node.child("EventData").children("Data")) {
+            if (insert_count >= MessageTemplate::MAX_INSERTS)
+                break;
+            inserts[insert_count++] = data_node.child_value();
+        }
+        if (static_cast<size_t>(message_template->highestInsert()) > insert_count)
+            return false;
+
+        text_buffer_ = Globals::instance()->getMessageBuffer("text_buffer_");
+        if (text_buffer_ == nullptr)
+            return false;
+        size_t text_size;
+        if (!message_template->render(inserts, insert_count, text_buffer_, 
+            Globals::MESSAGE_BUFFER_SIZE, text_size)) {
+            Globals::instance()->releaseMessageBuffer(text_buffer_);
+            text_buffer_ = nullptr;
+            return false;
+        }
+        return true;
     }
 
     void EventLogEvent::renderText(const char* publisher_name) {
@@ -82,21 +172,27 @@ namespace Syslog_agent {
         wchar_t publisher_name_w[1000];
         MultiByteToWideChar(CP_UTF8, 0, publisher_name, -1, publisher_name_w, 
             sizeof(publisher_name_w) / sizeof(wchar_t));
-        EVT_HANDLE metadata_handle = EvtOpenPublisherMetadata(nullptr, publisher_name_w, 
-            nullptr, 0, 0);
+        auto& metadata_cache = Globals::instance()->getPublisherMetadataCache();
+        std::uint32_t open_status;
+        auto metadata_handle = metadata_cache.acquire(publisher_name_w, &open_status);
         if (!metadata_handle) {
-            int status = GetLastError();
-            logger->recoverable_error("EventPublisher::openMetadata()> EvtOpenPublisherMetadata "
-                "failed with %d for %s\n", status, publisher_name);
+            // failure was already logged when the publisher was first tried
+            logger->debug2("EventLogEvent::renderText()> no publisher metadata (%u) for %s\n",
+                open_status, publisher_name);
             Globals::instance()->releaseMessageBuffer(reinterpret_cast<char*>(text_buffer_w));
             return;
         }
         DWORD buffer_size_needed;
-        BOOL succeeded = EvtFormatMessage(metadata_handle, windows_event_handle_, 0, 0, nullptr, 
-            EvtFormatMessageEvent, Globals::MESSAGE_BUFFER_SIZE / sizeof(wchar_t) - 1, text_buffer_w, 
-            &buffer_size_needed);
+        BOOL succeeded = EvtFormatMessage(static_cast<EVT_HANDLE>(metadata_handle.get()), 
+            windows_event_handle_, 0, 0, nullptr, EvtFormatMessageEvent, 
+            Globals::MESSAGE_BUFFER_SIZE / sizeof(wchar_t) - 1, text_buffer_w, &buffer_size_needed);
         if (!succeeded) {
             auto err = GetLastError();
+            if (err == ERROR_INVALID_HANDLE || err == ERROR_EVT_PUBLISHER_DISABLED) {
+                // publisher was probably uninstalled or updated since we opened it
+                metadata_cache.invalidate(publisher_name_w);
+                Globals::instance()->getMessageTemplateCache().invalidateProvider(publisher_name);
+            }
             // Check specifically for message not found
             if (err == 15029) {
                 logger->debug("EventLogEvent::renderText()> Message template not found\n");
@@ -109,15 +205,12 @@ namespace Syslog_agent {
             buffer_size_needed = 0;
         }
         text_buffer_w[buffer_size_needed] = L'\0';
-        
-        int utf8_size = WideCharToMultiByte(CP_UTF8, 0, text_buffer_w, 
-            static_cast<int>(buffer_size_needed), nullptr, 0, nullptr, nullptr);
-        if (utf8_size >= Globals::MESSAGE_BUFFER_SIZE - 1)
-            utf8_size = Globals::MESSAGE_BUFFER_SIZE - 1;
-        WideCharToMultiByte(CP_UTF8, 0, text_buffer_w, static_cast<int>(buffer_size_needed),
-            text_buffer_, utf8_size, nullptr, nullptr);
-        text_buffer_[utf8_size] = '\0';  // Ensure null termination
-        EvtClose(metadata_handle);
+
+        // on failure text_buffer_ may already hold a placeholder
+        if (buffer_size_needed > 0) {
+            Utf8Transcoder::utf16ToUtf8(text_buffer_w, wcslen(text_buffer_w), text_buffer_,
+                Globals::MESSAGE_BUFFER_SIZE);
+        }
         Globals::instance()->releaseMessageBuffer(reinterpret_cast<char*>(text_buffer_w));
     }
 }
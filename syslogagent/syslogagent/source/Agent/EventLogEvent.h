@@ -15,21 +15,45 @@ namespace Syslog_agent {
         class EventLogEvent {
         public:
                 EventLogEvent(EVT_HANDLE windows_event_handle);
+                // empty, for a source's reusable array of events; see reset()
+                EventLogEvent();
                 ~EventLogEvent();
+                EventLogEvent(const EventLogEvent&) = delete;
+                EventLogEvent& operator=(const EventLogEvent&) = delete;
+                // Starts over with another event: releases the buffers and
+                // the parsed XML.  The handle is not closed, it's the caller's.
+                void reset(EVT_HANDLE windows_event_handle);
+                // Releases the buffers (and so the parsed XML, which is in
+                // them) once the event has been handled, keeping the handle
+                void releaseBuffers();
+                EVT_HANDLE getHandle() const { return windows_event_handle_; }
+                // parseEvent() and renderMessage()
                 void renderEvent();
+                // Renders the XML and parses it in place, leaving the message text
+                void parseEvent();
+                // Renders the message text, parsing the event first if need be
+                void renderMessage();
+                // Writes the complete event as JSON (see XMLToJSONConverter).
+                // Must come before renderEvent(), which parses the XML in place;
+                // returns 0 after that, or if the JSON doesn't fit.
+                size_t renderRawJson(char* json_buffer, size_t buflen);
                 pugi::xml_document& getXmlDoc() { return xml_doc_; }
-                bool isRendered() const { return xml_buffer_ != nullptr; }      
+                bool isRendered() const { return parsed_; }
+                // once rendered, the XML has been parsed in place and this is the parser's buffer
                 char* getEventXml() const { return xml_buffer_; }
+                // null if the message hasn't been rendered
                 char* getEventText() const { return text_buffer_; }
 
         private:
                 void renderXml();
                 void renderText(const char* publisher_name);
+                bool renderTextFromTemplate(const char* publisher_name);
 
                 // these two stored as utf-8
                 char* xml_buffer_;
                 char* text_buffer_;
                 EVT_HANDLE windows_event_handle_;
+                bool parsed_;
                 pugi::xml_document xml_doc_;
         };
 }
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "EventLogSubscription.h"
+#include "AgentStatistics.h"
 #include "Logger.h"
 #include "Registry.h"
 #include "SlidingWindowMetrics.h"
@@ -9,33 +10,29 @@
 
 namespace Syslog_agent {
 
+    // rendered instead of the event, to check it against the SentRecordTracker
+    static LPCWSTR RECORD_ID_PATHS[] = { L"Event/System/EventRecordID" };
+
     // C-style function for handling SEH exceptions
     // This has no C++ objects so it can safely use __try/__except
-    static DWORD HandleSubscriptionSEH(
-        EVT_SUBSCRIBE_NOTIFY_ACTION action,
-        PVOID pContext,
+    static DWORD UpdateBookmarkSEH(
+        EventLogSubscription* subscription,
         EVT_HANDLE hEvent)
     {
         auto logger = LOG_THIS;
 
         __try {
-            // Call into the C++ implementation
-            auto subscription = reinterpret_cast<EventLogSubscription*>(pContext);
             if (!subscription) {
                 return ERROR_INVALID_PARAMETER;
             }
 
             // Handle updates to bookmark - this might throw SEH
-            if (action == EvtSubscribeActionDeliver && hEvent) {
-                EVT_HANDLE bookmark = subscription->getBookmark();
-                if (bookmark) {
-                    if (!subscription->updateBookmark(hEvent)) {
-                        DWORD lastError = GetLastError();
-                        logger->recoverable_error("HandleSubscriptionSEH()> Failed to update bookmark, error: %lu\n",
-                            lastError);
-                        return lastError;
-                    }
-                    return ERROR_SUCCESS;
+            if (hEvent && subscription->getBookmark()) {
+                if (!subscription->updateBookmark(hEvent)) {
+                    DWORD lastError = GetLastError();
+                    logger->recoverable_error("UpdateBookmarkSEH()> Failed to update bookmark, error: %lu\n",
+                        lastError);
+                    return lastError;
                 }
             }
 
@@ -44,38 +41,75 @@ namespace Syslog_agent {
         __except (EXCEPTION_EXECUTE_HANDLER) {
             // Return the Windows exception code
             DWORD exceptionCode = GetExceptionCode();
-            logger->critical("HandleSubscriptionSEH()> Structured exception: 0x%08X at %s:%d\n",
+            logger->critical("UpdateBookmarkSEH()> Structured exception: 0x%08X at %s:%d\n",
                 exceptionCode, __FILE__, __LINE__);
             return exceptionCode;
         }
     }
 
-    // Move constructor
-    EventLogSubscription::EventLogSubscription(EventLogSubscription&& source) noexcept
-        : subscription_name_(std::move(source.subscription_name_)),
-        channel_(std::move(source.channel_)),
-        query_(std::move(source.query_)),
-        event_handler_(std::move(source.event_handler_)),
-        bookmark_(source.bookmark_),
-		only_while_running_(source.only_while_running_),
-        subscription_handle_(source.subscription_handle_),
-        subscription_active_(false),
-        bookmark_modified_(source.bookmark_modified_),
-        last_bookmark_save_(source.last_bookmark_save_),
-        events_since_last_save_(0)
-    {
-        memcpy(bookmark_xml_buffer_, source.bookmark_xml_buffer_, sizeof(bookmark_xml_buffer_));
+    // One event on the render pool: prepared on a pool thread, then
+    // committed and the bookmark advanced, in order
+    class EventLogSubscription::RenderTask : public OrderedWorkPool::Task {
+    public:
+        RenderTask(EventLogSubscription& subscription, EVT_HANDLE event_handle, std::uint64_t record_id)
+            : subscription_(subscription), event_handle_(event_handle), event_(event_handle), record_id_(record_id) {
+        }
 
-        // Clear source pointers to prevent double deletion
-        source.bookmark_ = NULL;
-        source.subscription_handle_ = NULL;
-        source.bookmark_xml_buffer_[0] = 0;
-        // No need to reset event_handler_ as it's been moved
+        ~RenderTask() override {
+            if (event_handle_) {
+                event_.reset(NULL);
+                EvtClose(event_handle_);
+            }
+        }
+
+        void work() override {
+            auto logger = LOG_THIS;
+            try {
+                prepared_ = subscription_.event_handler_->prepareEvent(event_);
+            } catch (const std::exception& e) {
+                logger->critical("EventLogSubscription::RenderTask::work()> prepareEvent exception: %s\n", e.what());
+            } catch (...) {
+                logger->critical("EventLogSubscription::RenderTask::work()> prepareEvent unknown exception\n");
+            }
+        }
 
-        if (source.subscription_active_) {
-            source.subscription_active_ = false;
-            subscribe(bookmark_xml_buffer_, source.only_while_running_);
+        void complete() override {
+            auto logger = LOG_THIS;
+            try {
+                subscription_.event_handler_->commitEvent(subscription_.subscription_name_.c_str(), event_,
+                    std::move(prepared_));
+            } catch (const std::exception& e) {
+                logger->critical("EventLogSubscription::RenderTask::complete()> commitEvent exception: %s\n", e.what());
+            } catch (...) {
+                logger->critical("EventLogSubscription::RenderTask::complete()> commitEvent unknown exception\n");
+            }
+            if (UpdateBookmarkSEH(&subscription_, event_handle_) == ERROR_SUCCESS) {
+                subscription_.incrementedSaveBookmark();
+            }
+            if (record_id_ != 0) {
+                subscription_.sent_records_.markSent(record_id_);
+                if (++subscription_.records_since_save_ >= SENT_RECORDS_SAVE_INTERVAL) {
+                    subscription_.saveSentRecords();
+                }
+            }
+            event_.reset(NULL);
+            EvtClose(event_handle_);
+            event_handle_ = NULL;
         }
+
+    private:
+        EventLogSubscription& subscription_;
+        EVT_HANDLE event_handle_;
+        EventLogEvent event_;
+        std::uint64_t record_id_;
+        std::unique_ptr<IEventHandler::Prepared> prepared_;
+    };
+
+    // Move constructor
+    EventLogSubscription::EventLogSubscription(EventLogSubscription&& source) noexcept
+        : EventLogSubscription()
+    {
+        *this = std::move(source);
     }
 
     // Move assignment operator
@@ -90,32 +124,39 @@ namespace Syslog_agent {
                 EvtClose(bookmark_);
                 bookmark_ = NULL;
             }
+
+            // The source's delivery thread is using the source, so it has to
+            // stop before anything moves; we resubscribe if it was active
+            const bool resubscribe = source.subscription_active_;
+            if (resubscribe) {
+                source.cancelSubscription();
+            }
             
             // Move resource ownership
             subscription_name_ = std::move(source.subscription_name_);
             channel_ = std::move(source.channel_);
             query_ = std::move(source.query_);
             event_handler_ = std::move(source.event_handler_);
+            render_pool_ = std::move(source.render_pool_);
+            render_channel_ = std::move(source.render_channel_);
             bookmark_ = source.bookmark_;
             only_while_running_ = source.only_while_running_;
-            subscription_handle_ = source.subscription_handle_;
-            subscription_active_ = false; // We'll resubscribe if needed
+            record_tracking_ = source.record_tracking_;
+            sent_records_ = source.sent_records_;
             bookmark_modified_ = source.bookmark_modified_;
             last_bookmark_save_ = source.last_bookmark_save_;
             events_since_last_save_ = 0;
+            batch_events_ = std::move(source.batch_events_);
             
             memcpy(bookmark_xml_buffer_, source.bookmark_xml_buffer_, sizeof(bookmark_xml_buffer_));
             
             // Clear source handles to prevent double deletion
             source.bookmark_ = NULL;
-            source.subscription_handle_ = NULL;
             source.bookmark_xml_buffer_[0] = 0;
             // event_handler_ is already moved, no need to clear
             
-            // Resubscribe if the source was active
-            if (source.subscription_active_) {
-                source.subscription_active_ = false;
-                subscribe(bookmark_xml_buffer_, source.only_while_running_);
+            if (resubscribe) {
+                subscribe(bookmark_xml_buffer_, only_while_running_);
             }
         }
         
@@ -205,14 +246,27 @@ namespace Syslog_agent {
         logger->debug2("EventLogSubscription::subscribe()> Attempting subscription to %s with flags %d and bookmark %p (tracking bookmark %p)\n", 
             channel_buf, flags, subscribe_bookmark, bookmark_);
 
+        // a structured XML query names its own channel(s), and then the channel path must be NULL
+        const bool is_structured_query = !query_.empty() && query_[0] == L'<';
+
+        // manual reset, and set to begin with so the delivery thread's first
+        // pass reads whatever is already there
+        signal_event_ = CreateEvent(NULL, TRUE, TRUE, NULL);
+        if (signal_event_ == NULL) {
+            auto status = GetLastError();
+            logger->critical("EventLogSubscription::subscribe()> could not create signal event for %s (error %d)\n",
+                channel_buf, status);
+            return;
+        }
+
         subscription_handle_ = EvtSubscribe(
             NULL,
-            NULL,
-            channel_.c_str(),
+            signal_event_,
+            is_structured_query ? NULL : channel_.c_str(),
             query_.c_str(),
             subscribe_bookmark,  // Only pass bookmark for EvtSubscribeStartAfterBookmark
-            this,
-            EventLogSubscription::handleSubscriptionEvent,
+            NULL,
+            NULL,
             flags
         );
 
@@ -220,9 +274,25 @@ namespace Syslog_agent {
             auto status = GetLastError();
             logger->critical("EventLogSubscription::subscribe()> could not subscribe to %s (error %d)\n",
                 channel_buf, status);
+            CloseHandle(signal_event_);
+            signal_event_ = NULL;
             return;
         }
 
+        if (!batch_events_) {
+            batch_events_ = std::make_unique<EventLogEvent[]>(DELIVERY_BATCH_SIZE);
+        }
+        // only a subscription that catches up can see an event twice
+        if (record_tracking_ && !only_while_running) {
+            loadSentRecords();
+            record_id_context_ = EvtCreateRenderContext(1, RECORD_ID_PATHS, EvtRenderContextValues);
+            if (record_id_context_ == NULL) {
+                logger->recoverable_error("EventLogSubscription::subscribe()> could not create record ID context for %s"
+                    " (error %d), not tracking sent records\n", channel_buf, GetLastError());
+            }
+        }
+        stopping_ = false;
+        delivery_thread_ = std::thread(&EventLogSubscription::deliveryLoop, this);
         subscription_active_ = true;
         logger->debug2("EventLogSubscription::subscribe()> Successfully subscribed to %s\n", channel_buf);
     }
@@ -231,6 +301,26 @@ namespace Syslog_agent {
         auto logger = LOG_THIS;
         if (subscription_active_) {
             // saveBookmark();
+            stopping_ = true;
+            if (subscription_handle_) {
+                // ends an EvtNext() in progress
+                EvtCancel(subscription_handle_);
+            }
+            if (signal_event_) {
+                SetEvent(signal_event_);
+            }
+            if (delivery_thread_.joinable()) {
+                delivery_thread_.join();
+            }
+            if (render_pool_ && render_channel_) {
+                // events already read still go out, and move the bookmark
+                render_pool_->drain(*render_channel_);
+            }
+            if (record_id_context_) {
+                saveSentRecords();
+                EvtClose(record_id_context_);
+                record_id_context_ = NULL;
+            }
             if (subscription_handle_) {
                 if (!EvtClose(subscription_handle_)) {
                     logger->recoverable_error("EventLogSubscription::cancelSubscription()> "
@@ -239,69 +329,186 @@ namespace Syslog_agent {
                 }
                 subscription_handle_ = NULL;
             }
+            if (signal_event_) {
+                CloseHandle(signal_event_);
+                signal_event_ = NULL;
+            }
             subscription_active_ = false;
         }
     }
 
-    DWORD WINAPI EventLogSubscription::handleSubscriptionEvent(
-        EVT_SUBSCRIBE_NOTIFY_ACTION action, 
-        PVOID pContext, 
-        EVT_HANDLE hEvent) 
-    {
+    void EventLogSubscription::deliveryLoop() {
         auto logger = LOG_THIS;
-        
-        try {
-            // First, handle the SEH-prone parts in a separate C function
-            DWORD sehResult = HandleSubscriptionSEH(action, pContext, hEvent);
-            if (sehResult != ERROR_SUCCESS) {
-                logger->critical("EventLogSubscription::handleSubscriptionEvent()> Structured exception: 0x%08X at %s:%d\n",
-                    sehResult, __FILE__, __LINE__);
-                return ERROR_SUCCESS;
+        while (!stopping_) {
+            DWORD wait_result = WaitForSingleObject(signal_event_, INFINITE);
+            if (stopping_) {
+                break;
             }
-            
-            // If we get here, we've handled the SEH-prone parts successfully
-            EventLogSubscription* subscription = static_cast<EventLogSubscription*>(pContext);
-            
-            switch (action) {
-            case EvtSubscribeActionError:
-                if (hEvent && (DWORD_PTR)hEvent != ERROR_EVT_QUERY_RESULT_STALE) {
-                    logger->recoverable_error("EventLogSubscription::handleSubscriptionEvent()> Received error event, error code: %lu\n",
-                        (DWORD_PTR)hEvent);
-                }
+            if (wait_result != WAIT_OBJECT_0) {
+                logger->critical("EventLogSubscription::deliveryLoop()> wait failed for %ls (error %lu)\n",
+                    channel_.c_str(), GetLastError());
                 break;
+            }
+            // reset before reading, so events logged meanwhile set it again
+            ResetEvent(signal_event_);
+            try {
+                deliverAvailable();
+            } catch (const std::exception& e) {
+                logger->critical("EventLogSubscription::deliveryLoop()> Exception: %s\n", e.what());
+            } catch (...) {
+                logger->critical("EventLogSubscription::deliveryLoop()> Unknown exception\n");
+            }
+        }
+    }
 
-            case EvtSubscribeActionDeliver:
-                if (hEvent && subscription) {
-#if ONLY_FOR_DEBUGGING_CURRENTLY_DISABLED
-                    SlidingWindowMetrics::instance().recordIncoming();
-#endif
+    DWORD EventLogSubscription::readEvents(EVT_HANDLE* event_handles, DWORD max) {
+        auto logger = LOG_THIS;
+        DWORD returned = 0;
+        if (stopping_) {
+            return 0;
+        }
+        if (!EvtNext(subscription_handle_, max, event_handles, NEXT_TIMEOUT_MS, 0, &returned)) {
+            DWORD status = GetLastError();
+            if (status != ERROR_NO_MORE_ITEMS && status != ERROR_TIMEOUT && status != ERROR_CANCELLED
+                && status != ERROR_EVT_QUERY_RESULT_STALE) {
+                logger->recoverable_error("EventLogSubscription::readEvents()> EvtNext failed for %ls, error code: %lu\n",
+                    channel_.c_str(), status);
+            }
+            return 0;
+        }
+        return returned;
+    }
 
-                    // Create EventLogEvent on the stack within this scope
-                    EventLogEvent evt(hEvent);
-                    try {
-                        subscription->event_handler_->handleEvent(subscription->subscription_name_.c_str(), evt);
-                    } catch (const std::exception& e) {
-                        logger->critical("EventLogSubscription::handleEvent exception: %s\n", e.what());
-                    } catch (...) {
-                        logger->critical("EventLogSubscription::handleEvent unknown exception\n");
-                    }
+    void EventLogSubscription::deliverAvailable() {
+        if (render_pool_) {
+            render_pool_->pump(*this, *render_channel_);
+            return;
+        }
+        EVT_HANDLE event_handles[DELIVERY_BATCH_SIZE];
+        for (;;) {
+            DWORD returned = readEvents(event_handles, DELIVERY_BATCH_SIZE);
+            if (returned == 0) {
+                return;
+            }
+            deliverBatch(event_handles, returned);
+        }
+    }
 
-                    // Update the subscription bookmark and save it if needed
-                    if (subscription->updateBookmark(hEvent)) {
-                        subscription->incrementedSaveBookmark();
-                    }
+    size_t EventLogSubscription::next(std::unique_ptr<OrderedWorkPool::Task>* tasks, size_t max) {
+        EVT_HANDLE event_handles[DELIVERY_BATCH_SIZE];
+        size_t count = 0;
+        // 0 would end the pump, so a group that was all skipped isn't the end
+        while (count == 0) {
+            DWORD returned = readEvents(event_handles,
+                max < DELIVERY_BATCH_SIZE ? static_cast<DWORD>(max) : DELIVERY_BATCH_SIZE);
+            if (returned == 0) {
+                return 0;
+            }
+            for (DWORD i = 0; i < returned; ++i) {
+                std::uint64_t record_id = record_id_context_ ? recordId(event_handles[i]) : 0;
+                if (record_id != 0 && sent_records_.alreadySent(record_id)) {
+                    // nothing later moves the bookmark past it until an event is delivered
+                    EvtClose(event_handles[i]);
+                    AgentStatistics::instance().increment(AgentStatistics::RecordsSkipped);
+                    continue;
                 }
-                break;
+                tasks[count++] = std::make_unique<RenderTask>(*this, event_handles[i], record_id);
             }
+        }
+        AgentStatistics::instance().increment(AgentStatistics::DeliveredBatches);
+        AgentStatistics::instance().increment(AgentStatistics::DeliveredEvents, count);
+        return count;
+    }
 
-            return ERROR_SUCCESS;
-        } catch (const std::exception& e) {
-            logger->critical("EventLogSubscription::handleSubscriptionEvent()> Exception: %s\n", e.what());
-            return ERROR_SUCCESS;
-        } catch (...) {
-            logger->critical("EventLogSubscription::handleSubscriptionEvent()> Unknown exception\n");
-            return ERROR_SUCCESS;
+    void EventLogSubscription::deliverBatch(EVT_HANDLE* event_handles, DWORD count) {
+        auto logger = LOG_THIS;
+#if ONLY_FOR_DEBUGGING_CURRENTLY_DISABLED
+        for (DWORD i = 0; i < count; ++i) {
+            SlidingWindowMetrics::instance().recordIncoming();
+        }
+#endif
+        std::uint64_t record_ids[DELIVERY_BATCH_SIZE];
+        DWORD delivered = 0;
+        for (DWORD i = 0; i < count; ++i) {
+            std::uint64_t record_id = record_id_context_ ? recordId(event_handles[i]) : 0;
+            if (record_id != 0 && sent_records_.alreadySent(record_id)) {
+                continue;
+            }
+            record_ids[delivered] = record_id;
+            batch_events_[delivered++].reset(event_handles[i]);
+        }
+        if (delivered < count) {
+            AgentStatistics::instance().increment(AgentStatistics::RecordsSkipped, count - delivered);
+        }
+        if (delivered > 0) {
+            try {
+                event_handler_->handleEvents(subscription_name_.c_str(),
+                    std::span<EventLogEvent>(batch_events_.get(), delivered));
+            } catch (const std::exception& e) {
+                logger->critical("EventLogSubscription::deliverBatch()> handleEvents exception: %s\n", e.what());
+            } catch (...) {
+                logger->critical("EventLogSubscription::deliverBatch()> handleEvents unknown exception\n");
+            }
+            AgentStatistics::instance().increment(AgentStatistics::DeliveredBatches);
+            AgentStatistics::instance().increment(AgentStatistics::DeliveredEvents, delivered);
+            if (record_id_context_) {
+                for (DWORD i = 0; i < delivered; ++i) {
+                    sent_records_.markSent(record_ids[i]);
+                }
+                records_since_save_ += static_cast<int>(delivered);
+                if (records_since_save_ >= SENT_RECORDS_SAVE_INTERVAL) {
+                    saveSentRecords();
+                }
+            }
+        }
+
+        // the group's last event marks the position for all of it
+        DWORD seh_result = UpdateBookmarkSEH(this, event_handles[count - 1]);
+        if (seh_result == ERROR_SUCCESS) {
+            incrementedSaveBookmark(static_cast<int>(count));
+        }
+
+        for (DWORD i = 0; i < delivered; ++i) {
+            batch_events_[i].reset(NULL);
+        }
+        for (DWORD i = 0; i < count; ++i) {
+            EvtClose(event_handles[i]);
+        }
+    }
+
+    std::uint64_t EventLogSubscription::recordId(EVT_HANDLE event_handle) const {
+        EVT_VARIANT value;
+        DWORD buffer_used = 0;
+        DWORD property_count = 0;
+        if (!EvtRender(record_id_context_, event_handle, EvtRenderEventValues, sizeof value, &value,
+            &buffer_used, &property_count) || property_count != 1 || value.Type != EvtVarTypeUInt64) {
+            return 0;
+        }
+        return value.UInt64Val;
+    }
+
+    void EventLogSubscription::loadSentRecords() {
+        auto logger = LOG_THIS;
+        unsigned char state[SentRecordTracker::STATE_SIZE];
+        DWORD state_size = sizeof state;
+        if (Registry::readSentRecords(channel_.c_str(), state, state_size)
+            && sent_records_.deserialize(state, state_size)) {
+            logger->debug("EventLogSubscription::loadSentRecords()> %ls: sent up to record %llu\n",
+                channel_.c_str(), static_cast<unsigned long long>(sent_records_.highWaterMark()));
+        } else {
+            sent_records_ = SentRecordTracker();
+        }
+        records_since_save_ = 0;
+    }
+
+    void EventLogSubscription::saveSentRecords() {
+        records_since_save_ = 0;
+        if (sent_records_.empty()) {
+            return;
         }
+        unsigned char state[SentRecordTracker::STATE_SIZE];
+        size_t state_size = sent_records_.serialize(state, sizeof state);
+        Registry::writeSentRecords(channel_.c_str(), state, static_cast<DWORD>(state_size));
     }
 
     bool EventLogSubscription::saveBookmark()
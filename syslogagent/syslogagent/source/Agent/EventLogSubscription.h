@@ -1,18 +1,37 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 #include <Windows.h>
 #include <winevt.h>
 #include "EventLogEvent.h"
+#include "EventSource.h"
+#include "OrderedWorkPool.h"
+#include "SentRecordTracker.h"
 // Include your IEventHandler interface:
 #include "IEventHandler.h"  
 
 namespace Syslog_agent {
     using namespace std;
 
-    class EventLogSubscription {
+    // A pull subscription: the event log signals when it has events, and a
+    // delivery thread reads up to DELIVERY_BATCH_SIZE at a time (EvtNext)
+    // and hands each group to the handler in one handleEvents() call.  The
+    // bookmark is updated once per group, to the group's last event.
+    //
+    // Given a render pool, the subscription is instead an EventSource for
+    // it: each event is prepared by the handler on the pool's threads, and
+    // committed, and the bookmark advanced to it, in the order it was logged.
+    //
+    // With record tracking, each event's EventRecordID is read before it's
+    // rendered, and one the SentRecordTracker says was handled before (since
+    // the last bookmark saved, ahead of a crash) is skipped.  The tracker is
+    // saved every SENT_RECORDS_SAVE_INTERVAL events, checked after each
+    // group or pooled event, and when the subscription stops.
+    class EventLogSubscription : public EventSource {
     public:
         EventLogSubscription(
             const wstring& subscription_name,
@@ -20,14 +39,21 @@ namespace Syslog_agent {
             const wstring& query,
             const wstring& bookmark_xml,
             const bool only_while_running,
-            unique_ptr<IEventHandler> event_handler)
+            unique_ptr<IEventHandler> event_handler,
+            shared_ptr<OrderedWorkPool> render_pool = nullptr,
+            const bool record_tracking = false)
             : subscription_name_(subscription_name),
             channel_(channel),
             query_(query),
             only_while_running_(only_while_running),
+            record_tracking_(record_tracking),
             event_handler_(move(event_handler)),
+            render_pool_(render_pool),
+            render_channel_(render_pool ? render_pool->createChannel() : nullptr),
             bookmark_(NULL),
             subscription_handle_(NULL),
+            signal_event_(NULL),
+            record_id_context_(NULL),
             subscription_active_(false),
             bookmark_modified_(false),
             last_bookmark_save_(0),
@@ -47,25 +73,31 @@ namespace Syslog_agent {
         EventLogSubscription() : 
             bookmark_(NULL),
             subscription_handle_(NULL),
+            signal_event_(NULL),
+            record_id_context_(NULL),
             subscription_active_(false),
             bookmark_modified_(false),
             last_bookmark_save_(0),
             events_since_last_save_(0),
-            only_while_running_(false)
+            only_while_running_(false),
+            record_tracking_(false)
         {
             bookmark_xml_buffer_[0] = 0;
         }
 
-        ~EventLogSubscription();
+        ~EventLogSubscription() override;
 
         void subscribe(const wstring& bookmark_xml, const bool only_while_running);
         void cancelSubscription();
         bool saveBookmark();  // Returns true if bookmark was saved
         wstring getName() const { return subscription_name_; }
         wstring getChannel() const { return channel_; }
+        std::string describeStatistics() const {
+            return event_handler_ ? event_handler_->describeStatistics() : std::string();
+        }
         void markBookmarkModified() { bookmark_modified_ = true; }
-        bool incrementedSaveBookmark() {
-            if (++events_since_last_save_ >= MAX_EVENTS_BETWEEN_SAVES) {
+        bool incrementedSaveBookmark(int events = 1) {
+            if ((events_since_last_save_ += events) >= MAX_EVENTS_BETWEEN_SAVES) {
                 saveBookmark();
                 return true;
             }
@@ -74,31 +106,59 @@ namespace Syslog_agent {
         EVT_HANDLE getBookmark() const { return bookmark_; }
         bool updateBookmark(EVT_HANDLE hEvent);
 
+        static constexpr DWORD DELIVERY_BATCH_SIZE = 64;    // events per EvtNext() and handleEvents()
+
+        // With a render pool: one task per event read
+        size_t next(std::unique_ptr<OrderedWorkPool::Task>* tasks, size_t max) override;
+
     private:
-        static DWORD WINAPI handleSubscriptionEvent(
-            EVT_SUBSCRIBE_NOTIFY_ACTION action,
-            PVOID pContext,
-            EVT_HANDLE hEvent);
+        class RenderTask;
+
+        void deliveryLoop();
+        // EvtNext(): the number of handles read, 0 if none (or stopping)
+        DWORD readEvents(EVT_HANDLE* event_handles, DWORD max);
+        // Reads and delivers groups until the subscription has no more
+        void deliverAvailable();
+        void deliverBatch(EVT_HANDLE* event_handles, DWORD count);
+        // The event's EventRecordID, without rendering it; 0 if unknown
+        std::uint64_t recordId(EVT_HANDLE event_handle) const;
+        void loadSentRecords();
+        void saveSentRecords();
 
         static constexpr DWORD MAX_BOOKMARK_SIZE = 4096;  // 4KB should be more than enough for bookmark XML
+        static constexpr DWORD NEXT_TIMEOUT_MS = 1000;
 
         // Disable copy constructor and assignment
         EventLogSubscription(const EventLogSubscription&) = delete;
         EventLogSubscription& operator=(const EventLogSubscription&) = delete;
 
         static constexpr int MAX_EVENTS_BETWEEN_SAVES = 100;
+        static constexpr int SENT_RECORDS_SAVE_INTERVAL = 16;
 
         wstring subscription_name_;
         wstring channel_;
         wstring query_;
         wchar_t bookmark_xml_buffer_[MAX_BOOKMARK_SIZE];
         bool only_while_running_;
+        bool record_tracking_;
 
         // Store a unique_ptr to IEventHandler
         unique_ptr<IEventHandler> event_handler_;
+        shared_ptr<OrderedWorkPool> render_pool_;
+        shared_ptr<OrderedWorkPool::Channel> render_channel_;
 
         EVT_HANDLE bookmark_;
         EVT_HANDLE subscription_handle_;
+        HANDLE signal_event_;       // set by the event log when there are events to read
+        std::thread delivery_thread_;
+        std::atomic<bool> stopping_{ false };
+        // reused for every group; only the delivery thread touches them
+        unique_ptr<EventLogEvent[]> batch_events_;
+        // on the delivery thread, or on whichever pool thread is completing
+        // this subscription's events, one at a time
+        SentRecordTracker sent_records_;
+        EVT_HANDLE record_id_context_;
+        int records_since_save_ = 0;
         bool subscription_active_;
         bool bookmark_modified_;  // Flag to track if bookmark needs saving
         time_t last_bookmark_save_;  // Last time bookmark was saved
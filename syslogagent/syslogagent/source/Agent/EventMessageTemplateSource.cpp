@@ -0,0 +1,174 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "stdafx.h"
+#include <winevt.h>
+#include <cstring>
+#include "EventMessageTemplateSource.h"
+#include "Globals.h"
+#include "Logger.h"
+#include "Utf8Transcoder.h"
+#include "pugixml.hpp"
+
+#pragma comment(lib, "wevtapi.lib")
+
+namespace Syslog_agent {
+
+    namespace {
+        bool getEventMetadataUInt32(EVT_HANDLE event_metadata, EVT_EVENT_METADATA_PROPERTY_ID property_id,
+            DWORD& value_out) {
+            EVT_VARIANT variant;
+            DWORD buffer_used = 0;
+            if (!EvtGetEventMetadataProperty(event_metadata, property_id, 0, sizeof(variant),
+                &variant, &buffer_used)) {
+                return false;
+            }
+            if (variant.Type != EvtVarTypeUInt32) {
+                return false;
+            }
+            value_out = variant.UInt32Val;
+            return true;
+        }
+
+        // The event's <template> XML in UTF-8; empty if it has none
+        std::string getEventTemplate(EVT_HANDLE event_metadata) {
+            DWORD buffer_used = 0;
+            if (EvtGetEventMetadataProperty(event_metadata, EventMetadataEventTemplate, 0, 0, nullptr, &buffer_used)
+                || GetLastError() != ERROR_INSUFFICIENT_BUFFER || buffer_used == 0) {
+                return std::string();
+            }
+            std::vector<BYTE> buffer(buffer_used);
+            auto variant = reinterpret_cast<PEVT_VARIANT>(buffer.data());
+            if (!EvtGetEventMetadataProperty(event_metadata, EventMetadataEventTemplate, 0, buffer_used,
+                variant, &buffer_used) || variant->Type != EvtVarTypeString || variant->StringVal == nullptr) {
+                return std::string();
+            }
+            size_t length = wcslen(variant->StringVal);
+            std::string utf8(Utf8Transcoder::maxUtf8Length(length) + 1, '\0');
+            utf8.resize(Utf8Transcoder::utf16ToUtf8(variant->StringVal, length, utf8.data(), utf8.size()));
+            return utf8;
+        }
+
+        // The 1-based inserts of an event template whose values the message
+        // doesn't show as they are in the event XML
+        std::vector<int> unverbatimInserts(const std::string& template_xml) {
+            std::vector<int> inserts;
+            pugi::xml_document doc;
+            if (template_xml.empty() || !doc.load_buffer(template_xml.data(), template_xml.size())) {
+                return inserts;
+            }
+            int insert = 0;
+            for (auto node : doc.child("template").children()) {
+                if (node.type() != pugi::node_element) {
+                    continue;
+                }
+                ++insert;
+                if (strcmp(node.name(), "data") != 0 || node.attribute("length") || node.attribute("count")) {
+                    // a struct or array; the inserts from here on aren't worth placing
+                    for (; insert <= MessageTemplate::MAX_INSERTS; ++insert) {
+                        inserts.push_back(insert);
+                    }
+                    break;
+                }
+                if (!MessageTemplate::isVerbatimInsert(node.attribute("inType").value(),
+                    node.attribute("outType").value(), static_cast<bool>(node.attribute("map")))) {
+                    inserts.push_back(insert);
+                }
+            }
+            return inserts;
+        }
+
+        std::uint64_t eventKey(DWORD event_id, DWORD version) {
+            return (static_cast<std::uint64_t>(event_id & 0xFFFF) << 32) | version;
+        }
+    }
+
+    std::shared_ptr<const EventMessageTemplateSource::ProviderEvents> EventMessageTemplateSource::providerEvents(
+        const std::string& provider, EVT_HANDLE publisher_metadata) {
+        ULONGLONG now = GetTickCount64();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = providers_.find(provider);
+            if (found != providers_.end() && now - found->second->loaded_at < PROVIDER_EVENTS_TTL_MS) {
+                return found->second;
+            }
+        }
+
+        // read without holding the lock; it walks every event the provider defines
+        auto events = std::make_shared<ProviderEvents>();
+        events->loaded_at = now;
+        EVT_HANDLE enum_handle = EvtOpenEventMetadataEnum(publisher_metadata, 0);
+        if (enum_handle) {
+            EVT_HANDLE event_metadata;
+            while ((event_metadata = EvtNextEventMetadata(enum_handle, 0)) != nullptr) {
+                DWORD event_id, version, message_id;
+                if (getEventMetadataUInt32(event_metadata, EventMetadataEventID, event_id)
+                    && getEventMetadataUInt32(event_metadata, EventMetadataEventVersion, version)
+                    && getEventMetadataUInt32(event_metadata, EventMetadataEventMessageID, message_id)
+                    && message_id != static_cast<DWORD>(-1)) {
+                    auto& event = events->events[eventKey(event_id, version)];
+                    event.message_id = message_id;
+                    event.unverbatim_inserts = unverbatimInserts(getEventTemplate(event_metadata));
+                }
+                EvtClose(event_metadata);
+            }
+            EvtClose(enum_handle);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        providers_[provider] = events;
+        return events;
+    }
+
+    bool EventMessageTemplateSource::loadTemplate(const MessageTemplateKey& key,
+        std::string& utf8_template_out, std::vector<int>& unverbatim_inserts_out) {
+        auto logger = LOG_THIS;
+        wchar_t provider_w[1000];
+        if (MultiByteToWideChar(CP_UTF8, 0, key.provider.c_str(), -1, provider_w,
+            sizeof(provider_w) / sizeof(wchar_t)) == 0) {
+            return false;
+        }
+        auto metadata_handle = Globals::instance()->getPublisherMetadataCache().acquire(provider_w);
+        if (!metadata_handle) {
+            return false;
+        }
+        auto publisher_metadata = static_cast<EVT_HANDLE>(metadata_handle.get());
+
+        DWORD message_id = key.event_id;
+        unverbatim_inserts_out.clear();
+        auto events = providerEvents(key.provider, publisher_metadata);
+        auto found = events->events.find(eventKey(key.event_id, key.version));
+        if (found != events->events.end()) {
+            message_id = found->second.message_id;
+            unverbatim_inserts_out = found->second.unverbatim_inserts;
+        }
+
+        auto template_w = reinterpret_cast<wchar_t*>(Globals::instance()->getMessageBuffer("template_w"));
+        if (!template_w) {
+            return false;
+        }
+        // with no event and no values the inserts are left as %1..%n, which
+        // is reported as ERROR_EVT_UNRESOLVED_VALUE_INSERT but is what we want
+        DWORD buffer_size_needed = 0;
+        BOOL succeeded = EvtFormatMessage(publisher_metadata, nullptr, message_id, 0, nullptr,
+            EvtFormatMessageId, Globals::MESSAGE_BUFFER_SIZE / sizeof(wchar_t) - 1, template_w,
+            &buffer_size_needed);
+        if (!succeeded && GetLastError() != ERROR_EVT_UNRESOLVED_VALUE_INSERT) {
+            logger->debug2("EventMessageTemplateSource::loadTemplate()> no template for %s/%u "
+                "(message id %u), error %d\n", key.provider.c_str(), key.event_id, message_id,
+                GetLastError());
+            Globals::instance()->releaseMessageBuffer(reinterpret_cast<char*>(template_w));
+            return false;
+        }
+        template_w[Globals::MESSAGE_BUFFER_SIZE / sizeof(wchar_t) - 1] = L'\0';
+        size_t template_length = wcslen(template_w);
+        utf8_template_out.resize(Utf8Transcoder::maxUtf8Length(template_length) + 1);
+        size_t utf8_size = Utf8Transcoder::utf16ToUtf8(template_w, template_length,
+            utf8_template_out.data(), utf8_template_out.size());
+        utf8_template_out.resize(utf8_size);
+        Globals::instance()->releaseMessageBuffer(reinterpret_cast<char*>(template_w));
+        return true;
+    }
+}
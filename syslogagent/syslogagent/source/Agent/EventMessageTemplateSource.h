@@ -0,0 +1,52 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <windows.h>
+#include <winevt.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MessageTemplateCache.h"
+
+namespace Syslog_agent {
+
+    // Loads raw message templates from the publisher's message table for
+    // use by MessageTemplateCache.  Manifest-based events are looked up via
+    // the publisher's event metadata (event ID + version -> message ID);
+    // classic events use the qualified event ID as the message ID.
+    //
+    // A provider's event metadata is read once, into a map from event ID
+    // and version to the message ID and the inserts its template declares
+    // with a value map or a type not shown verbatim, and read again after
+    // PROVIDER_EVENTS_TTL_MS.
+    class EventMessageTemplateSource : public IMessageTemplateSource {
+    public:
+        static constexpr ULONGLONG PROVIDER_EVENTS_TTL_MS = MessageTemplateCache::DEFAULT_TTL_MS;
+
+        bool loadTemplate(const MessageTemplateKey& key, std::string& utf8_template_out,
+            std::vector<int>& unverbatim_inserts_out) override;
+
+    private:
+        struct ManifestEvent {
+            DWORD message_id;
+            std::vector<int> unverbatim_inserts;
+        };
+        struct ProviderEvents {
+            std::unordered_map<std::uint64_t, ManifestEvent> events;   // by event ID << 32 | version
+            ULONGLONG loaded_at;
+        };
+
+        std::shared_ptr<const ProviderEvents> providerEvents(const std::string& provider,
+            EVT_HANDLE publisher_metadata);
+
+        std::unordered_map<std::string, std::shared_ptr<const ProviderEvents>> providers_;
+        std::mutex mutex_;
+    };
+}
@@ -0,0 +1,48 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "stdafx.h"
+#include <winevt.h>
+#include "EventPublisherMetadataOpener.h"
+#include "Logger.h"
+
+#pragma comment(lib, "wevtapi.lib")
+
+namespace Syslog_agent {
+
+    IPublisherMetadataOpener::Handle EventPublisherMetadataOpener::open(
+        const wchar_t* publisher_name, std::uint32_t& error_out) {
+        auto logger = LOG_THIS;
+        EVT_HANDLE metadata_handle = EvtOpenPublisherMetadata(nullptr, publisher_name,
+            nullptr, 0, 0);
+        if (!metadata_handle) {
+            error_out = GetLastError();
+            logger->recoverable_error("EventPublisherMetadataOpener::open()> EvtOpenPublisherMetadata "
+                "failed with %u for %ls\n", error_out, publisher_name);
+            return nullptr;
+        }
+        error_out = ERROR_SUCCESS;
+        return static_cast<Handle>(metadata_handle);
+    }
+
+    void EventPublisherMetadataOpener::close(Handle handle) {
+        if (handle != nullptr) {
+            EvtClose(static_cast<EVT_HANDLE>(handle));
+        }
+    }
+
+    bool EventPublisherMetadataOpener::isPublisherMissingError(std::uint32_t error) const {
+        switch (error) {
+        case ERROR_EVT_PUBLISHER_METADATA_NOT_FOUND:
+        case ERROR_EVT_PUBLISHER_DISABLED:
+        case ERROR_FILE_NOT_FOUND:
+        case ERROR_MUI_FILE_NOT_FOUND:
+        case ERROR_RESOURCE_TYPE_NOT_FOUND:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include "PublisherMetadataCache.h"
+
+namespace Syslog_agent {
+
+    // Opens publisher metadata through the Windows event log API for use
+    // by PublisherMetadataCache.
+    class EventPublisherMetadataOpener : public IPublisherMetadataOpener {
+    public:
+        Handle open(const wchar_t* publisher_name, std::uint32_t& error_out) override;
+        void close(Handle handle) override;
+        bool isPublisherMissingError(std::uint32_t error) const override;
+    };
+}
@@ -6,8 +6,6 @@ Copyright c 2021 Logzilla Corp.
 #include "stdafx.h"
 
 #include "FileWatcher.h"
-#include "OStreamBuf.h"
-#include <ostream>
 #include <stdio.h>
 #include <windows.h>
 #include <winnt.h>
@@ -52,11 +50,46 @@ FileWatcher::FileWatcher(
 	read_buffer_.resize(max_line_length + READ_BUF_SIZE);
 	buffer_write_start_ = read_buffer_.data() + max_line_length;
 	num_prebuffer_chars_ = 0;
-	message_buffer_.resize(max_line_length + JSON_HEADERS_SIZE);
+	// escaping can grow a character to six (\u00XX)
+	escaped_line_.resize(static_cast<size_t>(max_line_length) * 6 + 1);
+	buildTemplates();
+	message_buffer_.resize(escaped_line_.size()
+		+ max(http_prefix_.length() + http_suffix_.length(), json_prefix_.length() + json_suffix_.length())
+		+ JSON_HEADERS_SIZE);
 
 	readToLastLine();
 }
 
+void FileWatcher::buildTemplates() {
+	auto escaped = [](const string& text) {
+		vector<char> buffer(text.length() * 6 + 1);
+		size_t length = Util::jsonEscapeString(text.c_str(), buffer.data(), buffer.size());
+		return string(buffer.data(), length);
+	};
+	string program = escaped(program_name_);
+	string host = escaped(host_name_);
+	string severity = to_string(severity_);
+	string facility = to_string(facility_);
+
+	http_prefix_ = "{ \"program\" : \"" + program + "\", "
+		+ "\"host\": \"" + host + "\", "
+		+ "\"severity\": " + severity + ", "
+		+ "\"facility\": " + facility + ", "
+		+ "\"message\": \"";
+	http_suffix_ = string("\", ")
+		+ "\"extra_fields\": { "
+		+ "\"_source_tag\": \"windows_agent\", "
+		+ "\"_log_type\": \"file\", "
+		+ "\"file\": \"" + filename_multibyte_escaped_ + "\" }"
+		+ " }\n";
+
+	json_prefix_ = "{ \"_source_type\": \"WindowsAgent\", \"_log_type\": \"file\", \"program\" : \""
+		+ program + "\", \"host\": \"" + host + "\", \"severity\": " + severity
+		+ ", \"facility\": " + facility + ", \"file\": \"" + filename_multibyte_escaped_
+		+ "\", \"message\": \"";
+	json_suffix_ = "\" }\n";
+}
+
 HANDLE FileWatcher::openLogFile() {
 	auto logger = LOG_THIS;
 	HANDLE file_handle = CreateFileA(
@@ -148,42 +181,25 @@ Result FileWatcher::readToLastLine() {
 
 void FileWatcher::processLine(const char* line_cstr) {
 
-	OStreamBuf<char> ostream_buffer(message_buffer_.data(), message_buffer_.size());
-	std::ostream stream_output(&ostream_buffer);
+	size_t line_length = Util::jsonEscapeString(line_cstr, escaped_line_.data(), escaped_line_.size());
 
 	for (int servernum = 0; servernum < 2; servernum++) {
 
-		// Reset the ostream to be used again
-		stream_output.clear(); // Clear any error flags
-		ostream_buffer.pubsetbuf(message_buffer_.data(), message_buffer_.size()); // Reset buffer
-		ostream_buffer.pubseekpos(0); // Optionally, reset position to the beginning
-
 		int log_format = (servernum == 0 ? config_.getPrimaryLogformat() : config_.getSecondaryLogformat());
+		const string& prefix = (log_format == SharedConstants::LOGFORMAT_HTTPPORT ? http_prefix_ : json_prefix_);
+		const string& suffix = (log_format == SharedConstants::LOGFORMAT_HTTPPORT ? http_suffix_ : json_suffix_);
 
-		if (log_format == SharedConstants::LOGFORMAT_HTTPPORT) {
-
-			stream_output << "{ "
-				<< "\"program\" : \"" << program_name_ << "\", "
-				<< "\"host\": \"" << host_name_ << "\", "
-				<< "\"severity\": " << severity_ << ", "
-				<< "\"facility\": " << facility_ << ", "
-				<< "\"message\": \"" << line_cstr << "\", "
-				<< "\"extra_fields\": { "
-				<< "\"_source_tag\": \"windows_agent\", "
-				<< "\"_log_type\": \"file\", "
-				<< "\"file\": \"" << filename_multibyte_escaped_ << "\" }"
-				<< " }" << '\n' << '\0';
-		}
-		else {
-			stream_output << "{ \"_source_type\": \"WindowsAgent\", \"_log_type\": \"file\", \"program\" : \""
-				<< program_name_ << "\", \"host\": \"" << host_name_ << "\", \"severity\": " << severity_
-				<< ", \"facility\": " << facility_ << ", \"file\": \"" << filename_multibyte_escaped_
-				<< "\", \"message\": \"" << line_cstr << "\" }" << '\n' << '\0';
-		}
+		char* out = message_buffer_.data();
+		memcpy(out, prefix.data(), prefix.length());
+		out += prefix.length();
+		memcpy(out, escaped_line_.data(), line_length);
+		out += line_length;
+		memcpy(out, suffix.data(), suffix.length());
+		out += suffix.length();
 
 		shared_ptr<MessageQueue> msg_queue = (servernum == 0 ? primary_message_queue_ : secondary_message_queue_);
 		msg_queue->enqueue(reinterpret_cast<const char*>(message_buffer_.data()), 
-			static_cast<uint32_t>(strlen(message_buffer_.data())));
+			static_cast<uint32_t>(out - message_buffer_.data()));
 
 		if (!config_.hasSecondaryHost()) {
 			break;
@@ -40,6 +40,13 @@ namespace Syslog_agent {
 		int max_line_length_;
 		vector<char> read_buffer_;
 		vector<char> message_buffer_;
+		vector<char> escaped_line_;
+		// everything but the line itself is the same for every line of the
+		// file, so each log format's JSON is built once around the message
+		string http_prefix_;
+		string http_suffix_;
+		string json_prefix_;
+		string json_suffix_;
 		wstring filename_;
 		char filename_multibyte_[2000];
 		char filename_multibyte_escaped_[2000];
@@ -58,6 +65,7 @@ namespace Syslog_agent {
 		shared_ptr<MessageQueue> secondary_message_queue_;
 
 
+		void buildTemplates();
 		HANDLE openLogFile();
 		Result readToLastLine();
 		void processLine(const char* line_cstr);
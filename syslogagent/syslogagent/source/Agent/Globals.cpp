@@ -4,9 +4,14 @@ Copyright 2021 Logzilla Corp.
 */
 
 #include "stdafx.h"
+#include <cstring>
 #include <memory>
+#include "EventMessageTemplateSource.h"
+#include "EventPublisherMetadataOpener.h"
 #include "Globals.h"
 #include "Logger.h"
+#include "Util.h"
+#include "WindowsSidResolver.h"
 
 using namespace std;
 
@@ -18,6 +23,21 @@ std::once_flag Globals::init_flag_;
 Globals::Globals(int buffer_chunk_size, int percent_slack) {
     message_buffers_ = make_unique<BitmappedObjectPool<char[MESSAGE_BUFFER_SIZE]>>(
         buffer_chunk_size, percent_slack);
+    publisher_metadata_cache_ = make_unique<PublisherMetadataCache>(
+        make_shared<EventPublisherMetadataOpener>());
+    message_template_cache_ = make_unique<MessageTemplateCache>(
+        make_shared<EventMessageTemplateSource>());
+    json_string_table_ = make_unique<JsonStringTable>(
+        [](string_view raw, string& escaped_out) {
+            // table strings are short; escape exactly as Util does for everything else
+            char input[JsonStringTable::MAX_STRING_LENGTH + 1];
+            char output[JsonStringTable::MAX_STRING_LENGTH * 6 + 1];
+            memcpy(input, raw.data(), raw.size());
+            input[raw.size()] = 0;
+            size_t length = Util::jsonEscapeString(input, output, sizeof(output));
+            escaped_out.append(output, length);
+        });
+    sid_resolver_cache_ = make_unique<SidResolverCache>(make_shared<WindowsSidResolver>());
 }
 
 void Globals::Initialize() {
@@ -8,6 +8,10 @@ Copyright © 2021 Logzilla Corp.
 #include <mutex>
 #include <vector>
 #include "BitmappedObjectPool.h"
+#include "JsonStringTable.h"
+#include "MessageTemplateCache.h"
+#include "PublisherMetadataCache.h"
+#include "SidResolverCache.h"
 
 /*
 I realize globals / singletons are denigrated but given that this app
@@ -41,6 +45,15 @@ namespace Syslog_agent {
         void releaseMessageBuffer(char* buffer);
         int getMessageBufferSize() const;
 
+        // Publisher metadata handles shared by all subscriptions
+        PublisherMetadataCache& getPublisherMetadataCache() { return *publisher_metadata_cache_; }
+        // Compiled event message templates, used instead of EvtFormatMessage where possible
+        MessageTemplateCache& getMessageTemplateCache() { return *message_template_cache_; }
+        // Pre-escaped JSON for strings that repeat across events (providers, key names)
+        JsonStringTable& getJsonStringTable() { return *json_string_table_; }
+        // Account names for SIDs, resolved in the background
+        SidResolverCache& getSidResolverCache() { return *sid_resolver_cache_; }
+
         ~Globals() = default;
     private:
         Globals(int buffer_chunk_size, int percent_slack);
@@ -53,5 +66,10 @@ namespace Syslog_agent {
         // Message buffer management
         std::unique_ptr<BitmappedObjectPool<char[MESSAGE_BUFFER_SIZE]>> message_buffers_;
         mutable std::mutex buffer_mutex_;
+
+        std::unique_ptr<PublisherMetadataCache> publisher_metadata_cache_;
+        std::unique_ptr<MessageTemplateCache> message_template_cache_;
+        std::unique_ptr<JsonStringTable> json_string_table_;
+        std::unique_ptr<SidResolverCache> sid_resolver_cache_;
     };
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "HttpNetworkClient.h"
 #include "Logger.h"
 #include "Configuration.h"
+#include "Utf8Transcoder.h"
 
 #include <WinSock2.h>
 #include <Windows.h>
@@ -13,6 +14,7 @@
 #include <locale>
 #include <codecvt>
 #include <mutex>
+#include <algorithm>
 
 using namespace Syslog_agent;
 
@@ -21,18 +23,7 @@ namespace {
     bool ws2s(const wchar_t* wstr, char* buffer, size_t bufferSize) {
         if (!wstr || !buffer || bufferSize == 0) return false;
         
-        int result = WideCharToMultiByte(
-            CP_UTF8,
-            0,
-            wstr,
-            -1,
-            buffer,
-            static_cast<int>(bufferSize),
-            NULL,
-            NULL
-        );
-        
-        return result > 0;
+        return Utf8Transcoder::utf16ToUtf8(wstr, wcslen(wstr), buffer, bufferSize) < bufferSize;
     }
 
     // Convert UTF-8 to wide string using fixed buffer
@@ -136,6 +127,16 @@ bool HttpNetworkClient::initialize(const Configuration* config, const wchar_t* a
     wcsncpy_s(api_key_, api_key_buffer, _countof(api_key_) - 1);
     api_key_[_countof(api_key_) - 1] = L'\0';
 
+    int level = config->getCompressionLevel();
+    if (level > 0) {
+        level = (std::min)(level, GzipCompressor::MAX_LEVEL);
+        compressor_ = std::make_unique<GzipCompressor>(level);
+        logger->info("HttpNetworkClient::initialize()> Request bodies sent gzipped at level %d\n", level);
+    }
+    else {
+        compressor_.reset();
+    }
+
     return true;
 }
 
@@ -196,6 +197,14 @@ HttpNetworkClient::RESULT_TYPE HttpNetworkClient::post(const char* buf, uint32_t
 
     logger->debug2("HttpNetworkClient::post() Starting post operation - Length: %d bytes\n", length);
 
+    const char* body = buf;
+    uint32_t body_length = length;
+    if (compressor_) {
+        body_length = static_cast<uint32_t>(compressor_->compress(buf, length, compressed_));
+        body = compressed_.data();
+        logger->debug2("HttpNetworkClient::post() Compressed to %u bytes\n", body_length);
+    }
+
     DWORD flags = WINHTTP_FLAG_REFRESH;
     if (use_ssl_) {
         flags |= WINHTTP_FLAG_SECURE;
@@ -233,6 +242,10 @@ HttpNetworkClient::RESULT_TYPE HttpNetworkClient::post(const char* buf, uint32_t
         headers += L"Accept-Encoding: gzip, deflate\r\n";
     }
 
+    if (compressor_) {
+        headers += L"Content-Encoding: gzip\r\n";
+    }
+
     if (!WinHttpAddRequestHeaders(hRequest_,
         headers.c_str(),
         -1L,
@@ -249,9 +262,9 @@ HttpNetworkClient::RESULT_TYPE HttpNetworkClient::post(const char* buf, uint32_t
     if (!WinHttpSendRequest(hRequest_,
         WINHTTP_NO_ADDITIONAL_HEADERS,
         0,
-        (LPVOID)buf,
-        length,
-        length,
+        (LPVOID)body,
+        body_length,
+        body_length,
         0))
     {
         DWORD error = GetLastError();
@@ -320,6 +333,14 @@ HttpNetworkClient::RESULT_TYPE HttpNetworkClient::post(const char* buf, uint32_t
 
     cleanup_request();
 
+    // A server that can't take gzipped bodies gets them as they are from
+    // now on, starting with this one
+    if (status_code == HTTP_STATUS_UNSUPPORTED_MEDIA && compressor_) {
+        logger->warning("HttpNetworkClient::post() Server refused gzipped body (http 415), sending uncompressed\n");
+        compressor_.reset();
+        std::vector<char>().swap(compressed_);
+        return post(buf, length);
+    }
 
     // Format the result message with both status and response body
     char msg[1024 + 256];  // Large enough for status line + response
@@ -327,13 +348,13 @@ HttpNetworkClient::RESULT_TYPE HttpNetworkClient::post(const char* buf, uint32_t
         snprintf(msg, sizeof(msg), "Server returned error (http %lu)\n%s", 
             status_code, 
             total_read > 0 ? response_buffer : "No response body");
-        return NetworkResult(ERROR_BAD_ARGUMENTS, msg);
+        return NetworkResult(ERROR_BAD_ARGUMENTS, msg, status_code);
     }
 
     snprintf(msg, sizeof(msg), "Send succeeded (http %lu)\n%s", 
         status_code,
         total_read > 0 ? response_buffer : "No response body");
-    return NetworkResult(ERROR_SUCCESS, msg);
+    return NetworkResult(ERROR_SUCCESS, msg, status_code);
 }
 
 void HttpNetworkClient::cleanup_request() {
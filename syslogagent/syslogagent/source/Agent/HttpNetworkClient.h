@@ -3,7 +3,10 @@
 #include <windows.h>
 #include <winhttp.h>
 #include <chrono>
+#include <memory>
+#include <vector>
 #include "Configuration.h"
+#include "GzipCompressor.h"
 #include "INetworkClient.h"
 #include "SyslogAgentSharedConstants.h"
 #include "Globals.h"
@@ -66,6 +69,10 @@ namespace Syslog_agent {
 
         bool use_ssl_;
         bool use_compression_;
+        // set when request bodies are sent gzipped; compressed_ is kept
+        // from post to post so its memory is reused
+        std::unique_ptr<GzipCompressor> compressor_;
+        std::vector<char> compressed_;
         HINTERNET hSession_;
         HINTERNET hConnection_;
         HINTERNET hRequest_;
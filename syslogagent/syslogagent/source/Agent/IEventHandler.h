@@ -1,12 +1,13 @@
 #pragma once
 
+#include <memory>
+#include <span>
+#include <string>
 #include "Result.h"
+#include "EventLogEvent.h"
 
 namespace Syslog_agent {
 
-    // Forward declarations
-    class EventLogEvent;
-
     // Interface for event handlers
     class IEventHandler {
     public:
@@ -14,6 +15,44 @@ namespace Syslog_agent {
 
         // Handle a Windows event
         virtual Result handleEvent(const wchar_t* subscription_name, EventLogEvent& event) = 0;
+
+        // Handle a group of Windows events from one subscription, in the order
+        // they were logged.  Sources deliver in groups so that whatever a
+        // handler sets up per call is paid once per group; this default hands
+        // them to handleEvent() one at a time.  Returns the first failure, and
+        // every event is handled regardless.
+        virtual Result handleEvents(const wchar_t* subscription_name, std::span<EventLogEvent> events) {
+            Result first_failure;
+            for (auto& event : events) {
+                Result result = handleEvent(subscription_name, event);
+                if (!result.isSuccess() && first_failure.isSuccess()) {
+                    first_failure = result;
+                }
+            }
+            return first_failure;
+        }
+
+        // For a worker pool (see OrderedWorkPool.h): prepareEvent() may run on
+        // any thread, in parallel with the subscription's other events, and
+        // what it returns goes to commitEvent(), which is called in the order
+        // the events were logged, one at a time.  By default nothing is
+        // prepared and commitEvent() handles the whole event.
+        struct Prepared {
+            virtual ~Prepared() = default;
+        };
+        virtual std::unique_ptr<Prepared> prepareEvent(EventLogEvent& event) {
+            return nullptr;
+        }
+        virtual Result commitEvent(const wchar_t* subscription_name, EventLogEvent& event,
+            std::unique_ptr<Prepared> prepared) {
+            return handleEvent(subscription_name, event);
+        }
+
+        // One line on what the handler has done so far, for the service's
+        // periodic statistics; empty if it has nothing to say
+        virtual std::string describeStatistics() const {
+            return std::string();
+        }
     };
 
 } // namespace Syslog_agent
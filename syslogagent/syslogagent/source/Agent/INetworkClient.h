@@ -11,12 +11,14 @@ public:
     static constexpr size_t MAX_MESSAGE_LENGTH = 1024;
 
     // Constructor for success
-    NetworkResult() : code_(ERROR_SUCCESS) {
+    NetworkResult() : code_(ERROR_SUCCESS), http_status_(0) {
         message_[0] = '\0';
     }
 
-    // Constructor for error with code and optional message
-    NetworkResult(DWORD error_code, const char* message = nullptr) : code_(error_code) {
+    // Constructor for error with code and optional message, and the HTTP
+    // status if the server answered
+    NetworkResult(DWORD error_code, const char* message = nullptr, DWORD http_status = 0)
+        : code_(error_code), http_status_(http_status) {
         if (message) {
             strncpy_s(message_, message, MAX_MESSAGE_LENGTH - 1);
         } else {
@@ -33,11 +35,13 @@ public:
 
     // Getters
     DWORD getCode() const { return code_; }
+    DWORD getHttpStatus() const { return http_status_; }
     const char* getMessage() const { return message_; }
     bool hasMessage() const { return message_[0] != '\0'; }
 
 private:
     DWORD code_;
+    DWORD http_status_;
     char message_[MAX_MESSAGE_LENGTH];
 };
 
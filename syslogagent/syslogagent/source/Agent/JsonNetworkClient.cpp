@@ -2,6 +2,7 @@
 #include "Logger.h"
 #include "JsonNetworkClient.h"
 #include "Configuration.h"
+#include "Utf8Transcoder.h"
 
 #include <WinSock2.h>
 #include <Windows.h>
@@ -19,18 +20,7 @@ namespace {
     bool ws2s(const wchar_t* wstr, char* buffer, size_t bufferSize) {
         if (!wstr || !buffer || bufferSize == 0) return false;
         
-        int result = WideCharToMultiByte(
-            CP_UTF8,
-            0,
-            wstr,
-            -1,
-            buffer,
-            static_cast<int>(bufferSize),
-            nullptr,
-            nullptr
-        );
-        
-        return result > 0;
+        return Utf8Transcoder::utf16ToUtf8(wstr, wcslen(wstr), buffer, bufferSize) < bufferSize;
     }
 }
 
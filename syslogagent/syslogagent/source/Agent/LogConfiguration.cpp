@@ -6,11 +6,16 @@ Copyright 2021 Logzilla Corp.
 
 #include "stdafx.h"
 #include "LogConfiguration.h"
+#include "SyslogAgentSharedConstants.h"
 
 using namespace Syslog_agent;
 
 void LogConfiguration::loadFromRegistry(Registry& parent) {
     bookmark_ = Registry::readBookmark(channel_.c_str());
+    skip_message_text_ = Registry::readChannelFlag(channel_.c_str(),
+        SharedConstants::RegistryKey::CHANNEL_SKIP_MESSAGE_TEXT, false);
+    pipeline_stages_ = Registry::readChannelString(channel_.c_str(),
+        SharedConstants::RegistryKey::CHANNEL_PIPELINE_STAGES, L"");
 }
 
 void LogConfiguration::saveToRegistry(Registry& parent) const {
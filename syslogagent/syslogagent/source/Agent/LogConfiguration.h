@@ -17,6 +17,8 @@ namespace Syslog_agent {
         std::wstring name_;
         std::string nname_;
         std::wstring bookmark_;
+        bool skip_message_text_ = false;    // send this channel's events without their message text
+        std::wstring pipeline_stages_;      // this channel's stage order, if not the configured one
         void loadFromRegistry(Registry& parent);
         void saveToRegistry(Registry& parent) const;
     };
@@ -225,6 +225,49 @@ std::wstring Registry::readBookmark(const wchar_t* channel) {
 }
 
 
+bool Registry::readChannelFlag(const wchar_t* channel, const wchar_t* name, bool default_value) {
+    HKEY channel_key;
+    wchar_t tempbuf[4096];
+    swprintf_s(tempbuf, 4096, L"%s\\%s",
+        SharedConstants::RegistryKey::CHANNELS_KEY, channel);
+    if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, tempbuf, 0, KEY_READ, &channel_key) != ERROR_SUCCESS) {
+        // readBookmark() has already complained about the channel
+        return default_value;
+    }
+    DWORD value;
+    DWORD value_size = sizeof value;
+    auto status = RegQueryValueEx(channel_key, name, nullptr, nullptr, (LPBYTE)&value, &value_size);
+    RegCloseKey(channel_key);
+    if (status != ERROR_SUCCESS) {
+        return default_value;
+    }
+    return value != 0;
+}
+
+
+std::wstring Registry::readChannelString(const wchar_t* channel, const wchar_t* name, const wchar_t* default_value) {
+    HKEY channel_key;
+    wchar_t tempbuf[4096];
+    swprintf_s(tempbuf, 4096, L"%s\\%s",
+        SharedConstants::RegistryKey::CHANNELS_KEY, channel);
+    if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, tempbuf, 0, KEY_READ, &channel_key) != ERROR_SUCCESS) {
+        // readBookmark() has already complained about the channel
+        return std::wstring(default_value);
+    }
+    wchar_t value[1024];
+    DWORD value_size = sizeof value - sizeof(wchar_t);
+    DWORD type;
+    auto status = RegQueryValueEx(channel_key, name, nullptr, &type, (LPBYTE)value, &value_size);
+    RegCloseKey(channel_key);
+    if (status != ERROR_SUCCESS || type != REG_SZ) {
+        return std::wstring(default_value);
+    }
+    // not necessarily stored with its terminator
+    value[value_size / sizeof(wchar_t)] = L'\0';
+    return std::wstring(value);
+}
+
+
 void Registry::writeBookmark(const wchar_t* channel, const wchar_t* bookmark_buffer, DWORD buffer_size) {
     auto logger = LOG_THIS;
     HKEY channel_key;
@@ -269,6 +312,50 @@ void Registry::writeBookmark(const wchar_t* channel, const wchar_t* bookmark_buf
 }
 
 
+bool Registry::readSentRecords(const wchar_t* channel, unsigned char* buffer, DWORD& buffer_size) {
+    HKEY channel_key;
+    wchar_t tempbuf[4096];
+    swprintf_s(tempbuf, 4096, L"%s\\%s",
+        SharedConstants::RegistryKey::CHANNELS_KEY, channel);
+    if (RegOpenKeyEx(HKEY_LOCAL_MACHINE, tempbuf, 0, KEY_READ, &channel_key) != ERROR_SUCCESS) {
+        // readBookmark() has already complained about the channel
+        buffer_size = 0;
+        return false;
+    }
+    DWORD type;
+    auto status = RegQueryValueEx(channel_key, SharedConstants::RegistryKey::CHANNEL_SENT_RECORDS,
+        nullptr, &type, buffer, &buffer_size);
+    RegCloseKey(channel_key);
+    if (status != ERROR_SUCCESS || type != REG_BINARY) {
+        buffer_size = 0;
+        return false;
+    }
+    return true;
+}
+
+
+void Registry::writeSentRecords(const wchar_t* channel, const unsigned char* buffer, DWORD buffer_size) {
+    auto logger = LOG_THIS;
+    HKEY channel_key;
+    wchar_t tempbuf[4096];
+    swprintf_s(tempbuf, 4096, L"%s\\%s",
+        SharedConstants::RegistryKey::CHANNELS_KEY, channel);
+    // opens the key, or creates it if the bookmark hasn't been saved yet
+    auto status = RegCreateKeyExW(HKEY_LOCAL_MACHINE, tempbuf, 0, NULL,
+        REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL, &channel_key, NULL);
+    if (status == ERROR_SUCCESS) {
+        status = RegSetValueEx(channel_key, SharedConstants::RegistryKey::CHANNEL_SENT_RECORDS,
+            0, REG_BINARY, buffer, buffer_size);
+        RegCloseKey(channel_key);
+    }
+    if (status != ERROR_SUCCESS) {
+        Util::toPrintableAscii(reinterpret_cast<char*>(tempbuf), sizeof(tempbuf), channel, ' ');
+        logger->recoverable_error("Registry::writeSentRecords()> error %d,"
+            " could not write sent records for channel %s\n", status, reinterpret_cast<char*>(tempbuf));
+    }
+}
+
+
 void Registry::loadSetupFile() {
     auto logger = LOG_THIS;
     HKEY key;
@@ -27,7 +27,12 @@ namespace Syslog_agent {
         void writeTime(const wchar_t* name, time_t value) const;
         std::vector<std::wstring> readChannels() const;
         static std::wstring readBookmark(const wchar_t* channel);
+        static bool readChannelFlag(const wchar_t* channel, const wchar_t* name, bool default_value);
+        static std::wstring readChannelString(const wchar_t* channel, const wchar_t* name, const wchar_t* default_value);
         static void writeBookmark(const wchar_t* channel, const wchar_t* bookmark_buffer, DWORD buffer_size);
+        // SentRecordTracker state; false if there's none
+        static bool readSentRecords(const wchar_t* channel, unsigned char* buffer, DWORD& buffer_size);
+        static void writeSentRecords(const wchar_t* channel, const unsigned char* buffer, DWORD buffer_size);
         static void loadSetupFile();
     private:
         std::wstring readSubkey(HKEY registry_key, DWORD index) const;
@@ -19,11 +19,19 @@ Copyright 2021 Logzilla Corp.
 #include <atomic>
 #include <Windows.h>
 
+#include "AgentStatistics.h"
 #include "Configuration.h"
 #include "EventHandlerMessageQueuer.h"
+#include "EventQueryCompiler.h"
+#include "EventRuleEngine.h"
 #include "EventLogEvent.h"
 #include "EventLogSubscription.h"
+#include "OrderedWorkPool.h"
+#include "FieldProjection.h"
+#include "PiiRedactor.h"
+#include "TemplateMiner.h"
 #include "FileWatcher.h"
+#include "MessageTextPolicy.h"
 #include "Globals.h"
 #include "HttpNetworkClient.h"
 #include "INetworkClient.h"
@@ -63,6 +71,9 @@ volatile bool Service::service_shutdown_requested_ = false;
 WindowsEvent Service::shutdown_event_(L"LogZilla_SyslogAgent_Service_Shutdown");
 shared_ptr<FileWatcher> Service::filewatcher_;
 vector<EventLogSubscription> Service::subscriptions_;
+shared_ptr<EventDeduplicator> Service::event_deduplicator_;
+shared_ptr<OverloadController> Service::overload_controller_;
+shared_ptr<EventAggregator> Service::event_aggregator_;
 static SERVICE_STATUS_HANDLE service_status_handle_ = nullptr;
 HANDLE Service::g_StopEvent = nullptr;
 HANDLE Service::g_ShutdownCompleteEvent = nullptr;
@@ -88,6 +99,69 @@ namespace {
             queue.reset();
         }
     }
+
+    // Reads a configured file and compiles it with `compile`, given the
+    // file's text and somewhere to put Compiled::CompileErrors; each error
+    // is logged and what it was on skipped.  nullptr if no file is
+    // configured or it can't be read.
+    template <typename Compiled, typename Compile>
+    shared_ptr<const Compiled> loadCompiledFile(const char* what, const std::wstring& file, Compile compile) {
+        auto logger = LOG_THIS;
+        if (file.empty()) {
+            return nullptr;
+        }
+        std::ifstream input(file, std::ios::binary);
+        if (!input) {
+            logger->recoverable_error("loadCompiledFile()> could not open %s file %ls\n", what, file.c_str());
+            return nullptr;
+        }
+        std::stringstream contents;
+        contents << input.rdbuf();
+        vector<typename Compiled::CompileError> errors;
+        shared_ptr<const Compiled> compiled = compile(contents.str(), &errors);
+        for (const auto& error : errors) {
+            logger->recoverable_error("loadCompiledFile()> %ls line %d: %s, skipped\n",
+                file.c_str(), error.line, error.message.c_str());
+        }
+        return compiled;
+    }
+
+    // Compiles the configured rules file; bad rules are logged and skipped
+    shared_ptr<const EventRuleEngine> loadEventRules(const std::wstring& rules_file) {
+        auto engine = loadCompiledFile<EventRuleEngine>("rules", rules_file,
+            [](const std::string& text, auto errors) { return EventRuleEngine::compile(text, errors); });
+        if (engine) {
+            auto logger = LOG_THIS;
+            logger->info("loadEventRules()> loaded %zu event rules from %ls\n", engine->ruleCount(), rules_file.c_str());
+        }
+        return engine;
+    }
+
+    // Compiles the configured field projection file; bad lines are logged and skipped
+    shared_ptr<const FieldProjection> loadFieldProjection(const std::wstring& projection_file) {
+        auto projection = loadCompiledFile<FieldProjection>("field projection", projection_file,
+            [](const std::string& text, auto errors) {
+                return FieldProjection::compile(text, Globals::instance()->getJsonStringTable(), errors);
+            });
+        if (projection) {
+            auto logger = LOG_THIS;
+            logger->info("loadFieldProjection()> loaded %zu field projection scopes from %ls\n",
+                projection->scopeCount(), projection_file.c_str());
+        }
+        return projection;
+    }
+
+    // Compiles the configured PII redaction file; bad lines are logged and skipped
+    shared_ptr<const PiiRedactor> loadPiiRedactor(const std::wstring& redaction_file) {
+        auto redactor = loadCompiledFile<PiiRedactor>("redaction", redaction_file,
+            [](const std::string& text, auto errors) { return PiiRedactor::compile(text, errors); });
+        if (redactor) {
+            auto logger = LOG_THIS;
+            logger->info("loadPiiRedactor()> loaded %zu redaction patterns from %ls\n",
+                redactor->patternCount(), redaction_file.c_str());
+        }
+        return redactor;
+    }
 } // end anonymous namespace
 
 void Service::loadConfiguration(bool running_from_console, bool override_log_level, Logger::LogLevel override_log_level_setting) {
@@ -107,7 +181,11 @@ void sendMessagesThread() {
         Service::primary_batcher_,
         Service::secondary_batcher_,
         Service::config_.getMaxBatchCount(),
-        Service::config_.getMaxBatchAge()
+        Service::config_.getMaxBatchAge(),
+        Service::config_.getIncrementalBatching(),
+        Service::config_.getAdaptiveBatching(),
+        Service::config_.getMinBatchCount(),
+        Service::config_.getTargetPostLatency()
     );
 
     try {
@@ -365,6 +443,7 @@ bool Service::initializeNetworkComponents() {
             config_.getMaxBatchAge()
         );
     }
+    primary_batcher_->SetTargetBatchBytes(config_.getBatchTargetBytes());
         
     logger->debug2("Service::run()> initializing primary_network_client\n");
 
@@ -480,6 +559,7 @@ bool Service::initializeSecondaryComponents() {
             config_.getMaxBatchAge()
         );
     }
+    secondary_batcher_->SetTargetBatchBytes(config_.getBatchTargetBytes());
         
     logger->debug2("Service::run()> initializing secondary_network_client\n");
 
@@ -570,6 +650,86 @@ void Service::initializeEventLogSubscriptions(const vector<LogConfiguration>& lo
         
         // Reserve space but don't resize - this avoids default construction
         subscriptions_.reserve(log_count);
+
+        // one compiled rule set shared by every channel's handler
+        auto rule_engine = loadEventRules(config_.getEventRulesFile());
+        // and field projection
+        auto field_projection = loadFieldProjection(config_.getFieldProjectionFile());
+        // and PII redaction
+        auto redactor = loadPiiRedactor(config_.getRedactionFile());
+        // and one template miner, so a template is announced once whichever channel uses it
+        auto template_miner = config_.getTemplateMining() ? make_shared<TemplateMiner>() : nullptr;
+        // message text is skipped per channel, or for these providers on every channel
+        wstring skip_providers_w = config_.getSkipMessageTextProviders();
+        string skip_providers(skip_providers_w.size() * 3 + 1, '\0');
+        skip_providers.resize(Util::wstr2str(skip_providers.data(), skip_providers.size(), skip_providers_w.c_str()));
+        int sample_interval_setting = config_.getMessageTextSampleInterval();
+        uint32_t text_sample_interval = sample_interval_setting > 0 ? static_cast<uint32_t>(sample_interval_setting) : 0;
+        // the handlers' stage order, unless a channel has its own
+        const wstring pipeline_stages = config_.getPipelineStages();
+        // and, if configured, one pool of threads rendering for every channel
+        int render_threads = config_.getRenderThreads();
+        shared_ptr<OrderedWorkPool> render_pool;
+        if (render_threads > 0) {
+            render_pool = make_shared<OrderedWorkPool>(static_cast<size_t>(render_threads));
+            logger->info("Service::initializeEventLogSubscriptions()> rendering events on %d threads\n", render_threads);
+        }
+
+        // and one duplicate-suppression table, so repeats are caught across channels
+        if (config_.getDedupWindowMs() > 0) {
+            event_deduplicator_ = make_shared<EventDeduplicator>(
+                [](const EventDeduplicator::Summary& summary) {
+                    size_t sent = 0;
+                    if (!summary.primary.empty() && primary_message_queue_) {
+                        auto message = EventHandlerMessageQueuer::addRepeatCount(summary.primary, summary.repeat_count);
+                        primary_message_queue_->enqueue(message.c_str(), static_cast<uint32_t>(message.size()));
+                        sent += message.size();
+                    }
+                    if (!summary.secondary.empty() && secondary_message_queue_) {
+                        auto message = EventHandlerMessageQueuer::addRepeatCount(summary.secondary, summary.repeat_count);
+                        secondary_message_queue_->enqueue(message.c_str(), static_cast<uint32_t>(message.size()));
+                        sent += message.size();
+                    }
+                    return sent;
+                },
+                config_.getDedupWindowMs());
+            logger->info("Service::initializeEventLogSubscriptions()> suppressing duplicate events within %d ms\n",
+                config_.getDedupWindowMs());
+        }
+
+        // and one aggregation table, if any rule aggregates
+        if (rule_engine && rule_engine->aggregateRuleCount() > 0) {
+            int window_ms = config_.getAggregateWindowMs() > 0 ? config_.getAggregateWindowMs()
+                : SharedConstants::Defaults::AGGREGATE_WINDOW_MS;
+            event_aggregator_ = make_shared<EventAggregator>(
+                [](const EventAggregator::Summary& summary) {
+                    size_t sent = 0;
+                    if (!summary.primary.empty() && primary_message_queue_) {
+                        auto message = EventHandlerMessageQueuer::addAggregateFields(summary.primary,
+                            summary.count, summary.first_time_us, summary.last_time_us);
+                        primary_message_queue_->enqueue(message.c_str(), static_cast<uint32_t>(message.size()));
+                        sent += message.size();
+                    }
+                    if (!summary.secondary.empty() && secondary_message_queue_) {
+                        auto message = EventHandlerMessageQueuer::addAggregateFields(summary.secondary,
+                            summary.count, summary.first_time_us, summary.last_time_us);
+                        secondary_message_queue_->enqueue(message.c_str(), static_cast<uint32_t>(message.size()));
+                        sent += message.size();
+                    }
+                    return sent;
+                },
+                window_ms);
+            logger->info("Service::initializeEventLogSubscriptions()> %zu aggregate rules, summarizing every %d ms\n",
+                rule_engine->aggregateRuleCount(), window_ms);
+        }
+
+        // and one overload controller, fed the primary queue's depth from mainLoop()
+        if (config_.getOverloadHighWater() > 0) {
+            overload_controller_ = make_shared<OverloadController>(
+                static_cast<size_t>(config_.getOverloadHighWater()));
+            logger->info("Service::initializeEventLogSubscriptions()> sampling low-severity events "
+                "under sustained overload past %d queued messages\n", config_.getOverloadHighWater());
+        }
         
         for (auto& log : logs) {
             // Validate log name before conversion
@@ -594,10 +754,32 @@ void Service::initializeEventLogSubscriptions(const vector<LogConfiguration>& lo
                 bookmark = log.bookmark_;
             }
 
-            const wstring query(L"*");
+            // filter in the subscription itself so unwanted events are never delivered
+            EventQueryFilter query_filter;
+            auto event_id_filter = config_.getEventIdFilter();
+            query_filter.event_ids.insert(event_id_filter.begin(), event_id_filter.end());
+            query_filter.include_event_ids = config_.getIncludeVsIgnoreEventIds();
+            query_filter.max_level = config_.getEventLevelFilter();
+            query_filter.max_age_days = SharedConstants::MAX_CATCHUP_DAYS;
+            const wstring query(EventQueryCompiler::compile(log.channel_, query_filter));
+            logger->debug2("Service::initializeEventLogSubscriptions()> query for %s: %ls\n",
+                log_name_buf, query.c_str());
             const wstring log_name(log.name_);
             const wstring log_channel(log.channel_);
 
+            shared_ptr<MessageTextPolicy> text_policy;
+            if (log.skip_message_text_ || !skip_providers.empty()) {
+                text_policy = make_shared<MessageTextPolicy>(log.skip_message_text_, skip_providers,
+                    text_sample_interval);
+                logger->info("Service::initializeEventLogSubscriptions()> %s: message text skipped for %s, "
+                    "1 in %u rendered anyway\n", log_name_buf,
+                    log.skip_message_text_ ? "every event" : "the listed providers", text_sample_interval);
+            }
+
+            const wstring& stages_w = log.pipeline_stages_.empty() ? pipeline_stages : log.pipeline_stages_;
+            string stage_order(stages_w.size() * 3 + 1, '\0');
+            stage_order.resize(Util::wstr2str(stage_order.data(), stage_order.size(), stages_w.c_str()));
+
             logger->debug("Creating event handler for %s\n", log_name_buf);
             
             // Create a temporary subscription, then move it into place
@@ -612,7 +794,18 @@ void Service::initializeEventLogSubscriptions(const vector<LogConfiguration>& lo
                     config_,
                     primary_message_queue_,
                     secondary_message_queue_,
-                    const_cast<const wchar_t*>(log.name_.c_str())));
+                    const_cast<const wchar_t*>(log.name_.c_str()),
+                    rule_engine,
+                    event_deduplicator_,
+                    overload_controller_,
+                    event_aggregator_,
+                    field_projection,
+                    redactor,
+                    template_miner,
+                    text_policy,
+                    stage_order),
+                render_pool,
+                config_.getRecordTracking());
 
             try {
                 // Subscribe with the appropriate flag based on whether we have a bookmark
@@ -660,6 +853,21 @@ void Service::mainLoop(bool running_as_console, bool& first_loop, int& restart_n
             }
 
             handleQueueStatusAndConfig();
+            if (event_deduplicator_) {
+                event_deduplicator_->flushExpired();
+            }
+            if (event_aggregator_) {
+                event_aggregator_->flushExpired();
+            }
+            if (overload_controller_) {
+                bool was_shedding = overload_controller_->isShedding();
+                overload_controller_->update(primary_message_queue_->length());
+                if (overload_controller_->isShedding() != was_shedding) {
+                    logger->warning("Service::mainLoop()> %s: in %.0f events/s, out %.0f events/s\n",
+                        was_shedding ? "overload over, sampling stopped" : "sustained overload, sampling low-severity events",
+                        overload_controller_->incomingRate(), overload_controller_->outgoingRate());
+                }
+            }
             Sleep(100);  // Small sleep to prevent tight loop
             if (++loop_count % 10 == 0) {
                 // Save bookmarks periodically during normal operation
@@ -669,6 +877,75 @@ void Service::mainLoop(bool running_as_console, bool& first_loop, int& restart_n
             }
             if (loop_count >= 100) {
                 logger->debug("Service::mainLoop()> heartbeat: 100 loops\n");
+                char stats_summary[1024];
+                if (AgentStatistics::instance().formatSummary(stats_summary, sizeof(stats_summary)) > 0) {
+                    logger->debug("Service::mainLoop()> statistics: %s\n", stats_summary);
+                }
+                auto& stats = AgentStatistics::instance();
+                auto string_lookups = stats.get(AgentStatistics::StringTableHits)
+                    + stats.get(AgentStatistics::StringTableMisses) + stats.get(AgentStatistics::StringTableRejected);
+                if (string_lookups > 0) {
+                    logger->debug("Service::mainLoop()> string table: %zu strings, %.1f%% hit rate\n",
+                        Globals::instance()->getJsonStringTable().size(),
+                        100.0 * stats.get(AgentStatistics::StringTableHits) / string_lookups);
+                }
+                auto projected_messages = stats.get(AgentStatistics::ProjectedMessages);
+                if (projected_messages > 0) {
+                    logger->debug("Service::mainLoop()> field projection: %.0f bytes less per message, "
+                        "%llu fields dropped\n",
+                        static_cast<double>(stats.get(AgentStatistics::ProjectionBytesSaved)) / projected_messages,
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::ProjectionFieldsDropped)));
+                }
+                auto redacted_fields = stats.get(AgentStatistics::RedactedFields);
+                if (redacted_fields > 0) {
+                    logger->debug("Service::mainLoop()> redaction: %llu fields masked, %llu sent empty\n",
+                        static_cast<unsigned long long>(redacted_fields),
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::RedactionOverflows)));
+                }
+                auto text_sampled = stats.get(AgentStatistics::MessageTextSampled);
+                if (text_sampled > 0) {
+                    logger->debug("Service::mainLoop()> message text: %llu events skipped, %.0f us per render sampled\n",
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::MessageTextSkipped)),
+                        static_cast<double>(stats.get(AgentStatistics::MessageTextSampleMicroseconds)) / text_sampled);
+                }
+                auto mined_messages = stats.get(AgentStatistics::TemplateMinedMessages);
+                if (mined_messages > 0) {
+                    logger->debug("Service::mainLoop()> template mining: %llu templates, %.0f bytes less per message\n",
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::TemplateCount)),
+                        static_cast<double>(stats.get(AgentStatistics::TemplateBytesSaved)) / mined_messages);
+                }
+                auto work_pool_tasks = stats.get(AgentStatistics::WorkPoolTasks);
+                if (work_pool_tasks > 0) {
+                    logger->debug("Service::mainLoop()> render pool: %llu events, %llu finished out of order\n",
+                        static_cast<unsigned long long>(work_pool_tasks),
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::WorkPoolReordered)));
+                }
+                auto delivered_batches = stats.get(AgentStatistics::DeliveredBatches);
+                if (delivered_batches > 0) {
+                    logger->debug("Service::mainLoop()> delivery: %llu events in %llu groups, %.1f per group\n",
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::DeliveredEvents)),
+                        static_cast<unsigned long long>(delivered_batches),
+                        static_cast<double>(stats.get(AgentStatistics::DeliveredEvents)) / delivered_batches);
+                }
+                auto records_skipped = stats.get(AgentStatistics::RecordsSkipped);
+                if (records_skipped > 0) {
+                    logger->debug("Service::mainLoop()> %llu events skipped, already sent before a restart\n",
+                        static_cast<unsigned long long>(records_skipped));
+                }
+                for (const auto& subscription : subscriptions_) {
+                    auto stages = subscription.describeStatistics();
+                    if (!stages.empty()) {
+                        logger->debug("Service::mainLoop()> %ls stages: %s\n",
+                            subscription.getName().c_str(), stages.c_str());
+                    }
+                }
+                auto aggregate_summaries = stats.get(AgentStatistics::AggregateSummaries);
+                if (aggregate_summaries > 0) {
+                    logger->debug("Service::mainLoop()> aggregation: %llu events in %llu summaries, %llu KB saved\n",
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::AggregateEvents)),
+                        static_cast<unsigned long long>(aggregate_summaries),
+                        static_cast<unsigned long long>(stats.get(AgentStatistics::AggregateBytesSaved) / 1024));
+                }
                 loop_count = 0;
             }
 #if ONLY_FOR_DEBUGGING_CURRENTLY_DISABLED
@@ -772,6 +1049,15 @@ void LogNormalExit() {
 }
 
 
+void Service::waitForQueuesToDrain() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHUTDOWN_DRAIN_MS);
+    auto drained = [](const shared_ptr<MessageQueue>& queue) { return !queue || queue->isEmpty(); };
+    while (!(drained(primary_message_queue_) && drained(secondary_message_queue_))
+        && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+}
+
 void Service::cleanupAndShutdown(bool running_as_console, int restart_needed) {
     auto logger = LOG_THIS;
     if (restart_needed) {
@@ -782,14 +1068,6 @@ void Service::cleanupAndShutdown(bool running_as_console, int restart_needed) {
     }
 
     try {
-        // First signal queues to stop accepting new messages
-        if (primary_message_queue_) {
-            primary_message_queue_->beginShutdown();
-        }
-        if (secondary_message_queue_) {
-            secondary_message_queue_->beginShutdown();
-        }
-
         // Save all bookmarks before closing subscriptions
         logger->debug2("Service::cleanupAndShutdown()> Saving bookmarks for %zu subscriptions\n", subscriptions_.size());
         for (auto& subscription : subscriptions_) {
@@ -801,6 +1079,26 @@ void Service::cleanupAndShutdown(bool running_as_console, int restart_needed) {
             subscription.cancelSubscription();
         }
         subscriptions_.clear();
+        // repeats and counted events are only ever sent in a summary, so
+        // they go out while the sender still reads the queues
+        if (event_deduplicator_) {
+            event_deduplicator_->flushAll();
+            event_deduplicator_.reset();
+        }
+        if (event_aggregator_) {
+            event_aggregator_->flushAll();
+            event_aggregator_.reset();
+        }
+        waitForQueuesToDrain();
+        overload_controller_.reset();
+
+        // Then signal queues to stop accepting new messages
+        if (primary_message_queue_) {
+            primary_message_queue_->beginShutdown();
+        }
+        if (secondary_message_queue_) {
+            secondary_message_queue_->beginShutdown();
+        }
 
         // Clean up file watcher if active
         if (filewatcher_) {
@@ -13,6 +13,9 @@ Copyright 2021 Logzilla Corp.
 #include <vector>
 
 #include "Configuration.h"
+#include "EventDeduplicator.h"
+#include "OverloadController.h"
+#include "EventAggregator.h"
 #include "EventLogSubscription.h"
 #include "FileWatcher.h"
 #include "HTTPMessageBatcher.h"
@@ -41,6 +44,7 @@ public:
     static constexpr int DEFAULT_EVENT_LOG_POLL_INTERVAL = 1;
     static constexpr int RATE_CHECK_INTERVAL_SEC{ 30 };  
     static constexpr double RATE_THRESHOLD_RATIO{ 1.5 };
+    static constexpr int SHUTDOWN_DRAIN_MS = 5000;     // for summaries flushed at shutdown to be sent
 
     // Static member variables, visible for use by sendMessagesThread
     static Configuration config_;
@@ -76,6 +80,7 @@ protected:
     static bool checkForShutdown(bool running_as_console, int& restart_needed);
     static void handleQueueStatusAndConfig();
     static void cleanupAndShutdown(bool running_as_console, int restart_needed);
+    static void waitForQueuesToDrain();
 
 private:
     // Internal state
@@ -86,6 +91,9 @@ private:
     static WindowsEvent shutdown_event_;
     static shared_ptr<FileWatcher> filewatcher_;
     static vector<EventLogSubscription> subscriptions_;
+    static shared_ptr<EventDeduplicator> event_deduplicator_;
+    static shared_ptr<OverloadController> overload_controller_;
+    static shared_ptr<EventAggregator> event_aggregator_;
     static HANDLE g_StopEvent;
     static HANDLE g_ShutdownCompleteEvent;
 
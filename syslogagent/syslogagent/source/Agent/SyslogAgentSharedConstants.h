@@ -69,6 +69,26 @@ namespace Syslog_agent {
             static constexpr int                POLL_INTERVAL_SEC   = 2;
             static constexpr uint32_t           MAX_BATCH_SIZE      = 1000;
             static constexpr uint32_t           MAX_BATCH_AGE        = 1000;
+            static constexpr bool               ADAPTIVE_BATCHING   = false;    // batches always MAX_BATCH_SIZE
+            static constexpr uint32_t           MIN_BATCH_SIZE      = 10;       // smallest adaptive batch
+            static constexpr uint32_t           TARGET_POST_LATENCY = 500;      // ms, adaptive batches shrink past this
+            static constexpr uint32_t           BATCH_TARGET_BYTES  = 0;        // 0 = as large as a batch buffer holds
+            static constexpr int                COMPRESSION_LEVEL   = 0;        // 0 = HTTP bodies sent as is, else gzip 1-9
+            static constexpr int                EVENT_LEVEL_FILTER  = 0;    // 0 = all levels
+            static constexpr const wchar_t*     EVENT_RULES_FILE    = L"";  // no rules
+            static constexpr int                DEDUP_WINDOW_MS     = 0;    // 0 = don't suppress duplicates
+            static constexpr bool               RAW_EVENT_MODE      = false;
+            static constexpr int                OVERLOAD_HIGH_WATER = 0;        // queued messages; 0 = never sample
+            static constexpr int                AGGREGATE_WINDOW_MS = 60000;    // for "aggregate" event rules
+            static constexpr const wchar_t*     FIELD_PROJECTION_FILE = L"";    // send every field
+            static constexpr const wchar_t*     REDACTION_FILE = L"";           // redact nothing
+            static constexpr bool               TEMPLATE_MINING = false;        // send the full message
+            static constexpr const wchar_t*     SKIP_MESSAGE_TEXT_PROVIDERS = L"";  // render every provider's text
+            static constexpr int                MESSAGE_TEXT_SAMPLE_INTERVAL = 100; // 1 in 100 skipped events rendered anyway
+            static constexpr int                RENDER_THREADS = 0;             // render on each channel's own thread
+            static constexpr bool               RECORD_TRACKING = true;         // skip events already sent before a restart
+            static constexpr const wchar_t*     PIPELINE_STAGES = L"";          // every stage, in the default order
+            static constexpr bool               INCREMENTAL_BATCHING = true;    // assemble batches as messages are queued
         };
 
         // Severity levels
@@ -132,6 +152,21 @@ namespace Syslog_agent {
             static constexpr const wchar_t* CONFIG_VERSION              = L"ConfigVersion";
             static constexpr const wchar_t* INCLUDE_VS_IGNORE_EVENT_IDS = L"IncludeVsIgnoreEventIds";
             static constexpr const wchar_t* EVENT_ID_FILTER             = L"EventIDFilterList";
+            static constexpr const wchar_t* EVENT_LEVEL_FILTER          = L"EventLevelFilter";
+            static constexpr const wchar_t* EVENT_RULES_FILE            = L"EventRulesFile";
+            static constexpr const wchar_t* DEDUP_WINDOW_MS             = L"DedupWindowMs";
+            static constexpr const wchar_t* RAW_EVENT_MODE              = L"RawEventMode";
+            static constexpr const wchar_t* OVERLOAD_HIGH_WATER         = L"OverloadQueueHighWater";
+            static constexpr const wchar_t* AGGREGATE_WINDOW_MS         = L"AggregateWindowMs";
+            static constexpr const wchar_t* FIELD_PROJECTION_FILE       = L"FieldProjectionFile";
+            static constexpr const wchar_t* REDACTION_FILE              = L"RedactionFile";
+            static constexpr const wchar_t* TEMPLATE_MINING             = L"TemplateMining";
+            static constexpr const wchar_t* SKIP_MESSAGE_TEXT_PROVIDERS = L"SkipMessageTextProviders";
+            static constexpr const wchar_t* MESSAGE_TEXT_SAMPLE_INTERVAL = L"MessageTextSampleInterval";
+            static constexpr const wchar_t* RENDER_THREADS              = L"RenderThreads";
+            static constexpr const wchar_t* RECORD_TRACKING             = L"RecordTracking";
+            static constexpr const wchar_t* PIPELINE_STAGES             = L"PipelineStages";
+            static constexpr const wchar_t* INCREMENTAL_BATCHING        = L"IncrementalBatching";
             static constexpr const wchar_t* ONLY_WHILE_RUNNING          = L"OnlyWhileRunning";
             static constexpr const wchar_t* EVENT_LOG_POLL_INTERVAL     = L"EventLogPollInterval";
             static constexpr const wchar_t* FORWARD_TO_SECONDARY        = L"ForwardToMirror";
@@ -158,6 +193,9 @@ namespace Syslog_agent {
             static constexpr const wchar_t* TAIL_PROGRAM_NAME           = L"TailProgramName";
             static constexpr const wchar_t* CHANNEL_ENABLED             = L"Enabled";
             static constexpr const wchar_t* CHANNEL_BOOKMARK            = L"Bookmark";
+            static constexpr const wchar_t* CHANNEL_SKIP_MESSAGE_TEXT   = L"SkipMessageText";
+            static constexpr const wchar_t* CHANNEL_SENT_RECORDS        = L"SentRecords";
+            static constexpr const wchar_t* CHANNEL_PIPELINE_STAGES     = L"PipelineStages";
             static constexpr const wchar_t* PRIMARY_TLS_FILENAME        = L"PrimaryTlsFileName";
             static constexpr const wchar_t* SECONDARY_TLS_FILENAME      = L"SecondaryTlsFileName";
             static constexpr const wchar_t* LOGZILLA_REGISTRY_KEY       = L"SOFTWARE\\LogZilla\\SyslogAgent";
@@ -170,6 +208,11 @@ namespace Syslog_agent {
             static constexpr const wchar_t* INITIAL_SETUP_FILE          = L"InitialSetupRegFile";
             static constexpr const wchar_t* MAX_BATCH_SIZE              = L"MaxBatchSize";
             static constexpr const wchar_t* MAX_BATCH_AGE               = L"MaxBatchAge";
+            static constexpr const wchar_t* ADAPTIVE_BATCHING           = L"AdaptiveBatching";
+            static constexpr const wchar_t* MIN_BATCH_SIZE              = L"MinBatchSize";
+            static constexpr const wchar_t* TARGET_POST_LATENCY         = L"TargetPostLatency";
+            static constexpr const wchar_t* BATCH_TARGET_BYTES          = L"BatchTargetBytes";
+            static constexpr const wchar_t* COMPRESSION_LEVEL           = L"CompressionLevel";
         };
     };
 
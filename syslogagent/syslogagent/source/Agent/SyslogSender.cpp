@@ -26,7 +26,11 @@ SyslogSender::SyslogSender(
     std::shared_ptr<MessageBatcher> primary_batcher,
     std::shared_ptr<MessageBatcher> secondary_batcher,
     uint32_t max_batch_count,
-    uint32_t max_batch_age)
+    uint32_t max_batch_age,
+    bool incremental_batching,
+    bool adaptive_batching,
+    uint32_t min_batch_count,
+    uint32_t target_post_latency)
     : stop_requested_(false)
     , max_batch_count_(max_batch_count)
     , max_batch_age_(max_batch_age)
@@ -40,12 +44,40 @@ SyslogSender::SyslogSender(
 {
     auto logger = LOG_THIS;
     logger->debug2("SyslogSender constructor\n");
-    using namespace std::placeholders;
-    std::function<bool(size_t, MessageQueue::Message*, bool)> hook = 
-        std::bind(&SyslogSender::enqueueHook, this, _1, _2, _3);
-    primary_queue_->setEnqueueHook(hook);
+    if (incremental_batching) {
+        if (primary_batcher_) {
+            primary_assembler_ = std::make_unique<BatchAssembler>(primary_batcher_);
+        }
+        if (secondary_queue_ && secondary_batcher_) {
+            secondary_assembler_ = std::make_unique<BatchAssembler>(secondary_batcher_);
+        }
+    }
+    if (adaptive_batching) {
+        if (primary_batcher_) {
+            primary_sizer_ = std::make_unique<BatchSizeController>(min_batch_count, max_batch_count_,
+                MIN_ADAPTIVE_BATCH_BYTES, primary_batcher_->GetTargetBatchBytes(), target_post_latency);
+        }
+        if (secondary_queue_ && secondary_batcher_) {
+            secondary_sizer_ = std::make_unique<BatchSizeController>(min_batch_count, max_batch_count_,
+                MIN_ADAPTIVE_BATCH_BYTES, secondary_batcher_->GetTargetBatchBytes(), target_post_latency);
+        }
+    }
+    auto already_queued = primary_queue_->setEnqueueHook(
+        [this](size_t queue_length, MessageQueue::Message* message, bool is_pre_enqueue) {
+            return enqueueHook(primary_assembler_.get(), primary_sizer_.get(), queue_length, message, is_pre_enqueue);
+        });
+    if (primary_assembler_) {
+        primary_assembler_->begin(already_queued);
+    }
     if (secondary_queue_) {
-        secondary_queue_->setEnqueueHook(hook);
+        already_queued = secondary_queue_->setEnqueueHook(
+            [this](size_t queue_length, MessageQueue::Message* message, bool is_pre_enqueue) {
+                return enqueueHook(secondary_assembler_.get(), secondary_sizer_.get(), queue_length, message,
+                    is_pre_enqueue);
+            });
+        if (secondary_assembler_) {
+            secondary_assembler_->begin(already_queued);
+        }
     }
 }
 
@@ -84,8 +116,8 @@ bool SyslogSender::waitForBatch(MessageQueue* first_queue, MessageQueue* second_
     
     auto size_check = [this, first_queue, second_queue]() { 
         return this->isStopRequested() || 
-               (first_queue && first_queue->length() >= max_batch_count_) || 
-               (second_queue && second_queue->length() >= max_batch_count_); 
+               (first_queue && first_queue->length() >= batchCountFor(primary_sizer_.get())) || 
+               (second_queue && second_queue->length() >= batchCountFor(secondary_sizer_.get())); 
     };
     
     if (size_check()) {
@@ -141,7 +173,12 @@ void SyslogSender::run() const {
             }
 
             // Process primary queue if messages are available
-            if (primary_queue) {
+            if (primary_queue && primary_assembler_) {
+                sendAssembledBatches(primary_queue_, primary_network_client_, primary_batcher_, *primary_assembler_,
+                    primary_sizer_.get());
+                primary_has_messages = (primary_queue->length() > 0);
+            }
+            else if (primary_queue) {
                 logger->debug3("SyslogSender::run()> Attempting to batch primary queue messages\n");
                 size_t initial_queue_size = primary_queue->length();
                 
@@ -152,14 +189,21 @@ void SyslogSender::run() const {
                 }
 
                 for (size_t messages_processed = 0; messages_processed < initial_queue_size;) {
-                    auto batch_result = primary_batcher_->BatchEvents(primary_queue_, batch_buffer, primary_batcher_->GetMaxBatchSizeBytes());
+                    auto batch_result = batchFromQueue(primary_queue_, primary_batcher_, primary_sizer_.get(), batch_buffer, UINT32_MAX);
                     logger->debug3("SyslogSender::run()> Primary batch result status: %d, messages: %d, bytes: %d\n",
                         (int)batch_result.status, batch_result.messages_batched, batch_result.bytes_written);
                     if (batch_result.status == MessageBatcher::BatchResult::Status::Success) {
                         sendMessageBatch(primary_queue_, primary_network_client_, batch_result.messages_batched,
-                            batch_buffer, static_cast<uint32_t>(batch_result.bytes_written));
+                            batch_buffer, static_cast<uint32_t>(batch_result.bytes_written), primary_sizer_.get());
                         messages_processed += batch_result.messages_batched;
                     }
+                    else if (batch_result.status == MessageBatcher::BatchResult::Status::MessageTooLarge) {
+                        if (sendOversizedMessage(primary_queue_, primary_network_client_, primary_batcher_,
+                            primary_sizer_.get()) == 0) {
+                            break;
+                        }
+                        messages_processed++;
+                    }
                     else {
                         break;
                     }
@@ -169,7 +213,12 @@ void SyslogSender::run() const {
             }
 
             // Process secondary queue if messages are available
-            if (secondary_queue) {
+            if (secondary_queue && secondary_assembler_) {
+                sendAssembledBatches(secondary_queue_, secondary_network_client_, secondary_batcher_, *secondary_assembler_,
+                    secondary_sizer_.get());
+                secondary_has_messages = (secondary_queue->length() > 0);
+            }
+            else if (secondary_queue) {
                 logger->debug3("SyslogSender::run()> Attempting to batch secondary queue messages\n");
                 size_t initial_queue_size = secondary_queue->length();
                 
@@ -180,14 +229,21 @@ void SyslogSender::run() const {
                 }
 
                 for (size_t messages_processed = 0; messages_processed < initial_queue_size;) {
-                    auto batch_result = secondary_batcher_->BatchEvents(secondary_queue_, batch_buffer, secondary_batcher_->GetMaxBatchSizeBytes());
+                    auto batch_result = batchFromQueue(secondary_queue_, secondary_batcher_, secondary_sizer_.get(), batch_buffer, UINT32_MAX);
                     logger->debug3("SyslogSender::run()> Secondary batch result status: %d, messages: %d, bytes: %d\n",
                         (int)batch_result.status, batch_result.messages_batched, batch_result.bytes_written);
                     if (batch_result.status == MessageBatcher::BatchResult::Status::Success) {
                         sendMessageBatch(secondary_queue_, secondary_network_client_, batch_result.messages_batched,
-                            batch_buffer, static_cast<uint32_t>(batch_result.bytes_written));
+                            batch_buffer, static_cast<uint32_t>(batch_result.bytes_written), secondary_sizer_.get());
                         messages_processed += batch_result.messages_batched;
                     }
+                    else if (batch_result.status == MessageBatcher::BatchResult::Status::MessageTooLarge) {
+                        if (sendOversizedMessage(secondary_queue_, secondary_network_client_, secondary_batcher_,
+                            secondary_sizer_.get()) == 0) {
+                            break;
+                        }
+                        messages_processed++;
+                    }
                     else {
                         break;
                     }
@@ -215,7 +271,8 @@ int SyslogSender::sendMessageBatch(
     shared_ptr<INetworkClient> network_client,
     uint32_t batch_count,
     char* batch_buf,
-    uint32_t batch_buf_length) const
+    uint32_t batch_buf_length,
+    BatchSizeController* sizer) const
 {
     auto logger = LOG_THIS;
     if (!network_client || !msg_queue || !batch_buf || batch_count == 0) {
@@ -240,7 +297,26 @@ int SyslogSender::sendMessageBatch(
 #endif
 
         // Attempt to send the batch
+        auto post_start = std::chrono::steady_clock::now();
         INetworkClient::RESULT_TYPE result = network_client->post(batch_buf, batch_buf_length);
+        auto post_ms = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - post_start).count());
+
+        // Tells the sizer how the post went, once the queue is as it will be
+        auto adapt = [&]() {
+            if (!sizer) {
+                return;
+            }
+            auto outcome = BatchSizeController::outcomeOf(result == INetworkClient::RESULT_SUCCESS,
+                result.getHttpStatus());
+            auto decision = sizer->onPost(batch_count, batch_buf_length, post_ms, outcome, msg_queue->length());
+            if (decision != BatchSizeController::Decision::None) {
+                logger->info("SyslogSender::sendMessageBatch()> Batches now up to %u messages, %zu bytes: %s "
+                    "(post %u ms, average %.0f ms, queue %zu)\n", sizer->batchCount(), sizer->batchBytes(),
+                    BatchSizeController::decisionName(decision), post_ms, sizer->averageLatencyMs(),
+                    static_cast<size_t>(msg_queue->length()));
+            }
+        };
 
 #if ONLY_FOR_DEBUGGING_CURRENTLY_DISABLED
         EventLogger::logNetworkReceive(result.getMessage(), strlen(result.getMessage()));
@@ -254,6 +330,7 @@ int SyslogSender::sendMessageBatch(
             else {
                 logger->critical("SyslogSender::sendMessageBatch()> Failed to send batch, network error: %d\n", result);
             }
+            adapt();
             return 0;
         }
 
@@ -278,6 +355,7 @@ int SyslogSender::sendMessageBatch(
 
         logger->debug2("SyslogSender::sendMessageBatch()> Successfully sent and removed %u messages\n",
             messages_removed);
+        adapt();
 
         return static_cast<int>(messages_removed);
     }
@@ -292,15 +370,127 @@ int SyslogSender::sendMessageBatch(
     }
 }
 
+void SyslogSender::sendAssembledBatches(
+    shared_ptr<MessageQueue> msg_queue,
+    shared_ptr<INetworkClient> network_client,
+    shared_ptr<MessageBatcher> batcher,
+    BatchAssembler& assembler,
+    BatchSizeController* sizer) const
+{
+    auto logger = LOG_THIS;
 
-bool SyslogSender::enqueueHook(size_t queue_length, MessageQueue::Message* message, bool is_pre_enqueue) const {
+    if (sizer) {
+        assembler.setLimits(sizer->batchCount(), sizer->batchBytes());
+    }
+    // A batch is due, for its count or its age, so whatever is open goes too
+    assembler.seal();
+    const BatchAssembler::Batch* batch;
+    while ((batch = assembler.front()) != nullptr && !this->isStopRequested()) {
+        if (batch->buffer == nullptr) {
+            // a message too large for a batch buffer, next in the queue
+            if (sendOversizedMessage(msg_queue, network_client, batcher, sizer) == 0) {
+                return;
+            }
+            assembler.sent();
+            continue;
+        }
+        logger->debug3("SyslogSender::sendAssembledBatches()> Sending assembled batch of %u messages, %zu bytes\n",
+            batch->messages, batch->length);
+        if (sendMessageBatch(msg_queue, network_client, batch->messages, batch->buffer,
+            static_cast<uint32_t>(batch->length), sizer) == 0) {
+            if (sizer && sizer->lastOutcome() == BatchSizeController::Outcome::TooLarge) {
+                // rebuilt from the queue next time, smaller
+                assembler.disassemble();
+            }
+            // otherwise it stays at the front, to be sent next time
+            return;
+        }
+        assembler.sent();
+        if (sizer) {
+            assembler.setLimits(sizer->batchCount(), sizer->batchBytes());
+        }
+    }
+
+    // the messages that arrived while it was behind are next in the queue
+    uint32_t unassembled = assembler.unassembled();
+    if (unassembled == 0 || this->isStopRequested()) {
+        return;
+    }
+    logger->debug2("SyslogSender::sendAssembledBatches()> Batching %u unassembled messages from the queue\n",
+        unassembled);
+    char* batch_buffer = batcher->GetBatchBuffer("unassembled batch");
+    if (!batch_buffer) {
+        logger->recoverable_error("SyslogSender::sendAssembledBatches()> Failed to get batch buffer\n");
+        return;
+    }
+    while (unassembled > 0 && !this->isStopRequested()) {
+        auto batch_result = batchFromQueue(msg_queue, batcher, sizer, batch_buffer, unassembled);
+        int sent;
+        if (batch_result.status == MessageBatcher::BatchResult::Status::MessageTooLarge) {
+            sent = sendOversizedMessage(msg_queue, network_client, batcher, sizer);
+        }
+        else if (batch_result.status != MessageBatcher::BatchResult::Status::Success || batch_result.messages_batched == 0) {
+            break;
+        }
+        else {
+            sent = sendMessageBatch(msg_queue, network_client, batch_result.messages_batched,
+                batch_buffer, static_cast<uint32_t>(batch_result.bytes_written), sizer);
+        }
+        if (sent == 0) {
+            break;
+        }
+        assembler.sentUnassembled(static_cast<uint32_t>(sent));
+        unassembled = assembler.unassembled();
+    }
+    batcher->ReleaseBatchBuffer(batch_buffer);
+}
+
+MessageBatcher::BatchResult SyslogSender::batchFromQueue(
+    shared_ptr<MessageQueue> msg_queue,
+    shared_ptr<MessageBatcher> batcher,
+    const BatchSizeController* sizer,
+    char* batch_buffer,
+    uint32_t max_messages) const
+{
+    size_t buffer_size = batcher->GetMaxBatchSizeBytes();
+    if (!sizer) {
+        return batcher->BatchEvents(msg_queue, batch_buffer, buffer_size, max_messages);
+    }
+    return batcher->BatchEvents(msg_queue, batch_buffer, buffer_size, (std::min)(sizer->batchCount(), max_messages),
+        sizer->batchBytes());
+}
+
+int SyslogSender::sendOversizedMessage(
+    shared_ptr<MessageQueue> msg_queue,
+    shared_ptr<INetworkClient> network_client,
+    shared_ptr<MessageBatcher> batcher,
+    BatchSizeController* sizer) const
+{
+    auto logger = LOG_THIS;
+    std::vector<char> batch;
+    auto batch_result = batcher->BatchOversizedMessage(msg_queue, batch);
+    if (batch_result.status != MessageBatcher::BatchResult::Status::Success) {
+        return 0;
+    }
+    logger->info("SyslogSender::sendOversizedMessage()> Sending a message too large for a batch buffer on its own, %zu bytes\n",
+        batch_result.bytes_written);
+    return sendMessageBatch(msg_queue, network_client, 1, batch.data(),
+        static_cast<uint32_t>(batch_result.bytes_written), sizer);
+}
+
+
+bool SyslogSender::enqueueHook(BatchAssembler* assembler, const BatchSizeController* sizer, size_t queue_length,
+    MessageQueue::Message* message, bool is_pre_enqueue) const {
     if (is_pre_enqueue) {
         // This is called before enqueue, we can do validation here
         return true;
     }
     else {
-        // This is called after successful enqueue
-        if (queue_length >= max_batch_count_) {
+        // This is called after successful enqueue, under the queue's lock
+        if (assembler && message) {
+            assembler->append(*message);
+        }
+        if (queue_length >= batchCountFor(sizer)) {
             batch_cv_.notify_one();
         }
         return true;
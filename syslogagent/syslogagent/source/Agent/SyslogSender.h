@@ -9,6 +9,8 @@
 #include <Windows.h>
 #include <WinSvc.h>
 
+#include "BatchAssembler.h"
+#include "BatchSizeController.h"
 #include "INetworkClient.h"
 #include "MessageQueue.h"
 #include "MessageBatcher.h"
@@ -20,6 +22,7 @@ class SyslogSender {
 public:
     static constexpr uint32_t MAX_MESSAGE_SIZE = 65536;         // Maximum size of a message batch in bytes
     static constexpr uint32_t SEND_BUFFER_SIZE = 8 * 1024 * 1024; // Size of the send buffer in bytes
+    static constexpr uint32_t MIN_ADAPTIVE_BATCH_BYTES = 16 * 1024; // Smallest batch buffer adaptive batching uses
 
     SyslogSender(
         std::shared_ptr<MessageQueue> primary_queue,
@@ -29,7 +32,11 @@ public:
         std::shared_ptr<MessageBatcher> primary_batcher,
         std::shared_ptr<MessageBatcher> secondary_batcher,
         uint32_t max_batch_size,
-        uint32_t max_batch_age);
+        uint32_t max_batch_age,
+        bool incremental_batching = false,
+        bool adaptive_batching = false,
+        uint32_t min_batch_count = 1,
+        uint32_t target_post_latency = BatchSizeController::DEFAULT_TARGET_LATENCY_MS);
 
     ~SyslogSender() = default;
 
@@ -48,8 +55,10 @@ public:
     
     bool isStopRequested() const { return stop_requested_; }
 
-    // Hook for message queue operations - called before/after message enqueue
-    bool enqueueHook(size_t queue_length, MessageQueue::Message* message, bool is_pre_enqueue) const;
+    // Hook for message queue operations - called before/after message enqueue;
+    // after, the message is added to the queue's batch assembler if it has one
+    bool enqueueHook(BatchAssembler* assembler, const BatchSizeController* sizer, size_t queue_length,
+        MessageQueue::Message* message, bool is_pre_enqueue) const;
 
 protected:
     bool isShuttingDown() const { return stop_requested_; }
@@ -59,7 +68,39 @@ protected:
         std::shared_ptr<INetworkClient> network_client,
         uint32_t batch_count,
         char* batch_buf,
-        uint32_t batch_buf_length) const;
+        uint32_t batch_buf_length,
+        BatchSizeController* sizer = nullptr) const;
+
+    // Sends the batches assembled as the queue's messages arrived, then
+    // batches any the assembler fell behind on from the queue
+    void sendAssembledBatches(
+        std::shared_ptr<MessageQueue> msg_queue,
+        std::shared_ptr<INetworkClient> network_client,
+        std::shared_ptr<MessageBatcher> batcher,
+        BatchAssembler& assembler,
+        BatchSizeController* sizer) const;
+
+    // The next batch from the front of the queue, within the sizer's limits;
+    // a message larger than its byte limit goes on its own, and one too
+    // large for the batch buffer is MessageTooLarge, for sendOversizedMessage()
+    MessageBatcher::BatchResult batchFromQueue(
+        std::shared_ptr<MessageQueue> msg_queue,
+        std::shared_ptr<MessageBatcher> batcher,
+        const BatchSizeController* sizer,
+        char* batch_buffer,
+        uint32_t max_messages) const;
+
+    // Sends the message at the front of the queue, too large for a batch
+    // buffer, as a batch of its own; 1 if it went
+    int sendOversizedMessage(
+        std::shared_ptr<MessageQueue> msg_queue,
+        std::shared_ptr<INetworkClient> network_client,
+        std::shared_ptr<MessageBatcher> batcher,
+        BatchSizeController* sizer) const;
+
+    uint32_t batchCountFor(const BatchSizeController* sizer) const {
+        return sizer ? sizer->batchCount() : max_batch_count_;
+    }
 
     uint64_t next_wait_time_ms(uint64_t longest_wait_time_ms) const;
     bool waitForBatch(MessageQueue* first_queue, MessageQueue* second_queue) const;
@@ -104,6 +145,10 @@ private:
     std::shared_ptr<INetworkClient> secondary_network_client_;
     std::shared_ptr<MessageBatcher> primary_batcher_;
     std::shared_ptr<MessageBatcher> secondary_batcher_;
+    std::unique_ptr<BatchAssembler> primary_assembler_;
+    std::unique_ptr<BatchAssembler> secondary_assembler_;
+    std::unique_ptr<BatchSizeController> primary_sizer_;
+    std::unique_ptr<BatchSizeController> secondary_sizer_;
 
     mutable std::mutex batch_mutex_;
     mutable std::condition_variable batch_cv_;
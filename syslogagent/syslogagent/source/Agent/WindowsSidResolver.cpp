@@ -0,0 +1,66 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "stdafx.h"
+#include <sddl.h>
+#include "WindowsSidResolver.h"
+#include "Logger.h"
+#include "Utf8Transcoder.h"
+
+#pragma comment(lib, "advapi32.lib")
+
+namespace Syslog_agent {
+
+    bool WindowsSidResolver::resolve(const std::string& sid, std::string& account_out,
+        std::uint32_t& error_out) {
+        auto logger = LOG_THIS;
+        PSID binary_sid = nullptr;
+        if (!ConvertStringSidToSidA(sid.c_str(), &binary_sid)) {
+            error_out = GetLastError();
+            return false;
+        }
+
+        wchar_t name[256];
+        DWORD name_length = _countof(name);
+        wchar_t domain[256];
+        DWORD domain_length = _countof(domain);
+        SID_NAME_USE sid_type;
+        BOOL found = LookupAccountSidW(nullptr, binary_sid, name, &name_length, domain,
+            &domain_length, &sid_type);
+        error_out = found ? ERROR_SUCCESS : GetLastError();
+        LocalFree(binary_sid);
+        if (!found) {
+            if (!isUnmappedError(error_out)) {
+                logger->debug("WindowsSidResolver::resolve()> LookupAccountSid failed with %u for %s\n",
+                    error_out, sid.c_str());
+            }
+            return false;
+        }
+
+        wchar_t account[sizeof(domain) / sizeof(wchar_t) + sizeof(name) / sizeof(wchar_t) + 1];
+        if (domain[0] != 0) {
+            swprintf_s(account, L"%ls\\%ls", domain, name);
+        }
+        else {
+            wcscpy_s(account, name);
+        }
+        size_t account_length = wcslen(account);
+        account_out.resize(Utf8Transcoder::maxUtf8Length(account_length) + 1);
+        account_out.resize(Utf8Transcoder::utf16ToUtf8(account, account_length,
+            account_out.data(), account_out.size()));
+        return true;
+    }
+
+    bool WindowsSidResolver::isUnmappedError(std::uint32_t error) const {
+        switch (error) {
+        case ERROR_NONE_MAPPED:
+        case ERROR_INVALID_SID:
+        case ERROR_INVALID_PARAMETER:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
@@ -0,0 +1,18 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include "SidResolverCache.h"
+
+namespace Syslog_agent {
+
+    // Resolves SIDs with LookupAccountSid for use by SidResolverCache.
+    class WindowsSidResolver : public ISidResolver {
+    public:
+        bool resolve(const std::string& sid, std::string& account_out, std::uint32_t& error_out) override;
+        bool isUnmappedError(std::uint32_t error) const override;
+    };
+}
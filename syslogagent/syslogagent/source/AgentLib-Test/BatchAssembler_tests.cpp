@@ -0,0 +1,338 @@
+#include "pch.h"
+#include "../AgentLib/BatchAssembler.h"
+#include "../AgentLib/MessageBatcher.h"
+#include "../AgentLib/MessageQueue.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    // Frames batches like the HTTP batcher; hands out at most `max_buffers`
+    class AssemblerTestBatcher : public MessageBatcher {
+    public:
+        AssemblerTestBatcher(uint32_t max_batch_count, uint32_t batch_bytes, int max_buffers = 100)
+            : MessageBatcher(max_batch_count, 1000), batch_bytes_(batch_bytes), max_buffers_(max_buffers) {
+        }
+
+        char* GetBatchBuffer(const char* debug_identifier = nullptr) const override {
+            if (buffers_out_ >= max_buffers_) {
+                return nullptr;
+            }
+            ++buffers_out_;
+            return new char[batch_bytes_];
+        }
+
+        bool ReleaseBatchBuffer(char* buffer) const override {
+            --buffers_out_;
+            delete[] buffer;
+            return true;
+        }
+
+        uint32_t GetMaxBatchSizeBytes() const override { return batch_bytes_; }
+
+        int buffersOut() const { return buffers_out_; }
+
+    protected:
+        uint32_t GetMaxBatchSizeBytes_() const override { return batch_bytes_; }
+
+        void GetMessageHeader_(char* dest, size_t max_size, size_t& size_out) const override {
+            write("{ \"events\": [ ", dest, max_size, size_out);
+        }
+        void GetMessageSeparator_(char* dest, size_t max_size, size_t& size_out) const override {
+            write(", ", dest, max_size, size_out);
+        }
+        void GetMessageTrailer_(char* dest, size_t max_size, size_t& size_out) const override {
+            write(" ] }", dest, max_size, size_out);
+        }
+
+    private:
+        static void write(const char* text, char* dest, size_t max_size, size_t& size_out) {
+            size_t len = strlen(text);
+            size_out = len < max_size ? len : 0;
+            if (size_out > 0) {
+                memcpy(dest, text, len);
+            }
+        }
+
+        uint32_t batch_bytes_;
+        int max_buffers_;
+        mutable int buffers_out_ = 0;
+    };
+
+    string body(const BatchAssembler::Batch* batch) {
+        return batch == nullptr || batch->buffer == nullptr ? string() : string(batch->buffer, batch->length);
+    }
+
+    // Sets the assembler up on the queue the way SyslogSender does
+    void attach(MessageQueue& queue, BatchAssembler& assembler) {
+        auto existing = queue.setEnqueueHook([&assembler](size_t, MessageQueue::Message* message, bool is_pre_enqueue) {
+            if (!is_pre_enqueue && message != nullptr) {
+                assembler.append(*message);
+            }
+            return true;
+        });
+        assembler.begin(existing);
+    }
+}
+
+TEST(BatchAssemblerTest, SealsAtTheBatchCount) {
+    auto batcher = make_shared<AssemblerTestBatcher>(3, 1024);
+    BatchAssembler assembler(batcher);
+    assembler.begin(0);
+    for (auto message : { "{\"a\":1}", "{\"a\":2}", "{\"a\":3}", "{\"a\":4}" }) {
+        assembler.append(message, strlen(message));
+    }
+    ASSERT_EQ(assembler.readyCount(), 1u);
+    auto batch = assembler.front();
+    EXPECT_EQ(batch->messages, 3u);
+    EXPECT_EQ(body(batch), "{ \"events\": [ {\"a\":1}, {\"a\":2}, {\"a\":3} ] }");
+    EXPECT_EQ(batch->buffer[batch->length], '\0');
+    assembler.sent();
+    EXPECT_EQ(assembler.front(), nullptr);
+
+    // the fourth is open until the sender seals it for its age
+    assembler.seal();
+    EXPECT_EQ(body(assembler.front()), "{ \"events\": [ {\"a\":4} ] }");
+    assembler.sent();
+    assembler.seal();
+    EXPECT_EQ(assembler.front(), nullptr);
+    EXPECT_EQ(assembler.batchesAssembled(), 2u);
+    EXPECT_EQ(assembler.messagesAssembled(), 4u);
+    EXPECT_EQ(batcher->buffersOut(), 0);
+}
+
+TEST(BatchAssemblerTest, SealsWhenTheNextMessageWouldNotFit) {
+    // header 14, separator 2, trailer 4, and a null
+    auto batcher = make_shared<AssemblerTestBatcher>(100, 64);
+    BatchAssembler assembler(batcher);
+    assembler.begin(0);
+    string message(20, 'x');
+    for (int i = 0; i < 3; ++i) {
+        assembler.append(message.data(), message.size());
+    }
+    // 14 + 20 + 2 + 20 + 4 = 60 fits in 64, a third message doesn't
+    ASSERT_EQ(assembler.readyCount(), 1u);
+    EXPECT_EQ(assembler.front()->messages, 2u);
+    EXPECT_EQ(assembler.front()->length, 60u);
+    assembler.sent();
+    assembler.seal();
+    EXPECT_EQ(assembler.front()->messages, 1u);
+}
+
+TEST(BatchAssemblerTest, MessageTooLargeForABatchBufferIsLeftToTheSenderInItsTurn) {
+    auto batcher = make_shared<AssemblerTestBatcher>(100, 64);
+    BatchAssembler assembler(batcher);
+    assembler.begin(0);
+    string big(60, 'b');
+    assembler.append("1", 1);
+    assembler.append(big.data(), big.size());
+    assembler.append("2", 1);
+    assembler.seal();
+
+    ASSERT_EQ(assembler.readyCount(), 3u);
+    EXPECT_EQ(body(assembler.front()), "{ \"events\": [ 1 ] }");
+    assembler.sent();
+    // the sender frames it from the queue itself
+    EXPECT_EQ(assembler.front()->buffer, nullptr);
+    EXPECT_EQ(assembler.front()->messages, 1u);
+    assembler.sent();
+    EXPECT_EQ(body(assembler.front()), "{ \"events\": [ 2 ] }");
+    assembler.sent();
+    EXPECT_EQ(batcher->buffersOut(), 0);
+}
+
+TEST(BatchAssemblerTest, FallsBehindAndCatchesUp) {
+    auto batcher = make_shared<AssemblerTestBatcher>(2, 1024);
+    BatchAssembler assembler(batcher, 2);
+    assembler.begin(0);
+    for (int i = 0; i < 7; ++i) {
+        string message = to_string(i);
+        assembler.append(message.data(), message.size());
+    }
+    // two batches waiting, so 4, 5 and 6 are only counted
+    EXPECT_EQ(assembler.readyCount(), 2u);
+    EXPECT_EQ(assembler.unassembled(), 3u);
+    EXPECT_EQ(batcher->buffersOut(), 2);
+
+    assembler.sent();
+    assembler.append("7", 1);
+    // still behind: 7 goes after 4, 5 and 6
+    EXPECT_EQ(assembler.unassembled(), 4u);
+    assembler.sent();
+    assembler.seal();
+    EXPECT_EQ(assembler.front(), nullptr);
+
+    assembler.sentUnassembled(4);
+    assembler.append("8", 1);
+    assembler.seal();
+    EXPECT_EQ(body(assembler.front()), "{ \"events\": [ 8 ] }");
+    assembler.sent();
+    EXPECT_EQ(assembler.messagesAssembled(), 5u);
+    EXPECT_EQ(assembler.messagesUnassembled(), 4u);
+    EXPECT_EQ(batcher->buffersOut(), 0);
+}
+
+TEST(BatchAssemblerTest, NoBufferMeansBehind) {
+    auto batcher = make_shared<AssemblerTestBatcher>(10, 1024, 0);
+    BatchAssembler assembler(batcher);
+    assembler.begin(0);
+    assembler.append("1", 1);
+    assembler.seal();
+    EXPECT_EQ(assembler.front(), nullptr);
+    EXPECT_EQ(assembler.unassembled(), 1u);
+}
+
+TEST(BatchAssemblerTest, SmallerLimitsSealSooner) {
+    auto batcher = make_shared<AssemblerTestBatcher>(100, 1024);
+    BatchAssembler assembler(batcher);
+    assembler.begin(0);
+    assembler.setLimits(2, 1024);
+    for (auto message : { "1", "2", "3" }) {
+        assembler.append(message, 1);
+    }
+    EXPECT_EQ(body(assembler.front()), "{ \"events\": [ 1, 2 ] }");
+    assembler.sent();
+
+    // the byte limit: a message larger than it goes on its own
+    assembler.setLimits(100, 40);
+    string big(30, 'b');
+    assembler.append(big.data(), big.size());
+    ASSERT_EQ(assembler.readyCount(), 2u);
+    EXPECT_EQ(body(assembler.front()), "{ \"events\": [ 3 ] }");
+    assembler.sent();
+    EXPECT_EQ(body(assembler.front()), "{ \"events\": [ " + big + " ] }");
+    assembler.sent();
+}
+
+TEST(BatchAssemblerTest, SealsAtTheBatchersTargetLikeTheQueuesBatches) {
+    auto queue = make_shared<MessageQueue>(10, 20);
+    auto batcher = make_shared<AssemblerTestBatcher>(100, 1024);
+    // header 14, separator 2, trailer 4: three 10 byte messages make 52
+    batcher->SetTargetBatchBytes(52);
+    BatchAssembler assembler(batcher);
+    attach(*queue, assembler);
+    vector<string> messages(7, string(10, 'm'));
+    messages[4] = string(100, 'L');
+    for (const auto& message : messages) {
+        ASSERT_TRUE(queue->enqueue(message.data(), static_cast<uint32_t>(message.size())));
+    }
+    assembler.seal();
+
+    vector<uint32_t> counts;
+    vector<char> buffer(1024);
+    while (auto batch = assembler.front()) {
+        counts.push_back(batch->messages);
+        EXPECT_LE(batch->length, 52u + (batch->messages == 1 ? 100u : 0u));
+        auto result = batcher->BatchEvents(queue, buffer.data(), buffer.size());
+        ASSERT_EQ(result.messages_batched, batch->messages);
+        EXPECT_EQ(body(batch), string(buffer.data(), result.bytes_written));
+        for (uint32_t i = 0; i < batch->messages; ++i) {
+            queue->removeFront();
+        }
+        assembler.sent();
+    }
+    // the large one on its own
+    EXPECT_EQ(counts, (vector<uint32_t>{ 3, 1, 1, 2 }));
+}
+
+TEST(BatchAssemblerTest, DisassembledBatchesAreUnassembledAgain) {
+    auto batcher = make_shared<AssemblerTestBatcher>(2, 1024);
+    BatchAssembler assembler(batcher);
+    assembler.begin(0);
+    for (auto message : { "1", "2", "3" }) {
+        assembler.append(message, 1);
+    }
+    assembler.disassemble();
+    EXPECT_EQ(assembler.front(), nullptr);
+    EXPECT_EQ(assembler.unassembled(), 3u);
+    EXPECT_EQ(batcher->buffersOut(), 0);
+    assembler.append("4", 1);
+    EXPECT_EQ(assembler.unassembled(), 4u);
+}
+
+TEST(BatchAssemblerTest, MatchesTheBatchBuiltFromTheQueue) {
+    auto queue = make_shared<MessageQueue>(10, 20);
+    queue->enqueue("early", 5);
+    auto batcher = make_shared<AssemblerTestBatcher>(4, 16384);
+    BatchAssembler assembler(batcher);
+    attach(*queue, assembler);
+    // queued before the hook was set, so batched from the queue
+    EXPECT_EQ(assembler.unassembled(), 1u);
+    vector<char> buffer(16384);
+    auto result = batcher->BatchEvents(queue, buffer.data(), buffer.size(), assembler.unassembled());
+    ASSERT_EQ(result.messages_batched, 1u);
+    queue->removeFront();
+    assembler.sentUnassembled(result.messages_batched);
+
+    // spans several of the queue's buffers
+    string long_message(3 * MessageQueue::MESSAGE_BUFFER_SIZE + 100, ' ');
+    for (size_t i = 0; i < long_message.size(); ++i) {
+        long_message[i] = static_cast<char>('a' + i % 26);
+    }
+    vector<string> messages = { "{\"n\":1}", long_message, "{\"n\":3}", "{\"n\":4}", "{\"n\":5}" };
+    for (const auto& message : messages) {
+        ASSERT_TRUE(queue->enqueue(message.data(), static_cast<uint32_t>(message.size())));
+    }
+    assembler.seal();
+
+    while (auto batch = assembler.front()) {
+        result = batcher->BatchEvents(queue, buffer.data(), buffer.size());
+        ASSERT_EQ(result.messages_batched, batch->messages);
+        EXPECT_EQ(body(batch), string(buffer.data(), result.bytes_written));
+        for (uint32_t i = 0; i < batch->messages; ++i) {
+            queue->removeFront();
+        }
+        assembler.sent();
+    }
+    EXPECT_EQ(queue->length(), 0u);
+    EXPECT_EQ(assembler.messagesAssembled(), messages.size());
+}
+
+// Not a pass/fail test: the time from a batch being due to it being ready
+// to send, building it from the queue then versus sealing the open one
+TEST(BatchAssemblerBenchmark, TimeToReadyBatch) {
+    const int BATCHES = 200;
+    const uint32_t COUNT = 1000;
+    string message(300, 'e');
+    auto batcher = make_shared<AssemblerTestBatcher>(COUNT, 512 * 1024);
+    vector<char> buffer(512 * 1024);
+
+    auto queue = make_shared<MessageQueue>(COUNT, COUNT);
+    for (uint32_t i = 0; i < COUNT; ++i) {
+        queue->enqueue(message.data(), static_cast<uint32_t>(message.size()));
+    }
+    auto start = chrono::steady_clock::now();
+    size_t bytes = 0;
+    for (int i = 0; i < BATCHES; ++i) {
+        bytes += batcher->BatchEvents(queue, buffer.data(), buffer.size()).bytes_written;
+    }
+    auto rebuild_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    BatchAssembler assembler(batcher);
+    assembler.begin(0);
+    long long append_us = 0;
+    long long seal_us = 0;
+    for (int i = 0; i < BATCHES; ++i) {
+        start = chrono::steady_clock::now();
+        for (uint32_t m = 0; m + 1 < COUNT; ++m) {
+            assembler.append(message.data(), message.size());
+        }
+        auto appended = chrono::steady_clock::now();
+        assembler.seal();
+        EXPECT_EQ(assembler.front()->messages, COUNT - 1);
+        seal_us += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - appended).count();
+        append_us += chrono::duration_cast<chrono::microseconds>(appended - start).count();
+        assembler.sent();
+    }
+    EXPECT_GT(bytes, 0u);
+    cout << "[ BENCH    ] " << COUNT << " messages: built when due " << (rebuild_us / BATCHES)
+        << " us, sealed when due " << (seal_us / BATCHES) << " us (appending beforehand "
+        << (append_us / BATCHES) << " us)" << endl;
+}
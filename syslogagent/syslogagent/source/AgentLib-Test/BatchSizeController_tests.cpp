@@ -0,0 +1,124 @@
+#include "pch.h"
+#include "../AgentLib/BatchSizeController.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <cstdint>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    using Outcome = BatchSizeController::Outcome;
+    using Decision = BatchSizeController::Decision;
+
+    const size_t KB = 1024;
+
+    // Posts `times` batches that fill the current count, at `latency_ms`,
+    // leaving `queue_length` behind; returns the last decision
+    Decision post(BatchSizeController& controller, int times, size_t queue_length, uint32_t latency_ms = 50,
+        size_t bytes = 1 * KB) {
+        Decision decision = Decision::None;
+        for (int i = 0; i < times; ++i) {
+            decision = controller.onPost(controller.batchCount(), bytes, latency_ms, Outcome::Sent, queue_length);
+        }
+        return decision;
+    }
+}
+
+TEST(BatchSizeControllerTest, StartsAtTheMaximum) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB);
+    EXPECT_EQ(controller.batchCount(), 1000u);
+    EXPECT_EQ(controller.batchBytes(), 512 * KB);
+}
+
+TEST(BatchSizeControllerTest, TrickleShrinksTheCountToTheMinimum) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB);
+    // nothing left after each post; one change per SETTLE_POSTS posts
+    EXPECT_EQ(post(controller, BatchSizeController::SETTLE_POSTS - 1, 0), Decision::None);
+    EXPECT_EQ(post(controller, 1, 0), Decision::ShrinkForTrickle);
+    EXPECT_EQ(controller.batchCount(), 750u);
+    post(controller, 200, 0);
+    EXPECT_EQ(controller.batchCount(), 10u);
+    EXPECT_EQ(controller.batchBytes(), 512 * KB);
+    EXPECT_EQ(post(controller, BatchSizeController::SETTLE_POSTS, 0), Decision::None);
+}
+
+TEST(BatchSizeControllerTest, BacklogGrowsItBackWithinTheBounds) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB, 500, 1);
+    post(controller, 100, 0);
+    ASSERT_EQ(controller.batchCount(), 10u);
+    // more than a batch waiting, and not going down
+    EXPECT_EQ(post(controller, 1, 50), Decision::GrowForBacklog);
+    EXPECT_EQ(controller.batchCount(), 16u);
+    post(controller, 100, 5000);
+    EXPECT_EQ(controller.batchCount(), 1000u);
+    EXPECT_EQ(post(controller, 1, 5000), Decision::None);
+
+    // draining: left as it is
+    BatchSizeController draining(10, 1000, 16 * KB, 512 * KB, 500, 1);
+    post(draining, 100, 0);
+    post(draining, 1, 500);
+    auto count = draining.batchCount();
+    EXPECT_EQ(post(draining, 1, 400), Decision::None);
+    EXPECT_EQ(draining.batchCount(), count);
+}
+
+TEST(BatchSizeControllerTest, BytesGrowOnlyWhenTheyLimitedTheBatch) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB, 500, 1);
+    controller.onPost(1000, 512 * KB, 50, Outcome::TooLarge, 0);
+    ASSERT_EQ(controller.batchBytes(), 256 * KB);
+    post(controller, 1, 5000, 50, 10 * KB);
+    EXPECT_EQ(controller.batchBytes(), 256 * KB);
+    post(controller, 1, 5000, 50, 250 * KB);
+    EXPECT_EQ(controller.batchBytes(), 384 * KB);
+}
+
+TEST(BatchSizeControllerTest, SlowPostsShrinkBoth) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB, 500, 1);
+    EXPECT_EQ(post(controller, 1, 5, 2000), Decision::ShrinkForLatency);
+    EXPECT_EQ(controller.batchCount(), 750u);
+    EXPECT_EQ(controller.batchBytes(), 384 * KB);
+    EXPECT_GT(controller.averageLatencyMs(), 500.0);
+    post(controller, 100, 5, 2000);
+    EXPECT_EQ(controller.batchCount(), 10u);
+    EXPECT_EQ(controller.batchBytes(), 16 * KB);
+}
+
+TEST(BatchSizeControllerTest, TooLargeHalvesTheRefusedBatchAtOnce) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB);
+    auto too_large = AgentStatistics::instance().get(AgentStatistics::BatchesTooLarge);
+    EXPECT_EQ(controller.onPost(400, 300 * KB, 50, Outcome::TooLarge, 0), Decision::ShrinkForTooLarge);
+    EXPECT_EQ(controller.batchCount(), 200u);
+    EXPECT_EQ(controller.batchBytes(), 150 * KB);
+    EXPECT_EQ(controller.lastOutcome(), Outcome::TooLarge);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::BatchesTooLarge), too_large + 1);
+}
+
+TEST(BatchSizeControllerTest, ThrottlingMeansFewerLargerPosts) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB);
+    controller.onPost(1000, 512 * KB, 50, Outcome::TooLarge, 0);
+    auto growths = AgentStatistics::instance().get(AgentStatistics::BatchGrowths);
+    EXPECT_EQ(controller.onPost(500, 10 * KB, 50, Outcome::Throttled, 0), Decision::GrowForThrottling);
+    EXPECT_EQ(controller.batchCount(), 1000u);
+    EXPECT_EQ(controller.batchBytes(), 512 * KB);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::BatchGrowths), growths + 1);
+    EXPECT_EQ(controller.onPost(500, 10 * KB, 50, Outcome::Throttled, 0), Decision::None);
+}
+
+TEST(BatchSizeControllerTest, OtherFailuresChangeNothing) {
+    BatchSizeController controller(10, 1000, 16 * KB, 512 * KB, 500, 1);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(controller.onPost(1000, 512 * KB, 30000, Outcome::Failed, 0), Decision::None);
+    }
+    EXPECT_EQ(controller.batchCount(), 1000u);
+    EXPECT_EQ(controller.averageLatencyMs(), 0.0);
+}
+
+TEST(BatchSizeControllerTest, OutcomeFromTheServersAnswer) {
+    EXPECT_EQ(BatchSizeController::outcomeOf(true, 200), Outcome::Sent);
+    EXPECT_EQ(BatchSizeController::outcomeOf(false, 413), Outcome::TooLarge);
+    EXPECT_EQ(BatchSizeController::outcomeOf(false, 429), Outcome::Throttled);
+    EXPECT_EQ(BatchSizeController::outcomeOf(false, 503), Outcome::Throttled);
+    EXPECT_EQ(BatchSizeController::outcomeOf(false, 500), Outcome::Failed);
+    EXPECT_EQ(BatchSizeController::outcomeOf(false, 0), Outcome::Failed);
+}
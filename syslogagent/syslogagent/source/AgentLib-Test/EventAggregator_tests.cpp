@@ -0,0 +1,195 @@
+#include "pch.h"
+#include "../AgentLib/EventAggregator.h"
+#include "../AgentLib/FastHash.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    struct Harness {
+        int64_t time_ms = 0;
+        vector<EventAggregator::Summary> emitted;
+        unique_ptr<EventAggregator> aggregator;
+
+        explicit Harness(int64_t window_ms = 1000, size_t max_groups = 16, size_t max_bytes = 1024 * 1024) {
+            aggregator = make_unique<EventAggregator>(
+                [this](const EventAggregator::Summary& summary) {
+                    emitted.push_back(summary);
+                    // about what the count and times add to a message
+                    return summary.primary.size() + summary.secondary.size() + 60;
+                },
+                window_ms, max_groups, max_bytes, [this]() { return time_ms; });
+        }
+
+        bool add(uint64_t key, int64_t event_time_us, const string& message = "message") {
+            if (!aggregator->add(key, event_time_us)) {
+                return false;
+            }
+            aggregator->setSample(key, message, string());
+            return true;
+        }
+    };
+}
+
+class EventAggregatorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AgentStatistics::instance().reset();
+    }
+};
+
+TEST_F(EventAggregatorTest, OneSummaryPerGroupPerWindow) {
+    Harness h;
+    EXPECT_TRUE(h.add(1, 5000000, "first"));
+    EXPECT_FALSE(h.add(1, 5000300, "second"));
+    EXPECT_FALSE(h.add(1, 4999900, "third"));
+    EXPECT_TRUE(h.add(2, 5000100));
+    // nothing is sent until the window closes
+    EXPECT_TRUE(h.emitted.empty());
+
+    h.time_ms = 1000;
+    h.aggregator->flushExpired();
+    ASSERT_EQ(h.emitted.size(), 2u);
+    EXPECT_EQ(h.emitted[0].key, 1u);
+    EXPECT_EQ(h.emitted[0].count, 3u);
+    EXPECT_EQ(h.emitted[0].first_time_us, 4999900);
+    EXPECT_EQ(h.emitted[0].last_time_us, 5000300);
+    EXPECT_EQ(h.emitted[0].primary, "first");
+    EXPECT_EQ(h.emitted[1].key, 2u);
+    EXPECT_EQ(h.emitted[1].count, 1u);
+    EXPECT_EQ(h.aggregator->size(), 0u);
+    EXPECT_EQ(h.aggregator->bytes(), 0u);
+}
+
+TEST_F(EventAggregatorTest, NewGroupAfterTheWindow) {
+    Harness h;
+    EXPECT_TRUE(h.add(1, 0));
+    EXPECT_FALSE(h.add(1, 0));
+    h.time_ms = 1000;
+    // closed lazily by the next add
+    EXPECT_TRUE(h.add(1, 0));
+    ASSERT_EQ(h.emitted.size(), 1u);
+    EXPECT_EQ(h.emitted[0].count, 2u);
+    h.aggregator->flushAll();
+    ASSERT_EQ(h.emitted.size(), 2u);
+    EXPECT_EQ(h.emitted[1].count, 1u);
+}
+
+TEST_F(EventAggregatorTest, SpillsTheOldestGroupWhenFull) {
+    Harness h(1000, 4);
+    for (uint64_t key = 0; key < 4; ++key) {
+        h.add(key, 0);
+        h.add(key, 0);
+    }
+    EXPECT_TRUE(h.emitted.empty());
+    h.add(4, 0);
+    EXPECT_EQ(h.aggregator->size(), 4u);
+    ASSERT_EQ(h.emitted.size(), 1u);
+    EXPECT_EQ(h.emitted[0].key, 0u);
+    EXPECT_EQ(h.emitted[0].count, 2u);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::AggregateSpills), 1u);
+}
+
+TEST_F(EventAggregatorTest, ByteLimitIsRespected) {
+    Harness h(1000, 1000, 1000);
+    string sample(50, 'x');
+    for (uint64_t key = 0; key < 100; ++key) {
+        h.add(key, 0, sample);
+        EXPECT_LE(h.aggregator->bytes(), 1000u);
+    }
+    EXPECT_EQ(h.aggregator->size(), 20u);
+    EXPECT_EQ(h.emitted.size(), 80u);
+}
+
+TEST_F(EventAggregatorTest, GroupClosedBeforeItsSampleIsStillSent) {
+    Harness h(1000, 1);
+    // another thread's event spills the group between add and setSample
+    EXPECT_TRUE(h.aggregator->add(1, 10));
+    EXPECT_FALSE(h.aggregator->add(1, 20));
+    EXPECT_TRUE(h.add(2, 30));
+    EXPECT_TRUE(h.emitted.empty());
+    h.aggregator->setSample(1, "late", string());
+    ASSERT_EQ(h.emitted.size(), 1u);
+    EXPECT_EQ(h.emitted[0].key, 1u);
+    EXPECT_EQ(h.emitted[0].count, 2u);
+    EXPECT_EQ(h.emitted[0].last_time_us, 20);
+    EXPECT_EQ(h.emitted[0].primary, "late");
+}
+
+TEST_F(EventAggregatorTest, CountsEventsAndBytesSaved) {
+    Harness h;
+    string sample(100, 'x');
+    for (int i = 0; i < 10; ++i) {
+        h.add(7, i, sample);
+    }
+    h.aggregator->flushAll();
+    auto& stats = AgentStatistics::instance();
+    EXPECT_EQ(stats.get(AgentStatistics::AggregateEvents), 10u);
+    EXPECT_EQ(stats.get(AgentStatistics::AggregateSummaries), 1u);
+    EXPECT_EQ(stats.get(AgentStatistics::AggregateBytesSaved), 10u * 100u - 160u);
+}
+
+// Not a pass/fail test: bandwidth for an hour of simulated logon traffic
+// (4624 for 200 users from 50 addresses) grouped by user and address, with
+// and without aggregation.
+TEST(EventAggregatorBenchmark, BandwidthReduction) {
+    AgentStatistics::instance().reset();
+    const int USERS = 200;
+    const int ADDRESSES = 50;
+    const int EVENTS_PER_SECOND = 200;
+    const int SECONDS = 60 * 60;
+    const string sample(900, 'x');     // a typical 4624 in JSON
+
+    int64_t now = 0;
+    size_t sent_bytes = 0;
+    size_t summaries = 0;
+    EventAggregator aggregator(
+        [&](const EventAggregator::Summary& summary) {
+            ++summaries;
+            // the sample plus "aggregate_count", "first_ts" and "last_ts"
+            size_t bytes = summary.primary.size() + 70;
+            sent_bytes += bytes;
+            return bytes;
+        },
+        EventAggregator::DEFAULT_WINDOW_MS, EventAggregator::DEFAULT_MAX_GROUPS,
+        EventAggregator::DEFAULT_MAX_BYTES, [&now]() { return now; });
+
+    uint64_t state = 12345;
+    size_t events = 0;
+    size_t max_groups = 0;
+    auto start = chrono::steady_clock::now();
+    for (int second = 0; second < SECONDS; ++second) {
+        now = second * 1000LL;
+        for (int i = 0; i < EVENTS_PER_SECOND; ++i) {
+            // users mostly log on from their own few machines
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            int user = static_cast<int>((state >> 33) % USERS);
+            int address = (user + static_cast<int>((state >> 20) % 3)) % ADDRESSES;
+            auto key = FastHasher().add(uint64_t(4624)).add(uint64_t(user)).add(uint64_t(address)).digest();
+            if (aggregator.add(key, now * 1000)) {
+                aggregator.setSample(key, sample, string());
+            }
+            ++events;
+        }
+        aggregator.flushExpired();
+        max_groups = max(max_groups, aggregator.size());
+    }
+    aggregator.flushAll();
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    size_t unaggregated_bytes = events * sample.size();
+    cout << "[ BENCH    ] " << events << " events in " << elapsed << "us, " << summaries
+        << " summaries, at most " << max_groups << " groups open" << endl;
+    cout << "[ BENCH    ] " << unaggregated_bytes / 1024 << "KB unaggregated, " << sent_bytes / 1024
+        << "KB aggregated (" << 100.0 * (1.0 - static_cast<double>(sent_bytes) / unaggregated_bytes)
+        << "% less), bytes saved stat " << AgentStatistics::instance().get(AgentStatistics::AggregateBytesSaved) / 1024
+        << "KB" << endl;
+    EXPECT_LT(sent_bytes, unaggregated_bytes / 10);
+}
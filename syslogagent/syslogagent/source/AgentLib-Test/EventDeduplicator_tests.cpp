@@ -0,0 +1,173 @@
+#include "pch.h"
+#include "../AgentLib/EventDeduplicator.h"
+#include "../AgentLib/FastHash.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    struct Harness {
+        int64_t time_ms = 0;
+        vector<EventDeduplicator::Summary> emitted;
+        unique_ptr<EventDeduplicator> dedup;
+
+        explicit Harness(int64_t window_ms = 1000, size_t max_entries = 16, size_t max_bytes = 1024 * 1024) {
+            dedup = make_unique<EventDeduplicator>(
+                [this](const EventDeduplicator::Summary& summary) {
+                    emitted.push_back(summary);
+                    return summary.primary.size() + summary.secondary.size();
+                },
+                window_ms, max_entries, max_bytes, [this]() { return time_ms; });
+        }
+
+        bool send(uint64_t key, const string& message = "message") {
+            if (!dedup->admit(key)) {
+                return false;
+            }
+            dedup->remember(key, message, string());
+            return true;
+        }
+    };
+}
+
+TEST(FastHashTest, FieldBoundariesMatter) {
+    auto a = FastHasher().add(string_view("ab")).add(string_view("c")).digest();
+    auto b = FastHasher().add(string_view("a")).add(string_view("bc")).digest();
+    EXPECT_NE(a, b);
+    EXPECT_EQ(fastHash("Security"), fastHash(string("Security")));
+    EXPECT_NE(fastHash("Security"), fastHash("security"));
+    EXPECT_NE(fastHash(""), fastHash(string_view("\0", 1)));
+}
+
+TEST(EventDeduplicatorTest, FirstEventPassesRepeatsAreCounted) {
+    Harness h;
+    EXPECT_TRUE(h.send(1));
+    EXPECT_FALSE(h.send(1));
+    EXPECT_FALSE(h.send(1));
+    EXPECT_TRUE(h.send(2));
+    EXPECT_TRUE(h.emitted.empty());
+
+    h.time_ms = 1000;
+    h.dedup->flushExpired();
+    ASSERT_EQ(h.emitted.size(), 1u);
+    EXPECT_EQ(h.emitted[0].key, 1u);
+    EXPECT_EQ(h.emitted[0].repeat_count, 2u);
+    EXPECT_EQ(h.emitted[0].primary, "message");
+    EXPECT_EQ(h.dedup->size(), 0u);
+    EXPECT_EQ(h.dedup->bytes(), 0u);
+}
+
+TEST(EventDeduplicatorTest, NewWindowAfterClose) {
+    Harness h;
+    EXPECT_TRUE(h.send(1));
+    h.time_ms = 999;
+    EXPECT_FALSE(h.send(1));
+    h.time_ms = 1000;
+    // closing happens lazily on admit too
+    EXPECT_TRUE(h.send(1));
+    ASSERT_EQ(h.emitted.size(), 1u);
+    EXPECT_EQ(h.emitted[0].repeat_count, 1u);
+}
+
+TEST(EventDeduplicatorTest, FlushAllEmitsOpenWindowsWithRepeats) {
+    // as at shutdown: windows still open are closed and their repeats sent
+    Harness h;
+    h.send(1, "one");
+    h.send(1);
+    h.send(1);
+    h.send(2, "two");
+    h.send(3, "three");
+    h.send(3);
+    h.time_ms = 10;
+    h.dedup->flushAll();
+    ASSERT_EQ(h.emitted.size(), 2u);
+    EXPECT_EQ(h.emitted[0].key, 1u);
+    EXPECT_EQ(h.emitted[0].repeat_count, 2u);
+    EXPECT_EQ(h.emitted[0].primary, "one");
+    EXPECT_EQ(h.emitted[1].key, 3u);
+    EXPECT_EQ(h.emitted[1].repeat_count, 1u);
+    EXPECT_EQ(h.dedup->size(), 0u);
+    EXPECT_EQ(h.dedup->bytes(), 0u);
+}
+
+TEST(EventDeduplicatorTest, EntryLimitClosesOldestEarly) {
+    Harness h(1000, 4);
+    for (uint64_t key = 1; key <= 4; ++key) {
+        EXPECT_TRUE(h.send(key));
+    }
+    EXPECT_FALSE(h.send(1));
+    EXPECT_TRUE(h.send(5));
+    EXPECT_EQ(h.dedup->size(), 4u);
+    ASSERT_EQ(h.emitted.size(), 1u);
+    EXPECT_EQ(h.emitted[0].key, 1u);
+    // key 1 starts over
+    EXPECT_TRUE(h.send(1));
+}
+
+TEST(EventDeduplicatorTest, ByteLimitIsRespected) {
+    Harness h(1000, 1000, 16 * 100);
+    string message(100, 'x');
+    for (uint64_t key = 1; key <= 100; ++key) {
+        h.send(key, message);
+        EXPECT_LE(h.dedup->bytes(), 16u * 100);
+    }
+    EXPECT_LE(h.dedup->size(), 16u);
+    // a copy over maxCopyBytes is never kept
+    EXPECT_TRUE(h.send(1000, string(h.dedup->maxCopyBytes() + 1, 'y')));
+    EXPECT_FALSE(h.send(1000));
+    h.dedup->flushAll();
+    for (const auto& summary : h.emitted) {
+        EXPECT_NE(summary.key, 1000u);
+    }
+}
+
+TEST(EventDeduplicatorTest, CountsBytesSaved) {
+    auto& stats = AgentStatistics::instance();
+    stats.reset();
+    Harness h;
+    h.send(7, string(50, 'a'));
+    for (int i = 0; i < 10; ++i) {
+        h.send(7, string(50, 'a'));
+    }
+    h.dedup->flushAll();
+    EXPECT_EQ(stats.get(AgentStatistics::DedupSuppressed), 10u);
+    EXPECT_EQ(stats.get(AgentStatistics::DedupSummaries), 1u);
+    EXPECT_EQ(stats.get(AgentStatistics::DedupBytesSaved), 9u * 50);
+}
+
+// Not a pass/fail test: prints admit throughput and hash speed for a burst
+// where most events repeat.
+TEST(EventDeduplicatorBenchmark, AdmitBurst) {
+    const int EVENTS = 500000;
+    vector<string> fields;
+    for (int i = 0; i < 20; ++i) {
+        fields.push_back("field value number " + to_string(i) + " with some typical length");
+    }
+    Harness h(10000, 4096);
+    int sent = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < EVENTS; ++i) {
+        FastHasher hasher;
+        hasher.add(string_view("Microsoft-Windows-Security-Auditing")).add(uint64_t(4625 + i % 50));
+        for (const auto& field : fields) {
+            hasher.add(string_view(field));
+        }
+        auto key = hasher.digest();
+        if (h.dedup->admit(key)) {
+            h.dedup->remember(key, "copy", string());
+            ++sent;
+        }
+    }
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - start).count();
+    cout << "[ BENCH    ] " << EVENTS << " events hashed and admitted in " << elapsed << "us ("
+        << (elapsed > 0 ? EVENTS * 1000000LL / elapsed : 0) << "/s), " << sent << " sent" << endl;
+    EXPECT_EQ(sent, 50);
+}
@@ -0,0 +1,181 @@
+#include "pch.h"
+#include "../AgentLib/EventPipeline.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    struct TestRecord {
+        vector<string> visited;
+        int value = 0;
+    };
+
+    using TestPipeline = EventPipeline<TestRecord>;
+
+    // Records its name, then does what it's told
+    unique_ptr<PipelineStage<TestRecord>> visit(const string& name, StageKind kind,
+        StageResult result = StageResult::Continue) {
+        return make_unique<FunctionStage<TestRecord>>(name, kind, [name, result](TestRecord& record) {
+            record.visited.push_back(name);
+            return result;
+        });
+    }
+
+    vector<TestPipeline::StageDefinition> definitions() {
+        return {
+            { "parse", []() { return visit("parse", StageKind::Extract); } },
+            { "rules", []() { return visit("rules", StageKind::Filter); } },
+            { "redact", []() { return visit("redact", StageKind::Transform); } },
+            // works on what rules found, on redacted values
+            { "aggregate", []() { return visit("aggregate", StageKind::Filter); }, { "redact" }, { "rules" } },
+            { "dedup", []() { return visit("dedup", StageKind::Filter); }, { "redact" } },
+            // its feature is off
+            { "templates", []() { return unique_ptr<PipelineStage<TestRecord>>(); } },
+            { "serialize", []() { return visit("serialize", StageKind::Serialize); } },
+            { "route", []() { return visit("route", StageKind::Route); } },
+        };
+    }
+}
+
+TEST(EventPipelineTest, RunsStagesInOrderOnTheSameRecord) {
+    TestPipeline pipeline;
+    pipeline.add(visit("parse", StageKind::Extract));
+    pipeline.add(make_unique<FunctionStage<TestRecord>>("double", StageKind::Transform, [](TestRecord& record) {
+        record.value *= 2;
+        return StageResult::Continue;
+    }));
+    pipeline.add(visit("route", StageKind::Route));
+    TestRecord record;
+    record.value = 21;
+    EXPECT_EQ(pipeline.run(record), StageResult::Continue);
+    EXPECT_EQ(record.visited, (vector<string>{ "parse", "route" }));
+    EXPECT_EQ(record.value, 42);
+    for (size_t i = 0; i < pipeline.size(); ++i) {
+        EXPECT_EQ(pipeline.stage(i).records(), 1u);
+    }
+}
+
+TEST(EventPipelineTest, DoneAndFailedStopTheRecord) {
+    TestPipeline pipeline;
+    pipeline.add(visit("parse", StageKind::Extract));
+    pipeline.add(make_unique<FunctionStage<TestRecord>>("rules", StageKind::Filter, [](TestRecord& record) {
+        record.visited.push_back("rules");
+        return record.value == 0 ? StageResult::Done
+            : record.value < 0 ? StageResult::Failed : StageResult::Continue;
+    }));
+    pipeline.add(visit("route", StageKind::Route));
+    for (int value : { 0, 0, -1, 1 }) {
+        TestRecord record;
+        record.value = value;
+        pipeline.run(record);
+    }
+    EXPECT_EQ(pipeline.stage(0).records(), 4u);
+    EXPECT_EQ(pipeline.stage(1).records(), 4u);
+    EXPECT_EQ(pipeline.stage(1).stopped(), 2u);
+    EXPECT_EQ(pipeline.stage(1).failed(), 1u);
+    EXPECT_EQ(pipeline.stage(2).records(), 1u);
+
+    auto description = pipeline.describe();
+    EXPECT_NE(description.find("rules (filter): 4, 2 stopped, 1 failed"), string::npos) << description;
+}
+
+TEST(EventPipelineTest, ExceptionsCountAsFailures) {
+    TestPipeline pipeline;
+    pipeline.add(make_unique<FunctionStage<TestRecord>>("parse", StageKind::Extract, [](TestRecord&) -> StageResult {
+        throw runtime_error("bad event");
+    }));
+    pipeline.add(visit("route", StageKind::Route));
+    TestRecord record;
+    EXPECT_THROW(pipeline.run(record), runtime_error);
+    EXPECT_EQ(pipeline.stage(0).failed(), 1u);
+    EXPECT_EQ(pipeline.stage(1).records(), 0u);
+}
+
+TEST(EventPipelineTest, AssemblesTheStagesNamedInTheirOrder) {
+    TestPipeline pipeline;
+    string error;
+    ASSERT_TRUE(pipeline.assemble(" parse, redact,rules ,templates, serialize,route ", definitions(), error)) << error;
+    // templates has nothing to do, so isn't there at all
+    EXPECT_EQ(pipeline.size(), 5u);
+    EXPECT_FALSE(pipeline.contains("templates"));
+    TestRecord record;
+    pipeline.run(record);
+    EXPECT_EQ(record.visited, (vector<string>{ "parse", "redact", "rules", "serialize", "route" }));
+
+    TestPipeline without_rules;
+    ASSERT_TRUE(without_rules.assemble("parse,serialize,route", definitions(), error)) << error;
+    EXPECT_FALSE(without_rules.contains("rules"));
+    EXPECT_EQ(without_rules.size(), 3u);
+}
+
+TEST(EventPipelineTest, RejectsUnknownAndRepeatedStages) {
+    TestPipeline pipeline;
+    string error;
+    EXPECT_FALSE(pipeline.assemble("parse,enrich,route", definitions(), error));
+    EXPECT_EQ(error, "unknown stage \"enrich\"");
+    EXPECT_FALSE(pipeline.assemble("parse,rules,rules,route", definitions(), error));
+    EXPECT_EQ(error, "stage \"rules\" given twice");
+    EXPECT_FALSE(pipeline.assemble(" , ", definitions(), error));
+    EXPECT_EQ(error, "no stages");
+    EXPECT_EQ(pipeline.size(), 0u);
+}
+
+TEST(EventPipelineTest, RejectsStagesBeforeWhatTheyFollow) {
+    TestPipeline pipeline;
+    string error;
+    EXPECT_FALSE(pipeline.assemble("parse,aggregate,rules,serialize,route", definitions(), error));
+    EXPECT_EQ(error, "stage \"aggregate\" has to come after \"rules\"");
+    // rules is needed, not just ordered
+    EXPECT_FALSE(pipeline.assemble("parse,aggregate,serialize,route", definitions(), error));
+    EXPECT_EQ(error, "stage \"aggregate\" has to come after \"rules\"");
+    EXPECT_FALSE(pipeline.assemble("parse,rules,dedup,redact,serialize,route", definitions(), error));
+    EXPECT_EQ(error, "stage \"dedup\" has to come after \"redact\"");
+    EXPECT_FALSE(pipeline.assemble("parse,rules,aggregate,redact,serialize,route", definitions(), error));
+    EXPECT_EQ(error, "stage \"aggregate\" has to come after \"redact\"");
+    EXPECT_EQ(pipeline.size(), 0u);
+
+    // redact is only ordered: without it, dedup can go anywhere
+    ASSERT_TRUE(pipeline.assemble("parse,dedup,rules,aggregate,serialize,route", definitions(), error)) << error;
+    EXPECT_EQ(pipeline.size(), 6u);
+}
+
+// Not a pass/fail test: what the pipeline adds per record over calling the
+// same eight functions directly
+TEST(EventPipelineBenchmark, PerStageOverhead) {
+    const int RECORDS = 500000;
+    const int STAGES = 8;
+    auto step = [](TestRecord& record) {
+        record.value = record.value * 31 + 7;
+        return StageResult::Continue;
+    };
+    TestPipeline pipeline;
+    for (int i = 0; i < STAGES; ++i) {
+        pipeline.add(make_unique<FunctionStage<TestRecord>>("step" + to_string(i), StageKind::Transform, step));
+    }
+
+    TestRecord direct_record;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < RECORDS; ++i) {
+        for (int s = 0; s < STAGES; ++s) {
+            step(direct_record);
+        }
+    }
+    auto direct_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+    TestRecord pipeline_record;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < RECORDS; ++i) {
+        pipeline.run(pipeline_record);
+    }
+    auto pipeline_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(pipeline_record.value, direct_record.value);
+    cout << "[ BENCH    ] direct: " << (direct_ns / RECORDS) << " ns per record, pipeline: "
+        << (pipeline_ns / RECORDS) << " ns per record (" << STAGES << " stages)" << endl;
+}
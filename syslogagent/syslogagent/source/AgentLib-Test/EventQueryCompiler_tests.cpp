@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "../AgentLib/EventQueryCompiler.h"
+
+#include <string>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    size_t countOccurrences(const wstring& text, const wstring& what) {
+        size_t count = 0;
+        for (size_t pos = text.find(what); pos != wstring::npos; pos = text.find(what, pos + what.size())) {
+            ++count;
+        }
+        return count;
+    }
+}
+
+TEST(EventQueryCompilerTest, NoFiltersSubscribesToEverything) {
+    EventQueryFilter filter;
+    EXPECT_EQ(EventQueryCompiler::compile(L"Security", filter), L"*");
+}
+
+TEST(EventQueryCompilerTest, IncludeListCollapsesRanges) {
+    EventQueryFilter filter;
+    filter.include_event_ids = true;
+    filter.event_ids = { 4624, 4634, 4635, 4636, 4647 };
+    EXPECT_EQ(EventQueryCompiler::compile(L"Security", filter),
+        L"<QueryList><Query Id=\"0\" Path=\"Security\">"
+        L"<Select Path=\"Security\">*[System[(EventID=4624 or (EventID&gt;=4634 and EventID&lt;=4636)"
+        L" or EventID=4647)]]</Select>"
+        L"</Query></QueryList>");
+}
+
+TEST(EventQueryCompilerTest, IgnoreListUsesSuppress) {
+    EventQueryFilter filter;
+    filter.include_event_ids = false;
+    filter.event_ids = { 4662 };
+    EXPECT_EQ(EventQueryCompiler::compile(L"Security", filter),
+        L"<QueryList><Query Id=\"0\" Path=\"Security\">"
+        L"<Select Path=\"Security\">*</Select>"
+        L"<Suppress Path=\"Security\">*[System[(EventID=4662)]]</Suppress>"
+        L"</Query></QueryList>");
+}
+
+TEST(EventQueryCompilerTest, LevelAndAge) {
+    EventQueryFilter filter;
+    filter.max_level = 3;
+    filter.max_age_days = 1;
+    EXPECT_EQ(EventQueryCompiler::compile(L"System", filter),
+        L"<QueryList><Query Id=\"0\" Path=\"System\">"
+        L"<Select Path=\"System\">*[System[(Level&gt;=1 and Level&lt;=3) and "
+        L"TimeCreated[timediff(@SystemTime)&lt;=86400000]]]</Select>"
+        L"</Query></QueryList>");
+}
+
+TEST(EventQueryCompilerTest, InformationLevelIncludesLogAlways) {
+    EventQueryFilter filter;
+    filter.max_level = 4;
+    auto query = EventQueryCompiler::compile(L"System", filter);
+    EXPECT_NE(query.find(L"*[System[Level&lt;=4]]"), wstring::npos) << query.c_str();
+}
+
+TEST(EventQueryCompilerTest, ConditionsAppliedToEverySelect) {
+    EventQueryFilter filter;
+    filter.include_event_ids = true;
+    filter.max_level = 2;
+    filter.max_age_days = 1;
+    for (uint32_t id = 1; id <= 200; id += 2) {
+        filter.event_ids.insert(id);
+    }
+    auto query = EventQueryCompiler::compile(L"Application", filter);
+    size_t selects = countOccurrences(query, L"<Select ");
+    EXPECT_EQ(selects, (100 + EventQueryCompiler::MAX_EXPRESSIONS_PER_SELECT - 1)
+        / EventQueryCompiler::MAX_EXPRESSIONS_PER_SELECT);
+    EXPECT_EQ(countOccurrences(query, L"Level&lt;=2"), selects);
+    EXPECT_EQ(countOccurrences(query, L"timediff"), selects);
+    EXPECT_EQ(countOccurrences(query, L"EventID="), 100u);
+}
+
+TEST(EventQueryCompilerTest, SplitsNeverExceedExpressionLimit) {
+    EventQueryFilter filter;
+    filter.include_event_ids = false;
+    // mix of singles and two-ID ranges
+    for (uint32_t id = 1; id <= 300; id += 3) {
+        filter.event_ids.insert(id);
+        if (id % 2) {
+            filter.event_ids.insert(id + 1);
+        }
+    }
+    auto query = EventQueryCompiler::compile(L"Application", filter);
+    size_t start = 0;
+    size_t elements = 0;
+    while ((start = query.find(L"<Suppress ", start)) != wstring::npos) {
+        size_t end = query.find(L"</Suppress>", start);
+        ASSERT_NE(end, wstring::npos);
+        auto element = query.substr(start, end - start);
+        size_t comparisons = countOccurrences(element, L"EventID=") + countOccurrences(element, L"EventID&");
+        EXPECT_LE(comparisons, static_cast<size_t>(EventQueryCompiler::MAX_EXPRESSIONS_PER_SELECT));
+        start = end;
+        ++elements;
+    }
+    EXPECT_GT(elements, 1u);
+    // every ID is still covered exactly once
+    EXPECT_EQ(countOccurrences(query, L"EventID=") + countOccurrences(query, L"EventID&gt;="), 100u);
+}
+
+TEST(EventQueryCompilerTest, ChannelNameIsEscaped) {
+    EventQueryFilter filter;
+    filter.max_level = 2;
+    auto query = EventQueryCompiler::compile(L"Vendor-A&B/Operational", filter);
+    EXPECT_NE(query.find(L"Path=\"Vendor-A&amp;B/Operational\""), wstring::npos);
+    EXPECT_EQ(query.find(L"A&B"), wstring::npos);
+}
@@ -0,0 +1,272 @@
+#include "pch.h"
+#include "../AgentLib/EventRuleEngine.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    typedef EventRuleEngine::Action Action;
+
+    struct TestEvent {
+        string provider = "Microsoft-Windows-Security-Auditing";
+        string channel = "Security";
+        uint32_t event_id = 4624;
+        int level = 0;
+        vector<pair<string, string>> data;
+
+        EventRuleEngine::EventView view(vector<EventRuleEngine::Field>& fields) const {
+            fields.clear();
+            for (const auto& item : data) {
+                fields.push_back({ item.first, item.second });
+            }
+            EventRuleEngine::EventView event;
+            event.provider = provider;
+            event.channel = channel;
+            event.event_id = event_id;
+            event.level = level;
+            event.fields = fields.data();
+            event.field_count = fields.size();
+            return event;
+        }
+    };
+
+    Action evaluate(const shared_ptr<const EventRuleEngine>& engine, const TestEvent& event) {
+        vector<EventRuleEngine::Field> fields;
+        return engine->evaluate(event.view(fields));
+    }
+
+    shared_ptr<const EventRuleEngine> compileClean(const string& rules) {
+        vector<EventRuleEngine::CompileError> errors;
+        auto engine = EventRuleEngine::compile(rules, &errors);
+        EXPECT_TRUE(errors.empty()) << (errors.empty() ? "" : errors[0].message);
+        return engine;
+    }
+}
+
+TEST(EventRuleEngineTest, NoRulesForwardsEverything) {
+    auto engine = compileClean("# nothing here\n\n");
+    EXPECT_EQ(engine->ruleCount(), 0u);
+    EXPECT_EQ(evaluate(engine, TestEvent()), Action::Forward);
+}
+
+TEST(EventRuleEngineTest, DropsByProviderIdAndEventData) {
+    auto engine = compileClean(
+        "drop provider=\"Microsoft-Windows-Security-Auditing\" id=4624 LogonType=3 TargetUserName~\"^svc_\"\n");
+    TestEvent event;
+    event.data = { { "LogonType", "3" }, { "TargetUserName", "svc_backup" } };
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+
+    event.data[1].second = "alice";
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+
+    event.data = { { "LogonType", "2" }, { "TargetUserName", "svc_backup" } };
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+
+    event.data = { { "LogonType", "3" }, { "TargetUserName", "svc_backup" } };
+    event.event_id = 4625;
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+}
+
+TEST(EventRuleEngineTest, ProviderAndChannelIgnoreCase) {
+    auto engine = compileClean("secondary channel=\"security\"\nprimary provider=SERVICE-control-manager\n");
+    TestEvent event;
+    EXPECT_EQ(evaluate(engine, event), Action::SecondaryOnly);
+    event.channel = "System";
+    event.provider = "Service Control Manager";
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+    event.provider = "Service-Control-Manager";
+    EXPECT_EQ(evaluate(engine, event), Action::PrimaryOnly);
+}
+
+TEST(EventRuleEngineTest, FirstMatchingRuleWins) {
+    auto engine = compileClean(
+        "forward id=1102,4719\n"
+        "drop channel=Security\n"
+        "secondary provider=\"Microsoft-Windows-Security-Auditing\" id=1102\n");
+    TestEvent event;
+    event.event_id = 1102;
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+    event.event_id = 4719;
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+    event.event_id = 4624;
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+}
+
+TEST(EventRuleEngineTest, IndexedRulesKeepFileOrder) {
+    // later rule is indexed more specifically than the earlier catch-all
+    auto engine = compileClean(
+        "primary level<=2\n"
+        "drop provider=P id=7\n"
+        "secondary id=7\n");
+    TestEvent event;
+    event.provider = "P";
+    event.event_id = 7;
+    event.level = 2;
+    EXPECT_EQ(evaluate(engine, event), Action::PrimaryOnly);
+    event.level = 4;
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+    event.provider = "Q";
+    EXPECT_EQ(evaluate(engine, event), Action::SecondaryOnly);
+}
+
+TEST(EventRuleEngineTest, LevelComparisons) {
+    auto engine = compileClean("drop level>3\n");
+    TestEvent event;
+    event.level = 0;    // LogAlways counts as Information
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+    event.level = 3;
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+    event.level = 5;
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+}
+
+TEST(EventRuleEngineTest, NegationAndMissingFields) {
+    auto engine = compileClean("drop id!=1,2 Status!=\"0x0\"\n");
+    TestEvent event;
+    event.event_id = 3;
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);     // no Status field at all
+    event.data = { { "Status", "0x0" } };
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+    event.data = { { "Status", "0xC000006D" } };
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+    event.event_id = 2;
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+}
+
+TEST(EventRuleEngineTest, NumericEventData) {
+    auto engine = compileClean("drop ProcessId<0x10 Size>=1000\n");
+    TestEvent event;
+    event.data = { { "ProcessId", "0x4" }, { "Size", "1000" } };
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+    event.data[0].second = "0x1C4";
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+    event.data[0].second = "not a number";
+    EXPECT_EQ(evaluate(engine, event), Action::Forward);
+}
+
+TEST(EventRuleEngineTest, QuotedValuesAndEscapes) {
+    auto engine = compileClean("drop CommandLine=\"say \\\"hi\\\" now\"\n");
+    TestEvent event;
+    event.data = { { "CommandLine", "say \"hi\" now" } };
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+}
+
+TEST(EventRuleEngineTest, ReportsErrorsWithLineNumbers) {
+    vector<EventRuleEngine::CompileError> errors;
+    auto engine = EventRuleEngine::compile(
+        "drop id=4624\n"
+        "discard id=1\n"
+        "drop id~\"12\"\n"
+        "drop Name~\"(\"\n"
+        "drop Name=\"unterminated\n"
+        "drop provider>3\n"
+        "drop level=high\n"
+        "forward channel=System\n", &errors);
+    EXPECT_EQ(engine->ruleCount(), 2u);
+    ASSERT_EQ(errors.size(), 6u);
+    EXPECT_EQ(errors[0].line, 2);
+    EXPECT_EQ(errors[5].line, 7);
+    for (const auto& error : errors) {
+        EXPECT_FALSE(error.message.empty());
+    }
+    TestEvent event;
+    EXPECT_EQ(evaluate(engine, event), Action::Drop);
+}
+
+TEST(EventRuleEngineTest, AggregateRulesCarryTheirFields) {
+    auto engine = compileClean(
+        "drop id=4634 TargetUserName~\"\\$$\"\n"
+        "aggregate(TargetUserName, IpAddress) id=4624,4634\n"
+        "aggregate() provider=\"Microsoft-Windows-Security-Auditing\"\n");
+    EXPECT_EQ(engine->ruleCount(), 3u);
+    EXPECT_EQ(engine->aggregateRuleCount(), 2u);
+
+    TestEvent event;
+    event.data = { { "TargetUserName", "alice" }, { "IpAddress", "10.0.0.5" } };
+    vector<EventRuleEngine::Field> fields;
+    const EventRuleEngine::Aggregation* aggregation = nullptr;
+    EXPECT_EQ(engine->evaluate(event.view(fields), &aggregation), Action::Aggregate);
+    ASSERT_NE(aggregation, nullptr);
+    EXPECT_EQ(aggregation->rule_line, 2);
+    EXPECT_EQ(aggregation->group_by, (vector<string>{ "TargetUserName", "IpAddress" }));
+
+    event.event_id = 4672;
+    EXPECT_EQ(engine->evaluate(event.view(fields), &aggregation), Action::Aggregate);
+    ASSERT_NE(aggregation, nullptr);
+    EXPECT_EQ(aggregation->rule_line, 3);
+    EXPECT_TRUE(aggregation->group_by.empty());
+
+    event.event_id = 4634;
+    event.data[0].second = "WORKSTATION$";
+    EXPECT_EQ(engine->evaluate(event.view(fields), &aggregation), Action::Drop);
+    EXPECT_EQ(aggregation, nullptr);
+    EXPECT_EQ(EventRuleEngine::actionName(Action::Aggregate), string("aggregate"));
+}
+
+TEST(EventRuleEngineTest, AggregateFieldListErrors) {
+    vector<EventRuleEngine::CompileError> errors;
+    auto engine = EventRuleEngine::compile(
+        "aggregate(TargetUserName id=4624\n"
+        "aggregate(,) id=4624\n"
+        "aggregate id=4625\n", &errors);
+    EXPECT_EQ(engine->ruleCount(), 1u);
+    ASSERT_EQ(errors.size(), 2u);
+    EXPECT_EQ(errors[0].line, 1);
+    EXPECT_EQ(errors[1].line, 2);
+}
+
+// Not a pass/fail test: prints evaluation throughput against rule sets of
+// increasing size, most of them for providers/IDs the events don't have.
+TEST(EventRuleEngineBenchmark, Evaluate) {
+    const int EVENTS = 200000;
+    vector<TestEvent> events(4);
+    events[0].data = { { "LogonType", "3" }, { "TargetUserName", "svc_backup" } };
+    events[1].data = { { "LogonType", "2" }, { "TargetUserName", "alice" } };
+    events[2].provider = "Service Control Manager";
+    events[2].channel = "System";
+    events[2].event_id = 7036;
+    events[2].data = { { "param1", "Windows Update" }, { "param2", "running" } };
+    events[3].provider = "Application Error";
+    events[3].channel = "Application";
+    events[3].event_id = 1000;
+    events[3].level = 2;
+
+    for (int rule_count : { 10, 100, 1000 }) {
+        string rules;
+        for (int i = 0; i < rule_count - 3; ++i) {
+            switch (i % 3) {
+            case 0: rules += "drop provider=Provider-" + to_string(i) + " id=" + to_string(i) + "\n"; break;
+            case 1: rules += "drop id=" + to_string(10000 + i) + " Field~\"^x\"\n"; break;
+            case 2: rules += "secondary provider=Provider-" + to_string(i) + " level<=2\n"; break;
+            }
+        }
+        rules += "drop provider=\"Microsoft-Windows-Security-Auditing\" id=4624 LogonType=3 TargetUserName~\"^svc_\"\n";
+        rules += "secondary channel=Application level<=2\n";
+        rules += "drop level>4\n";
+        auto engine = compileClean(rules);
+        ASSERT_EQ(engine->ruleCount(), static_cast<size_t>(rule_count));
+
+        vector<vector<EventRuleEngine::Field>> fields(events.size());
+        vector<EventRuleEngine::EventView> views;
+        for (size_t i = 0; i < events.size(); ++i) {
+            views.push_back(events[i].view(fields[i]));
+        }
+        int dropped = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < EVENTS; ++i) {
+            if (engine->evaluate(views[i % views.size()]) == Action::Drop) {
+                ++dropped;
+            }
+        }
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+        cout << "[ BENCH    ] " << rule_count << " rules: " << EVENTS << " events in " << elapsed << "us ("
+            << (elapsed > 0 ? EVENTS * 1000000LL / elapsed : 0) << "/s)" << endl;
+        EXPECT_EQ(dropped, EVENTS / 4);
+    }
+}
@@ -0,0 +1,236 @@
+#include "pch.h"
+#include "../AgentLib/FieldProjection.h"
+#include "../AgentLib/JsonStringTable.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    const char* const SECURITY = "Microsoft-Windows-Security-Auditing";
+
+    void plainEscape(string_view raw, string& escaped_out) {
+        for (char c : raw) {
+            if (c == '"' || c == '\\') {
+                escaped_out += '\\';
+            }
+            escaped_out += c;
+        }
+    }
+
+    class FieldProjectionTest : public ::testing::Test {
+    protected:
+        shared_ptr<const FieldProjection> compileClean(const string& text) {
+            vector<FieldProjection::CompileError> errors;
+            auto projection = FieldProjection::compile(text, table_, &errors);
+            EXPECT_TRUE(errors.empty()) << (errors.empty() ? "" : errors[0].message);
+            return projection;
+        }
+
+        bool keeps(const FieldProjection::Projection* projection, const string& name) {
+            return projection == nullptr || projection->keeps(table_.intern(name), name);
+        }
+
+        JsonStringTable table_{ plainEscape };
+    };
+}
+
+TEST_F(FieldProjectionTest, NothingConfiguredSendsEverything) {
+    auto projection = compileClean("# nothing\n\n");
+    EXPECT_EQ(projection->scopeCount(), 0u);
+    EXPECT_EQ(projection->select(SECURITY, 4624), nullptr);
+}
+
+TEST_F(FieldProjectionTest, ExcludeEverywhere) {
+    auto projection = compileClean("exclude * ProcessId ThreadId\n");
+    auto selected = projection->select("Service Control Manager", 7036);
+    ASSERT_NE(selected, nullptr);
+    EXPECT_FALSE(keeps(selected, "ProcessId"));
+    EXPECT_FALSE(keeps(selected, "ThreadId"));
+    EXPECT_TRUE(keeps(selected, "param1"));
+    EXPECT_FALSE(selected->stripMessage());
+}
+
+TEST_F(FieldProjectionTest, MostSpecificScopeWins) {
+    auto projection = compileClean(
+        "exclude * ProcessId\n"
+        "exclude provider=\"microsoft-windows-security-auditing\" SubjectLogonId\n"
+        "exclude id=4624 LogonGuid\n"
+        "include provider=\"Microsoft-Windows-Security-Auditing\" id=4624,4625 TargetUserName IpAddress ProcessId\n");
+    EXPECT_EQ(projection->scopeCount(), 5u);
+
+    // provider and ID: only what's included, less what * excludes
+    auto logon = projection->select(SECURITY, 4624);
+    ASSERT_NE(logon, nullptr);
+    EXPECT_TRUE(logon->includeOnly());
+    EXPECT_TRUE(keeps(logon, "TargetUserName"));
+    EXPECT_TRUE(keeps(logon, "IpAddress"));
+    EXPECT_FALSE(keeps(logon, "ProcessId"));
+    EXPECT_FALSE(keeps(logon, "LogonType"));
+    auto failed_logon = projection->select(SECURITY, 4625);
+    ASSERT_NE(failed_logon, nullptr);
+    EXPECT_TRUE(keeps(failed_logon, "TargetUserName"));
+    EXPECT_FALSE(keeps(failed_logon, "LogonType"));
+
+    // ID alone, for another provider
+    auto other_4624 = projection->select("Some-Other-Provider", 4624);
+    ASSERT_NE(other_4624, nullptr);
+    EXPECT_FALSE(keeps(other_4624, "LogonGuid"));
+    EXPECT_FALSE(keeps(other_4624, "ProcessId"));
+    EXPECT_TRUE(keeps(other_4624, "SubjectLogonId"));
+
+    // provider alone, case-insensitively
+    auto other_security = projection->select("MICROSOFT-WINDOWS-SECURITY-AUDITING", 4688);
+    ASSERT_NE(other_security, nullptr);
+    EXPECT_FALSE(keeps(other_security, "SubjectLogonId"));
+    EXPECT_FALSE(keeps(other_security, "ProcessId"));
+    EXPECT_TRUE(keeps(other_security, "NewProcessName"));
+
+    // everything else
+    auto anything = projection->select("Some-Other-Provider", 1);
+    ASSERT_NE(anything, nullptr);
+    EXPECT_FALSE(keeps(anything, "ProcessId"));
+    EXPECT_TRUE(keeps(anything, "SubjectLogonId"));
+}
+
+TEST_F(FieldProjectionTest, LinesForTheSameScopeAddUp) {
+    auto projection = compileClean(
+        "include id=4624 TargetUserName\n"
+        "include id=4624 IpAddress\n"
+        "strip-message id=4624\n");
+    auto selected = projection->select(SECURITY, 4624);
+    ASSERT_NE(selected, nullptr);
+    EXPECT_TRUE(keeps(selected, "TargetUserName"));
+    EXPECT_TRUE(keeps(selected, "IpAddress"));
+    EXPECT_FALSE(keeps(selected, "LogonType"));
+    EXPECT_TRUE(selected->stripMessage());
+    EXPECT_EQ(projection->select(SECURITY, 4625), nullptr);
+}
+
+TEST_F(FieldProjectionTest, StripMessageEverywhereCarriesDown) {
+    auto projection = compileClean("strip-message *\nexclude id=4688 ProcessId\n");
+    ASSERT_NE(projection->select(SECURITY, 4688), nullptr);
+    EXPECT_TRUE(projection->select(SECURITY, 4688)->stripMessage());
+    EXPECT_TRUE(projection->select(SECURITY, 1)->stripMessage());
+}
+
+TEST_F(FieldProjectionTest, NamesTheTableCantInternAreMatchedByName) {
+    string long_name(JsonStringTable::MAX_STRING_LENGTH + 10, 'x');
+    auto projection = compileClean("exclude * " + long_name + " ProcessId\n");
+    auto selected = projection->select(SECURITY, 1);
+    ASSERT_NE(selected, nullptr);
+    EXPECT_EQ(table_.intern(long_name), nullptr);
+    EXPECT_FALSE(selected->keeps(nullptr, long_name));
+    EXPECT_TRUE(selected->keeps(nullptr, long_name + "y"));
+    EXPECT_FALSE(keeps(selected, "ProcessId"));
+}
+
+TEST_F(FieldProjectionTest, ReportsErrorsWithLineNumbers) {
+    vector<FieldProjection::CompileError> errors;
+    auto projection = FieldProjection::compile(
+        "exclude * ProcessId\n"
+        "remove * ThreadId\n"
+        "exclude ThreadId\n"
+        "include id=12x Name\n"
+        "strip-message id=1 Name\n"
+        "include id=1\n"
+        "exclude * id=4 Name\n"
+        "exclude level=3 Name\n"
+        "include provider=\"unterminated Name\n"
+        "exclude id=4624 LogonGuid\n", table_, &errors);
+    EXPECT_EQ(projection->scopeCount(), 2u);
+    ASSERT_EQ(errors.size(), 8u);
+    EXPECT_EQ(errors[0].line, 2);
+    EXPECT_EQ(errors[7].line, 9);
+    for (const auto& error : errors) {
+        EXPECT_FALSE(error.message.empty());
+    }
+}
+
+// Not a pass/fail test: serializes a logon event's EventData with and
+// without a projection, and compares the per-field cost of the bit test
+// with comparing names.
+TEST(FieldProjectionBenchmark, BytesAndCostPerEvent) {
+    JsonStringTable table(plainEscape);
+    auto projection = FieldProjection::compile(
+        "exclude * ProcessId ThreadId\n"
+        "include provider=\"Microsoft-Windows-Security-Auditing\" id=4624 "
+        "SubjectUserName TargetUserName TargetDomainName LogonType IpAddress WorkstationName\n"
+        "strip-message provider=\"Microsoft-Windows-Security-Auditing\" id=4624\n", table);
+
+    vector<pair<string, string>> fields = {
+        { "SubjectUserSid", "S-1-5-18" }, { "SubjectUserName", "DC01$" }, { "SubjectDomainName", "CORP" },
+        { "SubjectLogonId", "0x3e7" }, { "TargetUserSid", "S-1-5-21-1004336348-1177238915-682003330-1117" },
+        { "TargetUserName", "alice" }, { "TargetDomainName", "CORP" }, { "TargetLogonId", "0x2f9c3b1" },
+        { "LogonType", "3" }, { "LogonProcessName", "Kerberos" }, { "AuthenticationPackageName", "Kerberos" },
+        { "WorkstationName", "-" }, { "LogonGuid", "{4b5d8f0e-6a3c-1e2b-9f7d-0c8a6e4b2d1f}" },
+        { "TransmittedServices", "-" }, { "LmPackageName", "-" }, { "KeyLength", "0" },
+        { "ProcessId", "0x0" }, { "ProcessName", "-" }, { "IpAddress", "10.20.30.40" }, { "IpPort", "51234" },
+        { "ImpersonationLevel", "%%1833" }, { "RestrictedAdminMode", "-" }, { "TargetOutboundUserName", "-" },
+        { "TargetOutboundDomainName", "-" }, { "VirtualAccount", "%%1843" }, { "TargetLinkedLogonId", "0x0" },
+        { "ElevatedToken", "%%1842" },
+    };
+    string message(1800, 'm');      // a 4624 message renders to about this much
+
+    const int EVENTS = 100000;
+    for (bool projected : { false, true }) {
+        size_t bytes = 0;
+        string json;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < EVENTS; ++i) {
+            const FieldProjection::Projection* selected =
+                projected ? projection->select("Microsoft-Windows-Security-Auditing", 4624) : nullptr;
+            json.clear();
+            for (const auto& field : fields) {
+                auto key = table.intern(field.first);
+                if (selected != nullptr && !selected->keeps(key, field.first)) {
+                    continue;
+                }
+                json += ", \"";
+                json.append(key->escaped, key->escaped_length);
+                json += "\":\"";
+                json += field.second;
+                json += "\"";
+            }
+            if (selected == nullptr || !selected->stripMessage()) {
+                json += ", \"message\":\"" + message + "\"";
+            }
+            bytes += json.size();
+        }
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        cout << "[ BENCH    ] " << (projected ? "projected" : "whole") << ": " << bytes / EVENTS
+            << " bytes/event of EventData and message, " << EVENTS << " events in " << elapsed << "us" << endl;
+    }
+
+    // the decision alone: one bit test against a name search
+    vector<string> listed = { "SubjectUserName", "TargetUserName", "TargetDomainName",
+        "LogonType", "IpAddress", "WorkstationName" };
+    auto selected = projection->select("Microsoft-Windows-Security-Auditing", 4624);
+    vector<const JsonStringTable::Entry*> keys;
+    for (const auto& field : fields) {
+        keys.push_back(table.intern(field.first));
+    }
+    size_t kept_bits = 0;
+    size_t kept_names = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < EVENTS; ++i) {
+        for (size_t f = 0; f < fields.size(); ++f) {
+            kept_bits += selected->keeps(keys[f], fields[f].first) ? 1 : 0;
+        }
+    }
+    auto bits_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < EVENTS; ++i) {
+        for (const auto& field : fields) {
+            kept_names += find(listed.begin(), listed.end(), field.first) != listed.end() ? 1 : 0;
+        }
+    }
+    auto names_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    cout << "[ BENCH    ] " << EVENTS * fields.size() << " field decisions: bit test " << bits_us
+        << "us, name search " << names_us << "us" << endl;
+    EXPECT_EQ(kept_bits, kept_names);
+}
@@ -0,0 +1,395 @@
+#include "pch.h"
+#include "../AgentLib/GzipCompressor.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    // A small inflater, after zlib's puff, to check what the compressor
+    // writes against the format rather than against itself
+    class Gunzip {
+    public:
+        explicit Gunzip(const vector<char>& in) : in_(in) {}
+
+        bool run(string& out) {
+            if (in_.size() < 18 || uint8_t(in_[0]) != 0x1F || uint8_t(in_[1]) != 0x8B || in_[2] != 8 || in_[3] != 0) {
+                return false;
+            }
+            pos_ = 10;
+            int last;
+            do {
+                last = bits(1);
+                int type = bits(2);
+                bool ok = type == 0 ? stored(out) : type == 1 ? fixed(out) : type == 2 ? dynamic(out) : false;
+                if (!ok || pos_ > in_.size()) {
+                    return false;
+                }
+            } while (!last);
+            bit_count_ = 0;
+            if (pos_ + 8 != in_.size()) {
+                return false;
+            }
+            uint32_t crc = read32();
+            uint32_t size = read32();
+            return crc == GzipCompressor::crc32(0, out.data(), out.size()) && size == uint32_t(out.size());
+        }
+
+    private:
+        struct Huffman {
+            vector<short> count = vector<short>(16);
+            vector<short> symbol;
+        };
+
+        int bits(int need) {
+            long value = bit_buffer_;
+            while (bit_count_ < need) {
+                if (pos_ >= in_.size()) {
+                    pos_ = in_.size() + 1;
+                    return 0;
+                }
+                value |= long(uint8_t(in_[pos_++])) << bit_count_;
+                bit_count_ += 8;
+            }
+            bit_buffer_ = value >> need;
+            bit_count_ -= need;
+            return int(value & ((1L << need) - 1));
+        }
+
+        uint32_t read32() {
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                value |= uint32_t(uint8_t(in_[pos_++])) << (8 * i);
+            }
+            return value;
+        }
+
+        bool stored(string& out) {
+            bit_buffer_ = 0;
+            bit_count_ = 0;
+            if (pos_ + 4 > in_.size()) {
+                return false;
+            }
+            unsigned length = uint8_t(in_[pos_]) | (uint8_t(in_[pos_ + 1]) << 8);
+            pos_ += 4;
+            if (pos_ + length > in_.size()) {
+                return false;
+            }
+            out.append(in_.data() + pos_, length);
+            pos_ += length;
+            return true;
+        }
+
+        // false if the lengths are over-subscribed, or incomplete other than
+        // a single code
+        static bool build(Huffman& h, const short* lengths, int n) {
+            h.symbol.assign(n, 0);
+            fill(h.count.begin(), h.count.end(), short(0));
+            for (int s = 0; s < n; ++s) {
+                h.count[lengths[s]]++;
+            }
+            if (h.count[0] == n) {
+                return true;
+            }
+            int left = 1;
+            for (int len = 1; len < 16; ++len) {
+                left = (left << 1) - h.count[len];
+                if (left < 0) {
+                    return false;
+                }
+            }
+            vector<short> offs(16, 0);
+            for (int len = 1; len < 15; ++len) {
+                offs[len + 1] = short(offs[len] + h.count[len]);
+            }
+            for (int s = 0; s < n; ++s) {
+                if (lengths[s] != 0) {
+                    h.symbol[offs[lengths[s]]++] = short(s);
+                }
+            }
+            return left == 0 || (n - h.count[0] == 1);
+        }
+
+        int decode(const Huffman& h) {
+            int code = 0, first = 0, index = 0;
+            for (int len = 1; len < 16; ++len) {
+                code |= bits(1);
+                int count = h.count[len];
+                if (code - count < first) {
+                    return h.symbol[index + (code - first)];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+
+        bool codes(string& out, const Huffman& lencode, const Huffman& distcode) {
+            static const short base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const short extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+            static const short dbase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const short dextra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+            while (true) {
+                int symbol = decode(lencode);
+                if (symbol < 0 || pos_ > in_.size()) {
+                    return false;
+                }
+                if (symbol < 256) {
+                    out.push_back(char(symbol));
+                    continue;
+                }
+                if (symbol == 256) {
+                    return true;
+                }
+                symbol -= 257;
+                if (symbol >= 29) {
+                    return false;
+                }
+                size_t length = base[symbol] + bits(extra[symbol]);
+                symbol = decode(distcode);
+                if (symbol < 0 || symbol >= 30) {
+                    return false;
+                }
+                size_t distance = dbase[symbol] + bits(dextra[symbol]);
+                if (distance > out.size() || distance > 32768) {
+                    return false;
+                }
+                for (size_t i = 0; i < length; ++i) {
+                    out.push_back(out[out.size() - distance]);
+                }
+            }
+        }
+
+        bool fixed(string& out) {
+            short lengths[288 + 30];
+            int s = 0;
+            for (; s < 144; ++s) lengths[s] = 8;
+            for (; s < 256; ++s) lengths[s] = 9;
+            for (; s < 280; ++s) lengths[s] = 7;
+            for (; s < 288; ++s) lengths[s] = 8;
+            Huffman lencode, distcode;
+            build(lencode, lengths, 288);
+            for (s = 0; s < 30; ++s) lengths[s] = 5;
+            build(distcode, lengths, 30);
+            return codes(out, lencode, distcode);
+        }
+
+        bool dynamic(string& out) {
+            static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            int nlen = bits(5) + 257;
+            int ndist = bits(5) + 1;
+            int ncode = bits(4) + 4;
+            if (nlen > 286 || ndist > 30) {
+                return false;
+            }
+            short lengths[320] = {};
+            for (int i = 0; i < ncode; ++i) {
+                lengths[order[i]] = short(bits(3));
+            }
+            Huffman lencode, distcode;
+            // the code length code must be complete
+            if (!build(lencode, lengths, 19)) {
+                return false;
+            }
+            int left = 1;
+            for (int len = 1; len < 16; ++len) {
+                left = (left << 1) - lencode.count[len];
+            }
+            if (left != 0) {
+                return false;
+            }
+            for (int index = 0; index < nlen + ndist;) {
+                int symbol = decode(lencode);
+                if (symbol < 0) {
+                    return false;
+                }
+                if (symbol < 16) {
+                    lengths[index++] = short(symbol);
+                    continue;
+                }
+                short length = 0;
+                int repeat;
+                if (symbol == 16) {
+                    if (index == 0) {
+                        return false;
+                    }
+                    length = lengths[index - 1];
+                    repeat = 3 + bits(2);
+                }
+                else if (symbol == 17) {
+                    repeat = 3 + bits(3);
+                }
+                else {
+                    repeat = 11 + bits(7);
+                }
+                if (index + repeat > nlen + ndist) {
+                    return false;
+                }
+                while (repeat--) {
+                    lengths[index++] = length;
+                }
+            }
+            if (lengths[256] == 0) {
+                return false;
+            }
+            if (!build(lencode, lengths, nlen) || !build(distcode, lengths + nlen, ndist)) {
+                return false;
+            }
+            return codes(out, lencode, distcode);
+        }
+
+        const vector<char>& in_;
+        size_t pos_ = 0;
+        long bit_buffer_ = 0;
+        int bit_count_ = 0;
+    };
+
+    string gunzip(const vector<char>& compressed) {
+        string out;
+        EXPECT_TRUE(Gunzip(compressed).run(out));
+        return out;
+    }
+
+    // A batch as the HTTP batcher builds it, of Security and System events
+    string eventBatch(int events, unsigned seed = 1) {
+        mt19937 random(seed);
+        const char* accounts[] = { "alice", "bob", "carol", "svc_backup", "SYSTEM", "ANONYMOUS LOGON" };
+        const char* hosts[] = { "WS-0142", "WS-0387", "DC01", "FS02", "SQL-PROD-3" };
+        string batch = "{ \"events\": [ ";
+        for (int i = 0; i < events; ++i) {
+            if (i > 0) {
+                batch += ", ";
+            }
+            int account = random() % 6;
+            int logon_type = random() % 2 ? 3 : 10;
+            string ip = "10." + to_string(random() % 4) + "." + to_string(random() % 250) + "." + to_string(random() % 250);
+            batch += "{\"host\": \"" + string(hosts[random() % 5]) + "\", \"program\": \"Microsoft-Windows-Security-Auditing\", "
+                "\"extra_fields\": {\"_source_type\": \"WindowsAgent\", \"_source_tag\": \"windows_agent\", "
+                "\"_log_type\": \"eventlog\", \"event_id\": \"4624\", \"event_log\": \"Security\", "
+                "\"severity\": \"5\", \"facility\": \"13\", \"record_id\": \"" + to_string(8812400 + i) + "\", "
+                "\"ts\": \"2025-02-20T10:" + to_string(10 + i % 50) + ":" + to_string(10 + random() % 50) + "." + to_string(random() % 1000000) + "\", "
+                "\"TargetUserName\": \"" + accounts[account] + "\", \"TargetDomainName\": \"CORP\", "
+                "\"LogonType\": \"" + to_string(logon_type) + "\", \"IpAddress\": \"" + ip + "\", "
+                "\"TargetLogonId\": \"0x" + to_string(random() % 100000000) + "\"}, "
+                "\"message\": \"An account was successfully logged on. Subject: Security ID: S-1-5-18 "
+                "Account Name: " + hosts[random() % 5] + "$ Logon Type: " + to_string(logon_type) + " New Logon: "
+                "Account Name: " + accounts[account] + " Account Domain: CORP Network Information: "
+                "Source Network Address: " + ip + " Source Port: " + to_string(49152 + random() % 16000) + "\"}";
+        }
+        return batch + " ] }";
+    }
+}
+
+TEST(GzipCompressorTest, RoundTripsAtEveryLevel) {
+    string batch = eventBatch(300);
+    for (int level = GzipCompressor::MIN_LEVEL; level <= GzipCompressor::MAX_LEVEL; ++level) {
+        GzipCompressor compressor(level);
+        vector<char> compressed;
+        size_t length = compressor.compress(batch.data(), batch.size(), compressed);
+        EXPECT_EQ(length, compressed.size());
+        EXPECT_EQ(gunzip(compressed), batch) << "level " << level;
+        EXPECT_LT(compressed.size() * 5, batch.size()) << "level " << level;
+    }
+}
+
+TEST(GzipCompressorTest, PiecesMakeTheSameMemberAsTheWhole) {
+    string batch = eventBatch(500);
+    GzipCompressor compressor;
+    vector<char> whole;
+    compressor.compress(batch.data(), batch.size(), whole);
+
+    vector<char> pieces;
+    compressor.begin(pieces);
+    mt19937 random(7);
+    for (size_t pos = 0; pos < batch.size();) {
+        size_t part = min(batch.size() - pos, size_t(1 + random() % 3000));
+        compressor.write(batch.data() + pos, part);
+        pos += part;
+    }
+    compressor.finish();
+    EXPECT_EQ(pieces, whole);
+    EXPECT_EQ(gunzip(pieces), batch);
+}
+
+TEST(GzipCompressorTest, AppendsToWhatIsThere) {
+    GzipCompressor compressor(1);
+    vector<char> out = { 'x', 'y' };
+    compressor.begin(out);
+    compressor.write("hello", 5);
+    size_t length = compressor.finish();
+    EXPECT_EQ(length + 2, out.size());
+    EXPECT_EQ(gunzip(vector<char>(out.begin() + 2, out.end())), "hello");
+}
+
+TEST(GzipCompressorTest, EdgeCases) {
+    GzipCompressor compressor(9);
+    vector<char> compressed;
+    compressor.compress("", 0, compressed);
+    EXPECT_EQ(gunzip(compressed), "");
+
+    compressor.compress("a", 1, compressed);
+    EXPECT_EQ(gunzip(compressed), "a");
+
+    // long runs: matches at distance 1 and the longest length
+    string runs = string(100000, 'a') + string(5000, 'b') + "abc" + string(70000, 'a');
+    compressor.compress(runs.data(), runs.size(), compressed);
+    EXPECT_EQ(gunzip(compressed), runs);
+    EXPECT_LT(compressed.size(), 1000u);
+
+    // nothing to find: barely larger than the input
+    mt19937 random(3);
+    string noise(200000, '\0');
+    for (auto& c : noise) {
+        c = char(random());
+    }
+    compressor.compress(noise.data(), noise.size(), compressed);
+    EXPECT_EQ(gunzip(compressed), noise);
+    EXPECT_LT(compressed.size(), noise.size() + noise.size() / 50);
+}
+
+TEST(GzipCompressorTest, Crc32) {
+    EXPECT_EQ(GzipCompressor::crc32(0, "123456789", 9), 0xCBF43926u);
+    EXPECT_EQ(GzipCompressor::crc32(GzipCompressor::crc32(0, "1234", 4), "56789", 5), 0xCBF43926u);
+}
+
+// Not a pass/fail test: compression throughput and ratio at each level on
+// 512KB batches of Security events, as the HTTP batcher sends them
+TEST(GzipCompressorBenchmark, ThroughputAndRatio) {
+    vector<string> batches;
+    for (unsigned seed = 1; seed <= 8; ++seed) {
+        string batch = eventBatch(1, seed);
+        for (int events = 2; batch.size() < 512 * 1024 - 1024; events += 50) {
+            batch = eventBatch(events, seed);
+        }
+        batches.push_back(batch);
+    }
+    size_t total = 0;
+    for (const auto& batch : batches) {
+        total += batch.size();
+    }
+    for (int level : { 1, 3, 6, 9 }) {
+        GzipCompressor compressor(level);
+        vector<char> compressed;
+        size_t compressed_total = 0;
+        auto start = chrono::steady_clock::now();
+        for (const auto& batch : batches) {
+            compressed_total += compressor.compress(batch.data(), batch.size(), compressed);
+        }
+        auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        EXPECT_EQ(gunzip(compressed), batches.back());
+        cout << "[ BENCH    ] level " << level << ": " << (total / 1024) << "KB in " << batches.size()
+            << " batches, " << (us / 1000) << " ms, " << (us > 0 ? total / us : 0) << " MB/s, ratio "
+            << (double(total) / compressed_total) << endl;
+    }
+}
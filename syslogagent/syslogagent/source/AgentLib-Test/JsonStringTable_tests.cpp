@@ -0,0 +1,180 @@
+#include "pch.h"
+#include "../AgentLib/JsonStringTable.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    atomic<int> escape_calls{ 0 };
+
+    void testEscape(string_view raw, string& escaped_out) {
+        ++escape_calls;
+        for (char c : raw) {
+            if (c == '"' || c == '\\') {
+                escaped_out += '\\';
+            }
+            escaped_out += c;
+        }
+    }
+
+    // Same work per character as Util::jsonEscapeString, which the per-event
+    // path used to run on every key
+    size_t escapeLikeUtil(const char* input, char* output, size_t output_size) {
+        size_t length = strlen(input);
+        size_t pos = 0;
+        for (size_t i = 0; i < length && pos + 7 < output_size; ++i) {
+            unsigned char c = static_cast<unsigned char>(input[i]);
+            if (c < 0x20) {
+                output[pos++] = '\\';
+                output[pos++] = 'u';
+                output[pos++] = '0';
+                output[pos++] = '0';
+                output[pos++] = "0123456789ABCDEF"[(c >> 4) & 0x0F];
+                output[pos++] = "0123456789ABCDEF"[c & 0x0F];
+            }
+            else if (c == '"' || c == '\\') {
+                output[pos++] = '\\';
+                output[pos++] = static_cast<char>(c);
+            }
+            else if (c <= 0x7F) {
+                output[pos++] = static_cast<char>(c);
+            }
+            else {
+                output[pos++] = '?';
+            }
+        }
+        output[pos] = 0;
+        return pos;
+    }
+
+    string entryText(const JsonStringTable::Entry* entry) {
+        return string(entry->escaped, entry->escaped_length);
+    }
+}
+
+TEST(JsonStringTableTest, InternsOnceAndEscapes) {
+    escape_calls = 0;
+    JsonStringTable table(testEscape);
+    auto first = table.intern("Microsoft-Windows-Security-Auditing");
+    ASSERT_NE(first, nullptr);
+    auto again = table.intern(string("Microsoft-Windows-Security-Auditing"));
+    EXPECT_EQ(first, again);
+    EXPECT_EQ(escape_calls, 1);
+    EXPECT_EQ(entryText(first), "Microsoft-Windows-Security-Auditing");
+
+    auto quoted = table.intern("say \"hi\"");
+    ASSERT_NE(quoted, nullptr);
+    EXPECT_EQ(entryText(quoted), "say \\\"hi\\\"");
+    EXPECT_NE(quoted->id, first->id);
+    EXPECT_EQ(table.size(), 2u);
+    EXPECT_EQ(table.find("say \"hi\""), quoted);
+    EXPECT_EQ(table.find("not there"), nullptr);
+}
+
+TEST(JsonStringTableTest, BoundedByCapacityAndLength) {
+    auto& stats = AgentStatistics::instance();
+    stats.reset();
+    JsonStringTable table(testEscape, 8);
+    for (int i = 0; i < 20; ++i) {
+        auto entry = table.intern("key" + to_string(i));
+        if (i < 8) {
+            EXPECT_NE(entry, nullptr);
+        }
+        else {
+            EXPECT_EQ(entry, nullptr);
+        }
+    }
+    EXPECT_EQ(table.size(), 8u);
+    EXPECT_EQ(table.intern(string(JsonStringTable::MAX_STRING_LENGTH + 1, 'x')), nullptr);
+    // existing entries are still found once full
+    EXPECT_NE(table.intern("key3"), nullptr);
+    EXPECT_EQ(stats.get(AgentStatistics::StringTableMisses), 8u);
+    EXPECT_EQ(stats.get(AgentStatistics::StringTableRejected), 13u);
+    EXPECT_EQ(stats.get(AgentStatistics::StringTableHits), 1u);
+    EXPECT_EQ(stats.get(AgentStatistics::StringTableSize), 8u);
+}
+
+TEST(JsonStringTableTest, ConcurrentInternGivesOneEntryPerString) {
+    JsonStringTable table(testEscape);
+    const int THREADS = 8;
+    vector<vector<const JsonStringTable::Entry*>> seen(THREADS);
+    vector<thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int round = 0; round < 200; ++round) {
+                for (int i = 0; i < 50; ++i) {
+                    auto entry = table.intern("Field" + to_string(i));
+                    if (round == 0) {
+                        seen[t].push_back(entry);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(table.size(), 50u);
+    set<uint32_t> ids;
+    for (int t = 0; t < THREADS; ++t) {
+        ASSERT_EQ(seen[t].size(), 50u);
+        for (int i = 0; i < 50; ++i) {
+            EXPECT_EQ(seen[t][i], seen[0][i]);
+            ids.insert(seen[t][i]->id);
+        }
+    }
+    EXPECT_EQ(ids.size(), 50u);
+}
+
+// Not a pass/fail test: compares serializing typical key names by escaping
+// each time against copying their interned escaped form.
+TEST(JsonStringTableBenchmark, InternedVersusEscaped) {
+    const int EVENTS = 100000;
+    vector<string> keys = { "SubjectUserSid", "SubjectUserName", "SubjectDomainName", "SubjectLogonId",
+        "TargetUserSid", "TargetUserName", "TargetDomainName", "TargetLogonId", "LogonType",
+        "LogonProcessName", "AuthenticationPackageName", "WorkstationName", "LogonGuid",
+        "TransmittedServices", "LmPackageName", "KeyLength", "ProcessId", "ProcessName",
+        "IpAddress", "IpPort", "ImpersonationLevel" };
+    JsonStringTable table(testEscape);
+    string output;
+    output.reserve(4096);
+
+    char scratch[1024];
+    auto start = chrono::steady_clock::now();
+    size_t escaped_total = 0;
+    for (int i = 0; i < EVENTS; ++i) {
+        output.clear();
+        for (const auto& key : keys) {
+            escapeLikeUtil(key.c_str(), scratch, sizeof(scratch));
+            output.append(scratch);
+        }
+        escaped_total += output.size();
+    }
+    auto escaped_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    size_t interned_total = 0;
+    for (int i = 0; i < EVENTS; ++i) {
+        output.clear();
+        for (const auto& key : keys) {
+            auto entry = table.intern(key);
+            output.append(entry->escaped, entry->escaped_length);
+        }
+        interned_total += output.size();
+    }
+    auto interned_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    cout << "[ BENCH    ] " << EVENTS << " events x " << keys.size() << " keys: escaped " << escaped_us
+        << "us, interned " << interned_us << "us" << endl;
+    EXPECT_EQ(escaped_total, interned_total);
+}
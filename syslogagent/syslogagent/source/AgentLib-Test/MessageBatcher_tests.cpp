@@ -181,28 +181,92 @@ TEST_F(MessageBatcherTest, BufferSizeConstraints) {
     EXPECT_EQ(result.messages_batched, 0);
     EXPECT_EQ(result.bytes_written, 0);
 
-    // Test with buffer that can fit only some messages plus safety margin
-    // Calculate a buffer size that will fit exactly 2 messages but not 3:
-    // Header: 13 bytes, Trailer: 11 bytes, 2 msgs (4 bytes each): 8 bytes, 1 separator: 1 byte, safety margin: 16 bytes
-    // Total for 2 messages: 13 + 11 + 8 + 1 + 16 = 49, but not enough for 3rd message + separator
-    char small_buffer[49];
+    // Test with buffer that can fit exactly 2 messages but not 3:
+    // Header: 13 bytes, Trailer: 11 bytes, 2 msgs (4 bytes each): 8 bytes, 1 separator: 1 byte, null: 1 byte
+    // Total for 2 messages: 13 + 11 + 8 + 1 + 1 = 34, and 39 for 3
+    char small_buffer[38];
     result = batcher->BatchEvents(message_queue, small_buffer, sizeof(small_buffer));
     EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::Success);
-    EXPECT_GT(result.messages_batched, 0);
-    EXPECT_LT(result.messages_batched, 3);
+    EXPECT_EQ(result.messages_batched, 2);
+    EXPECT_EQ(result.bytes_written, 33);
+    EXPECT_EQ(std::string(small_buffer), "[BATCH_START]msg1|msg2[BATCH_END]");
+
+    char exact_buffer[39];
+    result = batcher->BatchEvents(message_queue, exact_buffer, sizeof(exact_buffer));
+    EXPECT_EQ(result.messages_batched, 3);
+    EXPECT_EQ(result.bytes_written, 38);
 }
 
 TEST_F(MessageBatcherTest, LargeMessage) {
-    // Create a message larger than max size
+    // A message larger than the batcher's 1024 bytes is sent on its own
     std::string large_msg(2000, 'X');  // 2000 'X' characters
-    std::vector<std::string> messages = { large_msg };
+    std::vector<std::string> messages = { "before", large_msg, "after" };
     AddTestMessages(messages);
 
     char buffer[4096];
     auto result = batcher->BatchEvents(message_queue, buffer, sizeof(buffer));
     EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::Success);
+    EXPECT_EQ(result.messages_batched, 1);
+    EXPECT_EQ(std::string(buffer, result.bytes_written), "[BATCH_START]before[BATCH_END]");
+    CommitBatch(result.messages_batched);
+
+    result = batcher->BatchEvents(message_queue, buffer, sizeof(buffer));
+    EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::Success);
+    EXPECT_EQ(result.messages_batched, 1);
+    EXPECT_EQ(std::string(buffer, result.bytes_written), "[BATCH_START]" + large_msg + "[BATCH_END]");
+    CommitBatch(result.messages_batched);
+
+    result = batcher->BatchEvents(message_queue, buffer, sizeof(buffer));
+    EXPECT_EQ(result.messages_batched, 1);
+    EXPECT_EQ(std::string(buffer, result.bytes_written), "[BATCH_START]after[BATCH_END]");
+}
+
+TEST_F(MessageBatcherTest, MessageTooLargeForTheBufferIsFramedAlone) {
+    std::string large_msg(2000, 'X');
+    std::vector<std::string> messages = { large_msg, "after" };
+    AddTestMessages(messages);
+
+    char buffer[1024];
+    auto result = batcher->BatchEvents(message_queue, buffer, sizeof(buffer));
+    EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::MessageTooLarge);
     EXPECT_EQ(result.messages_batched, 0);
-    EXPECT_EQ(result.bytes_written, 0);
+    EXPECT_EQ(message_queue->length(), 2);
+
+    std::vector<char> oversized;
+    result = batcher->BatchOversizedMessage(message_queue, oversized);
+    EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::Success);
+    EXPECT_EQ(result.messages_batched, 1);
+    EXPECT_EQ(result.bytes_written, 13 + 2000 + 11);
+    EXPECT_EQ(std::string(oversized.data()), "[BATCH_START]" + large_msg + "[BATCH_END]");
+    CommitBatch(result.messages_batched);
+
+    result = batcher->BatchEvents(message_queue, buffer, sizeof(buffer));
+    EXPECT_EQ(result.messages_batched, 1);
+    EXPECT_EQ(std::string(buffer, result.bytes_written), "[BATCH_START]after[BATCH_END]");
+}
+
+TEST_F(MessageBatcherTest, TargetBatchBytes) {
+    // 13 + 5 * 10 + 4 + 11 = 78 bytes for five 10 byte messages
+    batcher = std::make_unique<TestMessageBatcher>(100, 1000);
+    EXPECT_EQ(batcher->GetTargetBatchBytes(), 1023);
+    batcher->SetTargetBatchBytes(78);
+    EXPECT_EQ(batcher->GetTargetBatchBytes(), 78);
+    std::vector<std::string> messages(12, std::string(10, 'm'));
+    AddTestMessages(messages);
+
+    char buffer[1024];
+    auto result = batcher->BatchEvents(message_queue, buffer, sizeof(buffer));
+    EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::Success);
+    EXPECT_EQ(result.messages_batched, 5);
+    EXPECT_EQ(result.bytes_written, 78);
+
+    // a smaller limit for this batch only
+    result = batcher->BatchEvents(message_queue, buffer, sizeof(buffer), UINT32_MAX, 77);
+    EXPECT_EQ(result.messages_batched, 4);
+
+    // no more than the buffer holds
+    batcher->SetTargetBatchBytes(100000);
+    EXPECT_EQ(batcher->GetTargetBatchBytes(), 1023);
 }
 
 TEST_F(MessageBatcherTest, BatchFormatConsistency) {
@@ -591,10 +655,10 @@ protected:
 TEST_F(MessageBatcherAdditionalTest, ExactFitMessage) {
     // Define a small buffer where the sizes can be computed.
     // For TestMessageBatcher, header = "[BATCH_START]" (13 bytes),
-    // trailer = "[BATCH_END]" (11 bytes), and our implementation now includes a safety margin of 16 bytes.
-    // For a buffer of size 66, available for message = 66 - 13 - 11 - 16 = 26.
-    const size_t buffer_size = 66;
-    char buffer[66];
+    // trailer = "[BATCH_END]" (11 bytes), and the terminating null (1 byte).
+    // For a buffer of size 51, available for message = 51 - 13 - 11 - 1 = 26.
+    const size_t buffer_size = 51;
+    char buffer[51];
     std::string msg(26, 'A');
 
     // Use the base test batcher (from your current tests).
@@ -611,14 +675,17 @@ TEST_F(MessageBatcherAdditionalTest, ExactFitMessage) {
 
     std::string expected = "[BATCH_START]" + msg + "[BATCH_END]";
     std::string actual(buffer, result.bytes_written);
-    
-    // Due to the additional safety margin, the actual written bytes may not match buffer_size exactly
-    // Instead, we'll check that the content is correct (header + message + trailer)
     EXPECT_EQ(actual, expected);
+    EXPECT_EQ(buffer[buffer_size - 1], '\0');
+
+    // One byte less and it doesn't fit at all
+    result = batcher.BatchEvents(message_queue, buffer, buffer_size - 1);
+    EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::MessageTooLarge);
 }
 
 // -----------------------------------------------------------------------------
-// MixedValidAndInvalidMessages: Test when one message is too large and skipped.
+// MixedValidAndInvalidMessages: Test when one message is too large for the
+// buffer: the batch ends before it, and it is left for BatchOversizedMessage().
 // -----------------------------------------------------------------------------
 TEST_F(MessageBatcherAdditionalTest, MixedValidAndInvalidMessages) {
     std::string valid1 = "valid1";
@@ -634,15 +701,26 @@ TEST_F(MessageBatcherAdditionalTest, MixedValidAndInvalidMessages) {
     char buffer[1024];
     auto result = batcher.BatchEvents(message_queue, buffer, sizeof(buffer));
 
-    // Expect only the valid messages to be batched (skipping the invalid one)
+    // The batch stops before the large message, to keep the queue's order
     EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::Success);
-    EXPECT_EQ(result.messages_batched, 2);
+    EXPECT_EQ(result.messages_batched, 1);
 
     std::string batch(buffer, result.bytes_written);
-    EXPECT_NE(batch.find("valid1"), std::string::npos);
-    EXPECT_NE(batch.find("valid2"), std::string::npos);
-    // The invalid message should not appear in the batch.
-    EXPECT_EQ(batch.find(invalid.substr(0, 10)), std::string::npos);
+    EXPECT_EQ(batch, "[BATCH_START]valid1[BATCH_END]");
+    message_queue->removeFront();
+
+    result = batcher.BatchEvents(message_queue, buffer, sizeof(buffer));
+    EXPECT_EQ(result.status, MessageBatcher::BatchResult::Status::MessageTooLarge);
+    EXPECT_EQ(result.messages_batched, 0);
+    std::vector<char> oversized;
+    result = batcher.BatchOversizedMessage(message_queue, oversized);
+    EXPECT_EQ(result.messages_batched, 1);
+    EXPECT_EQ(std::string(oversized.data(), result.bytes_written), "[BATCH_START]" + invalid + "[BATCH_END]");
+    message_queue->removeFront();
+
+    result = batcher.BatchEvents(message_queue, buffer, sizeof(buffer));
+    EXPECT_EQ(result.messages_batched, 1);
+    EXPECT_EQ(std::string(buffer, result.bytes_written), "[BATCH_START]valid2[BATCH_END]");
 }
 
 // -----------------------------------------------------------------------------
@@ -8,6 +8,7 @@
 #include <chrono>
 #include <atomic>
 #include <cstring> // for strlen
+#include <iostream>
 
 using namespace Syslog_agent;
 using namespace std;
@@ -94,6 +95,28 @@ TEST_F(MessageQueueTest, MultipleMessages) {
     }
 }
 
+// Test enqueueing a batch under one lock
+TEST_F(MessageQueueTest, EnqueueBatch) {
+    // one message spans several buffers, and one is empty and skipped
+    std::string large(MessageQueue::MESSAGE_BUFFER_SIZE * 2 + 100, 'x');
+    std::string contents = "First" + large + "Third";
+    uint32_t lengths[] = { 5, static_cast<uint32_t>(large.size()), 0, 5 };
+
+    EXPECT_EQ(queue->enqueueBatch(contents.data(), lengths, 4), 3u);
+    EXPECT_EQ(queue->length(), 3);
+    EXPECT_EQ(queue->enqueueBatch(nullptr, lengths, 4), 0u);
+    EXPECT_EQ(queue->enqueueBatch(contents.data(), lengths, 0), 0u);
+
+    std::vector<char> buffer(large.size() + 1);
+    EXPECT_EQ(queue->dequeue(buffer.data(), static_cast<uint32_t>(buffer.size())), 5);
+    EXPECT_STREQ(buffer.data(), "First");
+    EXPECT_EQ(queue->dequeue(buffer.data(), static_cast<uint32_t>(buffer.size())), static_cast<int>(large.size()));
+    EXPECT_EQ(std::string(buffer.data()), large);
+    EXPECT_EQ(queue->dequeue(buffer.data(), static_cast<uint32_t>(buffer.size())), 5);
+    EXPECT_STREQ(buffer.data(), "Third");
+    EXPECT_TRUE(queue->isEmpty());
+}
+
 // Test timestamp behavior
 TEST_F(MessageQueueTest, MessageTimestamp) {
     const char* msg = "Test";
@@ -301,3 +324,47 @@ TEST_F(MessageQueueAdditionalTest, PeekInvalidParameters) {
     int len = queue->peek(nullptr, nullptr, 0);
     EXPECT_EQ(len, -1);
 }
+
+// -----------------------------------------------------------------------------
+// Not a pass/fail test: messages per second enqueued one at a time and in
+// groups of 64, with a consumer draining the queue at the same time.
+// -----------------------------------------------------------------------------
+TEST(MessageQueueBenchmark, EnqueueBatch) {
+    const int MESSAGES = 200000;
+    const size_t GROUP = 64;
+    string message(600, 'm');
+    string group_contents;
+    vector<uint32_t> lengths(GROUP, static_cast<uint32_t>(message.size()));
+    for (size_t i = 0; i < GROUP; ++i) {
+        group_contents += message;
+    }
+
+    for (bool batched : { false, true }) {
+        MessageQueue bench_queue(1000, 1000);
+        atomic<bool> done{ false };
+        thread consumer([&]() {
+            vector<char> buffer(MessageQueue::MESSAGE_BUFFER_SIZE);
+            while (!done || !bench_queue.isEmpty()) {
+                if (bench_queue.dequeue(buffer.data(), static_cast<uint32_t>(buffer.size())) < 0) {
+                    this_thread::yield();
+                }
+            }
+        });
+        auto start = chrono::steady_clock::now();
+        for (int sent = 0; sent < MESSAGES; sent += static_cast<int>(GROUP)) {
+            if (batched) {
+                bench_queue.enqueueBatch(group_contents.data(), lengths.data(), GROUP);
+            }
+            else {
+                for (size_t i = 0; i < GROUP; ++i) {
+                    bench_queue.enqueue(message.data(), static_cast<uint32_t>(message.size()));
+                }
+            }
+        }
+        auto elapsed_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        done = true;
+        consumer.join();
+        cout << "[ BENCH    ] " << (batched ? "enqueueBatch: " : "enqueue: ")
+            << (MESSAGES * 1000000LL / (elapsed_us + 1)) << " messages/s" << endl;
+    }
+}
@@ -0,0 +1,239 @@
+#include "pch.h"
+#include "../AgentLib/MessageTemplateCache.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    // Templates as returned from the publishers' message tables
+    const char* LOGON_TEMPLATE =
+        "An account was successfully logged on.%n%n"
+        "Subject:%n%tSecurity ID:%t%t%1%n%tAccount Name:%t%t%2%n%tAccount Domain:%t%t%3%n"
+        "%tLogon ID:%t%t%4%n%nLogon Information:%n%tLogon Type:%t%t%9%n%tElevated Token:%t%t%28%n";
+    const char* SERVICE_TEMPLATE = "The %1 service entered the %2 state.";
+    const char* HEX_TEMPLATE = "Status code %1!08X! returned by %2";
+
+    class FakeTemplateSource : public IMessageTemplateSource {
+    public:
+        bool loadTemplate(const MessageTemplateKey& key, string& utf8_template_out,
+            vector<int>& unverbatim_inserts_out) override {
+            ++load_calls;
+            auto name = key.provider + "/" + to_string(key.event_id);
+            auto found = templates.find(name);
+            if (found == templates.end()) {
+                return false;
+            }
+            utf8_template_out = found->second;
+            unverbatim_inserts_out = unverbatim[name];
+            return true;
+        }
+        map<string, string> templates;
+        map<string, vector<int>> unverbatim;
+        int load_calls = 0;
+    };
+
+    string renderToString(const MessageTemplate& message_template, const vector<string_view>& inserts,
+        bool* ok = nullptr) {
+        char buffer[4096];
+        size_t size = 0;
+        bool rendered = message_template.render(inserts.data(), inserts.size(), buffer, sizeof(buffer), size);
+        if (ok) {
+            *ok = rendered;
+        }
+        return rendered ? string(buffer, size) : string();
+    }
+
+    shared_ptr<const MessageTemplate> compile(const char* text) {
+        return MessageTemplate::compile(text, strlen(text));
+    }
+}
+
+TEST(MessageTemplateTest, SubstitutesInserts) {
+    auto compiled = compile(SERVICE_TEMPLATE);
+    ASSERT_TRUE(compiled->isSupported());
+    EXPECT_EQ(compiled->highestInsert(), 2);
+    EXPECT_EQ(renderToString(*compiled, { "Windows Update", "running" }),
+        "The Windows Update service entered the running state.");
+}
+
+TEST(MessageTemplateTest, HandlesEscapes) {
+    auto compiled = compile("100%% done%.%n%tnext%!%rend%0ignored");
+    ASSERT_TRUE(compiled->isSupported());
+    EXPECT_EQ(renderToString(*compiled, {}), "100% done.\r\n\tnext!\rend");
+}
+
+TEST(MessageTemplateTest, TwoDigitInsertsAndRepeats) {
+    auto compiled = compile("%10-%1-%10%2");
+    vector<string_view> inserts = { "a", "b", "c", "d", "e", "f", "g", "h", "i", "j" };
+    EXPECT_EQ(renderToString(*compiled, inserts), "j-a-jb");
+}
+
+TEST(MessageTemplateTest, StringAndDecimalFormatsAreSupported) {
+    auto compiled = compile("%1!s! %2!d! %3!lu!");
+    ASSERT_TRUE(compiled->isSupported());
+    EXPECT_EQ(renderToString(*compiled, { "x", "12", "34" }), "x 12 34");
+}
+
+TEST(MessageTemplateTest, OtherFormatsAreNotSupported) {
+    EXPECT_FALSE(compile(HEX_TEMPLATE)->isSupported());
+    EXPECT_FALSE(compile("unterminated %1!s")->isSupported());
+}
+
+TEST(MessageTemplateTest, MissingInsertFallsBack) {
+    bool ok = true;
+    renderToString(*compile(SERVICE_TEMPLATE), { "only one" }, &ok);
+    EXPECT_FALSE(ok);
+}
+
+TEST(MessageTemplateTest, ParameterReferenceInsertFallsBack) {
+    bool ok = true;
+    renderToString(*compile(SERVICE_TEMPLATE), { "Spooler", "%%1842" }, &ok);
+    EXPECT_FALSE(ok);
+    renderToString(*compile(SERVICE_TEMPLATE), { "Spooler", "50%" }, &ok);
+    EXPECT_TRUE(ok);
+}
+
+TEST(MessageTemplateTest, TruncatesToBuffer) {
+    auto compiled = compile(SERVICE_TEMPLATE);
+    vector<string_view> inserts = { "Windows Update", "running" };
+    char buffer[10];
+    size_t size = 0;
+    ASSERT_TRUE(compiled->render(inserts.data(), inserts.size(), buffer, sizeof(buffer), size));
+    EXPECT_EQ(size, 9u);
+    EXPECT_STREQ(buffer, "The Windo");
+}
+
+TEST(MessageTemplateTest, VerbatimInsertTypes) {
+    EXPECT_TRUE(MessageTemplate::isVerbatimInsert("win:UnicodeString", "", false));
+    EXPECT_TRUE(MessageTemplate::isVerbatimInsert("win:UnicodeString", "xs:string", false));
+    EXPECT_TRUE(MessageTemplate::isVerbatimInsert("win:SID", "xs:string", false));
+    EXPECT_TRUE(MessageTemplate::isVerbatimInsert("win:UInt32", "xs:unsignedInt", false));
+    EXPECT_TRUE(MessageTemplate::isVerbatimInsert("win:UInt32", "xs:string", false));
+    // a value map's text, not the number
+    EXPECT_FALSE(MessageTemplate::isVerbatimInsert("win:UInt32", "xs:string", true));
+    // dates, hex, booleans, GUIDs and the rest are formatted differently
+    EXPECT_FALSE(MessageTemplate::isVerbatimInsert("win:FILETIME", "xs:dateTime", false));
+    EXPECT_FALSE(MessageTemplate::isVerbatimInsert("win:SYSTEMTIME", "", false));
+    EXPECT_FALSE(MessageTemplate::isVerbatimInsert("win:UInt32", "win:HexInt32", false));
+    EXPECT_FALSE(MessageTemplate::isVerbatimInsert("win:HexInt64", "", false));
+    EXPECT_FALSE(MessageTemplate::isVerbatimInsert("win:Boolean", "", false));
+    EXPECT_FALSE(MessageTemplate::isVerbatimInsert("win:UnicodeString", "win:Xml", false));
+}
+
+class MessageTemplateCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AgentStatistics::instance().reset();
+        source = make_shared<FakeTemplateSource>();
+        source->templates["Service Control Manager/7036"] = SERVICE_TEMPLATE;
+        source->templates["Hex/1"] = HEX_TEMPLATE;
+        now_ms = 0;
+        cache = make_unique<MessageTemplateCache>(source, 2, 1000, [this]() { return now_ms; });
+    }
+
+    shared_ptr<FakeTemplateSource> source;
+    unique_ptr<MessageTemplateCache> cache;
+    int64_t now_ms;
+};
+
+TEST_F(MessageTemplateCacheTest, LoadsOncePerKey) {
+    auto first = cache->acquire("Service Control Manager", 7036, 0, 1033);
+    auto second = cache->acquire("Service Control Manager", 7036, 0, 1033);
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first.get(), second.get());
+    EXPECT_EQ(source->load_calls, 1);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::MessageTemplateHits), 1u);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::MessageTemplateMisses), 1u);
+}
+
+TEST_F(MessageTemplateCacheTest, KeyIncludesVersionAndLocale) {
+    cache->acquire("Service Control Manager", 7036, 0, 1033);
+    cache->acquire("Service Control Manager", 7036, 1, 1033);
+    cache->acquire("Service Control Manager", 7036, 0, 1031);
+    EXPECT_EQ(source->load_calls, 3);
+}
+
+TEST_F(MessageTemplateCacheTest, UnavailableAndUnsupportedAreCachedAsEmpty) {
+    EXPECT_FALSE(cache->acquire("Nobody", 1, 0, 0));
+    EXPECT_FALSE(cache->acquire("Nobody", 1, 0, 0));
+    EXPECT_FALSE(cache->acquire("Hex", 1, 0, 0));
+    EXPECT_FALSE(cache->acquire("Hex", 1, 0, 0));
+    EXPECT_EQ(source->load_calls, 2);
+}
+
+TEST_F(MessageTemplateCacheTest, MappedInsertFallsBackOnlyWhenUsed) {
+    // %2, the state, is a value map in the event's template
+    source->templates["Mapped/1"] = SERVICE_TEMPLATE;
+    source->unverbatim["Mapped/1"] = { 2 };
+    EXPECT_FALSE(cache->acquire("Mapped", 1, 0, 0));
+    source->templates["Mapped/2"] = "The %1 service was changed.";
+    source->unverbatim["Mapped/2"] = { 2 };
+    auto compiled = cache->acquire("Mapped", 2, 0, 0);
+    ASSERT_TRUE(compiled);
+    EXPECT_EQ(renderToString(*compiled, { "Spooler", "4" }), "The Spooler service was changed.");
+}
+
+TEST_F(MessageTemplateCacheTest, EvictsAndExpires) {
+    cache->acquire("Service Control Manager", 7036, 0, 0);
+    cache->acquire("Nobody", 1, 0, 0);
+    cache->acquire("Nobody", 2, 0, 0);
+    EXPECT_EQ(cache->size(), 2u);
+    cache->acquire("Service Control Manager", 7036, 0, 0);
+    EXPECT_EQ(source->load_calls, 4);
+
+    now_ms += 1000;
+    cache->acquire("Service Control Manager", 7036, 0, 0);
+    EXPECT_EQ(source->load_calls, 5);
+}
+
+TEST_F(MessageTemplateCacheTest, InvalidateProvider) {
+    cache->acquire("Service Control Manager", 7036, 0, 0);
+    cache->acquire("Nobody", 1, 0, 0);
+    cache->invalidateProvider("Service Control Manager");
+    EXPECT_EQ(cache->size(), 1u);
+    cache->acquire("Service Control Manager", 7036, 0, 0);
+    EXPECT_EQ(source->load_calls, 3);
+}
+
+// Not a pass/fail test: prints cached lookup + render throughput for a
+// captured Security logon template.
+TEST(MessageTemplateBenchmark, LookupAndRender) {
+    const int EVENTS = 200000;
+    auto source = make_shared<FakeTemplateSource>();
+    source->templates["Microsoft-Windows-Security-Auditing/4624"] = LOGON_TEMPLATE;
+    MessageTemplateCache cache(source);
+    vector<string> values;
+    for (int i = 1; i <= 28; ++i) {
+        values.push_back("value-" + to_string(i));
+    }
+    values[0] = "S-1-5-18";
+    values[1] = "WORKSTATION$";
+    values[2] = "CONTOSO";
+    values[3] = "0x3E7";
+    vector<string_view> inserts(values.begin(), values.end());
+    vector<char> buffer(32768);
+    size_t total_bytes = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < EVENTS; ++i) {
+        auto compiled = cache.acquire("Microsoft-Windows-Security-Auditing", 4624, 2, 1033);
+        ASSERT_TRUE(compiled);
+        size_t size = 0;
+        ASSERT_TRUE(compiled->render(inserts.data(), inserts.size(), buffer.data(), buffer.size(), size));
+        total_bytes += size;
+    }
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - start).count();
+    cout << "[ BENCH    ] " << EVENTS << " renders in " << elapsed << "us ("
+        << (elapsed > 0 ? EVENTS * 1000000LL / elapsed : 0) << "/s, "
+        << total_bytes / EVENTS << " bytes each)" << endl;
+    EXPECT_EQ(source->load_calls, 1);
+}
@@ -0,0 +1,132 @@
+#include "pch.h"
+#include "../AgentLib/MessageTextPolicy.h"
+#include "../AgentLib/MessageTemplateCache.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+class MessageTextPolicyTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AgentStatistics::instance().reset();
+    }
+};
+
+TEST_F(MessageTextPolicyTest, RendersEverythingByDefault) {
+    MessageTextPolicy policy(false, "");
+    EXPECT_FALSE(policy.skipsAny());
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(policy.decide("Microsoft-Windows-Security-Auditing"), MessageTextPolicy::Decision::Render);
+    }
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::MessageTextSkipped), 0u);
+}
+
+TEST_F(MessageTextPolicyTest, SkipsListedProvidersInAnyCase) {
+    MessageTextPolicy policy(false, " Microsoft-Windows-Security-Auditing ;Service Control Manager,, ", 0);
+    EXPECT_TRUE(policy.skipsAny());
+    EXPECT_EQ(policy.providerCount(), 2u);
+    EXPECT_EQ(policy.decide("microsoft-windows-security-auditing"), MessageTextPolicy::Decision::Skip);
+    EXPECT_EQ(policy.decide("Service Control Manager"), MessageTextPolicy::Decision::Skip);
+    EXPECT_EQ(policy.decide("Microsoft-Windows-Kernel-General"), MessageTextPolicy::Decision::Render);
+    EXPECT_EQ(policy.decide(""), MessageTextPolicy::Decision::Render);
+    EXPECT_EQ(policy.decide(string(MessageTextPolicy::MAX_PROVIDER_LENGTH + 1, 'x')),
+        MessageTextPolicy::Decision::Render);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::MessageTextSkipped), 2u);
+}
+
+TEST_F(MessageTextPolicyTest, SkipsAWholeChannel) {
+    MessageTextPolicy policy(true, "", 0);
+    EXPECT_TRUE(policy.skipsAny());
+    EXPECT_EQ(policy.decide("Microsoft-Windows-Kernel-General"), MessageTextPolicy::Decision::Skip);
+    EXPECT_EQ(policy.decide("anything"), MessageTextPolicy::Decision::Skip);
+}
+
+TEST_F(MessageTextPolicyTest, SamplesOneInInterval) {
+    int64_t now = 1000;
+    MessageTextPolicy policy(true, "", 10, [&now]() { return now; });
+    int sampled = 0;
+    for (int i = 0; i < 1000; ++i) {
+        if (policy.decide("Microsoft-Windows-Security-Auditing") == MessageTextPolicy::Decision::Sample) {
+            ++sampled;
+            auto started = policy.now();
+            now += 250;
+            policy.renderDone(started);
+        }
+    }
+    EXPECT_EQ(sampled, 100);
+    auto& stats = AgentStatistics::instance();
+    EXPECT_EQ(stats.get(AgentStatistics::MessageTextSampled), 100u);
+    EXPECT_EQ(stats.get(AgentStatistics::MessageTextSkipped), 900u);
+    EXPECT_EQ(stats.get(AgentStatistics::MessageTextSampleMicroseconds), 100u * 250);
+}
+
+// Not a pass/fail test: events per second through rendering and
+// serializing a 4624 event, with the message text rendered and with it
+// skipped (1 in 100 still rendered).  The renderer here is the local
+// template one; EvtFormatMessage, which the agent falls back to, costs
+// more again, and what it costs on a live system is in
+// message_text_sample_microseconds.
+TEST(MessageTextPolicyBenchmark, EventsPerSecond) {
+    const char* TEMPLATE =
+        "An account was successfully logged on.%n%nSubject:%n%tSecurity ID:%t%t%1%n%tAccount Name:%t%t%2%n"
+        "%tAccount Domain:%t%t%3%n%tLogon ID:%t%t%4%n%nLogon Information:%n%tLogon Type:%t%t%9%n"
+        "%tRestricted Admin Mode:%t%22%n%tVirtual Account:%t%t%24%n%tElevated Token:%t%t%27%n%n"
+        "Impersonation Level:%t%t%21%n%nNew Logon:%n%tSecurity ID:%t%t%5%n%tAccount Name:%t%t%6%n"
+        "%tAccount Domain:%t%t%7%n%tLogon ID:%t%t%8%n%tLinked Logon ID:%t%t%25%n%tNetwork Account Name:%t%26%n"
+        "%tLogon GUID:%t%t%13%n%nProcess Information:%n%tProcess ID:%t%t%17%n%tProcess Name:%t%t%18%n%n"
+        "Network Information:%n%tWorkstation Name:%t%12%n%tSource Network Address:%t%19%n%tSource Port:%t%t%20%n%n"
+        "Detailed Authentication Information:%n%tLogon Process:%t%t%10%n%tAuthentication Package:%t%11%n"
+        "%tTransited Services:%t%14%n%tPackage Name (NTLM only):%t%15%n%tKey Length:%t%t%16%n";
+    auto compiled = MessageTemplate::compile(TEMPLATE, strlen(TEMPLATE));
+    ASSERT_TRUE(compiled && compiled->isSupported());
+    vector<string> names = { "SubjectUserSid", "SubjectUserName", "SubjectDomainName", "SubjectLogonId",
+        "TargetUserSid", "TargetUserName", "TargetDomainName", "TargetLogonId", "LogonType",
+        "LogonProcessName", "AuthenticationPackageName", "WorkstationName", "LogonGuid",
+        "TransmittedServices", "LmPackageName", "KeyLength", "ProcessId", "ProcessName", "IpAddress",
+        "IpPort", "ImpersonationLevel", "RestrictedAdminMode", "TargetOutboundUserName",
+        "VirtualAccount", "TargetLinkedLogonId", "TargetOutboundDomainName", "ElevatedToken" };
+    vector<string> values = { "S-1-5-18", "DC01$", "CORP", "0x3E7", "S-1-5-21-1004336348-1177238915-682003330-1117",
+        "alice", "CORP", "0x2f9c3b1", "3", "Kerberos", "Kerberos", "-", "{4b5d8f0e-6a3c-1e2b-9f7d-0c8a6e4b2d1f}",
+        "-", "-", "0", "0x0", "-", "10.20.30.40", "51234", "Impersonation", "-", "-", "No", "0x0", "-", "Yes" };
+    vector<string_view> inserts(values.begin(), values.end());
+
+    const int EVENTS = 200000;
+    vector<char> text(65536);
+    size_t rendered_size = 0;
+    ASSERT_TRUE(compiled->render(inserts.data(), inserts.size(), text.data(), text.size(), rendered_size));
+    string json;
+    json.reserve(8192);
+    for (bool skipping : { false, true }) {
+        MessageTextPolicy policy(skipping, "");
+        size_t bytes = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < EVENTS; ++i) {
+            size_t text_size = 0;
+            if (policy.decide("Microsoft-Windows-Security-Auditing") != MessageTextPolicy::Decision::Skip) {
+                compiled->render(inserts.data(), inserts.size(), text.data(), text.size(), text_size);
+            }
+            json.assign("{\"program\":\"Microsoft-Windows-Security-Auditing\", \"event_id\":\"4624\"");
+            for (size_t f = 0; f < names.size(); ++f) {
+                json += ", \"";
+                json += names[f];
+                json += "\":\"";
+                json += values[f];
+                json += "\"";
+            }
+            json += ", \"message\":\"";
+            json.append(text.data(), text_size);
+            json += "\"}";
+            bytes += json.size();
+        }
+        auto elapsed_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        cout << "[ BENCH    ] " << (skipping ? "text skipped: " : "text rendered: ")
+            << (EVENTS * 1000000LL / (elapsed_us + 1)) << " events/s, " << bytes / EVENTS << " bytes/event" << endl;
+    }
+}
@@ -0,0 +1,210 @@
+#include "pch.h"
+#include "../AgentLib/OrderedWorkPool.h"
+#include "../AgentLib/ReplayEventSource.h"
+#include "../AgentLib/AgentStatistics.h"
+#include "../Infrastructure/XMLToJsonConverter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    // Works for a while, then records its sequence on completion
+    class RecordingTask : public OrderedWorkPool::Task {
+    public:
+        RecordingTask(uint64_t sequence, vector<uint64_t>& completed, int work_us)
+            : sequence_(sequence), completed_(completed), work_us_(work_us) {}
+        void work() override {
+            this_thread::sleep_for(chrono::microseconds(work_us_));
+        }
+        void complete() override {
+            completed_.push_back(sequence_);
+        }
+    private:
+        uint64_t sequence_;
+        vector<uint64_t>& completed_;
+        int work_us_;
+    };
+
+    // A 4624 logon as EvtRender gives it, on one line
+    const char* LOGON_XML =
+        "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+        "<Provider Name='Microsoft-Windows-Security-Auditing' Guid='{54849625-5478-4994-a5ba-3e3b0328c30d}'/>"
+        "<EventID>4624</EventID><Version>2</Version><Level>0</Level><Task>12544</Task><Opcode>0</Opcode>"
+        "<Keywords>0x8020000000000000</Keywords><TimeCreated SystemTime='2025-03-14T15:09:26.535897900Z'/>"
+        "<EventRecordID>1843201</EventRecordID><Correlation ActivityID='{a1b2c3d4-0000-0000-0000-000000000000}'/>"
+        "<Execution ProcessID='784' ThreadID='5120'/><Channel>Security</Channel><Computer>DC01.corp.example.com</Computer>"
+        "<Security/></System><EventData><Data Name='SubjectUserSid'>S-1-5-18</Data>"
+        "<Data Name='SubjectUserName'>DC01$</Data><Data Name='SubjectDomainName'>CORP</Data>"
+        "<Data Name='SubjectLogonId'>0x3e7</Data><Data Name='TargetUserSid'>S-1-5-21-1004336348-1177238915-682003330-1117</Data>"
+        "<Data Name='TargetUserName'>alice</Data><Data Name='TargetDomainName'>CORP</Data>"
+        "<Data Name='TargetLogonId'>0x2f9c3b1</Data><Data Name='LogonType'>3</Data>"
+        "<Data Name='LogonProcessName'>Kerberos</Data><Data Name='AuthenticationPackageName'>Kerberos</Data>"
+        "<Data Name='WorkstationName'>-</Data><Data Name='LogonGuid'>{4b5d8f0e-6a3c-1e2b-9f7d-0c8a6e4b2d1f}</Data>"
+        "<Data Name='TransmittedServices'>-</Data><Data Name='LmPackageName'>-</Data><Data Name='KeyLength'>0</Data>"
+        "<Data Name='ProcessId'>0x0</Data><Data Name='ProcessName'>-</Data><Data Name='IpAddress'>10.20.30.40</Data>"
+        "<Data Name='IpPort'>51234</Data><Data Name='ImpersonationLevel'>%%1833</Data></EventData></Event>";
+}
+
+class OrderedWorkPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AgentStatistics::instance().reset();
+    }
+};
+
+TEST_F(OrderedWorkPoolTest, CompletesInSubmissionOrder) {
+    OrderedWorkPool pool(4);
+    auto channel = pool.createChannel(16);
+    vector<uint64_t> completed;
+    for (uint64_t i = 0; i < 300; ++i) {
+        // later tasks often finish first
+        pool.submit(*channel, make_unique<RecordingTask>(i, completed, static_cast<int>((i * 7919) % 400)));
+    }
+    pool.drain(*channel);
+    ASSERT_EQ(completed.size(), 300u);
+    EXPECT_TRUE(is_sorted(completed.begin(), completed.end()));
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::WorkPoolTasks), 300u);
+}
+
+TEST_F(OrderedWorkPoolTest, BoundsTasksInFlight) {
+    class CountingTask : public OrderedWorkPool::Task {
+    public:
+        CountingTask(atomic<int>& in_flight, atomic<int>& most) : in_flight_(in_flight) {
+            int now = ++in_flight_;
+            int seen = most.load();
+            while (now > seen && !most.compare_exchange_weak(seen, now)) {
+            }
+        }
+        void work() override { this_thread::sleep_for(chrono::microseconds(200)); }
+        void complete() override { --in_flight_; }
+    private:
+        atomic<int>& in_flight_;
+    };
+    OrderedWorkPool pool(3);
+    auto channel = pool.createChannel(4);
+    atomic<int> in_flight{ 0 };
+    atomic<int> most{ 0 };
+    for (int i = 0; i < 100; ++i) {
+        // constructed before submit() can block, so up to one more than the bound
+        pool.submit(*channel, make_unique<CountingTask>(in_flight, most));
+    }
+    pool.drain(*channel);
+    EXPECT_EQ(in_flight.load(), 0);
+    EXPECT_LE(most.load(), 5);
+}
+
+TEST_F(OrderedWorkPoolTest, ASlowEventOnlyHoldsBackItsOwnChannel) {
+    class GatedTask : public OrderedWorkPool::Task {
+    public:
+        GatedTask(atomic<bool>& gate, atomic<bool>& completed) : gate_(gate), completed_(completed) {}
+        void work() override {
+            while (!gate_) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        }
+        void complete() override { completed_ = true; }
+    private:
+        atomic<bool>& gate_;
+        atomic<bool>& completed_;
+    };
+    OrderedWorkPool pool(2);
+    auto slow_channel = pool.createChannel();
+    auto other_channel = pool.createChannel();
+    atomic<bool> gate{ false };
+    atomic<bool> slow_completed{ false };
+    pool.submit(*slow_channel, make_unique<GatedTask>(gate, slow_completed));
+    vector<uint64_t> slow_after;
+    pool.submit(*slow_channel, make_unique<RecordingTask>(1, slow_after, 0));
+    vector<uint64_t> other;
+    for (uint64_t i = 0; i < 20; ++i) {
+        pool.submit(*other_channel, make_unique<RecordingTask>(i, other, 0));
+    }
+    pool.drain(*other_channel);
+    EXPECT_EQ(other.size(), 20u);
+    EXPECT_FALSE(slow_completed);
+    EXPECT_TRUE(slow_after.empty());
+
+    gate = true;
+    pool.drain(*slow_channel);
+    EXPECT_TRUE(slow_completed);
+    EXPECT_EQ(slow_after.size(), 1u);
+}
+
+TEST_F(OrderedWorkPoolTest, ReplaysARecordingThroughThePool) {
+    istringstream recording("<Event>one</Event>\r\n\r\n<Event>two</Event>\n   \n<Event>three</Event>");
+    auto events = ReplayEventSource::readRecording(recording);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0], "<Event>one</Event>");
+
+    vector<uint64_t> completed;
+    vector<string> first_pass;
+    ReplayEventSource source(events, 4, [&](const string& event_xml, uint64_t sequence) {
+        if (sequence < 3) {
+            first_pass.push_back(event_xml);
+        }
+        return make_unique<RecordingTask>(sequence, completed, static_cast<int>((sequence * 31) % 100));
+    });
+    OrderedWorkPool pool(4);
+    auto channel = pool.createChannel(8);
+    EXPECT_EQ(pool.pump(source, *channel), 12u);
+    pool.drain(*channel);
+    EXPECT_EQ(first_pass, events);
+    ASSERT_EQ(completed.size(), 12u);
+    EXPECT_TRUE(is_sorted(completed.begin(), completed.end()));
+    unique_ptr<OrderedWorkPool::Task> more[4];
+    EXPECT_EQ(source.next(more, 4), 0u);
+}
+
+// Not a pass/fail test: events per second through one channel, by worker
+// count, converting each replayed event to JSON.  "with a 100us wait" adds
+// the time a render spends waiting on the event log service rather than
+// computing, which is where more workers than cores still pay.
+TEST(OrderedWorkPoolBenchmark, ChannelScaling) {
+    class ConvertTask : public OrderedWorkPool::Task {
+    public:
+        ConvertTask(const string& xml, int wait_us, atomic<size_t>& bytes)
+            : xml_(xml), wait_us_(wait_us), bytes_(bytes) {}
+        void work() override {
+            if (wait_us_ > 0) {
+                this_thread::sleep_for(chrono::microseconds(wait_us_));
+            }
+            json_ = XMLToJSONConverter::convert(xml_);
+        }
+        void complete() override { bytes_ += json_.size(); }
+    private:
+        const string& xml_;
+        int wait_us_;
+        atomic<size_t>& bytes_;
+        string json_;
+    };
+
+    const size_t REPEAT = 5000;
+    vector<string> recording = { LOGON_XML };
+    cout << "[ BENCH    ] " << thread::hardware_concurrency() << " cores" << endl;
+    for (int wait_us : { 0, 100 }) {
+        for (size_t workers : { 1, 2, 4, 8 }) {
+            atomic<size_t> bytes{ 0 };
+            ReplayEventSource source(recording, REPEAT, [&](const string& xml, uint64_t) {
+                return make_unique<ConvertTask>(xml, wait_us, bytes);
+            });
+            OrderedWorkPool pool(workers);
+            auto channel = pool.createChannel();
+            auto start = chrono::steady_clock::now();
+            size_t events = pool.pump(source, *channel);
+            pool.drain(*channel);
+            auto elapsed_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            cout << "[ BENCH    ] " << (wait_us > 0 ? "with a 100us wait, " : "") << workers << " workers: "
+                << (events * 1000000LL / (elapsed_us + 1)) << " events/s" << endl;
+            EXPECT_GT(bytes.load(), 0u);
+        }
+    }
+}
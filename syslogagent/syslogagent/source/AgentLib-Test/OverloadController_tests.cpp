@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "../AgentLib/OverloadController.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    const int NOTICE = 5;
+    const int WARNING = 4;
+    const int ERR = 3;
+
+    // A queue drained at a fixed rate, fed through the controller in 100ms
+    // ticks of simulated time.
+    struct Simulation {
+        Simulation(OverloadController* controller, int64_t* clock, double drain_per_tick)
+            : controller(controller), clock(clock), drain_per_tick(drain_per_tick) {}
+
+        OverloadController* controller;
+        int64_t* clock;
+        size_t depth = 0;
+        size_t max_depth = 0;
+        double drain_per_tick;
+        double drain_credit = 0;
+
+        void tick(const vector<pair<uint64_t, int>>& events) {
+            for (const auto& event : events) {
+                if (controller == nullptr || controller->admit(event.first, event.second) > 0) {
+                    ++depth;
+                }
+            }
+            drain_credit += drain_per_tick;
+            size_t drained = min(depth, static_cast<size_t>(drain_credit));
+            depth -= drained;
+            drain_credit -= static_cast<double>(drained);
+            max_depth = max(max_depth, depth);
+            *clock += 100;
+            if (controller != nullptr) {
+                controller->update(depth);
+            }
+        }
+    };
+}
+
+class OverloadControllerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AgentStatistics::instance().reset();
+    }
+
+    int64_t now_ = 0;
+    OverloadController::Clock clock_ = [this]() { return now_; };
+
+    // Overload at twice the drain rate: one noisy key plus a quiet one
+    void overload(Simulation& simulation, int seconds) {
+        vector<pair<uint64_t, int>> events;
+        for (int i = 0; i < 190; ++i) {
+            events.push_back({ 1, NOTICE });
+        }
+        for (int i = 0; i < 10; ++i) {
+            events.push_back({ 2, NOTICE });
+        }
+        for (int tick = 0; tick < seconds * 10; ++tick) {
+            simulation.tick(events);
+        }
+    }
+};
+
+TEST_F(OverloadControllerTest, PassesEverythingWhenHealthy) {
+    OverloadController controller(1000, 5000, 100, clock_);
+    Simulation simulation(&controller, &now_, 1000);
+    vector<pair<uint64_t, int>> events(200, { 1, NOTICE });
+    for (int tick = 0; tick < 600; ++tick) {
+        simulation.tick(events);
+    }
+    EXPECT_EQ(controller.level(), 0u);
+    EXPECT_EQ(controller.admit(1, NOTICE), 1u);
+    EXPECT_EQ(controller.trackedKeys(), 0u);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::OverloadSampledOut), 0u);
+}
+
+TEST_F(OverloadControllerTest, SamplesOnlyAfterSustainedPressure) {
+    OverloadController controller(1000, 3000, 100, clock_);
+    Simulation simulation(&controller, &now_, 190);
+    overload(simulation, 7);
+    // past half the high water mark, but not for long enough yet
+    EXPECT_GT(simulation.depth, 500u);
+    EXPECT_EQ(controller.level(), 0u);
+    overload(simulation, 2);
+    EXPECT_LT(simulation.depth, 1000u);
+    EXPECT_GT(controller.level(), 0u);
+}
+
+TEST_F(OverloadControllerTest, GoesStraightToSamplingPastHighWater) {
+    OverloadController controller(1000, 60000, 100, clock_);
+    Simulation simulation(&controller, &now_, 100);
+    overload(simulation, 2);
+    EXPECT_GT(simulation.depth, 1000u);
+    EXPECT_GT(controller.level(), 0u);
+}
+
+TEST_F(OverloadControllerTest, SamplesTheNoisyKeyAndReportsItsRate) {
+    OverloadController controller(1000, 2000, 100, clock_);
+    Simulation simulation(&controller, &now_, 100);
+    overload(simulation, 60);
+    ASSERT_GT(controller.level(), 0u);
+
+    // what's kept of the noisy key, weighted by rate, adds up to what was sent
+    uint64_t noisy_weight = 0;
+    int quiet_kept = 0;
+    const int EVENTS = 20000;
+    for (int i = 0; i < EVENTS; ++i) {
+        noisy_weight += controller.admit(1, NOTICE);
+        if (i % 19 == 0) {
+            quiet_kept += controller.admit(2, NOTICE) > 0 ? 1 : 0;
+        }
+    }
+    EXPECT_NEAR(static_cast<double>(noisy_weight), EVENTS, EVENTS * 0.1);
+    EXPECT_GT(AgentStatistics::instance().get(AgentStatistics::OverloadSampledOut), 0u);
+    EXPECT_GT(quiet_kept, 0);
+}
+
+TEST_F(OverloadControllerTest, NeverSamplesWarningOrWorse) {
+    OverloadController controller(1000, 2000, 100, clock_);
+    Simulation simulation(&controller, &now_, 100);
+    overload(simulation, 60);
+    ASSERT_GT(controller.level(), 0u);
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_EQ(controller.admit(1, WARNING), 1u);
+        ASSERT_EQ(controller.admit(1, ERR), 1u);
+    }
+}
+
+TEST_F(OverloadControllerTest, SamplesAuditEventsAtLevelZero) {
+    EXPECT_EQ(OverloadController::severityOfWindowsLevel(0), NOTICE);
+    EXPECT_EQ(OverloadController::severityOfWindowsLevel(3), WARNING);
+    EXPECT_EQ(OverloadController::severityOfWindowsLevel(2), ERR);
+
+    OverloadController controller(1000, 2000, 100, clock_);
+    Simulation simulation(&controller, &now_, 100);
+    overload(simulation, 60);
+    ASSERT_GT(controller.level(), 0u);
+    // 4624s, at LogAlways like every Security-Auditing event
+    int dropped = 0;
+    for (int i = 0; i < 10000; ++i) {
+        dropped += controller.admit(1, OverloadController::severityOfWindowsLevel(0)) == 0 ? 1 : 0;
+    }
+    EXPECT_GT(dropped, 0);
+}
+
+TEST_F(OverloadControllerTest, BacksOffOnceDrained) {
+    OverloadController controller(1000, 2000, 100, clock_);
+    Simulation simulation(&controller, &now_, 100);
+    overload(simulation, 60);
+    ASSERT_GT(controller.level(), 0u);
+
+    vector<pair<uint64_t, int>> trickle(5, { 1, NOTICE });
+    for (int tick = 0; tick < 3000 && controller.level() > 0; ++tick) {
+        simulation.tick(trickle);
+    }
+    EXPECT_EQ(controller.level(), 0u);
+    EXPECT_EQ(controller.admit(1, NOTICE), 1u);
+}
+
+TEST_F(OverloadControllerTest, KeyTableIsBounded) {
+    OverloadController controller(1000, 2000, 50, clock_);
+    Simulation simulation(&controller, &now_, 100);
+    vector<pair<uint64_t, int>> events;
+    for (uint64_t key = 0; key < 200; ++key) {
+        events.push_back({ key, NOTICE });
+    }
+    for (int tick = 0; tick < 300; ++tick) {
+        simulation.tick(events);
+        EXPECT_LE(controller.trackedKeys(), 50u);
+    }
+}
+
+// Not a pass/fail test: ten simulated minutes at nearly three times what
+// the destination takes, with and without the controller.
+TEST(OverloadControllerBenchmark, BoundedUnderSustainedOverload) {
+    const size_t HIGH_WATER = 50000;
+    const size_t AVERAGE_MESSAGE_BYTES = 600;
+    // 2800 events/s in (a noisy info key, 100 quiet ones at 2/s each, some
+    // warnings) and 1000/s out
+    vector<vector<pair<uint64_t, int>>> ticks(5);
+    for (size_t tick = 0; tick < ticks.size(); ++tick) {
+        auto& events = ticks[tick];
+        for (int i = 0; i < 250; ++i) {
+            events.push_back({ 4624, NOTICE });
+        }
+        for (uint64_t i = 0; i < 20; ++i) {
+            events.push_back({ 10000 + tick * 20 + i, NOTICE });
+        }
+        for (int i = 0; i < 10; ++i) {
+            events.push_back({ 4625, WARNING });
+        }
+    }
+
+    for (bool controlled : { false, true }) {
+        int64_t now = 0;
+        OverloadController controller(HIGH_WATER, OverloadController::DEFAULT_SUSTAIN_MS,
+            OverloadController::DEFAULT_MAX_KEYS, [&now]() { return now; });
+        Simulation simulation(controlled ? &controller : nullptr, &now, 100);
+        size_t max_keys = 0;
+        for (int tick = 0; tick < 10 * 60 * 10; ++tick) {
+            simulation.tick(ticks[tick % ticks.size()]);
+            max_keys = max(max_keys, controller.trackedKeys());
+        }
+        cout << "[ BENCH    ] " << (controlled ? "with controller" : "without controller")
+            << ": max queue " << simulation.max_depth << " messages (~"
+            << simulation.max_depth * AVERAGE_MESSAGE_BYTES / (1024 * 1024) << "MB), final queue "
+            << simulation.depth << ", sample rate 1/" << controller.baseSampleRate()
+            << ", keys tracked " << max_keys << endl;
+        if (controlled) {
+            EXPECT_LT(simulation.max_depth, 2 * HIGH_WATER);
+        }
+    }
+}
@@ -0,0 +1,223 @@
+#include "pch.h"
+#include "../AgentLib/PublisherMetadataCache.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    // Hands out fake handles and keeps track of what is open, so tests can
+    // check that every handle the cache opened gets closed exactly once.
+    class FakeMetadataOpener : public IPublisherMetadataOpener {
+    public:
+        static constexpr uint32_t MISSING_ERROR = 15002;
+        static constexpr uint32_t TRANSIENT_ERROR = 1450;
+
+        Handle open(const wchar_t* publisher_name, uint32_t& error_out) override {
+            if (during_open) {
+                auto hook = move(during_open);
+                hook();
+            }
+            ++open_calls;
+            wstring name(publisher_name);
+            if (missing.count(name)) {
+                error_out = MISSING_ERROR;
+                return nullptr;
+            }
+            if (transient.count(name)) {
+                error_out = TRANSIENT_ERROR;
+                return nullptr;
+            }
+            error_out = 0;
+            auto handle = reinterpret_cast<Handle>(++next_handle);
+            open_handles.insert(handle);
+            return handle;
+        }
+
+        void close(Handle handle) override {
+            ++close_calls;
+            EXPECT_EQ(open_handles.erase(handle), 1u) << "closed a handle that wasn't open";
+        }
+
+        bool isPublisherMissingError(uint32_t error) const override {
+            return error == MISSING_ERROR;
+        }
+
+        function<void()> during_open;   // run once, as if another thread
+        set<wstring> missing;
+        set<wstring> transient;
+        set<Handle> open_handles;
+        uintptr_t next_handle = 0;
+        int open_calls = 0;
+        int close_calls = 0;
+    };
+}
+
+class PublisherMetadataCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AgentStatistics::instance().reset();
+        opener = make_shared<FakeMetadataOpener>();
+        now_ms = 0;
+        cache = make_unique<PublisherMetadataCache>(opener, 3, 1000, 500,
+            [this]() { return now_ms; });
+    }
+
+    void TearDown() override {
+        cache.reset();
+    }
+
+    uint64_t stat(AgentStatistics::Counter counter) {
+        return AgentStatistics::instance().get(counter);
+    }
+
+    shared_ptr<FakeMetadataOpener> opener;
+    unique_ptr<PublisherMetadataCache> cache;
+    int64_t now_ms;
+};
+
+TEST_F(PublisherMetadataCacheTest, SecondLookupIsAHit) {
+    auto first = cache->acquire(L"Microsoft-Windows-Security-Auditing");
+    auto second = cache->acquire(L"Microsoft-Windows-Security-Auditing");
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first.get(), second.get());
+    EXPECT_EQ(opener->open_calls, 1);
+    EXPECT_EQ(stat(AgentStatistics::PublisherCacheMisses), 1u);
+    EXPECT_EQ(stat(AgentStatistics::PublisherCacheHits), 1u);
+}
+
+TEST_F(PublisherMetadataCacheTest, EvictsLeastRecentlyUsed) {
+    cache->acquire(L"A");
+    cache->acquire(L"B");
+    cache->acquire(L"C");
+    cache->acquire(L"A");      // B is now the oldest
+    cache->acquire(L"D");
+    EXPECT_EQ(cache->size(), 3u);
+    EXPECT_EQ(stat(AgentStatistics::PublisherCacheEvictions), 1u);
+    EXPECT_EQ(opener->close_calls, 1);
+
+    int opens_before = opener->open_calls;
+    cache->acquire(L"A");
+    cache->acquire(L"C");
+    cache->acquire(L"D");
+    EXPECT_EQ(opener->open_calls, opens_before);
+    cache->acquire(L"B");
+    EXPECT_EQ(opener->open_calls, opens_before + 1);
+}
+
+TEST_F(PublisherMetadataCacheTest, ExpiredEntryIsReopened) {
+    auto first = cache->acquire(L"A");
+    now_ms += 999;
+    cache->acquire(L"A");
+    EXPECT_EQ(opener->open_calls, 1);
+    now_ms += 1;
+    auto refreshed = cache->acquire(L"A");
+    EXPECT_EQ(opener->open_calls, 2);
+    EXPECT_NE(first.get(), refreshed.get());
+}
+
+TEST_F(PublisherMetadataCacheTest, EvictedHandleStaysOpenWhileInUse) {
+    auto in_use = cache->acquire(L"A");
+    cache->invalidate(L"A");
+    EXPECT_EQ(cache->size(), 0u);
+    EXPECT_EQ(opener->close_calls, 0);
+    EXPECT_EQ(opener->open_handles.count(in_use.get()), 1u);
+    in_use.reset();
+    EXPECT_EQ(opener->close_calls, 1);
+}
+
+TEST_F(PublisherMetadataCacheTest, ConcurrentOpenKeepsTheFirstHandleCached) {
+    PublisherMetadataCache::HandleRef theirs;
+    opener->during_open = [&]() { theirs = cache->acquire(L"A"); };
+    auto ours = cache->acquire(L"A");
+    ASSERT_TRUE(theirs);
+    EXPECT_EQ(ours, theirs);
+    EXPECT_EQ(opener->open_calls, 2);
+    EXPECT_EQ(opener->close_calls, 1);
+    EXPECT_EQ(opener->open_handles.size(), 1u);
+    EXPECT_EQ(cache->acquire(L"A"), theirs);
+    EXPECT_EQ(opener->open_calls, 2);
+}
+
+TEST_F(PublisherMetadataCacheTest, MissingPublisherIsNegativelyCached) {
+    opener->missing.insert(L"Uninstalled");
+    uint32_t error = 0;
+    EXPECT_FALSE(cache->acquire(L"Uninstalled", &error));
+    EXPECT_EQ(error, FakeMetadataOpener::MISSING_ERROR);
+    error = 0;
+    EXPECT_FALSE(cache->acquire(L"Uninstalled", &error));
+    EXPECT_EQ(error, FakeMetadataOpener::MISSING_ERROR);
+    EXPECT_EQ(opener->open_calls, 1);
+    EXPECT_EQ(stat(AgentStatistics::PublisherCacheUnavailable), 1u);
+
+    // publisher gets installed; picked up once the negative entry expires
+    opener->missing.clear();
+    now_ms += 500;
+    EXPECT_TRUE(cache->acquire(L"Uninstalled"));
+    EXPECT_EQ(opener->open_calls, 2);
+}
+
+TEST_F(PublisherMetadataCacheTest, TransientFailureIsRetriedSooner) {
+    cache = make_unique<PublisherMetadataCache>(opener, 3, 60000, 60000,
+        [this]() { return now_ms; });
+    opener->transient.insert(L"Busy");
+    EXPECT_FALSE(cache->acquire(L"Busy"));
+    opener->transient.clear();
+    now_ms += PublisherMetadataCache::TRANSIENT_ERROR_TTL_MS;
+    EXPECT_TRUE(cache->acquire(L"Busy"));
+}
+
+TEST_F(PublisherMetadataCacheTest, ClearClosesAllHandles) {
+    cache->acquire(L"A");
+    cache->acquire(L"B");
+    cache->clear();
+    EXPECT_TRUE(opener->open_handles.empty());
+    cache->acquire(L"C");
+    cache.reset();
+    EXPECT_TRUE(opener->open_handles.empty());
+}
+
+TEST_F(PublisherMetadataCacheTest, EmptyNameIsNotCached) {
+    EXPECT_FALSE(cache->acquire(L""));
+    EXPECT_FALSE(cache->acquire(nullptr));
+    EXPECT_EQ(opener->open_calls, 0);
+}
+
+// Not a pass/fail test: prints lookup throughput for a skewed publisher mix
+// with the working set both inside and larger than the cache.
+TEST(PublisherMetadataCacheBenchmark, SkewedLookups) {
+    const int LOOKUPS = 200000;
+    for (int publishers : { 32, 512 }) {
+        AgentStatistics::instance().reset();
+        auto opener = make_shared<FakeMetadataOpener>();
+        PublisherMetadataCache cache(opener, PublisherMetadataCache::DEFAULT_CAPACITY);
+        vector<wstring> names;
+        for (int i = 0; i < publishers; ++i) {
+            names.push_back(L"Microsoft-Windows-Provider-" + to_wstring(i));
+        }
+        uint32_t seed = 12345;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < LOOKUPS; ++i) {
+            seed = seed * 1103515245 + 12345;
+            // squaring the uniform value skews lookups toward the first publishers
+            double r = (seed >> 8) / double(1 << 24);
+            auto handle = cache.acquire(names[static_cast<int>(r * r * publishers)].c_str());
+            ASSERT_TRUE(handle);
+        }
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+        auto& stats = AgentStatistics::instance();
+        cout << "[ BENCH    ] " << publishers << " publishers: " << LOOKUPS << " lookups in "
+            << elapsed << "us, hits=" << stats.get(AgentStatistics::PublisherCacheHits)
+            << " misses=" << stats.get(AgentStatistics::PublisherCacheMisses)
+            << " evictions=" << stats.get(AgentStatistics::PublisherCacheEvictions) << endl;
+        EXPECT_LE(cache.size(), PublisherMetadataCache::DEFAULT_CAPACITY);
+    }
+}
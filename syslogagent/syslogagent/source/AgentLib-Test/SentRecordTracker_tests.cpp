@@ -0,0 +1,116 @@
+#include "pch.h"
+#include "../AgentLib/SentRecordTracker.h"
+
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+TEST(SentRecordTrackerTest, KnowsWhatWasSent) {
+    SentRecordTracker tracker;
+    EXPECT_TRUE(tracker.empty());
+    EXPECT_FALSE(tracker.alreadySent(1));
+    for (uint64_t id = 1000; id <= 1100; ++id) {
+        tracker.markSent(id);
+    }
+    EXPECT_EQ(tracker.highWaterMark(), 1100u);
+    EXPECT_TRUE(tracker.alreadySent(1000));
+    EXPECT_TRUE(tracker.alreadySent(1050));
+    EXPECT_TRUE(tracker.alreadySent(1100));
+    EXPECT_FALSE(tracker.alreadySent(999));
+    EXPECT_FALSE(tracker.alreadySent(1101));
+}
+
+TEST(SentRecordTrackerTest, GapsAreNotSent) {
+    SentRecordTracker tracker;
+    tracker.markSent(100);
+    tracker.markSent(102);
+    tracker.markSent(105);
+    EXPECT_TRUE(tracker.alreadySent(100));
+    EXPECT_FALSE(tracker.alreadySent(101));
+    EXPECT_TRUE(tracker.alreadySent(102));
+    EXPECT_FALSE(tracker.alreadySent(103));
+    EXPECT_FALSE(tracker.alreadySent(104));
+    EXPECT_TRUE(tracker.alreadySent(105));
+    // late, but inside the window
+    tracker.markSent(103);
+    EXPECT_TRUE(tracker.alreadySent(103));
+    EXPECT_EQ(tracker.highWaterMark(), 105u);
+}
+
+TEST(SentRecordTrackerTest, OnlyTheWindowIsKnown) {
+    SentRecordTracker tracker;
+    for (uint64_t id = 1; id <= 3000; ++id) {
+        tracker.markSent(id);
+    }
+    EXPECT_TRUE(tracker.alreadySent(3000 - SentRecordTracker::WINDOW + 1));
+    EXPECT_FALSE(tracker.alreadySent(3000 - SentRecordTracker::WINDOW));
+    EXPECT_FALSE(tracker.alreadySent(1));
+}
+
+TEST(SentRecordTrackerTest, MatchesAReferenceSetAcrossShifts) {
+    SentRecordTracker tracker;
+    set<uint64_t> sent;
+    mt19937_64 random(45);
+    uint64_t id = 1;
+    for (int i = 0; i < 20000; ++i) {
+        // mostly in order, with gaps of every size and some late arrivals
+        switch (random() % 8) {
+        case 0:
+            id += 1 + random() % 200;
+            break;
+        case 1:
+            id += 63 + random() % 3;
+            break;
+        default:
+            id += 1;
+            break;
+        }
+        uint64_t marked = id;
+        if (random() % 10 == 0 && id > 600) {
+            marked = id - random() % 500;
+        }
+        tracker.markSent(marked);
+        sent.insert(marked);
+    }
+    uint64_t high = *sent.rbegin();
+    ASSERT_EQ(tracker.highWaterMark(), high);
+    for (uint64_t check = high - SentRecordTracker::WINDOW + 1; check <= high + 5; ++check) {
+        ASSERT_EQ(tracker.alreadySent(check), sent.count(check) == 1) << check;
+    }
+}
+
+TEST(SentRecordTrackerTest, SurvivesARestart) {
+    SentRecordTracker tracker;
+    for (uint64_t id = 500; id < 700; id += 3) {
+        tracker.markSent(id);
+    }
+    vector<unsigned char> state(SentRecordTracker::STATE_SIZE);
+    EXPECT_EQ(tracker.serialize(state.data(), state.size() - 1), 0u);
+    ASSERT_EQ(tracker.serialize(state.data(), state.size()), SentRecordTracker::STATE_SIZE);
+
+    SentRecordTracker restored;
+    ASSERT_TRUE(restored.deserialize(state.data(), state.size()));
+    EXPECT_EQ(restored.highWaterMark(), tracker.highWaterMark());
+    for (uint64_t id = 400; id < 800; ++id) {
+        ASSERT_EQ(restored.alreadySent(id), tracker.alreadySent(id)) << id;
+    }
+
+    EXPECT_FALSE(restored.deserialize(state.data(), state.size() - 1));
+    EXPECT_TRUE(restored.empty());
+    EXPECT_FALSE(restored.alreadySent(500));
+}
+
+TEST(SentRecordTrackerTest, ClearedLogStartsOver) {
+    SentRecordTracker tracker;
+    for (uint64_t id = 5000; id <= 5100; ++id) {
+        tracker.markSent(id);
+    }
+    tracker.markSent(1);
+    EXPECT_EQ(tracker.highWaterMark(), 1u);
+    EXPECT_TRUE(tracker.alreadySent(1));
+    EXPECT_FALSE(tracker.alreadySent(2));
+    EXPECT_FALSE(tracker.alreadySent(5050));
+}
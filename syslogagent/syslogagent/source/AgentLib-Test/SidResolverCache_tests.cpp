@@ -0,0 +1,260 @@
+#include "pch.h"
+#include "../AgentLib/SidResolverCache.h"
+#include "../AgentLib/AgentStatistics.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    // Resolves from a table, optionally taking a while about it, and counts
+    // how often it's asked.
+    class FakeSidResolver : public ISidResolver {
+    public:
+        static constexpr uint32_t NONE_MAPPED = 1332;
+        static constexpr uint32_t DC_UNREACHABLE = 1722;
+
+        bool resolve(const string& sid, string& account_out, uint32_t& error_out) override {
+            ++resolve_calls;
+            if (delay_ms > 0) {
+                this_thread::sleep_for(chrono::milliseconds(delay_ms));
+            }
+            lock_guard<mutex> lock(table_mutex);
+            if (unreachable) {
+                error_out = DC_UNREACHABLE;
+                return false;
+            }
+            auto found = accounts.find(sid);
+            if (found == accounts.end()) {
+                error_out = NONE_MAPPED;
+                return false;
+            }
+            account_out = found->second;
+            error_out = 0;
+            return true;
+        }
+
+        bool isUnmappedError(uint32_t error) const override {
+            return error == NONE_MAPPED;
+        }
+
+        void set(const string& sid, const string& account) {
+            lock_guard<mutex> lock(table_mutex);
+            accounts[sid] = account;
+        }
+
+        map<string, string> accounts;
+        bool unreachable = false;
+        int delay_ms = 0;
+        atomic<int> resolve_calls{ 0 };
+        mutex table_mutex;
+    };
+
+    string lookup(SidResolverCache& cache, const string& sid) {
+        char account[SidResolverCache::MAX_ACCOUNT_LENGTH];
+        size_t length = cache.lookup(sid, account, sizeof(account));
+        EXPECT_EQ(length, strlen(account));
+        return account;
+    }
+}
+
+class SidResolverCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AgentStatistics::instance().reset();
+        resolver_ = make_shared<FakeSidResolver>();
+        resolver_->set("S-1-5-18", "NT AUTHORITY\\SYSTEM");
+        resolver_->set("S-1-5-21-1004336348-1177238915-682003330-500", "CORP\\Administrator");
+    }
+
+    shared_ptr<FakeSidResolver> resolver_;
+    int64_t now_ = 1000000;
+    SidResolverCache::Clock clock_ = [this]() { return now_; };
+};
+
+TEST_F(SidResolverCacheTest, MissReturnsNothingThenResolvesInBackground) {
+    SidResolverCache cache(resolver_, 64, 60000, 10000, clock_);
+    EXPECT_EQ(lookup(cache, "S-1-5-18"), "");
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(lookup(cache, "S-1-5-18"), "NT AUTHORITY\\SYSTEM");
+    EXPECT_EQ(lookup(cache, "S-1-5-18"), "NT AUTHORITY\\SYSTEM");
+    EXPECT_EQ(resolver_->resolve_calls, 1);
+
+    auto& stats = AgentStatistics::instance();
+    EXPECT_EQ(stats.get(AgentStatistics::SidCacheMisses), 1u);
+    EXPECT_EQ(stats.get(AgentStatistics::SidCacheHits), 2u);
+    EXPECT_EQ(stats.get(AgentStatistics::SidCacheResolved), 1u);
+}
+
+TEST_F(SidResolverCacheTest, RejectsThingsThatAreNotSids) {
+    SidResolverCache cache(resolver_, 64, 60000, 10000, clock_);
+    EXPECT_EQ(lookup(cache, ""), "");
+    EXPECT_EQ(lookup(cache, "SYSTEM"), "");
+    EXPECT_EQ(lookup(cache, "S-" + string(SidResolverCache::MAX_SID_LENGTH, '1')), "");
+    EXPECT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(resolver_->resolve_calls, 0);
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST_F(SidResolverCacheTest, UnmappedSidsAreNegativelyCached) {
+    SidResolverCache cache(resolver_, 64, 60000, 10000, clock_);
+    const string deleted_user = "S-1-5-21-1004336348-1177238915-682003330-1117";
+    EXPECT_EQ(lookup(cache, deleted_user), "");
+    ASSERT_TRUE(cache.waitIdle(5000));
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(lookup(cache, deleted_user), "");
+    }
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(resolver_->resolve_calls, 1);
+
+    // retried once the negative entry expires
+    resolver_->set(deleted_user, "CORP\\restored");
+    now_ += 10001;
+    EXPECT_EQ(lookup(cache, deleted_user), "");
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(lookup(cache, deleted_user), "CORP\\restored");
+    EXPECT_EQ(resolver_->resolve_calls, 2);
+}
+
+TEST_F(SidResolverCacheTest, ExpiredNamesAreServedWhileTheyRefresh) {
+    SidResolverCache cache(resolver_, 64, 60000, 10000, clock_);
+    const string admin = "S-1-5-21-1004336348-1177238915-682003330-500";
+    lookup(cache, admin);
+    ASSERT_TRUE(cache.waitIdle(5000));
+    resolver_->set(admin, "CORP\\renamed-admin");
+    resolver_->delay_ms = 200;      // long enough for the second lookup to beat it
+
+    now_ += 60001;
+    // the old name, and only one refresh however many events ask
+    EXPECT_EQ(lookup(cache, admin), "CORP\\Administrator");
+    EXPECT_EQ(lookup(cache, admin), "CORP\\Administrator");
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(resolver_->resolve_calls, 2);
+    EXPECT_EQ(lookup(cache, admin), "CORP\\renamed-admin");
+}
+
+TEST_F(SidResolverCacheTest, TransientFailuresKeepTheOldNameAndRetrySooner) {
+    SidResolverCache cache(resolver_, 64, 60000, 10000, clock_);
+    lookup(cache, "S-1-5-18");
+    ASSERT_TRUE(cache.waitIdle(5000));
+
+    resolver_->unreachable = true;
+    now_ += 60001;
+    lookup(cache, "S-1-5-18");
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(lookup(cache, "S-1-5-18"), "NT AUTHORITY\\SYSTEM");
+    EXPECT_EQ(resolver_->resolve_calls, 2);
+
+    resolver_->unreachable = false;
+    now_ += SidResolverCache::TRANSIENT_ERROR_TTL_MS + 1;
+    lookup(cache, "S-1-5-18");
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(resolver_->resolve_calls, 3);
+    EXPECT_EQ(AgentStatistics::instance().get(AgentStatistics::SidCacheFailures), 1u);
+}
+
+TEST_F(SidResolverCacheTest, BoundedByCapacity) {
+    SidResolverCache cache(resolver_, 32, 60000, 10000, clock_);
+    for (int i = 0; i < 500; ++i) {
+        lookup(cache, "S-1-5-21-1-2-3-" + to_string(i));
+    }
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_LE(cache.size(), cache.capacity());
+    EXPECT_GE(cache.capacity(), 32u);
+}
+
+TEST_F(SidResolverCacheTest, ConcurrentMissesResolveOnce) {
+    resolver_->delay_ms = 50;
+    SidResolverCache cache(resolver_, 64, 60000, 10000, clock_);
+    vector<thread> threads;
+    atomic<int> resolved_lookups{ 0 };
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 1000; ++i) {
+                if (!lookup(cache, "S-1-5-18").empty()) {
+                    ++resolved_lookups;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_TRUE(cache.waitIdle(5000));
+    EXPECT_EQ(resolver_->resolve_calls, 1);
+    EXPECT_EQ(lookup(cache, "S-1-5-18"), "NT AUTHORITY\\SYSTEM");
+}
+
+TEST_F(SidResolverCacheTest, StopDropsWhatIsQueued) {
+    resolver_->delay_ms = 20;
+    SidResolverCache cache(resolver_, 64, 60000, 10000, clock_, 1);
+    for (int i = 0; i < 50; ++i) {
+        lookup(cache, "S-1-5-21-9-9-9-" + to_string(i));
+    }
+    cache.stop();
+    EXPECT_LT(resolver_->resolve_calls, 50);
+    EXPECT_EQ(lookup(cache, "S-1-5-21-9-9-9-0"), "");
+}
+
+// Not a pass/fail test: events per second through lookup() with a resolver
+// that takes 5ms per call, against resolving synchronously per event.
+TEST(SidResolverCacheBenchmark, CachedAgainstSynchronous) {
+    auto resolver = make_shared<FakeSidResolver>();
+    resolver->delay_ms = 5;
+    const int SID_COUNT = 200;
+    vector<string> sids;
+    for (int i = 0; i < SID_COUNT; ++i) {
+        sids.push_back("S-1-5-21-1004336348-1177238915-682003330-" + to_string(1000 + i));
+        resolver->set(sids.back(), "CORP\\user" + to_string(i));
+    }
+
+    const int SYNC_EVENTS = 200;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < SYNC_EVENTS; ++i) {
+        string account;
+        uint32_t error;
+        resolver->resolve(sids[i % SID_COUNT], account, error);
+    }
+    auto sync_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    SidResolverCache cache(resolver);
+    resolver->resolve_calls = 0;
+    const int THREADS = 4;
+    const int EVENTS_PER_THREAD = 250000;
+    atomic<uint64_t> named{ 0 };
+    start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            char account[SidResolverCache::MAX_ACCOUNT_LENGTH];
+            uint64_t local_named = 0;
+            for (int i = 0; i < EVENTS_PER_THREAD; ++i) {
+                if (cache.lookup(sids[(i * 7 + t) % SID_COUNT], account, sizeof(account)) > 0) {
+                    ++local_named;
+                }
+            }
+            named += local_named;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto cached_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    int total = THREADS * EVENTS_PER_THREAD;
+    cout << "[ BENCH    ] synchronous: " << SYNC_EVENTS << " events in " << sync_us << "us ("
+        << (SYNC_EVENTS * 1000000LL / (sync_us + 1)) << "/s)" << endl;
+    cout << "[ BENCH    ] cached, " << THREADS << " threads: " << total << " events in " << cached_us << "us ("
+        << (total * 1000000LL / (cached_us + 1)) << "/s), " << named << " with the name, "
+        << resolver->resolve_calls << " resolver calls" << endl;
+    EXPECT_GT(named, 0u);
+}
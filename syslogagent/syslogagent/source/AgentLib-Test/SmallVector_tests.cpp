@@ -0,0 +1,54 @@
+#include "pch.h"
+#include "../AgentLib/SmallVector.h"
+
+#include <string>
+#include <string_view>
+
+using namespace Syslog_agent;
+using namespace std;
+
+TEST(SmallVectorTest, StaysInlineUpToCapacity) {
+    SmallVector<int, 4> values;
+    EXPECT_TRUE(values.empty());
+    for (int i = 0; i < 4; ++i) {
+        values.push_back(i * 10);
+    }
+    EXPECT_TRUE(values.isInline());
+    EXPECT_EQ(values.size(), 4u);
+    EXPECT_EQ(values[3], 30);
+}
+
+TEST(SmallVectorTest, SpillsWithoutLimitAndKeepsOrder) {
+    SmallVector<int, 4> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(i);
+    }
+    EXPECT_FALSE(values.isInline());
+    ASSERT_EQ(values.size(), 1000u);
+    int expected = 0;
+    for (int value : values) {
+        EXPECT_EQ(value, expected++);
+    }
+
+    values.clear();
+    EXPECT_TRUE(values.isInline());
+    values.push_back(7);
+    EXPECT_EQ(values[0], 7);
+}
+
+TEST(SmallVectorTest, CopiesAreIndependent) {
+    string backing = "SubjectUserName";
+    SmallVector<string_view, 2> original;
+    original.push_back(backing);
+    auto inline_copy = original;
+    original.push_back("a");
+    original.push_back("b");
+    auto heap_copy = original;
+    original.clear();
+
+    ASSERT_EQ(inline_copy.size(), 1u);
+    EXPECT_EQ(inline_copy[0], "SubjectUserName");
+    EXPECT_EQ(inline_copy[0].data(), backing.data());
+    ASSERT_EQ(heap_copy.size(), 3u);
+    EXPECT_EQ(heap_copy[2], "b");
+}
@@ -0,0 +1,183 @@
+#include "pch.h"
+#include "../AgentLib/TemplateMiner.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Syslog_agent;
+using namespace std;
+
+namespace {
+    string expanded(const string& template_text, const TemplateMiner::Match& match) {
+        return TemplateMiner::expand(template_text, match.params.data(), match.params.size());
+    }
+
+    string logonMessage(const string& account, const string& domain, int logon_type, const string& address) {
+        return "An account was successfully logged on.\r\n\r\nSubject:\r\n\tSecurity ID:\t\tS-1-5-18\r\n"
+            "\tAccount Name:\t\tDC01$\r\n\tAccount Domain:\t\t" + domain + "\r\n\r\nLogon Information:\r\n"
+            "\tLogon Type:\t\t" + to_string(logon_type) + "\r\n\r\nNew Logon:\r\n\tAccount Name:\t\t" + account
+            + "\r\n\r\nNetwork Information:\r\n\tSource Network Address:\t" + address + "\r\n";
+    }
+}
+
+class TemplateMinerTest : public ::testing::Test {
+protected:
+    int64_t now_ = 0;
+    TemplateMiner::Clock clock_ = [this]() { return now_; };
+};
+
+TEST_F(TemplateMinerTest, RepeatsShareATemplateAnnouncedOnce) {
+    TemplateMiner miner(64, TemplateMiner::DEFAULT_SIMILARITY, 60000, clock_);
+    TemplateMiner::Match first;
+    ASSERT_TRUE(miner.mine("The Windows Update service entered the running state.", first));
+    EXPECT_TRUE(first.announce);
+    EXPECT_EQ(first.template_text, "The Windows Update service entered the running state.");
+    EXPECT_EQ(first.params.size(), 0u);
+
+    TemplateMiner::Match second;
+    ASSERT_TRUE(miner.mine("The Windows Update service entered the running state.", second));
+    EXPECT_EQ(second.template_id, first.template_id);
+    EXPECT_FALSE(second.announce);
+    EXPECT_TRUE(second.template_text.empty());
+    EXPECT_EQ(miner.templateCount(), 1u);
+}
+
+TEST_F(TemplateMinerTest, DifferingWordsBecomeParameters) {
+    TemplateMiner miner(64, TemplateMiner::DEFAULT_SIMILARITY, 60000, clock_);
+    TemplateMiner::Match match;
+    ASSERT_TRUE(miner.mine(logonMessage("alice", "CORP", 3, "10.0.0.5"), match));
+    auto first_id = match.template_id;
+
+    string message = logonMessage("bob", "LAB", 10, "192.168.1.20");
+    ASSERT_TRUE(miner.mine(message, match));
+    // widened, so a new ID, sent with its text
+    EXPECT_NE(match.template_id, first_id);
+    ASSERT_TRUE(match.announce);
+    EXPECT_NE(match.template_text.find("Account Domain:\t\t<*>\r\n"), string::npos);
+    ASSERT_EQ(match.params.size(), 4u);
+    EXPECT_EQ(match.params[0], "LAB");
+    EXPECT_EQ(match.params[3], "192.168.1.20");
+    EXPECT_EQ(expanded(match.template_text, match), message);
+
+    string template_text = match.template_text;
+    message = logonMessage("carol", "CORP", 2, "-");
+    ASSERT_TRUE(miner.mine(message, match));
+    EXPECT_FALSE(match.announce);
+    EXPECT_EQ(expanded(template_text, match), message);
+    EXPECT_EQ(miner.templateCount(), 1u);
+}
+
+TEST_F(TemplateMinerTest, DissimilarMessagesGetTheirOwnTemplates) {
+    TemplateMiner miner(64, TemplateMiner::DEFAULT_SIMILARITY, 60000, clock_);
+    TemplateMiner::Match first;
+    TemplateMiner::Match second;
+    ASSERT_TRUE(miner.mine("The Print Spooler service entered the stopped state.", first));
+    ASSERT_TRUE(miner.mine("The Print Spooler driver failed to load its configuration.", second));
+    EXPECT_NE(first.template_id, second.template_id);
+    EXPECT_TRUE(second.announce);
+
+    // same words, different whitespace
+    ASSERT_TRUE(miner.mine("The Print Spooler service entered the stopped  state.", second));
+    EXPECT_NE(first.template_id, second.template_id);
+    EXPECT_EQ(miner.templateCount(), 3u);
+}
+
+TEST_F(TemplateMinerTest, VariableLeadingWordsShareABranch) {
+    TemplateMiner miner(64, TemplateMiner::DEFAULT_SIMILARITY, 60000, clock_);
+    TemplateMiner::Match match;
+    ASSERT_TRUE(miner.mine("4096 bytes were written to disk by the writer", match));
+    auto first_id = match.template_id;
+    ASSERT_TRUE(miner.mine("8192 bytes were written to disk by the writer", match));
+    ASSERT_TRUE(miner.mine("65536 bytes were written to disk by the writer", match));
+    EXPECT_NE(match.template_id, first_id);
+    EXPECT_FALSE(match.announce);
+    ASSERT_EQ(match.params.size(), 1u);
+    EXPECT_EQ(match.params[0], "65536");
+    EXPECT_EQ(miner.templateCount(), 1u);
+}
+
+TEST_F(TemplateMinerTest, ReannouncedAfterTheInterval) {
+    TemplateMiner miner(64, TemplateMiner::DEFAULT_SIMILARITY, 60000, clock_);
+    TemplateMiner::Match match;
+    ASSERT_TRUE(miner.mine("Service started", match));
+    ASSERT_TRUE(miner.mine("Service started", match));
+    EXPECT_FALSE(match.announce);
+    now_ += 60000;
+    ASSERT_TRUE(miner.mine("Service started", match));
+    EXPECT_TRUE(match.announce);
+    EXPECT_EQ(match.template_text, "Service started");
+}
+
+TEST_F(TemplateMinerTest, WhatCannotBeMined) {
+    TemplateMiner miner(2, TemplateMiner::DEFAULT_SIMILARITY, 60000, clock_);
+    TemplateMiner::Match match;
+    EXPECT_FALSE(miner.mine("", match));
+    EXPECT_FALSE(miner.mine("value was <*> here", match));
+    EXPECT_FALSE(miner.mine("x<*>y", match));
+    EXPECT_TRUE(miner.mine("one two three", match));
+    EXPECT_TRUE(miner.mine("four five", match));
+    // full
+    EXPECT_FALSE(miner.mine("six seven eight nine", match));
+    EXPECT_TRUE(miner.mine("one two four", match));
+    EXPECT_EQ(miner.templateCount(), 2u);
+}
+
+// Not a pass/fail test: bytes sent for the message field and mining time
+// per event over a mix of typical Security and System messages.
+TEST(TemplateMinerBenchmark, CompressionAndCpu) {
+    vector<string> corpus;
+    const char* accounts[] = { "alice", "bob", "carol", "dave", "svc_backup", "SYSTEM" };
+    const char* services[] = { "Windows Update", "Print Spooler", "Background Intelligent Transfer Service",
+        "Windows Defender Antivirus Service", "WinHTTP Web Proxy Auto-Discovery Service" };
+    for (int i = 0; i < 20000; ++i) {
+        switch (i % 4) {
+        case 0:
+        case 1:
+            corpus.push_back(logonMessage(accounts[i % 6], i % 3 ? "CORP" : "LAB", i % 5 == 0 ? 10 : 3,
+                "10.20." + to_string(i % 250) + "." + to_string(i % 199)));
+            break;
+        case 2:
+            corpus.push_back(string("The ") + services[i % 5] + " service entered the "
+                + (i % 8 < 4 ? "running" : "stopped") + " state.");
+            break;
+        default:
+            corpus.push_back("A new process has been created.\r\n\r\nCreator Subject:\r\n\tAccount Name:\t\t"
+                + string(accounts[i % 6]) + "\r\n\tLogon ID:\t\t0x" + to_string(100000 + i)
+                + "\r\n\r\nProcess Information:\r\n\tNew Process ID:\t\t0x" + to_string(4000 + i % 977)
+                + "\r\n\tNew Process Name:\tC:\\Windows\\System32\\svchost.exe\r\n\tToken Elevation Type:\t%%1936\r\n");
+            break;
+        }
+    }
+
+    TemplateMiner miner;
+    TemplateMiner::Match match;
+    size_t message_bytes = 0;
+    size_t mined_bytes = 0;
+    size_t announcements = 0;
+    auto start = chrono::steady_clock::now();
+    for (const auto& message : corpus) {
+        message_bytes += message.size();
+        if (!miner.mine(message, match)) {
+            mined_bytes += message.size();
+            continue;
+        }
+        // "template_id":"n", "template_params":["...", ...]
+        mined_bytes += 40;
+        for (const auto& param : match.params) {
+            mined_bytes += param.size() + 3;
+        }
+        if (match.announce) {
+            ++announcements;
+            mined_bytes += match.template_text.size() + 16;
+        }
+    }
+    auto elapsed_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    cout << "[ BENCH    ] " << corpus.size() << " messages, " << miner.templateCount() << " templates, "
+        << announcements << " announcements" << endl;
+    cout << "[ BENCH    ] message bytes " << message_bytes << " -> " << mined_bytes << " ("
+        << static_cast<double>(message_bytes) / mined_bytes << "x), "
+        << elapsed_ns / static_cast<long long>(corpus.size()) << "ns per event" << endl;
+    EXPECT_LT(mined_bytes, message_bytes / 2);
+}
@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "../Infrastructure/Utf8Transcoder.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string transcode(const u16string& text, size_t output_size, size_t* needed = nullptr) {
+        vector<char> output(output_size + 1, 'x');
+        size_t result = Utf8Transcoder::utf16ToUtf8(text.data(), text.size(), output.data(), output_size);
+        if (needed != nullptr) {
+            *needed = result;
+        }
+        return string(output.data());
+    }
+
+    u16string asUtf16(const string& ascii) {
+        return u16string(ascii.begin(), ascii.end());
+    }
+}
+
+TEST(Utf8TranscoderTest, EncodesEveryLength) {
+    u16string text = u"A\u00e9\u20ac\U0001F600z";
+    size_t needed;
+    EXPECT_EQ(transcode(text, 64, &needed), "A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80z");
+    EXPECT_EQ(needed, 11u);
+    EXPECT_EQ(Utf8Transcoder::utf8Length(text.data(), text.size()), 11u);
+    EXPECT_LE(needed, Utf8Transcoder::maxUtf8Length(text.size()));
+}
+
+TEST(Utf8TranscoderTest, UnpairedSurrogatesAreReplaced) {
+    u16string text;
+    text += u'a';
+    text += char16_t(0xD800);
+    text += u'b';
+    text += char16_t(0xDC00);
+    text += char16_t(0xD83D);     // high surrogate at the very end
+    EXPECT_EQ(transcode(text, 64), "a\xEF\xBF\xBD" "b\xEF\xBF\xBD\xEF\xBF\xBD");
+}
+
+TEST(Utf8TranscoderTest, TruncatesOnCharacterBoundaryAndReportsNeeded) {
+    u16string text = u"ab\u20accd";        // 2 + 3 + 2 bytes
+    size_t needed;
+    EXPECT_EQ(transcode(text, 4, &needed), "ab");       // euro sign doesn't fit in 3 bytes
+    EXPECT_EQ(needed, 7u);
+    EXPECT_EQ(transcode(text, 6, &needed), "ab\xE2\x82\xAC" "");
+    EXPECT_EQ(transcode(text, 8, &needed), "ab\xE2\x82\xAC" "cd");
+    EXPECT_EQ(needed, 7u);
+    EXPECT_EQ(Utf8Transcoder::utf16ToUtf8(text.data(), text.size(), nullptr, 0), 7u);
+
+    // the SIMD path must also stop exactly at the end of the output
+    u16string ascii = asUtf16(string(100, 'q'));
+    EXPECT_EQ(transcode(ascii, 40, &needed), string(39, 'q'));
+    EXPECT_EQ(needed, 100u);
+}
+
+TEST(Utf8TranscoderTest, NullTerminatedInput) {
+    char output[16];
+    EXPECT_EQ(Utf8Transcoder::utf16ToUtf8(u"Security", output, sizeof(output)), 8u);
+    EXPECT_STREQ(output, "Security");
+}
+
+TEST(Utf8TranscoderTest, MatchesScalarReferenceOnRandomText) {
+    mt19937 random(12345);
+    // mostly ASCII with non-ASCII sprinkled in at every offset within a SIMD block
+    const char16_t alphabet[] = { u'a', u'<', u'"', u'\n', 0x7F, 0x80, 0xE9, 0x7FF, 0x800, 0x4E2D,
+        0xFFFF, 0xD83D, 0xDE00, 0xDBFF, 0xDC00 };
+    for (int round = 0; round < 2000; ++round) {
+        u16string text;
+        size_t length = random() % 80;
+        for (size_t i = 0; i < length; ++i) {
+            text += (random() % 4 == 0) ? alphabet[random() % size(alphabet)] : char16_t(u'A' + random() % 26);
+        }
+        size_t output_size = random() % 250;
+        vector<char> simd(output_size + 1, 'x');
+        vector<char> scalar(output_size + 1, 'x');
+        size_t simd_needed = Utf8Transcoder::utf16ToUtf8(text.data(), text.size(), simd.data(), output_size);
+        size_t scalar_needed = Utf8Transcoder::utf16ToUtf8Scalar(text.data(), text.size(), scalar.data(), output_size);
+        ASSERT_EQ(simd_needed, scalar_needed);
+        ASSERT_EQ(simd_needed, Utf8Transcoder::utf8Length(text.data(), text.size()));
+        if (output_size > 0) {
+            ASSERT_STREQ(simd.data(), scalar.data());
+        }
+    }
+}
+
+// Not a pass/fail test: SIMD transcoding against the scalar reference and
+// against the two-call size-then-convert pattern, on typical event text.
+TEST(Utf8TranscoderBenchmark, AgainstScalar) {
+    string xml_ascii = "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+        "<Provider Name='Microsoft-Windows-Security-Auditing' Guid='{54849625-5478-4994-a5ba-3e3b0328c30d}'/>"
+        "<EventID>4624</EventID><Version>2</Version><Level>0</Level><Task>12544</Task>"
+        "<TimeCreated SystemTime='2024-03-11T14:22:07.4410519Z'/><EventRecordID>1184402</EventRecordID>"
+        "<Channel>Security</Channel><Computer>dc01.corp.example.com</Computer></System><EventData>"
+        "<Data Name='SubjectUserSid'>S-1-5-18</Data><Data Name='TargetUserName'>administrator</Data>"
+        "<Data Name='IpAddress'>10.20.4.117</Data></EventData></Event>";
+    vector<pair<string, u16string>> inputs = {
+        { "event XML (ASCII)", asUtf16(xml_ascii) },
+        { "German message", u"Der Dienst \"Windows Update\" wurde erfolgreich gestartet. Übergeordneter Prozess: "
+            u"C:\\Windows\\System32\\services.exe, Benutzer: NT-AUTORITÄT\\SYSTEM, Größe 4096." },
+        { "Chinese message", u"服务控制管理器: Windows Update 服务处于 正在运行 状态。事件记录 安全 审核 成功。" },
+    };
+    const int ROUNDS = 200000;
+    vector<char> output(8192);
+    for (const auto& input : inputs) {
+        const u16string& text = input.second;
+        size_t total = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; ++i) {
+            total += Utf8Transcoder::utf16ToUtf8(text.data(), text.size(), output.data(), output.size());
+        }
+        auto simd_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; ++i) {
+            total -= Utf8Transcoder::utf16ToUtf8Scalar(text.data(), text.size(), output.data(), output.size());
+        }
+        auto scalar_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < ROUNDS; ++i) {
+            size_t needed = Utf8Transcoder::utf8Length(text.data(), text.size());
+            total += Utf8Transcoder::utf16ToUtf8Scalar(text.data(), text.size(), output.data(), needed + 1);
+        }
+        auto two_pass_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+        cout << "[ BENCH    ] " << input.first << ", " << text.size() << " units x " << ROUNDS << ": simd "
+            << simd_us << "us, scalar " << scalar_us << "us, scalar two-pass " << two_pass_us << "us" << endl;
+        EXPECT_GT(total, 0u);
+    }
+}
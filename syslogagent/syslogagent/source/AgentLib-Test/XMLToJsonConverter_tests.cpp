@@ -0,0 +1,181 @@
+#include "pch.h"
+#include "../Infrastructure/XMLToJsonConverter.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // Events as EvtRender(EvtRenderEventXml) produces them, captured from a
+    // Windows Server 2019 host
+    const char* LOGON_FAILURE_XML =
+        "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+        "<Provider Name='Microsoft-Windows-Security-Auditing' Guid='{54849625-5478-4994-a5ba-3e3b0328c30d}'/>"
+        "<EventID>4625</EventID><Version>0</Version><Level>0</Level><Task>12544</Task><Opcode>0</Opcode>"
+        "<Keywords>0x8010000000000000</Keywords><TimeCreated SystemTime='2024-03-11T14:22:07.4410519Z'/>"
+        "<EventRecordID>1184402</EventRecordID><Correlation ActivityID='{1f2e6a0c-73b5-0001-a26b-2e1fb573da01}'/>"
+        "<Execution ProcessID='724' ThreadID='6412'/><Channel>Security</Channel>"
+        "<Computer>dc01.corp.example.com</Computer><Security/></System><EventData>"
+        "<Data Name='SubjectUserSid'>S-1-5-18</Data><Data Name='SubjectUserName'>DC01$</Data>"
+        "<Data Name='SubjectDomainName'>CORP</Data><Data Name='SubjectLogonId'>0x3e7</Data>"
+        "<Data Name='TargetUserSid'>S-1-0-0</Data><Data Name='TargetUserName'>administrator</Data>"
+        "<Data Name='TargetDomainName'>CORP</Data><Data Name='Status'>0xc000006d</Data>"
+        "<Data Name='FailureReason'>%%2313</Data><Data Name='SubStatus'>0xc000006a</Data>"
+        "<Data Name='LogonType'>3</Data><Data Name='LogonProcessName'>NtLmSsp </Data>"
+        "<Data Name='AuthenticationPackageName'>NTLM</Data><Data Name='WorkstationName'>WS-0142</Data>"
+        "<Data Name='TransmittedServices'>-</Data><Data Name='LmPackageName'>-</Data>"
+        "<Data Name='KeyLength'>0</Data><Data Name='ProcessId'>0x0</Data><Data Name='ProcessName'>-</Data>"
+        "<Data Name='IpAddress'>10.20.4.117</Data><Data Name='IpPort'>51122</Data></EventData></Event>";
+
+    const char* SERVICE_STATE_XML =
+        "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+        "<Provider Name='Service Control Manager' Guid='{555908d1-a6d7-4695-8e1e-26931d2012f4}' "
+        "EventSourceName='Service Control Manager'/><EventID Qualifiers='16384'>7036</EventID>"
+        "<Version>0</Version><Level>4</Level><Task>0</Task><Opcode>0</Opcode><Keywords>0x8080000000000000</Keywords>"
+        "<TimeCreated SystemTime='2024-03-11T14:22:09.1201833Z'/><EventRecordID>88214</EventRecordID>"
+        "<Correlation/><Execution ProcessID='668' ThreadID='7940'/><Channel>System</Channel>"
+        "<Computer>dc01.corp.example.com</Computer><Security/></System><EventData>"
+        "<Data Name='param1'>Windows Update</Data><Data Name='param2'>running</Data>"
+        "<Binary>770075006100750073006500720076002F0034000000</Binary></EventData></Event>";
+
+    const char* APPLICATION_XML =
+        "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+        "<Provider Name='Application Error'/><EventID Qualifiers='0'>1000</EventID><Version>0</Version>"
+        "<Level>2</Level><Task>100</Task><Opcode>0</Opcode><Keywords>0x80000000000000</Keywords>"
+        "<TimeCreated SystemTime='2024-03-11T14:23:41.0066251Z'/><EventRecordID>41207</EventRecordID>"
+        "<Correlation/><Execution ProcessID='0' ThreadID='0'/><Channel>Application</Channel>"
+        "<Computer>ws-0142.corp.example.com</Computer><Security/></System><EventData>"
+        "<Data>report.exe</Data><Data>10.2.1.0</Data><Data>65e0c1a8</Data><Data>ucrtbase.dll</Data>"
+        "<Data>10.0.17763.2989</Data><Data>b3b4e8d5</Data><Data>c0000409</Data><Data>000000000006e06e</Data>"
+        "<Data>1a3c</Data><Data>01da73bc6ab1c4f2</Data><Data>C:\\Program Files\\Report\\report.exe</Data>"
+        "<Data>C:\\Windows\\System32\\ucrtbase.dll</Data><Data>6c1b5d9e-37f1-4c55-9d6a-28e1a45f0b2d</Data>"
+        "<Data></Data><Data></Data></EventData></Event>";
+
+    const char* USERDATA_XML =
+        "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+        "<Provider Name='Microsoft-Windows-Eventlog' Guid='{fc65ddd8-d6ef-4962-83d5-6e5cfe9ce148}'/>"
+        "<EventID>1102</EventID><Version>0</Version><Level>4</Level><Task>104</Task><Opcode>0</Opcode>"
+        "<Keywords>0x4020000000000000</Keywords><TimeCreated SystemTime='2024-03-11T14:30:00.6611120Z'/>"
+        "<EventRecordID>1184411</EventRecordID><Correlation/><Execution ProcessID='1292' ThreadID='5528'/>"
+        "<Channel>Security</Channel><Computer>dc01.corp.example.com</Computer><Security/></System>"
+        "<UserData><LogFileCleared xmlns='http://manifests.microsoft.com/win/2004/08/windows/eventlog'>"
+        "<SubjectUserSid>S-1-5-21-3623811015-3361044348-30300820-1013</SubjectUserSid>"
+        "<SubjectUserName>jsmith</SubjectUserName><SubjectDomainName>CORP</SubjectDomainName>"
+        "<SubjectLogonId>0x1f2a7c</SubjectLogonId></LogFileCleared></UserData>"
+        "<RenderingInfo Culture='en-US'><Message>The audit log was cleared.&#13;&#10;Subject:&#13;&#10;"
+        "&#9;Security ID:&#9;CORP\\jsmith&#13;&#10;&#9;Account Name:&#9;jsmith</Message>"
+        "<Level>Information</Level><Task>Log clear</Task><Opcode>Info</Opcode><Channel>Security</Channel>"
+        "<Provider>Microsoft Windows security auditing.</Provider><Keywords><Keyword>Audit Success</Keyword>"
+        "<Keyword>Classic</Keyword></Keywords></RenderingInfo></Event>";
+
+    string convert(const string& xml) {
+        return XMLToJSONConverter::convert(xml);
+    }
+}
+
+TEST(XMLToJsonConverterTest, SystemFieldsAndNamedData) {
+    string json = convert(SERVICE_STATE_XML);
+    EXPECT_EQ(json,
+        "{\"Event\":{\"xmlns\":\"http://schemas.microsoft.com/win/2004/08/events/event\",\"System\":{"
+        "\"Provider\":{\"Name\":\"Service Control Manager\",\"Guid\":\"{555908d1-a6d7-4695-8e1e-26931d2012f4}\","
+        "\"EventSourceName\":\"Service Control Manager\"},\"EventID\":{\"Qualifiers\":\"16384\",\"#text\":\"7036\"},"
+        "\"Version\":\"0\",\"Level\":\"4\",\"Task\":\"0\",\"Opcode\":\"0\",\"Keywords\":\"0x8080000000000000\","
+        "\"TimeCreated\":{\"SystemTime\":\"2024-03-11T14:22:09.1201833Z\"},\"EventRecordID\":\"88214\","
+        "\"Correlation\":\"\",\"Execution\":{\"ProcessID\":\"668\",\"ThreadID\":\"7940\"},\"Channel\":\"System\","
+        "\"Computer\":\"dc01.corp.example.com\",\"Security\":\"\"},\"EventData\":{"
+        "\"param1\":\"Windows Update\",\"param2\":\"running\","
+        "\"Binary\":\"770075006100750073006500720076002F0034000000\"}}}");
+}
+
+TEST(XMLToJsonConverterTest, RepeatedNamesAreNumbered) {
+    string json = convert(APPLICATION_XML);
+    EXPECT_NE(json.find("\"EventData\":{\"Data\":\"report.exe\",\"Data_2\":\"10.2.1.0\","), string::npos);
+    EXPECT_NE(json.find("\"Data_11\":\"C:\\\\Program Files\\\\Report\\\\report.exe\""), string::npos);
+    EXPECT_NE(json.find("\"Data_14\":\"\",\"Data_15\":\"\"}"), string::npos);
+}
+
+TEST(XMLToJsonConverterTest, UserDataAndRenderingInfo) {
+    string json = convert(USERDATA_XML);
+    EXPECT_NE(json.find("\"UserData\":{\"LogFileCleared\":{\"xmlns\":"
+        "\"http://manifests.microsoft.com/win/2004/08/windows/eventlog\","
+        "\"SubjectUserSid\":\"S-1-5-21-3623811015-3361044348-30300820-1013\""), string::npos);
+    EXPECT_NE(json.find("\"Message\":\"The audit log was cleared.\\r\\nSubject:\\r\\n"
+        "\\tSecurity ID:\\tCORP\\\\jsmith"), string::npos);
+    EXPECT_NE(json.find("\"Keywords\":{\"Keyword\":\"Audit Success\",\"Keyword_2\":\"Classic\"}"), string::npos);
+    // RenderingInfo's Level doesn't clash with System's: different objects
+    EXPECT_NE(json.find("\"Level\":\"Information\""), string::npos);
+    EXPECT_EQ(json.find("Level_2"), string::npos);
+}
+
+TEST(XMLToJsonConverterTest, EntitiesCdataAndMarkup) {
+    EXPECT_EQ(convert("<?xml version=\"1.0\"?>\n<!-- c --><a x=\"1 &lt; 2\">\n"
+        "  <b>&quot;q&quot; &amp; &#x41;&#66;&#233; &unknown;</b>\n"
+        "  <!-- skipped --><c><![CDATA[<raw> & \"]]></c>\n"
+        "  tail\n</a>\n"),
+        "{\"a\":{\"x\":\"1 < 2\",\"b\":\"\\\"q\\\" & AB\xC3\xA9 &unknown;\","
+        "\"c\":\"<raw> & \\\"\",\"#text\":\"\\n  tail\\n\"}}");
+    EXPECT_EQ(convert("<a>caf\xC3\xA9</a>"), "{\"a\":\"caf\xC3\xA9\"}");
+    EXPECT_EQ(convert("<Data Name=\"a&amp;b\">v</Data>"), "{\"a&b\":\"v\"}");
+    // surrogates referred to on their own aren't written as UTF-8
+    EXPECT_EQ(convert("<a>&#xD800;&#56319;&#xDFFF;&#x1F600;</a>"),
+        "{\"a\":\"\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD\xF0\x9F\x98\x80\"}");
+}
+
+TEST(XMLToJsonConverterTest, MalformedOrTooLarge) {
+    EXPECT_EQ(convert(""), "");
+    EXPECT_EQ(convert("<a><b></a>"), "");
+    EXPECT_EQ(convert("<a>text"), "");
+    EXPECT_EQ(convert("<a x=1/>"), "");
+    EXPECT_EQ(convert("<a/><b/>"), "");
+    string deep;
+    for (int i = 0; i < 100; ++i) deep += "<d>";
+    EXPECT_EQ(convert(deep), "");
+
+    char small[32];
+    EXPECT_EQ(XMLToJSONConverter::convert(SERVICE_STATE_XML, strlen(SERVICE_STATE_XML), small, sizeof(small)), 0u);
+    EXPECT_EQ(small[0], '\0');
+    vector<char> exact(convert(SERVICE_STATE_XML).size() + 1);
+    EXPECT_EQ(XMLToJSONConverter::convert(SERVICE_STATE_XML, strlen(SERVICE_STATE_XML), exact.data(), exact.size()),
+        exact.size() - 1);
+}
+
+TEST(XMLToJsonConverterTest, LargeEventSpillsArena) {
+    string xml = "<Event><EventData>";
+    for (int i = 0; i < 500; ++i) {
+        xml += "<Data Name='field" + to_string(i) + "'>" + to_string(i) + "</Data>";
+    }
+    xml += "</EventData></Event>";
+    string json = convert(xml);
+    EXPECT_NE(json.find("\"field0\":\"0\""), string::npos);
+    EXPECT_NE(json.find("\"field499\":\"499\"}}}"), string::npos);
+}
+
+TEST(XMLToJsonConverterTest, EscapeJsonString) {
+    EXPECT_EQ(XMLToJSONConverter::escapeJSONString("a\"b\\c\n\x01 &amp;"), "a\\\"b\\\\c\\n\\u0001 &amp;");
+}
+
+// Not a pass/fail test: converts the captured corpus repeatedly and prints
+// the throughput.
+TEST(XMLToJsonConverterBenchmark, CapturedCorpus) {
+    const int ROUNDS = 50000;
+    vector<string> corpus = { LOGON_FAILURE_XML, SERVICE_STATE_XML, APPLICATION_XML, USERDATA_XML };
+    vector<char> output(64 * 1024);
+    size_t xml_bytes = 0;
+    size_t json_bytes = 0;
+    auto start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (const auto& xml : corpus) {
+            json_bytes += XMLToJSONConverter::convert(xml.data(), xml.size(), output.data(), output.size());
+            xml_bytes += xml.size();
+        }
+    }
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    size_t events = static_cast<size_t>(ROUNDS) * corpus.size();
+    cout << "[ BENCH    ] " << events << " events, " << xml_bytes / (1024 * 1024) << "MB of XML in "
+        << elapsed << "us: " << (elapsed > 0 ? events * 1000000 / elapsed : 0) << " events/s, "
+        << (elapsed > 0 ? xml_bytes / elapsed : 0) << "MB/s" << endl;
+    EXPECT_GT(json_bytes, 0u);
+}
@@ -0,0 +1,111 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "AgentStatistics.h"
+#include <cstdio>
+
+namespace Syslog_agent {
+
+    namespace {
+        // must stay in the same order as AgentStatistics::Counter
+        const char* const COUNTER_NAMES[AgentStatistics::COUNTER_COUNT] = {
+            "publisher_cache_hits",
+            "publisher_cache_misses",
+            "publisher_cache_evictions",
+            "publisher_cache_unavailable",
+            "message_template_hits",
+            "message_template_misses",
+            "message_template_fallbacks",
+            "rule_dropped",
+            "rule_primary_only",
+            "rule_secondary_only",
+            "dedup_suppressed",
+            "dedup_summaries",
+            "dedup_evictions",
+            "dedup_bytes_saved",
+            "string_table_hits",
+            "string_table_misses",
+            "string_table_rejected",
+            "string_table_size",
+            "sid_cache_hits",
+            "sid_cache_misses",
+            "sid_cache_resolved",
+            "sid_cache_failures",
+            "sid_cache_queue_full",
+            "overload_sampled_out",
+            "overload_sample_rate",
+            "aggregate_events",
+            "aggregate_summaries",
+            "aggregate_spills",
+            "aggregate_bytes_saved",
+            "projected_messages",
+            "projection_fields_dropped",
+            "projection_bytes_saved",
+            "redacted_fields",
+            "redaction_overflows",
+            "template_mined_messages",
+            "template_count",
+            "template_bytes_saved",
+            "message_text_skipped",
+            "message_text_sampled",
+            "message_text_sample_microseconds",
+            "delivered_batches",
+            "delivered_events",
+            "work_pool_tasks",
+            "work_pool_reordered",
+            "records_skipped",
+            "batch_growths",
+            "batch_shrinks",
+            "batches_too_large",
+            "batches_throttled",
+        };
+    }
+
+    AgentStatistics::AgentStatistics() {
+        reset();
+    }
+
+    AgentStatistics& AgentStatistics::instance() {
+        static AgentStatistics instance;
+        return instance;
+    }
+
+    void AgentStatistics::reset() {
+        for (auto& counter : counters_) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    const char* AgentStatistics::counterName(Counter counter) {
+        if (counter < 0 || counter >= COUNTER_COUNT) {
+            return "unknown";
+        }
+        return COUNTER_NAMES[counter];
+    }
+
+    size_t AgentStatistics::formatSummary(char* dest, size_t max_size) const {
+        if (dest == nullptr || max_size == 0) {
+            return 0;
+        }
+        dest[0] = 0;
+        size_t used = 0;
+        for (int i = 0; i < COUNTER_COUNT; ++i) {
+            auto value = get(static_cast<Counter>(i));
+            if (value == 0) {
+                continue;
+            }
+            int written = snprintf(dest + used, max_size - used, "%s%s=%llu",
+                used == 0 ? "" : ", ", COUNTER_NAMES[i],
+                static_cast<unsigned long long>(value));
+            if (written < 0 || static_cast<size_t>(written) >= max_size - used) {
+                // truncated; snprintf has already terminated the buffer
+                return max_size - 1;
+            }
+            used += written;
+        }
+        return used;
+    }
+}
@@ -0,0 +1,102 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "framework.h"
+
+// AgentStatistics is a process-wide set of named counters that the
+// various caches and pipeline stages bump as they work.  Counters are
+// lock-free atomics so they can be updated from the event subscription
+// callbacks and the sender thread without contention.  The service
+// periodically logs a one-line summary of the non-zero counters.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API AgentStatistics {
+    public:
+        enum Counter {
+            PublisherCacheHits = 0,
+            PublisherCacheMisses,
+            PublisherCacheEvictions,
+            PublisherCacheUnavailable,
+            MessageTemplateHits,
+            MessageTemplateMisses,
+            MessageTemplateFallbacks,
+            RuleDropped,
+            RulePrimaryOnly,
+            RuleSecondaryOnly,
+            DedupSuppressed,
+            DedupSummaries,
+            DedupEvictions,
+            DedupBytesSaved,
+            StringTableHits,
+            StringTableMisses,
+            StringTableRejected,
+            StringTableSize,
+            SidCacheHits,
+            SidCacheMisses,
+            SidCacheResolved,
+            SidCacheFailures,
+            SidCacheQueueFull,
+            OverloadSampledOut,
+            OverloadSampleRate,
+            AggregateEvents,
+            AggregateSummaries,
+            AggregateSpills,
+            AggregateBytesSaved,
+            ProjectedMessages,
+            ProjectionFieldsDropped,
+            ProjectionBytesSaved,
+            RedactedFields,
+            RedactionOverflows,
+            TemplateMinedMessages,
+            TemplateCount,
+            TemplateBytesSaved,
+            MessageTextSkipped,
+            MessageTextSampled,
+            MessageTextSampleMicroseconds,
+            DeliveredBatches,
+            DeliveredEvents,
+            WorkPoolTasks,
+            WorkPoolReordered,
+            RecordsSkipped,
+            BatchGrowths,
+            BatchShrinks,
+            BatchesTooLarge,
+            BatchesThrottled,
+            COUNTER_COUNT
+        };
+
+        AgentStatistics(const AgentStatistics&) = delete;
+        AgentStatistics& operator=(const AgentStatistics&) = delete;
+
+        static AgentStatistics& instance();
+
+        void increment(Counter counter, std::uint64_t amount = 1) {
+            counters_[counter].fetch_add(amount, std::memory_order_relaxed);
+        }
+        void set(Counter counter, std::uint64_t value) {
+            counters_[counter].store(value, std::memory_order_relaxed);
+        }
+        std::uint64_t get(Counter counter) const {
+            return counters_[counter].load(std::memory_order_relaxed);
+        }
+        void reset();
+
+        static const char* counterName(Counter counter);
+
+        // Writes "name=value, ..." for all non-zero counters, null-terminated.
+        // Returns the number of characters written (excluding the terminator).
+        size_t formatSummary(char* dest, size_t max_size) const;
+
+    private:
+        AgentStatistics();
+        std::atomic<std::uint64_t> counters_[COUNTER_COUNT];
+    };
+}
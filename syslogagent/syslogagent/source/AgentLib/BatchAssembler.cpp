@@ -0,0 +1,207 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "BatchAssembler.h"
+#include "../Infrastructure/Logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Syslog_agent {
+
+    BatchAssembler::BatchAssembler(std::shared_ptr<const MessageBatcher> batcher, std::uint32_t max_ready_batches)
+        : batcher_(std::move(batcher)),
+        header_(batcher_->GetMessageHeader()),
+        separator_(batcher_->GetMessageSeparator()),
+        trailer_(batcher_->GetMessageTrailer()),
+        max_messages_((std::max)(batcher_->GetMaxBatchCount(), std::uint32_t(1))),
+        max_bytes_(batcher_->GetMaxBatchSizeBytes()),
+        target_bytes_(batcher_->GetTargetBatchBytes()),
+        max_ready_batches_(max_ready_batches),
+        limit_messages_(max_messages_),
+        limit_bytes_(target_bytes_) {
+    }
+
+    BatchAssembler::~BatchAssembler() {
+        if (open_.buffer != nullptr) {
+            batcher_->ReleaseBatchBuffer(open_.buffer);
+        }
+        for (auto& batch : ready_) {
+            if (batch.buffer != nullptr) {
+                batcher_->ReleaseBatchBuffer(batch.buffer);
+            }
+        }
+    }
+
+    void BatchAssembler::begin(size_t already_queued) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unassembled_ += static_cast<std::uint32_t>(already_queued);
+        messages_unassembled_ += already_queued;
+        begun_ = true;
+    }
+
+    void BatchAssembler::append(const MessageQueue::Message& message) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!makeRoom(message.data_length)) {
+            return;
+        }
+        size_t remaining = message.data_length;
+        for (auto buffer = message.message_buffers; buffer != nullptr && remaining > 0; buffer = buffer->next) {
+            size_t part = (std::min)(remaining, static_cast<size_t>(MessageQueue::MESSAGE_BUFFER_SIZE));
+            copy(buffer->buffer, part);
+            remaining -= part;
+        }
+        added();
+    }
+
+    void BatchAssembler::append(const char* data, size_t length) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!makeRoom(length)) {
+            return;
+        }
+        copy(data, length);
+        added();
+    }
+
+    bool BatchAssembler::makeRoom(size_t length) {
+        if (!begun_ || unassembled_ > 0) {
+            ++unassembled_;
+            ++messages_unassembled_;
+            return false;
+        }
+        if (open_.messages > 0 && (open_.messages >= limit_messages_
+            || open_.length + separator_.size() + length + trailer_.size() > limit_bytes_)) {
+            sealOpen();
+        }
+        // room is kept for the trailer and a terminating null
+        if (header_.size() + length + trailer_.size() + 1 > max_bytes_) {
+            auto logger = LOG_THIS;
+            logger->warning("BatchAssembler::makeRoom()> Message of %zu bytes too large for a batch buffer, left to send on its own\n",
+                length);
+            sealOpen();
+            Batch oversized;
+            oversized.messages = 1;
+            ready_.push_back(oversized);
+            return false;
+        }
+        if (open_.buffer == nullptr) {
+            if (ready_.size() >= max_ready_batches_
+                || (open_.buffer = batcher_->GetBatchBuffer("batch assembler")) == nullptr) {
+                ++unassembled_;
+                ++messages_unassembled_;
+                return false;
+            }
+            copy(header_.data(), header_.size());
+        }
+        else if (open_.messages > 0) {
+            copy(separator_.data(), separator_.size());
+        }
+        return true;
+    }
+
+    void BatchAssembler::copy(const char* data, size_t length) {
+        memcpy(open_.buffer + open_.length, data, length);
+        open_.length += length;
+    }
+
+    void BatchAssembler::added() {
+        ++messages_assembled_;
+        // sealed as soon as not even a one byte message would fit
+        if (++open_.messages >= limit_messages_ || open_.length + separator_.size() + 1 + trailer_.size() > limit_bytes_) {
+            sealOpen();
+        }
+    }
+
+    void BatchAssembler::setLimits(std::uint32_t max_messages, size_t max_bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        limit_messages_ = (std::max)((std::min)(max_messages, max_messages_), std::uint32_t(1));
+        limit_bytes_ = (std::min)(max_bytes, target_bytes_);
+    }
+
+    void BatchAssembler::disassemble() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // they are at the front of the queue, before any already unassembled
+        std::uint32_t messages = open_.messages;
+        if (open_.buffer != nullptr) {
+            batcher_->ReleaseBatchBuffer(open_.buffer);
+        }
+        open_ = Batch();
+        for (auto& batch : ready_) {
+            messages += batch.messages;
+            if (batch.buffer != nullptr) {
+                batcher_->ReleaseBatchBuffer(batch.buffer);
+            }
+        }
+        ready_.clear();
+        unassembled_ += messages;
+    }
+
+    void BatchAssembler::seal() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sealOpen();
+    }
+
+    void BatchAssembler::sealOpen() {
+        if (open_.messages == 0) {
+            if (open_.buffer != nullptr) {
+                batcher_->ReleaseBatchBuffer(open_.buffer);
+            }
+            open_ = Batch();
+            return;
+        }
+        copy(trailer_.data(), trailer_.size());
+        open_.buffer[open_.length] = '\0';
+        ready_.push_back(open_);
+        ++batches_assembled_;
+        open_ = Batch();
+    }
+
+    const BatchAssembler::Batch* BatchAssembler::front() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // a deque's elements stay where they are while others are added
+        return ready_.empty() ? nullptr : &ready_.front();
+    }
+
+    void BatchAssembler::sent() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ready_.empty()) {
+            return;
+        }
+        if (ready_.front().buffer != nullptr) {
+            batcher_->ReleaseBatchBuffer(ready_.front().buffer);
+        }
+        ready_.pop_front();
+    }
+
+    std::uint32_t BatchAssembler::unassembled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return unassembled_;
+    }
+
+    void BatchAssembler::sentUnassembled(std::uint32_t count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unassembled_ -= (std::min)(count, unassembled_);
+    }
+
+    size_t BatchAssembler::readyCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ready_.size();
+    }
+
+    std::uint64_t BatchAssembler::batchesAssembled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return batches_assembled_;
+    }
+
+    std::uint64_t BatchAssembler::messagesAssembled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return messages_assembled_;
+    }
+
+    std::uint64_t BatchAssembler::messagesUnassembled() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return messages_unassembled_;
+    }
+}
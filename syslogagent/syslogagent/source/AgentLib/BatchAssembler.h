@@ -0,0 +1,134 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "MessageBatcher.h"
+#include "MessageQueue.h"
+#include "framework.h"
+
+// BatchAssembler builds a queue's batches as its messages are enqueued,
+// rather than when they are about to be sent.  Each message is copied onto
+// the end of an open batch, after the header and a separator, from the
+// queue's post-enqueue hook; when the open batch has the batcher's maximum
+// count, or the next message would take it, trailer included, past the
+// batcher's target size in bytes, it's sealed (the trailer written) and is
+// ready to send as it is.  The sender seals whatever is open when a batch
+// is due for its age.
+//
+// Batches are taken in queue order and cover the front of the queue
+// exactly: once a batch is sent, its messages are the ones to remove from
+// the queue.  A batch stays at the front, to be sent again, until sent()
+// says it went.  A message larger than the target on its own is a batch on
+// its own; one too large for a batch buffer at all is sealed as a batch
+// with no buffer, for the sender to frame from the queue in its turn
+// (MessageBatcher::BatchOversizedMessage()).
+//
+// Batch buffers come from the batcher's pool.  When MAX_READY_BATCHES are
+// waiting (the server is down or slow) or the pool is empty, the assembler
+// falls behind: it stops copying and only counts the messages, which are
+// then at the front of the queue once the sealed batches have gone, for
+// the sender to batch from the queue itself as before.  It catches up when
+// those have all been sent.  Messages already queued before begin() are
+// counted the same way.
+//
+// setLimits() makes batches smaller than the batcher's count and target
+// (BatchSizeController): a batch is sealed once it reaches either, though
+// a single message larger than the byte limit is still sent, on its own.
+// disassemble() gives up every batch, counting its messages unassembled
+// again, for when the server refuses one as too large.
+//
+// append() is called by the queue's producers (one at a time, under the
+// queue's lock); everything else by one sender thread.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API BatchAssembler {
+    public:
+        static constexpr std::uint32_t MAX_READY_BATCHES = 8;
+
+        struct Batch {
+            char* buffer = nullptr;         // from the batcher's pool, null for a message too large for one
+            size_t length = 0;              // header, messages and trailer
+            std::uint32_t messages = 0;
+        };
+
+        explicit BatchAssembler(std::shared_ptr<const MessageBatcher> batcher,
+            std::uint32_t max_ready_batches = MAX_READY_BATCHES);
+        ~BatchAssembler();
+
+        BatchAssembler(const BatchAssembler&) = delete;
+        BatchAssembler& operator=(const BatchAssembler&) = delete;
+
+        // Starts assembling; `already_queued` messages were in the queue
+        // before the hook was set.  Messages appended before this are counted
+        // as unassembled too.
+        void begin(size_t already_queued);
+
+        // Adds a message that was just enqueued
+        void append(const MessageQueue::Message& message);
+        void append(const char* data, size_t length);
+
+        // Seals the open batch, if it has any messages
+        void seal();
+
+        // At most `max_messages` and `max_bytes` (no more than the batcher's
+        // target) in the batches sealed from now on
+        void setLimits(std::uint32_t max_messages, size_t max_bytes);
+        // Drops the batches not yet sent, for them to be batched from the
+        // queue instead
+        void disassemble();
+
+        // The oldest sealed batch, or null if there is none.  It stays valid
+        // until sent().
+        const Batch* front() const;
+        // The front batch went; its buffer goes back to the pool
+        void sent();
+
+        // Messages at the end of the assembled ones that were only counted
+        std::uint32_t unassembled() const;
+        // `count` of them were batched from the queue and sent
+        void sentUnassembled(std::uint32_t count);
+
+        size_t readyCount() const;
+        std::uint64_t batchesAssembled() const;
+        std::uint64_t messagesAssembled() const;
+        std::uint64_t messagesUnassembled() const;
+
+    private:
+        // Makes room in the open batch for a message of `length` bytes and
+        // writes the separator before it; false if it isn't to be copied
+        bool makeRoom(size_t length);
+        void copy(const char* data, size_t length);
+        void added();
+        void sealOpen();
+
+        std::shared_ptr<const MessageBatcher> batcher_;
+        const std::string header_;
+        const std::string separator_;
+        const std::string trailer_;
+        const std::uint32_t max_messages_;
+        const size_t max_bytes_;            // a batch buffer, the terminating null included
+        const size_t target_bytes_;
+        const std::uint32_t max_ready_batches_;
+        std::uint32_t limit_messages_;
+        size_t limit_bytes_;
+
+        mutable std::mutex mutex_;
+        bool begun_ = false;
+        Batch open_;
+        std::deque<Batch> ready_;
+        std::uint32_t unassembled_ = 0;
+        std::uint64_t batches_assembled_ = 0;
+        std::uint64_t messages_assembled_ = 0;
+        std::uint64_t messages_unassembled_ = 0;
+    };
+}
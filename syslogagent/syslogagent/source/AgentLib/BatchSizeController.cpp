@@ -0,0 +1,140 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "BatchSizeController.h"
+#include <algorithm>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    namespace {
+        // weight of the newest post in the average latency
+        const double LATENCY_SMOOTHING = 0.25;
+    }
+
+    const char* BatchSizeController::decisionName(Decision decision) {
+        switch (decision) {
+        case Decision::None: return "none";
+        case Decision::GrowForBacklog: return "grown for backlog";
+        case Decision::ShrinkForLatency: return "shrunk for latency";
+        case Decision::ShrinkForTrickle: return "shrunk for trickle";
+        case Decision::ShrinkForTooLarge: return "shrunk, too large";
+        case Decision::GrowForThrottling: return "grown, throttled";
+        }
+        return "unknown";
+    }
+
+    BatchSizeController::Outcome BatchSizeController::outcomeOf(bool succeeded, std::uint32_t http_status) {
+        if (succeeded) {
+            return Outcome::Sent;
+        }
+        if (http_status == 413) {
+            return Outcome::TooLarge;
+        }
+        if (http_status == 429 || http_status == 503) {
+            return Outcome::Throttled;
+        }
+        return Outcome::Failed;
+    }
+
+    BatchSizeController::BatchSizeController(
+        std::uint32_t min_count,
+        std::uint32_t max_count,
+        size_t min_bytes,
+        size_t max_bytes,
+        std::uint32_t target_latency_ms,
+        std::uint32_t settle_posts)
+        : min_count_((std::max)(min_count, std::uint32_t(1))),
+        max_count_((std::max)(max_count, (std::max)(min_count, std::uint32_t(1)))),
+        min_bytes_((std::min)(min_bytes, max_bytes)),
+        max_bytes_(max_bytes),
+        target_latency_ms_(target_latency_ms),
+        settle_posts_((std::max)(settle_posts, std::uint32_t(1))),
+        count_(max_count_),
+        bytes_(max_bytes_) {
+    }
+
+    void BatchSizeController::setCount(std::uint64_t count) {
+        count_.store(static_cast<std::uint32_t>((std::min)((std::max)(count, std::uint64_t(min_count_)),
+            std::uint64_t(max_count_))), std::memory_order_relaxed);
+    }
+
+    void BatchSizeController::setBytes(std::uint64_t bytes) {
+        bytes_.store(static_cast<size_t>((std::min)((std::max)(bytes, std::uint64_t(min_bytes_)),
+            std::uint64_t(max_bytes_))), std::memory_order_relaxed);
+    }
+
+    BatchSizeController::Decision BatchSizeController::onPost(
+        std::uint32_t messages,
+        size_t bytes,
+        std::uint32_t latency_ms,
+        Outcome outcome,
+        size_t queue_length) {
+        auto& stats = AgentStatistics::instance();
+        last_outcome_ = outcome;
+        const std::uint32_t count = batchCount();
+        const size_t size = batchBytes();
+        Decision decision = Decision::None;
+
+        switch (outcome) {
+        case Outcome::Failed:
+            return Decision::None;
+        case Outcome::TooLarge:
+            stats.increment(AgentStatistics::BatchesTooLarge);
+            setCount((std::min)(count, messages) / 2);
+            setBytes((std::min)(size, bytes) / 2);
+            decision = Decision::ShrinkForTooLarge;
+            break;
+        case Outcome::Throttled:
+            stats.increment(AgentStatistics::BatchesThrottled);
+            setCount(std::uint64_t(count) * 2);
+            setBytes(std::uint64_t(size) * 2);
+            decision = Decision::GrowForThrottling;
+            break;
+        case Outcome::Sent: {
+            if (!have_latency_) {
+                average_latency_ms_ = latency_ms;
+                have_latency_ = true;
+            }
+            else {
+                average_latency_ms_ += LATENCY_SMOOTHING * (latency_ms - average_latency_ms_);
+            }
+            const size_t previous_length = last_queue_length_;
+            last_queue_length_ = queue_length;
+            if (++posts_since_change_ < settle_posts_) {
+                return Decision::None;
+            }
+            if (queue_length >= count && queue_length >= previous_length) {
+                setCount(std::uint64_t(count) + count / 2 + 1);
+                // the batch was about as large as it could be
+                if (bytes + bytes / 8 >= size) {
+                    setBytes(std::uint64_t(size) + size / 2);
+                }
+                decision = Decision::GrowForBacklog;
+            }
+            else if (average_latency_ms_ > target_latency_ms_) {
+                setCount(count - count / 4);
+                setBytes(size - size / 4);
+                decision = Decision::ShrinkForLatency;
+            }
+            else if (queue_length == 0) {
+                setCount(count - count / 4);
+                decision = Decision::ShrinkForTrickle;
+            }
+            break;
+        }
+        }
+
+        if (batchCount() == count && batchBytes() == size) {
+            // already at the bound
+            return Decision::None;
+        }
+        posts_since_change_ = 0;
+        stats.increment(batchCount() > count || batchBytes() > size
+            ? AgentStatistics::BatchGrowths : AgentStatistics::BatchShrinks);
+        return decision;
+    }
+}
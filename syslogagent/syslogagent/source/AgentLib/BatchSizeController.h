@@ -0,0 +1,91 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "framework.h"
+
+// BatchSizeController tunes how many messages, and how many bytes, go in
+// each batch a queue sends, between a configured minimum and maximum.  The
+// sender tells it how every post went: the batch's size, how long the post
+// took, what the server said and how long the queue was afterwards.
+//
+// It starts at the maximum, which is what a batch always was before, and
+// adjusts at most once every SETTLE_POSTS posts:
+//
+//   backlog   a full batch or more still waiting after a post, and not
+//             draining: the count grows by half, and the byte size too if
+//             that is what limited the batch.  Fewer, larger posts.
+//   latency   posts taking longer on average than the target: both shrink
+//             by a quarter.
+//   trickle   the queue empty after a post: the count shrinks by a quarter,
+//             so that a batch is due, and sent, after fewer messages
+//             rather than waiting out its age.
+//
+// A 413 (too large) halves both from the batch that was refused, straight
+// away; the sender has to rebuild the batches it has.  A 429 or 503 (too
+// many requests, busy) doubles both: the same messages in fewer requests.
+//
+// The current sizes can be read from any thread; onPost() is called by
+// the one sender thread.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API BatchSizeController {
+    public:
+        static constexpr std::uint32_t DEFAULT_TARGET_LATENCY_MS = 500;
+        static constexpr std::uint32_t SETTLE_POSTS = 4;
+
+        enum class Outcome { Sent, TooLarge, Throttled, Failed };
+        enum class Decision { None, GrowForBacklog, ShrinkForLatency, ShrinkForTrickle, ShrinkForTooLarge, GrowForThrottling };
+
+        static const char* decisionName(Decision decision);
+        // The outcome of a post the server answered with `http_status`
+        // (0 if it didn't answer)
+        static Outcome outcomeOf(bool succeeded, std::uint32_t http_status);
+
+        BatchSizeController(
+            std::uint32_t min_count,
+            std::uint32_t max_count,
+            size_t min_bytes,
+            size_t max_bytes,
+            std::uint32_t target_latency_ms = DEFAULT_TARGET_LATENCY_MS,
+            std::uint32_t settle_posts = SETTLE_POSTS);
+
+        BatchSizeController(const BatchSizeController&) = delete;
+        BatchSizeController& operator=(const BatchSizeController&) = delete;
+
+        // Reports one post of `messages` messages, `bytes` long
+        Decision onPost(std::uint32_t messages, size_t bytes, std::uint32_t latency_ms, Outcome outcome,
+            size_t queue_length);
+
+        std::uint32_t batchCount() const { return count_.load(std::memory_order_relaxed); }
+        size_t batchBytes() const { return bytes_.load(std::memory_order_relaxed); }
+        double averageLatencyMs() const { return average_latency_ms_; }
+        Outcome lastOutcome() const { return last_outcome_; }
+
+    private:
+        void setCount(std::uint64_t count);
+        void setBytes(std::uint64_t bytes);
+
+        const std::uint32_t min_count_;
+        const std::uint32_t max_count_;
+        const size_t min_bytes_;
+        const size_t max_bytes_;
+        const std::uint32_t target_latency_ms_;
+        const std::uint32_t settle_posts_;
+
+        std::atomic<std::uint32_t> count_;
+        std::atomic<size_t> bytes_;
+        double average_latency_ms_ = 0.0;
+        bool have_latency_ = false;
+        std::uint32_t posts_since_change_ = 0;
+        size_t last_queue_length_ = 0;
+        Outcome last_outcome_ = Outcome::Sent;
+    };
+}
@@ -0,0 +1,164 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "EventAggregator.h"
+#include <chrono>
+#include <vector>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    EventAggregator::EventAggregator(
+        Emitter emitter,
+        std::int64_t window_ms,
+        size_t max_groups,
+        size_t max_bytes,
+        Clock clock)
+        : emitter_(emitter),
+        window_ms_(window_ms),
+        max_groups_(max_groups > 0 ? max_groups : 1),
+        max_bytes_(max_bytes),
+        clock_(clock) {
+    }
+
+    std::int64_t EventAggregator::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void EventAggregator::closeLocked(GroupList::iterator it, std::vector<Summary>& ready) {
+        bytes_ -= it->primary.size() + it->secondary.size();
+        if (it->has_sample) {
+            ready.push_back(Summary{ it->key, it->count, it->first_time_us, it->last_time_us,
+                std::move(it->primary), std::move(it->secondary) });
+        }
+        else if (unsampled_.size() < max_groups_) {
+            // its opener is still generating the sample; setSample() sends it
+            unsampled_.emplace(it->key, std::move(*it));
+        }
+        index_.erase(it->key);
+        groups_.erase(it);
+    }
+
+    void EventAggregator::emit(std::vector<Summary>& ready) {
+        auto& stats = AgentStatistics::instance();
+        for (const auto& summary : ready) {
+            size_t sent = emitter_ ? emitter_(summary) : 0;
+            size_t sample_bytes = summary.primary.size() + summary.secondary.size();
+            size_t unaggregated_bytes = static_cast<size_t>(summary.count) * sample_bytes;
+            stats.increment(AgentStatistics::AggregateSummaries);
+            if (unaggregated_bytes > sent) {
+                stats.increment(AgentStatistics::AggregateBytesSaved, unaggregated_bytes - sent);
+            }
+        }
+    }
+
+    bool EventAggregator::add(std::uint64_t key, std::int64_t event_time_us) {
+        auto& stats = AgentStatistics::instance();
+        auto current_time = now();
+        std::vector<Summary> ready;
+        bool opened;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats.increment(AgentStatistics::AggregateEvents);
+            while (!groups_.empty() && groups_.front().opened_at + window_ms_ <= current_time) {
+                closeLocked(groups_.begin(), ready);
+            }
+            auto found = index_.find(key);
+            if (found != index_.end()) {
+                auto& group = *found->second;
+                ++group.count;
+                if (event_time_us < group.first_time_us) {
+                    group.first_time_us = event_time_us;
+                }
+                if (event_time_us > group.last_time_us) {
+                    group.last_time_us = event_time_us;
+                }
+                opened = false;
+            }
+            else {
+                while (groups_.size() >= max_groups_) {
+                    stats.increment(AgentStatistics::AggregateSpills);
+                    closeLocked(groups_.begin(), ready);
+                }
+                groups_.push_back(Group{ key, current_time, 1, event_time_us, event_time_us,
+                    false, std::string(), std::string() });
+                index_.emplace(key, std::prev(groups_.end()));
+                opened = true;
+            }
+        }
+        emit(ready);
+        return opened;
+    }
+
+    void EventAggregator::setSample(std::uint64_t key, std::string primary, std::string secondary) {
+        size_t sample_bytes = primary.size() + secondary.size();
+        std::vector<Summary> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(key);
+            if (found == index_.end()) {
+                // spilled or expired in the meantime: send what it counted now
+                auto closed = unsampled_.find(key);
+                if (closed != unsampled_.end()) {
+                    auto& group = closed->second;
+                    ready.push_back(Summary{ key, group.count, group.first_time_us, group.last_time_us,
+                        std::move(primary), std::move(secondary) });
+                    unsampled_.erase(closed);
+                }
+            }
+            else {
+                auto group = found->second;
+                while (bytes_ + sample_bytes > max_bytes_ && groups_.begin() != group) {
+                    AgentStatistics::instance().increment(AgentStatistics::AggregateSpills);
+                    closeLocked(groups_.begin(), ready);
+                }
+                bytes_ -= group->primary.size() + group->secondary.size();
+                group->primary = std::move(primary);
+                group->secondary = std::move(secondary);
+                group->has_sample = true;
+                bytes_ += sample_bytes;
+            }
+        }
+        emit(ready);
+    }
+
+    void EventAggregator::flushExpired() {
+        auto current_time = now();
+        std::vector<Summary> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!groups_.empty() && groups_.front().opened_at + window_ms_ <= current_time) {
+                closeLocked(groups_.begin(), ready);
+            }
+        }
+        emit(ready);
+    }
+
+    void EventAggregator::flushAll() {
+        std::vector<Summary> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!groups_.empty()) {
+                closeLocked(groups_.begin(), ready);
+            }
+        }
+        emit(ready);
+    }
+
+    size_t EventAggregator::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return groups_.size();
+    }
+
+    size_t EventAggregator::bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+}
@@ -0,0 +1,117 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "framework.h"
+
+// EventAggregator turns high-volume events (logons, logoffs, object access)
+// into one summary per group per time window, for the "aggregate" rule
+// action (see EventRuleEngine.h).
+//
+// Callers key each event by a hash of the fields it's grouped by and call
+// add() before generating any output:
+//
+// - The first event with a key opens a group.  The caller generates its
+//   messages as usual, but hands them to setSample() instead of sending
+//   them.
+// - Further events with that key inside the window are only counted, along
+//   with the first and last event times.
+// - When the window closes, the sample is passed to the emitter once with
+//   the count and times, so the receiver gets one message per group per
+//   window however many events it stood for.
+//
+// Unlike EventDeduplicator nothing is sent when the group opens; the events
+// in a group differ in everything but the grouped fields, and the sample is
+// only an example of them.
+//
+// The table is bounded both in groups and in bytes of samples.  When it's
+// full the oldest group is spilled (its summary sent early), so memory
+// stays flat under any event rate and no event is ever lost from a count.
+// Groups are closed lazily on add() and by calling flushExpired()
+// periodically.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API EventAggregator {
+    public:
+        typedef std::function<std::int64_t()> Clock;   // milliseconds, monotonic
+
+        struct Summary {
+            std::uint64_t key;
+            std::uint32_t count;            // events in the group, including the sample
+            std::int64_t first_time_us;     // earliest and latest event times
+            std::int64_t last_time_us;
+            std::string primary;            // copies given to setSample()
+            std::string secondary;
+        };
+        // Sends the summary and returns the number of bytes it sent.
+        typedef std::function<size_t(const Summary&)> Emitter;
+
+        static constexpr std::int64_t DEFAULT_WINDOW_MS = 60 * 1000;
+        static constexpr size_t DEFAULT_MAX_GROUPS = 4096;
+        static constexpr size_t DEFAULT_MAX_BYTES = 8 * 1024 * 1024;
+
+        EventAggregator(
+            Emitter emitter,
+            std::int64_t window_ms = DEFAULT_WINDOW_MS,
+            size_t max_groups = DEFAULT_MAX_GROUPS,
+            size_t max_bytes = DEFAULT_MAX_BYTES,
+            Clock clock = nullptr);
+
+        EventAggregator(const EventAggregator&) = delete;
+        EventAggregator& operator=(const EventAggregator&) = delete;
+
+        // Counts one event into its group.  True if it opened the group and
+        // the caller should generate its messages and pass them to
+        // setSample(); false if it was counted into a group already open.
+        bool add(std::uint64_t key, std::int64_t event_time_us);
+        // Keeps the messages generated for the event that opened a group.
+        void setSample(std::uint64_t key, std::string primary, std::string secondary);
+        // Largest event worth aggregating; bigger ones should bypass add().
+        size_t maxSampleBytes() const { return max_bytes_ / 16; }
+
+        void flushExpired();
+        void flushAll();
+        size_t size() const;
+        size_t bytes() const;
+
+    private:
+        struct Group {
+            std::uint64_t key;
+            std::int64_t opened_at;
+            std::uint32_t count;
+            std::int64_t first_time_us;
+            std::int64_t last_time_us;
+            bool has_sample;
+            std::string primary;
+            std::string secondary;
+        };
+        typedef std::list<Group> GroupList;
+
+        void closeLocked(GroupList::iterator it, std::vector<Summary>& ready);
+        void emit(std::vector<Summary>& ready);
+        std::int64_t now() const;
+
+        Emitter emitter_;
+        std::int64_t window_ms_;
+        size_t max_groups_;
+        size_t max_bytes_;
+        Clock clock_;
+        GroupList groups_;          // oldest first; groups all last window_ms_
+        std::unordered_map<std::uint64_t, GroupList::iterator> index_;
+        // groups closed before their opener got to setSample(), waiting for it
+        std::unordered_map<std::uint64_t, Group> unsampled_;
+        size_t bytes_ = 0;
+        mutable std::mutex mutex_;
+    };
+}
@@ -0,0 +1,144 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "EventDeduplicator.h"
+#include <chrono>
+#include <vector>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    EventDeduplicator::EventDeduplicator(
+        Emitter emitter,
+        std::int64_t window_ms,
+        size_t max_entries,
+        size_t max_bytes,
+        Clock clock)
+        : emitter_(emitter),
+        window_ms_(window_ms),
+        max_entries_(max_entries > 0 ? max_entries : 1),
+        max_bytes_(max_bytes),
+        clock_(clock) {
+    }
+
+    std::int64_t EventDeduplicator::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void EventDeduplicator::closeLocked(EntryList::iterator it, std::vector<Summary>& ready) {
+        bytes_ -= it->primary.size() + it->secondary.size();
+        if (it->repeats > 0 && (!it->primary.empty() || !it->secondary.empty())) {
+            ready.push_back(Summary{ it->key, it->repeats, std::move(it->primary), std::move(it->secondary) });
+        }
+        index_.erase(it->key);
+        windows_.erase(it);
+    }
+
+    void EventDeduplicator::emit(std::vector<Summary>& ready) {
+        auto& stats = AgentStatistics::instance();
+        for (const auto& summary : ready) {
+            size_t sent = emitter_ ? emitter_(summary) : 0;
+            size_t copy_bytes = summary.primary.size() + summary.secondary.size();
+            size_t dropped_bytes = static_cast<size_t>(summary.repeat_count) * copy_bytes;
+            stats.increment(AgentStatistics::DedupSummaries);
+            if (dropped_bytes > sent) {
+                stats.increment(AgentStatistics::DedupBytesSaved, dropped_bytes - sent);
+            }
+        }
+    }
+
+    bool EventDeduplicator::admit(std::uint64_t key) {
+        auto& stats = AgentStatistics::instance();
+        auto current_time = now();
+        std::vector<Summary> ready;
+        bool send;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!windows_.empty() && windows_.front().opened_at + window_ms_ <= current_time) {
+                closeLocked(windows_.begin(), ready);
+            }
+            auto found = index_.find(key);
+            if (found != index_.end()) {
+                ++found->second->repeats;
+                stats.increment(AgentStatistics::DedupSuppressed);
+                send = false;
+            }
+            else {
+                while (windows_.size() >= max_entries_) {
+                    stats.increment(AgentStatistics::DedupEvictions);
+                    closeLocked(windows_.begin(), ready);
+                }
+                windows_.push_back(Entry{ key, current_time, 0, std::string(), std::string() });
+                index_.emplace(key, std::prev(windows_.end()));
+                send = true;
+            }
+        }
+        emit(ready);
+        return send;
+    }
+
+    void EventDeduplicator::remember(std::uint64_t key, std::string primary, std::string secondary) {
+        size_t copy_bytes = primary.size() + secondary.size();
+        if (copy_bytes > maxCopyBytes()) {
+            return;
+        }
+        std::vector<Summary> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(key);
+            if (found == index_.end()) {
+                return;     // its window already closed
+            }
+            auto entry = found->second;
+            while (bytes_ + copy_bytes > max_bytes_ && windows_.begin() != entry) {
+                AgentStatistics::instance().increment(AgentStatistics::DedupEvictions);
+                closeLocked(windows_.begin(), ready);
+            }
+            bytes_ -= entry->primary.size() + entry->secondary.size();
+            entry->primary = std::move(primary);
+            entry->secondary = std::move(secondary);
+            bytes_ += copy_bytes;
+        }
+        emit(ready);
+    }
+
+    void EventDeduplicator::flushExpired() {
+        auto current_time = now();
+        std::vector<Summary> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!windows_.empty() && windows_.front().opened_at + window_ms_ <= current_time) {
+                closeLocked(windows_.begin(), ready);
+            }
+        }
+        emit(ready);
+    }
+
+    void EventDeduplicator::flushAll() {
+        std::vector<Summary> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (!windows_.empty()) {
+                closeLocked(windows_.begin(), ready);
+            }
+        }
+        emit(ready);
+    }
+
+    size_t EventDeduplicator::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return windows_.size();
+    }
+
+    size_t EventDeduplicator::bytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+}
@@ -0,0 +1,103 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "framework.h"
+
+// EventDeduplicator suppresses bursts of identical events (repeated logon
+// failures, a service crash-looping) within a time window.
+//
+// Callers key each event by a hash of its normalized content (see
+// FastHash.h) and ask admit() before generating any output:
+//
+// - The first event with a key opens a window and is sent as usual.  The
+//   caller then hands its generated messages to remember().
+// - Further events with that key inside the window are counted and dropped.
+// - When the window closes, if anything was dropped, the remembered copy is
+//   passed to the emitter once with the number of repeats, so the receiver
+//   sees the first event right away and one "repeat_count" copy at the end
+//   of the burst.
+//
+// The table is bounded both in entries and in bytes of remembered copies.
+// When it's full the oldest window is closed early (and emitted if it has
+// repeats), so memory stays flat under any event rate.  Windows are closed
+// lazily on admit() and by calling flushExpired() periodically.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API EventDeduplicator {
+    public:
+        typedef std::function<std::int64_t()> Clock;   // milliseconds, monotonic
+
+        struct Summary {
+            std::uint64_t key;
+            std::uint32_t repeat_count;     // events dropped after the first
+            std::string primary;            // copies given to remember()
+            std::string secondary;
+        };
+        // Sends the summary and returns the number of bytes it sent.
+        typedef std::function<size_t(const Summary&)> Emitter;
+
+        static constexpr std::int64_t DEFAULT_WINDOW_MS = 10 * 1000;
+        static constexpr size_t DEFAULT_MAX_ENTRIES = 4096;
+        static constexpr size_t DEFAULT_MAX_BYTES = 8 * 1024 * 1024;
+
+        EventDeduplicator(
+            Emitter emitter,
+            std::int64_t window_ms = DEFAULT_WINDOW_MS,
+            size_t max_entries = DEFAULT_MAX_ENTRIES,
+            size_t max_bytes = DEFAULT_MAX_BYTES,
+            Clock clock = nullptr);
+
+        EventDeduplicator(const EventDeduplicator&) = delete;
+        EventDeduplicator& operator=(const EventDeduplicator&) = delete;
+
+        // True if the event should be sent, false if it's a repeat within
+        // the window and has been counted instead.
+        bool admit(std::uint64_t key);
+        // Keeps the messages generated for an admitted event, to be resent
+        // with the repeat count when its window closes.
+        void remember(std::uint64_t key, std::string primary, std::string secondary);
+        // Largest event worth remembering; bigger ones should bypass admit().
+        size_t maxCopyBytes() const { return max_bytes_ / 16; }
+
+        void flushExpired();
+        void flushAll();
+        size_t size() const;
+        size_t bytes() const;
+
+    private:
+        struct Entry {
+            std::uint64_t key;
+            std::int64_t opened_at;
+            std::uint32_t repeats;
+            std::string primary;
+            std::string secondary;
+        };
+        typedef std::list<Entry> EntryList;
+
+        void closeLocked(EntryList::iterator it, std::vector<Summary>& ready);
+        void emit(std::vector<Summary>& ready);
+        std::int64_t now() const;
+
+        Emitter emitter_;
+        std::int64_t window_ms_;
+        size_t max_entries_;
+        size_t max_bytes_;
+        Clock clock_;
+        EntryList windows_;         // oldest first; windows all last window_ms_
+        std::unordered_map<std::uint64_t, EntryList::iterator> index_;
+        size_t bytes_ = 0;
+        mutable std::mutex mutex_;
+    };
+}
@@ -0,0 +1,279 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// EventPipeline passes a record through a list of stages, each of one kind:
+//
+//   Extract    pulls the fields out of the raw event
+//   Filter     decides whether the record goes on (rules, sampling, dedup)
+//   Enrich     adds to it or narrows it (lookups, projections)
+//   Transform  rewrites it (redaction, templates)
+//   Serialize  turns it into the message(s) to send
+//   Route      hands the messages to where they go
+//
+// Every stage works on the same Record&, so nothing is copied between
+// them.  A stage returns Continue to pass the record on, Done when the
+// record is finished with early (dropped, or held back for a summary), or
+// Failed.
+//
+// A pipeline is assembled from a table of named stage definitions and an
+// order, a comma-separated list of names, so that a channel can reorder
+// stages or leave some out.  A definition's factory returns null when its
+// stage would have nothing to do (its feature is off), and then that stage
+// isn't in the pipeline at all rather than being called to do nothing.
+// A definition also names the stages it has to come after: `after` ones if
+// they're in the order at all, `needs` ones always, as when a stage only
+// works on what another one found.  An order that breaks either is refused.
+//
+// Each stage counts the records it was given, the ones it stopped and the
+// ones it failed.  One record in TIMING_INTERVAL (on each thread) is also
+// timed, one clock read per stage, for the average time a stage takes; a
+// clock read costs about as much as a small stage.  The counters are
+// atomic: run() may be called from several threads at once, provided the
+// stages themselves allow it.
+
+namespace Syslog_agent {
+
+    enum class StageKind { Extract, Filter, Enrich, Transform, Serialize, Route };
+
+    inline const char* stageKindName(StageKind kind) {
+        switch (kind) {
+        case StageKind::Extract: return "extract";
+        case StageKind::Filter: return "filter";
+        case StageKind::Enrich: return "enrich";
+        case StageKind::Transform: return "transform";
+        case StageKind::Serialize: return "serialize";
+        case StageKind::Route: return "route";
+        }
+        return "unknown";
+    }
+
+    enum class StageResult { Continue, Done, Failed };
+
+    template <typename Record> class EventPipeline;
+
+    template <typename Record>
+    class PipelineStage {
+    public:
+        PipelineStage(std::string name, StageKind kind) : name_(std::move(name)), kind_(kind) {}
+        virtual ~PipelineStage() = default;
+
+        virtual StageResult process(Record& record) = 0;
+
+        const std::string& name() const { return name_; }
+        StageKind kind() const { return kind_; }
+        std::uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+        std::uint64_t stopped() const { return stopped_.load(std::memory_order_relaxed); }
+        std::uint64_t failed() const { return failed_.load(std::memory_order_relaxed); }
+        // Average time per record, over the records timed
+        double averageMicroseconds() const {
+            auto timed = timed_.load(std::memory_order_relaxed);
+            return timed > 0 ? static_cast<double>(nanoseconds_.load(std::memory_order_relaxed)) / 1000.0 / timed : 0.0;
+        }
+
+    private:
+        friend class EventPipeline<Record>;
+
+        std::string name_;
+        StageKind kind_;
+        std::atomic<std::uint64_t> records_{ 0 };
+        std::atomic<std::uint64_t> stopped_{ 0 };
+        std::atomic<std::uint64_t> failed_{ 0 };
+        std::atomic<std::uint64_t> timed_{ 0 };
+        std::atomic<std::uint64_t> nanoseconds_{ 0 };
+    };
+
+    // A stage that calls a function, for those with no state of their own
+    template <typename Record>
+    class FunctionStage : public PipelineStage<Record> {
+    public:
+        using Function = std::function<StageResult(Record&)>;
+
+        FunctionStage(std::string name, StageKind kind, Function function)
+            : PipelineStage<Record>(std::move(name), kind), function_(std::move(function)) {}
+
+        StageResult process(Record& record) override { return function_(record); }
+
+    private:
+        Function function_;
+    };
+
+    template <typename Record>
+    class EventPipeline {
+    public:
+        static constexpr std::uint32_t TIMING_INTERVAL = 16;
+
+        using Stage = PipelineStage<Record>;
+        using StageFactory = std::function<std::unique_ptr<Stage>()>;
+        struct StageDefinition {
+            std::string name;
+            StageFactory factory;
+            std::vector<std::string> after;     // earlier, where they're in the order
+            std::vector<std::string> needs;     // in the order, and earlier
+        };
+
+        void add(std::unique_ptr<Stage> stage) {
+            stages_.push_back(std::move(stage));
+        }
+
+        // Adds the stages named in `order`, in that order.  False, leaving
+        // the pipeline as it was and saying why in `error`, if a name isn't
+        // one of `definitions`, is given twice, or comes before a stage it
+        // has to follow.
+        bool assemble(const std::string& order, const std::vector<StageDefinition>& definitions,
+            std::string& error) {
+            std::vector<const StageDefinition*> chosen;
+            size_t start = 0;
+            while (start <= order.size()) {
+                size_t end = order.find(',', start);
+                if (end == std::string::npos) {
+                    end = order.size();
+                }
+                size_t first = order.find_first_not_of(" \t", start);
+                size_t last = order.find_last_not_of(" \t", end - 1);
+                if (first < end && last != std::string::npos && last >= first) {
+                    std::string name = order.substr(first, last - first + 1);
+                    const StageDefinition* found = nullptr;
+                    for (const auto& definition : definitions) {
+                        if (definition.name == name) {
+                            found = &definition;
+                            break;
+                        }
+                    }
+                    if (found == nullptr) {
+                        error = "unknown stage \"" + name + "\"";
+                        return false;
+                    }
+                    for (auto previous : chosen) {
+                        if (previous == found) {
+                            error = "stage \"" + name + "\" given twice";
+                            return false;
+                        }
+                    }
+                    chosen.push_back(found);
+                }
+                start = end + 1;
+            }
+            if (chosen.empty()) {
+                error = "no stages";
+                return false;
+            }
+            for (size_t index = 0; index < chosen.size(); ++index) {
+                auto position = [&chosen](const std::string& name) {
+                    for (size_t other = 0; other < chosen.size(); ++other) {
+                        if (chosen[other]->name == name) {
+                            return other;
+                        }
+                    }
+                    return chosen.size();
+                };
+                auto follows = [&](const std::string& name, bool needed) {
+                    size_t other = position(name);
+                    if (other < index || (other == chosen.size() && !needed)) {
+                        return true;
+                    }
+                    error = "stage \"" + chosen[index]->name + "\" has to come after \"" + name + "\"";
+                    return false;
+                };
+                for (const auto& name : chosen[index]->after) {
+                    if (!follows(name, false)) {
+                        return false;
+                    }
+                }
+                for (const auto& name : chosen[index]->needs) {
+                    if (!follows(name, true)) {
+                        return false;
+                    }
+                }
+            }
+            for (auto definition : chosen) {
+                auto stage = definition->factory();
+                if (stage) {
+                    add(std::move(stage));
+                }
+            }
+            return true;
+        }
+
+        StageResult run(Record& record) const {
+            static thread_local std::uint32_t runs = 0;
+            const bool timed = ++runs % TIMING_INTERVAL == 0;
+            std::chrono::steady_clock::time_point started;
+            if (timed) {
+                started = std::chrono::steady_clock::now();
+            }
+            for (const auto& stage : stages_) {
+                StageResult result;
+                try {
+                    result = stage->process(record);
+                }
+                catch (...) {
+                    stage->records_.fetch_add(1, std::memory_order_relaxed);
+                    stage->failed_.fetch_add(1, std::memory_order_relaxed);
+                    throw;
+                }
+                stage->records_.fetch_add(1, std::memory_order_relaxed);
+                if (timed) {
+                    // each stage's end is the next one's start
+                    auto finished = std::chrono::steady_clock::now();
+                    stage->timed_.fetch_add(1, std::memory_order_relaxed);
+                    stage->nanoseconds_.fetch_add(static_cast<std::uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count()),
+                        std::memory_order_relaxed);
+                    started = finished;
+                }
+                if (result == StageResult::Done) {
+                    stage->stopped_.fetch_add(1, std::memory_order_relaxed);
+                    return result;
+                }
+                if (result == StageResult::Failed) {
+                    stage->failed_.fetch_add(1, std::memory_order_relaxed);
+                    return result;
+                }
+            }
+            return StageResult::Continue;
+        }
+
+        size_t size() const { return stages_.size(); }
+        const Stage& stage(size_t index) const { return *stages_[index]; }
+        bool contains(const std::string& name) const {
+            for (const auto& stage : stages_) {
+                if (stage->name() == name) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // "name (kind): records, stopped, failed, average us" for each stage
+        std::string describe() const {
+            std::string description;
+            for (const auto& stage : stages_) {
+                char line[160];
+                auto records = stage->records();
+                snprintf(line, sizeof(line), "%s%s (%s): %llu, %llu stopped, %llu failed, %.2f us",
+                    description.empty() ? "" : "; ", stage->name().c_str(), stageKindName(stage->kind()),
+                    static_cast<unsigned long long>(records), static_cast<unsigned long long>(stage->stopped()),
+                    static_cast<unsigned long long>(stage->failed()), stage->averageMicroseconds());
+                description += line;
+            }
+            return description;
+        }
+
+    private:
+        std::vector<std::unique_ptr<Stage>> stages_;
+    };
+}
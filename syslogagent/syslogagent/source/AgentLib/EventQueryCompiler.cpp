@@ -0,0 +1,137 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "EventQueryCompiler.h"
+#include <utility>
+#include <vector>
+
+namespace Syslog_agent {
+
+    namespace {
+        typedef std::pair<std::uint32_t, std::uint32_t> IdRange;
+
+        std::vector<IdRange> collapseRanges(const std::set<std::uint32_t>& ids) {
+            std::vector<IdRange> ranges;
+            for (auto id : ids) {
+                if (!ranges.empty() && ranges.back().second + 1 == id) {
+                    ranges.back().second = id;
+                }
+                else {
+                    ranges.push_back(IdRange(id, id));
+                }
+            }
+            return ranges;
+        }
+
+        std::wstring rangeExpression(const IdRange& range) {
+            if (range.first == range.second) {
+                return L"EventID=" + std::to_wstring(range.first);
+            }
+            return L"(EventID&gt;=" + std::to_wstring(range.first)
+                + L" and EventID&lt;=" + std::to_wstring(range.second) + L")";
+        }
+
+        // Groups the ranges so that no group has more than the allowed
+        // number of comparisons, returning each group as "(a or b or ...)"
+        std::vector<std::wstring> chunkIdExpressions(const std::vector<IdRange>& ranges) {
+            std::vector<std::wstring> chunks;
+            std::wstring current;
+            int expressions = 0;
+            for (const auto& range : ranges) {
+                int cost = range.first == range.second ? 1 : 2;
+                if (expressions > 0 && expressions + cost > EventQueryCompiler::MAX_EXPRESSIONS_PER_SELECT) {
+                    chunks.push_back(L"(" + current + L")");
+                    current.clear();
+                    expressions = 0;
+                }
+                if (expressions > 0) {
+                    current += L" or ";
+                }
+                current += rangeExpression(range);
+                expressions += cost;
+            }
+            if (expressions > 0) {
+                chunks.push_back(L"(" + current + L")");
+            }
+            return chunks;
+        }
+
+        std::wstring systemPath(const std::vector<std::wstring>& conditions) {
+            std::wstring joined;
+            for (const auto& condition : conditions) {
+                if (condition.empty()) {
+                    continue;
+                }
+                if (!joined.empty()) {
+                    joined += L" and ";
+                }
+                joined += condition;
+            }
+            if (joined.empty()) {
+                return L"*";
+            }
+            return L"*[System[" + joined + L"]]";
+        }
+    }
+
+    std::wstring EventQueryCompiler::escapeXml(const std::wstring& value) {
+        std::wstring escaped;
+        escaped.reserve(value.size());
+        for (auto c : value) {
+            switch (c) {
+            case L'&': escaped += L"&amp;"; break;
+            case L'<': escaped += L"&lt;"; break;
+            case L'>': escaped += L"&gt;"; break;
+            case L'"': escaped += L"&quot;"; break;
+            case L'\'': escaped += L"&apos;"; break;
+            default: escaped += c; break;
+            }
+        }
+        return escaped;
+    }
+
+    std::wstring EventQueryCompiler::compile(const std::wstring& channel, const EventQueryFilter& filter) {
+        bool filter_ids = !filter.event_ids.empty();
+        if (!filter_ids && filter.max_level <= 0 && filter.max_age_days == 0) {
+            return L"*";
+        }
+
+        std::wstring level_condition;
+        if (filter.max_level >= LEVEL_INFORMATION) {
+            // Level 0 (LogAlways) is used for informational events such as audits
+            level_condition = L"Level&lt;=" + std::to_wstring(filter.max_level);
+        }
+        else if (filter.max_level > 0) {
+            level_condition = L"(Level&gt;=1 and Level&lt;=" + std::to_wstring(filter.max_level) + L")";
+        }
+        std::wstring age_condition;
+        if (filter.max_age_days > 0) {
+            std::uint64_t max_age_ms = static_cast<std::uint64_t>(filter.max_age_days) * 24 * 60 * 60 * 1000;
+            age_condition = L"TimeCreated[timediff(@SystemTime)&lt;=" + std::to_wstring(max_age_ms) + L"]";
+        }
+
+        std::wstring path = escapeXml(channel);
+        std::wstring select_open = L"<Select Path=\"" + path + L"\">";
+        std::wstring suppress_open = L"<Suppress Path=\"" + path + L"\">";
+        std::wstring query = L"<QueryList><Query Id=\"0\" Path=\"" + path + L"\">";
+
+        auto id_chunks = filter_ids
+            ? chunkIdExpressions(collapseRanges(filter.event_ids)) : std::vector<std::wstring>();
+        if (filter_ids && filter.include_event_ids) {
+            for (const auto& ids : id_chunks) {
+                query += select_open + systemPath({ ids, level_condition, age_condition }) + L"</Select>";
+            }
+        }
+        else {
+            query += select_open + systemPath({ level_condition, age_condition }) + L"</Select>";
+            for (const auto& ids : id_chunks) {
+                query += suppress_open + systemPath({ ids }) + L"</Suppress>";
+            }
+        }
+        query += L"</Query></QueryList>";
+        return query;
+    }
+}
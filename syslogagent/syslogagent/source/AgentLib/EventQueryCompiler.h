@@ -0,0 +1,51 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include "framework.h"
+
+// EventQueryCompiler turns the configured event filters into the query that
+// is passed to EvtSubscribe, so that events we'd throw away anyway are
+// filtered by the event log service and never delivered or rendered.
+//
+// With no filters the query is just "*".  Otherwise a structured XML query
+// is produced:
+//
+//   <QueryList><Query Id="0" Path="Security">
+//     <Select Path="Security">*[System[(EventID=4624 or (EventID&gt;=4634 and
+//       EventID&lt;=4647)) and (Level&lt;=3) and TimeCreated[timediff(@SystemTime)
+//       &lt;=86400000]]]</Select>
+//     <Suppress Path="Security">*[System[(EventID=4662)]]</Suppress>
+//   </Query></QueryList>
+//
+// The event log's XPath subset limits how many expressions one Select can
+// hold, so event ID lists are collapsed into ranges and spread over as many
+// Select (include list) or Suppress (ignore list) elements as needed.
+
+namespace Syslog_agent {
+
+    struct AGENTLIB_API EventQueryFilter {
+        std::set<std::uint32_t> event_ids;
+        bool include_event_ids = false;     // true: only these IDs, false: all but these
+        int max_level = 0;                  // keep Level 1..max_level (plus LogAlways when >= 4), 0 = all
+        std::uint32_t max_age_days = 0;     // skip events older than this, 0 = no limit
+    };
+
+    class AGENTLIB_API EventQueryCompiler {
+    public:
+        // stays under the ~22 expression limit with room for the level and age terms
+        static constexpr int MAX_EXPRESSIONS_PER_SELECT = 16;
+        static constexpr int LEVEL_INFORMATION = 4;
+
+        static std::wstring compile(const std::wstring& channel, const EventQueryFilter& filter);
+
+    private:
+        static std::wstring escapeXml(const std::wstring& value);
+    };
+}
@@ -0,0 +1,499 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "EventRuleEngine.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace Syslog_agent {
+
+    namespace {
+        constexpr int LEVEL_LOG_ALWAYS = 0;
+        constexpr int LEVEL_INFORMATION = 4;
+
+        void skipSpaces(std::string_view& text) {
+            while (!text.empty() && isspace(static_cast<unsigned char>(text.front()))) {
+                text.remove_prefix(1);
+            }
+        }
+
+        std::string_view readWord(std::string_view& text) {
+            size_t length = 0;
+            while (length < text.size()) {
+                char c = text[length];
+                if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' && c != '.' && c != ':') {
+                    break;
+                }
+                ++length;
+            }
+            auto word = text.substr(0, length);
+            text.remove_prefix(length);
+            return word;
+        }
+
+        bool equalsIgnoreCase(std::string_view a, const char* b) {
+            size_t b_length = strlen(b);
+            if (a.size() != b_length) {
+                return false;
+            }
+            for (size_t i = 0; i < b_length; ++i) {
+                if (tolower(static_cast<unsigned char>(a[i])) != b[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::string toLower(std::string_view text) {
+            std::string lower(text);
+            for (auto& c : lower) {
+                c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            }
+            return lower;
+        }
+
+        bool parseNumber(std::string_view text, std::int64_t& value_out) {
+            char buffer[32];
+            if (text.empty() || text.size() >= sizeof(buffer)) {
+                return false;
+            }
+            memcpy(buffer, text.data(), text.size());
+            buffer[text.size()] = 0;
+            char* end;
+            value_out = strtoll(buffer, &end, 0);   // accepts 0x hex as used in event data
+            return *end == 0;
+        }
+    }
+
+    const char* EventRuleEngine::actionName(Action action) {
+        switch (action) {
+        case Action::Forward: return "forward";
+        case Action::Drop: return "drop";
+        case Action::PrimaryOnly: return "primary";
+        case Action::SecondaryOnly: return "secondary";
+        case Action::Aggregate: return "aggregate";
+        }
+        return "unknown";
+    }
+
+    bool EventRuleEngine::compareNumbers(std::int64_t value, Op op, std::int64_t target) {
+        switch (op) {
+        case Op::Lt: return value < target;
+        case Op::Le: return value <= target;
+        case Op::Gt: return value > target;
+        case Op::Ge: return value >= target;
+        default: return value == target;
+        }
+    }
+
+    std::uint32_t EventRuleEngine::intern(std::string_view name) {
+        auto lower = toLower(name);
+        auto found = symbols_.find(std::string_view(lower));
+        if (found != symbols_.end()) {
+            return found->second;
+        }
+        auto symbol = static_cast<std::uint32_t>(symbols_.size() + 1);
+        symbols_.emplace(std::move(lower), symbol);
+        return symbol;
+    }
+
+    std::uint32_t EventRuleEngine::lookupSymbol(std::string_view name) const {
+        char lower[MAX_NAME_LENGTH];
+        if (name.size() > sizeof(lower) || symbols_.empty()) {
+            return 0;
+        }
+        for (size_t i = 0; i < name.size(); ++i) {
+            lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(name[i])));
+        }
+        auto found = symbols_.find(std::string_view(lower, name.size()));
+        return found == symbols_.end() ? 0 : found->second;
+    }
+
+    bool EventRuleEngine::parseCondition(std::string_view& rest, Condition& condition, std::string& error) {
+        auto field = readWord(rest);
+        if (field.empty()) {
+            error = "expected a field name at \"" + std::string(rest.substr(0, 20)) + "\"";
+            return false;
+        }
+
+        if (rest.substr(0, 2) == "!=") { condition.op = Op::Ne; rest.remove_prefix(2); }
+        else if (rest.substr(0, 2) == "<=") { condition.op = Op::Le; rest.remove_prefix(2); }
+        else if (rest.substr(0, 2) == ">=") { condition.op = Op::Ge; rest.remove_prefix(2); }
+        else if (rest.substr(0, 1) == "=") { condition.op = Op::Eq; rest.remove_prefix(1); }
+        else if (rest.substr(0, 1) == "~") { condition.op = Op::Match; rest.remove_prefix(1); }
+        else if (rest.substr(0, 1) == "<") { condition.op = Op::Lt; rest.remove_prefix(1); }
+        else if (rest.substr(0, 1) == ">") { condition.op = Op::Gt; rest.remove_prefix(1); }
+        else {
+            error = "expected an operator after \"" + std::string(field) + "\"";
+            return false;
+        }
+
+        std::string value;
+        if (!rest.empty() && rest.front() == '"') {
+            rest.remove_prefix(1);
+            bool closed = false;
+            while (!rest.empty()) {
+                char c = rest.front();
+                rest.remove_prefix(1);
+                if (c == '\\' && !rest.empty()) {
+                    value.push_back(rest.front());
+                    rest.remove_prefix(1);
+                }
+                else if (c == '"') {
+                    closed = true;
+                    break;
+                }
+                else {
+                    value.push_back(c);
+                }
+            }
+            if (!closed) {
+                error = "unterminated string for \"" + std::string(field) + "\"";
+                return false;
+            }
+        }
+        else {
+            while (!rest.empty() && !isspace(static_cast<unsigned char>(rest.front()))) {
+                value.push_back(rest.front());
+                rest.remove_prefix(1);
+            }
+        }
+
+        bool numeric_op = condition.op == Op::Lt || condition.op == Op::Le
+            || condition.op == Op::Gt || condition.op == Op::Ge;
+
+        if (equalsIgnoreCase(field, "provider") || equalsIgnoreCase(field, "channel")) {
+            condition.kind = equalsIgnoreCase(field, "provider") ? FieldKind::Provider : FieldKind::Channel;
+            if (numeric_op) {
+                error = std::string(field) + " can't be compared as a number";
+                return false;
+            }
+            if (condition.op != Op::Match) {
+                condition.symbol = intern(value);
+            }
+        }
+        else if (equalsIgnoreCase(field, "id")) {
+            condition.kind = FieldKind::EventId;
+            if (condition.op == Op::Match) {
+                error = "id can't be matched with a regular expression";
+                return false;
+            }
+            if (numeric_op) {
+                if (!parseNumber(value, condition.number)) {
+                    error = "bad event id \"" + value + "\"";
+                    return false;
+                }
+            }
+            else {
+                std::string_view list(value);
+                while (!list.empty()) {
+                    auto comma = list.find(',');
+                    auto item = list.substr(0, comma);
+                    std::int64_t id;
+                    if (!parseNumber(item, id) || id < 0 || id > UINT32_MAX) {
+                        error = "bad event id \"" + std::string(item) + "\"";
+                        return false;
+                    }
+                    condition.ids.push_back(static_cast<std::uint32_t>(id));
+                    list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+                }
+                if (condition.ids.empty()) {
+                    error = "empty event id list";
+                    return false;
+                }
+                std::sort(condition.ids.begin(), condition.ids.end());
+                condition.ids.erase(std::unique(condition.ids.begin(), condition.ids.end()), condition.ids.end());
+            }
+        }
+        else if (equalsIgnoreCase(field, "level")) {
+            condition.kind = FieldKind::Level;
+            if (condition.op == Op::Match) {
+                error = "level can't be matched with a regular expression";
+                return false;
+            }
+            if (!parseNumber(value, condition.number)) {
+                error = "bad level \"" + value + "\"";
+                return false;
+            }
+        }
+        else {
+            condition.kind = FieldKind::EventData;
+            condition.name.assign(field);
+            if (numeric_op && !parseNumber(value, condition.number)) {
+                error = "bad number \"" + value + "\" for " + condition.name;
+                return false;
+            }
+            condition.text = value;
+        }
+
+        if (condition.op == Op::Match) {
+            try {
+                auto flags = std::regex::ECMAScript | std::regex::optimize;
+                if (condition.kind != FieldKind::EventData) {
+                    flags |= std::regex::icase;
+                }
+                condition.regex = std::make_shared<const std::regex>(value, flags);
+            }
+            catch (const std::regex_error& e) {
+                error = "bad regular expression \"" + value + "\": " + e.what();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool EventRuleEngine::parseRule(std::string_view line, int line_number, Rule& rule,
+        std::uint32_t& provider_out, std::vector<std::uint32_t>& ids_out, std::string& error) {
+        auto action = readWord(line);
+        if (equalsIgnoreCase(action, "forward")) rule.action = Action::Forward;
+        else if (equalsIgnoreCase(action, "drop")) rule.action = Action::Drop;
+        else if (equalsIgnoreCase(action, "primary")) rule.action = Action::PrimaryOnly;
+        else if (equalsIgnoreCase(action, "secondary")) rule.action = Action::SecondaryOnly;
+        else if (equalsIgnoreCase(action, "aggregate")) rule.action = Action::Aggregate;
+        else {
+            error = "unknown action \"" + std::string(action) + "\"";
+            return false;
+        }
+        rule.line = line_number;
+
+        if (rule.action == Action::Aggregate) {
+            rule.aggregation.rule_line = line_number;
+            if (!line.empty() && line.front() == '(') {
+                line.remove_prefix(1);
+                while (true) {
+                    skipSpaces(line);
+                    if (!line.empty() && line.front() == ')') {
+                        line.remove_prefix(1);
+                        break;
+                    }
+                    auto field = readWord(line);
+                    if (field.empty()) {
+                        error = "expected a field name in the aggregate list";
+                        return false;
+                    }
+                    rule.aggregation.group_by.emplace_back(field);
+                    skipSpaces(line);
+                    if (!line.empty() && line.front() == ',') {
+                        line.remove_prefix(1);
+                    }
+                    else if (line.empty() || line.front() != ')') {
+                        error = "expected , or ) in the aggregate list";
+                        return false;
+                    }
+                }
+            }
+        }
+
+        skipSpaces(line);
+        while (!line.empty()) {
+            Condition condition;
+            if (!parseCondition(line, condition, error)) {
+                return false;
+            }
+            rule.conditions.push_back(std::move(condition));
+            skipSpaces(line);
+        }
+
+        // pull out the conditions the index will take care of
+        provider_out = 0;
+        ids_out.clear();
+        for (auto it = rule.conditions.begin(); it != rule.conditions.end(); ) {
+            if (provider_out == 0 && it->kind == FieldKind::Provider && it->op == Op::Eq) {
+                provider_out = it->symbol;
+                it = rule.conditions.erase(it);
+            }
+            else if (ids_out.empty() && it->kind == FieldKind::EventId && it->op == Op::Eq) {
+                ids_out = std::move(it->ids);
+                it = rule.conditions.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        return true;
+    }
+
+    void EventRuleEngine::indexRule(Rule&& rule, std::uint32_t provider, const std::vector<std::uint32_t>& ids) {
+        auto rule_index = static_cast<std::uint32_t>(rules_.size());
+        if (rule.action == Action::Aggregate) {
+            ++aggregate_rule_count_;
+        }
+        rules_.push_back(std::move(rule));
+        if (provider != 0 && !ids.empty()) {
+            for (auto id : ids) {
+                by_provider_and_id_[(static_cast<std::uint64_t>(provider) << 32) | id].push_back(rule_index);
+            }
+        }
+        else if (provider != 0) {
+            by_provider_[provider].push_back(rule_index);
+        }
+        else if (!ids.empty()) {
+            for (auto id : ids) {
+                by_id_[id].push_back(rule_index);
+            }
+        }
+        else {
+            unindexed_.push_back(rule_index);
+        }
+    }
+
+    std::shared_ptr<const EventRuleEngine> EventRuleEngine::compile(std::string_view rules_text,
+        std::vector<CompileError>* errors) {
+        std::shared_ptr<EventRuleEngine> engine(new EventRuleEngine());
+        int line_number = 0;
+        while (!rules_text.empty()) {
+            auto newline = rules_text.find('\n');
+            auto line = rules_text.substr(0, newline);
+            rules_text.remove_prefix(newline == std::string_view::npos ? rules_text.size() : newline + 1);
+            ++line_number;
+
+            skipSpaces(line);
+            while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) {
+                line.remove_suffix(1);
+            }
+            if (line.empty() || line.front() == '#') {
+                continue;
+            }
+
+            Rule rule;
+            std::uint32_t provider;
+            std::vector<std::uint32_t> ids;
+            std::string error;
+            if (engine->parseRule(line, line_number, rule, provider, ids, error)) {
+                engine->indexRule(std::move(rule), provider, ids);
+            }
+            else if (errors) {
+                errors->push_back(CompileError{ line_number, error });
+            }
+        }
+        return engine;
+    }
+
+    bool EventRuleEngine::matches(const Rule& rule, const EventView& event,
+        std::uint32_t provider_symbol, std::uint32_t channel_symbol) const {
+        for (const auto& condition : rule.conditions) {
+            bool result = false;
+            switch (condition.kind) {
+            case FieldKind::Provider:
+            case FieldKind::Channel: {
+                if (condition.op == Op::Match) {
+                    auto text = condition.kind == FieldKind::Provider ? event.provider : event.channel;
+                    result = std::regex_search(text.begin(), text.end(), *condition.regex);
+                }
+                else {
+                    auto symbol = condition.kind == FieldKind::Provider ? provider_symbol : channel_symbol;
+                    result = (symbol == condition.symbol) == (condition.op == Op::Eq);
+                }
+                break;
+            }
+            case FieldKind::EventId:
+                if (condition.op == Op::Eq || condition.op == Op::Ne) {
+                    bool listed = std::binary_search(condition.ids.begin(), condition.ids.end(), event.event_id);
+                    result = listed == (condition.op == Op::Eq);
+                }
+                else {
+                    result = compareNumbers(event.event_id, condition.op, condition.number);
+                }
+                break;
+            case FieldKind::Level: {
+                int level = event.level == LEVEL_LOG_ALWAYS ? LEVEL_INFORMATION : event.level;
+                result = compareNumbers(level, condition.op, condition.number);
+                break;
+            }
+            case FieldKind::EventData: {
+                const Field* field = nullptr;
+                for (size_t i = 0; i < event.field_count; ++i) {
+                    if (event.fields[i].name == condition.name) {
+                        field = &event.fields[i];
+                        break;
+                    }
+                }
+                if (field == nullptr) {
+                    result = condition.op == Op::Ne;
+                }
+                else if (condition.op == Op::Eq || condition.op == Op::Ne) {
+                    result = (field->value == condition.text) == (condition.op == Op::Eq);
+                }
+                else if (condition.op == Op::Match) {
+                    result = std::regex_search(field->value.begin(), field->value.end(), *condition.regex);
+                }
+                else {
+                    std::int64_t value;
+                    result = parseNumber(field->value, value)
+                        && compareNumbers(value, condition.op, condition.number);
+                }
+                break;
+            }
+            }
+            if (!result) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    EventRuleEngine::Action EventRuleEngine::evaluate(const EventView& event) const {
+        return evaluate(event, nullptr);
+    }
+
+    EventRuleEngine::Action EventRuleEngine::evaluate(const EventView& event,
+        const Aggregation** aggregation_out) const {
+        if (aggregation_out) {
+            *aggregation_out = nullptr;
+        }
+        if (rules_.empty()) {
+            return Action::Forward;
+        }
+        auto provider_symbol = lookupSymbol(event.provider);
+        auto channel_symbol = lookupSymbol(event.channel);
+
+        // at most four candidate lists, each in rule order
+        const std::vector<std::uint32_t>* lists[4];
+        size_t list_count = 0;
+        if (provider_symbol != 0) {
+            auto found = by_provider_and_id_.find((static_cast<std::uint64_t>(provider_symbol) << 32) | event.event_id);
+            if (found != by_provider_and_id_.end()) {
+                lists[list_count++] = &found->second;
+            }
+            auto found_provider = by_provider_.find(provider_symbol);
+            if (found_provider != by_provider_.end()) {
+                lists[list_count++] = &found_provider->second;
+            }
+        }
+        auto found_id = by_id_.find(event.event_id);
+        if (found_id != by_id_.end()) {
+            lists[list_count++] = &found_id->second;
+        }
+        if (!unindexed_.empty()) {
+            lists[list_count++] = &unindexed_;
+        }
+
+        size_t positions[4] = { 0, 0, 0, 0 };
+        while (true) {
+            size_t best_list = list_count;
+            std::uint32_t best_rule = UINT32_MAX;
+            for (size_t i = 0; i < list_count; ++i) {
+                if (positions[i] < lists[i]->size() && (*lists[i])[positions[i]] < best_rule) {
+                    best_rule = (*lists[i])[positions[i]];
+                    best_list = i;
+                }
+            }
+            if (best_list == list_count) {
+                return Action::Forward;
+            }
+            ++positions[best_list];
+            const auto& rule = rules_[best_rule];
+            if (matches(rule, event, provider_symbol, channel_symbol)) {
+                if (aggregation_out && rule.action == Action::Aggregate) {
+                    *aggregation_out = &rule.aggregation;
+                }
+                return rule.action;
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "framework.h"
+
+// EventRuleEngine filters and routes events after their fields have been
+// extracted and before any JSON is generated.
+//
+// Rules are plain text, one per line, evaluated in order; the first rule
+// whose conditions all match decides what happens to the event.  Events
+// matching no rule are forwarded as usual.
+//
+//   # drop network logons by service accounts
+//   drop provider="Microsoft-Windows-Security-Auditing" id=4624 LogonType=3 TargetUserName~"^svc_"
+//   # only Warning and above from this provider
+//   drop provider="Noisy-Provider" level>3
+//   # channel Y goes to the secondary server only
+//   secondary channel="Y"
+//   forward id=1102,4719
+//   # one summary per user and address instead of every logon
+//   aggregate(TargetUserName,IpAddress) id=4624,4634
+//
+// Actions:    forward | drop | primary | secondary | aggregate(field,...)
+// Fields:     provider, channel, id, level, or any EventData name
+// Operators:  =  !=  (strings, or numbers; id accepts a comma list)
+//             ~ (regular expression search, strings only)
+//             <  <=  >  >=  (numbers)
+// provider and channel compare case-insensitively; level 0 (LogAlways)
+// compares as 4 (Information).
+// aggregate groups matching events by event ID, provider and the listed
+// EventData fields, and sends one summary per group per window instead of
+// each event (see EventAggregator); the field list may be empty.
+//
+// The rules are compiled into hash tables keyed on provider and event ID,
+// so an event is only checked against the rules that could apply to it
+// (those for its provider and/or ID, plus the rules that name neither),
+// and provider/channel literals are interned so comparing them is an
+// integer compare.  Regular expressions are compiled once up front.  A
+// compiled engine is immutable and can be shared between threads.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API EventRuleEngine {
+    public:
+        enum class Action { Forward, Drop, PrimaryOnly, SecondaryOnly, Aggregate };
+
+        // What an aggregate rule groups by; rule_line tells the rules apart
+        struct Aggregation {
+            int rule_line = 0;
+            std::vector<std::string> group_by;
+        };
+
+        struct Field {
+            std::string_view name;
+            std::string_view value;
+        };
+
+        struct EventView {
+            std::string_view provider;
+            std::string_view channel;
+            std::uint32_t event_id = 0;
+            int level = 0;
+            const Field* fields = nullptr;
+            size_t field_count = 0;
+        };
+
+        struct CompileError {
+            int line;
+            std::string message;
+        };
+
+        static constexpr size_t MAX_NAME_LENGTH = 512;
+
+        // Compiles the rules; rules with errors are skipped and reported in errors.
+        static std::shared_ptr<const EventRuleEngine> compile(std::string_view rules_text,
+            std::vector<CompileError>* errors = nullptr);
+
+        Action evaluate(const EventView& event) const;
+        // Same, and for Action::Aggregate also the matching rule's
+        // Aggregation, which lives as long as the engine does
+        Action evaluate(const EventView& event, const Aggregation** aggregation_out) const;
+        size_t ruleCount() const { return rules_.size(); }
+        size_t aggregateRuleCount() const { return aggregate_rule_count_; }
+
+        static const char* actionName(Action action);
+
+    private:
+        enum class FieldKind { Provider, Channel, EventId, Level, EventData };
+        enum class Op { Eq, Ne, Match, Lt, Le, Gt, Ge };
+
+        struct Condition {
+            FieldKind kind;
+            Op op;
+            std::string name;                   // EventData field name
+            std::string text;                   // string literal
+            std::uint32_t symbol = 0;           // interned provider/channel literal
+            std::int64_t number = 0;
+            std::vector<std::uint32_t> ids;     // id = / != list, sorted
+            std::shared_ptr<const std::regex> regex;
+        };
+
+        struct Rule {
+            Action action;
+            int line;
+            std::vector<Condition> conditions;  // minus what the index already guarantees
+            Aggregation aggregation;            // aggregate rules only
+        };
+
+        EventRuleEngine() = default;
+
+        bool parseRule(std::string_view line, int line_number, Rule& rule,
+            std::uint32_t& provider_out, std::vector<std::uint32_t>& ids_out, std::string& error);
+        bool parseCondition(std::string_view& rest, Condition& condition, std::string& error);
+        void indexRule(Rule&& rule, std::uint32_t provider, const std::vector<std::uint32_t>& ids);
+        std::uint32_t intern(std::string_view name);
+        std::uint32_t lookupSymbol(std::string_view name) const;
+        bool matches(const Rule& rule, const EventView& event, std::uint32_t provider_symbol,
+            std::uint32_t channel_symbol) const;
+        static bool compareNumbers(std::int64_t value, Op op, std::int64_t target);
+
+        struct SymbolHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+        };
+        struct SymbolEqual {
+            using is_transparent = void;
+            bool operator()(std::string_view a, std::string_view b) const { return a == b; }
+        };
+
+        std::vector<Rule> rules_;
+        // lower-cased provider/channel names; symbol 0 means "not named by any rule"
+        std::unordered_map<std::string, std::uint32_t, SymbolHash, SymbolEqual> symbols_;
+        std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> by_provider_and_id_;
+        std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> by_provider_;
+        std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> by_id_;
+        std::vector<std::uint32_t> unindexed_;
+        size_t aggregate_rule_count_ = 0;
+    };
+}
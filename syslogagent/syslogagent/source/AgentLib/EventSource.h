@@ -0,0 +1,25 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <memory>
+#include "OrderedWorkPool.h"
+
+// EventSource is where a channel's events come from, as OrderedWorkPool
+// tasks: the event log on Windows (EventLogSubscription), or a recording
+// (ReplayEventSource), so the pool's scaling can be measured anywhere.
+
+namespace Syslog_agent {
+
+    class EventSource {
+    public:
+        virtual ~EventSource() = default;
+
+        // Up to `max` tasks for the next events, in the order they were
+        // logged; 0 when there are no more for now
+        virtual size_t next(std::unique_ptr<OrderedWorkPool::Task>* tasks, size_t max) = 0;
+    };
+}
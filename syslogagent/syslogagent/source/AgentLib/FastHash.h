@@ -0,0 +1,83 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// FastHash is a small non-cryptographic 64-bit hash for keying events in
+// in-memory tables.  It consumes 8 bytes per step with one multiply, which
+// is several times faster than byte-at-a-time hashes such as FNV on
+// typical event fields, and finishes with the murmur3 avalanche so that the
+// low bits are usable directly as a bucket index.
+//
+// FastHasher hashes a sequence of fields; each field's length is mixed in
+// so that ("ab", "c") and ("a", "bc") hash differently.
+
+namespace Syslog_agent {
+
+    class FastHasher {
+    public:
+        explicit FastHasher(std::uint64_t seed = 0) : state_(seed ^ PRIME_1) {}
+
+        FastHasher& add(const void* data, size_t length) {
+            auto bytes = static_cast<const unsigned char*>(data);
+            size_t remaining = length;
+            while (remaining >= 8) {
+                std::uint64_t word;
+                memcpy(&word, bytes, sizeof(word));
+                mixWord(word);
+                bytes += 8;
+                remaining -= 8;
+            }
+            if (remaining > 0) {
+                std::uint64_t word = 0;
+                memcpy(&word, bytes, remaining);
+                mixWord(word);
+            }
+            mixWord(static_cast<std::uint64_t>(length) ^ PRIME_3);
+            return *this;
+        }
+
+        FastHasher& add(std::string_view text) {
+            return add(text.data(), text.size());
+        }
+
+        FastHasher& add(std::uint64_t value) {
+            mixWord(value);
+            return *this;
+        }
+
+        std::uint64_t digest() const {
+            std::uint64_t h = state_;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+    private:
+        static constexpr std::uint64_t PRIME_1 = 0x9e3779b185ebca87ULL;
+        static constexpr std::uint64_t PRIME_2 = 0xc2b2ae3d27d4eb4fULL;
+        static constexpr std::uint64_t PRIME_3 = 0x165667b19e3779f9ULL;
+
+        void mixWord(std::uint64_t word) {
+            word *= PRIME_2;
+            word = (word << 31) | (word >> 33);
+            state_ ^= word * PRIME_1;
+            state_ = ((state_ << 27) | (state_ >> 37)) * PRIME_1 + PRIME_3;
+        }
+
+        std::uint64_t state_;
+    };
+
+    inline std::uint64_t fastHash(std::string_view text, std::uint64_t seed = 0) {
+        return FastHasher(seed).add(text).digest();
+    }
+}
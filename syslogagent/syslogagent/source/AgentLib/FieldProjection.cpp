@@ -0,0 +1,319 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "FieldProjection.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace Syslog_agent {
+
+    namespace {
+        void skipSpaces(std::string_view& text) {
+            while (!text.empty() && isspace(static_cast<unsigned char>(text.front()))) {
+                text.remove_prefix(1);
+            }
+        }
+
+        // A bare word, or a double-quoted string with backslash escapes
+        bool readToken(std::string_view& text, std::string& token, std::string& error) {
+            token.clear();
+            while (!text.empty() && !isspace(static_cast<unsigned char>(text.front()))) {
+                char c = text.front();
+                text.remove_prefix(1);
+                if (c != '"') {
+                    token.push_back(c);
+                    continue;
+                }
+                bool closed = false;
+                while (!text.empty()) {
+                    c = text.front();
+                    text.remove_prefix(1);
+                    if (c == '\\' && !text.empty()) {
+                        token.push_back(text.front());
+                        text.remove_prefix(1);
+                    }
+                    else if (c == '"') {
+                        closed = true;
+                        break;
+                    }
+                    else {
+                        token.push_back(c);
+                    }
+                }
+                if (!closed) {
+                    error = "unterminated string";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool startsWithIgnoreCase(std::string_view text, const char* prefix) {
+            size_t length = strlen(prefix);
+            if (text.size() < length) {
+                return false;
+            }
+            for (size_t i = 0; i < length; ++i) {
+                if (tolower(static_cast<unsigned char>(text[i])) != prefix[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::string toLower(std::string_view text) {
+            std::string lower(text);
+            for (auto& c : lower) {
+                c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            }
+            return lower;
+        }
+
+        void addUnique(std::vector<std::string>& names, const std::vector<std::string>& more) {
+            for (const auto& name : more) {
+                if (std::find(names.begin(), names.end(), name) == names.end()) {
+                    names.push_back(name);
+                }
+            }
+        }
+    }
+
+    bool FieldProjection::Projection::listedByName(std::string_view name) const {
+        return std::binary_search(listed_names_.begin(), listed_names_.end(), name,
+            [](std::string_view a, std::string_view b) { return a < b; });
+    }
+
+    bool FieldProjection::parseLine(std::string_view line, std::string& verb, std::string& provider,
+        std::vector<std::uint32_t>& ids, bool& everything, std::vector<std::string>& fields,
+        std::string& error) {
+        std::string token;
+        readToken(line, verb, error);
+        verb = toLower(verb);
+        if (verb != "include" && verb != "exclude" && verb != "strip-message") {
+            error = "unknown verb \"" + verb + "\"";
+            return false;
+        }
+
+        provider.clear();
+        ids.clear();
+        everything = false;
+        fields.clear();
+        while (true) {
+            skipSpaces(line);
+            if (line.empty()) {
+                break;
+            }
+            if (!readToken(line, token, error)) {
+                return false;
+            }
+            if (token == "*") {
+                everything = true;
+            }
+            else if (startsWithIgnoreCase(token, "provider=")) {
+                provider = token.substr(strlen("provider="));
+                if (provider.empty() || provider.size() > MAX_NAME_LENGTH) {
+                    error = "bad provider \"" + provider + "\"";
+                    return false;
+                }
+            }
+            else if (startsWithIgnoreCase(token, "id=")) {
+                std::string_view list(token);
+                list.remove_prefix(strlen("id="));
+                while (!list.empty()) {
+                    auto comma = list.find(',');
+                    std::string item(list.substr(0, comma));
+                    char* end;
+                    long long id = strtoll(item.c_str(), &end, 10);
+                    if (item.empty() || *end != 0 || id < 0 || id > UINT32_MAX) {
+                        error = "bad event id \"" + item + "\"";
+                        return false;
+                    }
+                    ids.push_back(static_cast<std::uint32_t>(id));
+                    list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+                }
+                if (ids.empty()) {
+                    error = "empty event id list";
+                    return false;
+                }
+            }
+            else if (token.find('=') != std::string::npos) {
+                error = "unknown scope \"" + token + "\"";
+                return false;
+            }
+            else {
+                fields.push_back(token);
+            }
+        }
+
+        if (everything == (!provider.empty() || !ids.empty())) {
+            error = everything ? "* can't be combined with provider= or id=" : "expected *, provider= or id=";
+            return false;
+        }
+        if (verb == "strip-message" && !fields.empty()) {
+            error = "strip-message takes no field names";
+            return false;
+        }
+        if (verb != "strip-message" && fields.empty()) {
+            error = "expected field names after the scope";
+            return false;
+        }
+        return true;
+    }
+
+    FieldProjection::Projection FieldProjection::build(const ScopeLists& scope, const ScopeLists& global,
+        JsonStringTable& string_table) {
+        Projection projection;
+        std::vector<std::string> excluded = scope.exclude;
+        addUnique(excluded, global.exclude);
+        std::vector<std::string> listed;
+        if (!scope.include.empty()) {
+            projection.include_only_ = true;
+            for (const auto& name : scope.include) {
+                if (std::find(excluded.begin(), excluded.end(), name) == excluded.end()) {
+                    listed.push_back(name);
+                }
+            }
+        }
+        else {
+            listed = std::move(excluded);
+        }
+        projection.strip_message_ = scope.strip_message || global.strip_message;
+
+        for (const auto& name : listed) {
+            auto entry = string_table.intern(name);
+            if (entry == nullptr) {
+                projection.listed_names_.push_back(name);
+                continue;
+            }
+            size_t word = entry->id >> 6;
+            if (word >= projection.listed_bits_.size()) {
+                projection.listed_bits_.resize(word + 1, 0);
+            }
+            projection.listed_bits_[word] |= std::uint64_t(1) << (entry->id & 63);
+        }
+        std::sort(projection.listed_names_.begin(), projection.listed_names_.end());
+        return projection;
+    }
+
+    std::shared_ptr<const FieldProjection> FieldProjection::compile(std::string_view text,
+        JsonStringTable& string_table, std::vector<CompileError>* errors) {
+        std::shared_ptr<FieldProjection> result(new FieldProjection());
+
+        // gather every line's lists by scope first, so * applies under all of them
+        ScopeLists global;
+        bool has_global = false;
+        std::map<std::uint32_t, ScopeLists> ids;
+        std::map<std::string, ScopeLists> providers;
+        std::map<std::pair<std::string, std::uint32_t>, ScopeLists> provider_ids;
+
+        int line_number = 0;
+        while (!text.empty()) {
+            auto newline = text.find('\n');
+            auto line = text.substr(0, newline);
+            text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+            ++line_number;
+
+            skipSpaces(line);
+            while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) {
+                line.remove_suffix(1);
+            }
+            if (line.empty() || line.front() == '#') {
+                continue;
+            }
+
+            std::string verb;
+            std::string provider;
+            std::vector<std::uint32_t> line_ids;
+            bool everything;
+            std::vector<std::string> fields;
+            std::string error;
+            if (!parseLine(line, verb, provider, line_ids, everything, fields, error)) {
+                if (errors) {
+                    errors->push_back(CompileError{ line_number, error });
+                }
+                continue;
+            }
+
+            auto apply = [&](ScopeLists& scope) {
+                if (verb == "include") addUnique(scope.include, fields);
+                else if (verb == "exclude") addUnique(scope.exclude, fields);
+                else scope.strip_message = true;
+            };
+            if (everything) {
+                apply(global);
+                has_global = true;
+            }
+            else if (!provider.empty() && !line_ids.empty()) {
+                for (auto id : line_ids) {
+                    apply(provider_ids[{ toLower(provider), id }]);
+                }
+            }
+            else if (!provider.empty()) {
+                apply(providers[toLower(provider)]);
+            }
+            else {
+                for (auto id : line_ids) {
+                    apply(ids[id]);
+                }
+            }
+        }
+
+        auto add = [&](const ScopeLists& scope) {
+            result->projections_.push_back(build(scope, global, string_table));
+            return static_cast<int>(result->projections_.size() - 1);
+        };
+        if (has_global) {
+            result->global_ = add(global);
+        }
+        for (const auto& item : ids) {
+            result->by_id_[item.first] = add(item.second);
+        }
+        for (const auto& item : providers) {
+            result->by_provider_[item.first].any = add(item.second);
+        }
+        for (const auto& item : provider_ids) {
+            result->by_provider_[item.first.first].by_id[item.first.second] = add(item.second);
+        }
+        return result;
+    }
+
+    const FieldProjection::Projection* FieldProjection::select(std::string_view provider,
+        std::uint32_t event_id) const {
+        if (projections_.empty()) {
+            return nullptr;
+        }
+        if (!by_provider_.empty()) {
+            char lower[MAX_NAME_LENGTH];
+            if (provider.size() <= sizeof(lower)) {
+                for (size_t i = 0; i < provider.size(); ++i) {
+                    lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(provider[i])));
+                }
+                auto found = by_provider_.find(std::string_view(lower, provider.size()));
+                if (found != by_provider_.end()) {
+                    auto by_id = found->second.by_id.find(event_id);
+                    if (by_id != found->second.by_id.end()) {
+                        return &projections_[by_id->second];
+                    }
+                    auto by_event_id = by_id_.find(event_id);
+                    if (by_event_id != by_id_.end()) {
+                        return &projections_[by_event_id->second];
+                    }
+                    if (found->second.any >= 0) {
+                        return &projections_[found->second.any];
+                    }
+                    return global_ >= 0 ? &projections_[global_] : nullptr;
+                }
+            }
+        }
+        auto by_event_id = by_id_.find(event_id);
+        if (by_event_id != by_id_.end()) {
+            return &projections_[by_event_id->second];
+        }
+        return global_ >= 0 ? &projections_[global_] : nullptr;
+    }
+}
@@ -0,0 +1,129 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "framework.h"
+#include "JsonStringTable.h"
+
+// FieldProjection decides which EventData fields go into the generated
+// JSON, per provider and event ID, so fields nobody uses (ProcessId,
+// ThreadId, logon GUIDs) are never escaped, serialized or sent.
+//
+// The lists are plain text, one per line:
+//
+//   # never send these
+//   exclude *                                  ProcessId ThreadId
+//   # only these for logons, and no message text
+//   include provider="Microsoft-Windows-Security-Auditing" id=4624,4625 TargetUserName IpAddress LogonType
+//   strip-message provider="Microsoft-Windows-Security-Auditing" id=4624,4625
+//   exclude id=4688                            ProcessId ParentProcessName
+//
+// A line is a verb, the scope it applies to, then field names.  The scope
+// is * (every event), or provider=, id= (a comma list), or both.  An event
+// takes the most specific scope that matches it: provider and ID, then ID,
+// then provider, then *.  A scope with an include list sends only those
+// fields; one without sends everything not excluded.  The exclusions and
+// strip-message of * apply under every other scope as well.  Provider
+// names compare case-insensitively, field names exactly.
+//
+// strip-message drops the rendered message text of events that have
+// EventData (the message is mostly the same fields again, in prose);
+// events with no EventData keep it.
+//
+// Field names are interned in the JsonStringTable at compile time, and
+// each scope's list compiled into a bitmap over the interned ids, so with
+// the key's table entry in hand (which serializing needs anyway) deciding
+// on a field is one bit test.  A compiled projection is immutable and can
+// be shared between threads.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API FieldProjection {
+    public:
+        // The fields one scope sends
+        class AGENTLIB_API Projection {
+        public:
+            // key is the name's string table entry, or nullptr if the table
+            // couldn't intern it
+            bool keeps(const JsonStringTable::Entry* key, std::string_view name) const {
+                bool listed;
+                if (key != nullptr) {
+                    size_t word = key->id >> 6;
+                    listed = word < listed_bits_.size() && ((listed_bits_[word] >> (key->id & 63)) & 1) != 0;
+                }
+                else {
+                    listed = listedByName(name);
+                }
+                return listed == include_only_;
+            }
+            bool stripMessage() const { return strip_message_; }
+            bool includeOnly() const { return include_only_; }
+
+        private:
+            friend class FieldProjection;
+            bool listedByName(std::string_view name) const;
+
+            bool include_only_ = false;
+            bool strip_message_ = false;
+            std::vector<std::uint64_t> listed_bits_;    // by interned id
+            std::vector<std::string> listed_names_;     // sorted, for names the table couldn't take
+        };
+
+        struct CompileError {
+            int line;
+            std::string message;
+        };
+
+        static constexpr size_t MAX_NAME_LENGTH = 512;
+
+        // Compiles the lists, interning field names in string_table; lines
+        // with errors are skipped and reported in errors.
+        static std::shared_ptr<const FieldProjection> compile(std::string_view text,
+            JsonStringTable& string_table, std::vector<CompileError>* errors = nullptr);
+
+        // The projection for an event, or nullptr if it's sent whole.
+        const Projection* select(std::string_view provider, std::uint32_t event_id) const;
+        size_t scopeCount() const { return projections_.size(); }
+
+    private:
+        struct ScopeLists {
+            std::vector<std::string> include;
+            std::vector<std::string> exclude;
+            bool strip_message = false;
+        };
+        struct ProviderScopes {
+            int any = -1;                                   // provider= alone
+            std::unordered_map<std::uint32_t, int> by_id;   // provider= and id=
+        };
+        struct NameHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+        };
+        struct NameEqual {
+            using is_transparent = void;
+            bool operator()(std::string_view a, std::string_view b) const { return a == b; }
+        };
+
+        FieldProjection() = default;
+
+        static bool parseLine(std::string_view line, std::string& verb, std::string& provider,
+            std::vector<std::uint32_t>& ids, bool& everything, std::vector<std::string>& fields,
+            std::string& error);
+        static Projection build(const ScopeLists& scope, const ScopeLists& global, JsonStringTable& string_table);
+
+        std::vector<Projection> projections_;
+        int global_ = -1;
+        std::unordered_map<std::uint32_t, int> by_id_;
+        std::unordered_map<std::string, ProviderScopes, NameHash, NameEqual> by_provider_;   // lower case
+    };
+}
@@ -0,0 +1,632 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "GzipCompressor.h"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+
+namespace Syslog_agent {
+
+    namespace {
+        const size_t WINDOW_SIZE = 32768;
+        const size_t WINDOW_MASK = WINDOW_SIZE - 1;
+        const size_t MIN_MATCH = 3;
+        const size_t MAX_MATCH = 258;
+        // enough ahead of the current position for the longest match, and the
+        // hash of the string after it
+        const size_t MIN_LOOKAHEAD = MAX_MATCH + MIN_MATCH + 1;
+        const size_t MAX_DISTANCE = WINDOW_SIZE - MIN_LOOKAHEAD;
+        // a 3 byte match further back than this costs more than the literals
+        const size_t TOO_FAR = 4096;
+        const int HASH_BITS = 15;
+        const size_t HASH_SIZE = size_t(1) << HASH_BITS;
+        const int NIL = -1;
+
+        const int LITERALS = 256;
+        const int END_OF_BLOCK = 256;
+        const int LENGTH_CODES = 29;
+        const int LITERAL_LENGTH_CODES = LITERALS + 1 + LENGTH_CODES;
+        const int DISTANCE_CODES = 30;
+        const int CODE_LENGTH_CODES = 19;
+        const int MAX_BITS = 15;
+        const int MAX_CODE_LENGTH_BITS = 7;
+
+        const int LENGTH_BASE[LENGTH_CODES] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        const int LENGTH_EXTRA[LENGTH_CODES] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        const int DISTANCE_BASE[DISTANCE_CODES] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        const int DISTANCE_EXTRA[DISTANCE_CODES] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+        const int CODE_LENGTH_ORDER[CODE_LENGTH_CODES] = {
+            16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+        // zlib's: how long a match is good enough to search less for, to stop
+        // looking for a longer one after, and to stop searching at; and how
+        // far down a hash chain to look
+        struct LevelConfig {
+            size_t good_length;
+            size_t max_lazy;
+            size_t nice_length;
+            int max_chain;
+        };
+        const LevelConfig LEVELS[GzipCompressor::MAX_LEVEL + 1] = {
+            { 0, 0, 0, 0 },
+            { 4, 4, 8, 4 },
+            { 4, 5, 16, 8 },
+            { 4, 6, 32, 32 },
+            { 4, 4, 16, 16 },
+            { 8, 16, 32, 32 },
+            { 8, 16, 128, 128 },
+            { 8, 32, 128, 256 },
+            { 32, 128, 258, 1024 },
+            { 32, 258, 258, 4096 } };
+
+        struct Tables {
+            std::uint32_t crc[256];
+            unsigned char length_code[MAX_MATCH + 1];
+            unsigned char distance_code[512];
+
+            Tables() {
+                for (std::uint32_t n = 0; n < 256; ++n) {
+                    std::uint32_t c = n;
+                    for (int k = 0; k < 8; ++k) {
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    crc[n] = c;
+                }
+                for (int code = 0; code < LENGTH_CODES; ++code) {
+                    int end = code + 1 < LENGTH_CODES ? LENGTH_BASE[code + 1] : MAX_MATCH + 1;
+                    for (int length = LENGTH_BASE[code]; length < end; ++length) {
+                        length_code[length] = static_cast<unsigned char>(code);
+                    }
+                }
+                // 258 has a code of its own, rather than 227 + 31
+                length_code[MAX_MATCH] = LENGTH_CODES - 1;
+                // distances up to 256 directly, the rest by 128s, as in zlib
+                for (int code = 0; code < DISTANCE_CODES; ++code) {
+                    int end = code + 1 < DISTANCE_CODES ? DISTANCE_BASE[code + 1] : 32769;
+                    for (int distance = DISTANCE_BASE[code]; distance < end; ++distance) {
+                        if (distance <= 256) {
+                            distance_code[distance - 1] = static_cast<unsigned char>(code);
+                        }
+                        else {
+                            distance_code[256 + ((distance - 1) >> 7)] = static_cast<unsigned char>(code);
+                        }
+                    }
+                }
+            }
+        };
+
+        const Tables& tables() {
+            static const Tables instance;
+            return instance;
+        }
+
+        int distanceCode(size_t distance) {
+            return distance <= 256 ? tables().distance_code[distance - 1]
+                : tables().distance_code[256 + ((distance - 1) >> 7)];
+        }
+
+        // Code lengths of at most `max_bits` for the symbols' frequencies;
+        // halves the frequencies until the Huffman code fits
+        void huffmanLengths(const std::uint32_t* freqs, int count, int max_bits, unsigned char* lengths) {
+            std::vector<std::uint32_t> scaled(freqs, freqs + count);
+            while (true) {
+                std::fill(lengths, lengths + count, static_cast<unsigned char>(0));
+                struct Node {
+                    std::uint64_t freq;
+                    int left;
+                    int right;
+                };
+                std::vector<Node> nodes;
+                typedef std::pair<std::uint64_t, int> Entry;
+                std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+                for (int symbol = 0; symbol < count; ++symbol) {
+                    if (scaled[symbol] > 0) {
+                        heap.push(Entry(scaled[symbol], static_cast<int>(nodes.size())));
+                        nodes.push_back({ scaled[symbol], -1, symbol });
+                    }
+                }
+                if (nodes.empty()) {
+                    return;
+                }
+                if (nodes.size() == 1) {
+                    lengths[nodes[0].right] = 1;
+                    return;
+                }
+                while (heap.size() > 1) {
+                    Entry a = heap.top();
+                    heap.pop();
+                    Entry b = heap.top();
+                    heap.pop();
+                    heap.push(Entry(a.first + b.first, static_cast<int>(nodes.size())));
+                    nodes.push_back({ a.first + b.first, a.second, b.second });
+                }
+                // depths, walking down from the root
+                std::vector<int> depth(nodes.size(), 0);
+                int deepest = 0;
+                for (int n = static_cast<int>(nodes.size()) - 1; n >= 0; --n) {
+                    if (nodes[n].left < 0) {
+                        lengths[nodes[n].right] = static_cast<unsigned char>(depth[n]);
+                        deepest = (std::max)(deepest, depth[n]);
+                    }
+                    else {
+                        depth[nodes[n].left] = depth[n] + 1;
+                        depth[nodes[n].right] = depth[n] + 1;
+                    }
+                }
+                if (deepest <= max_bits) {
+                    return;
+                }
+                for (auto& freq : scaled) {
+                    if (freq > 0) {
+                        freq = (freq + 1) / 2;
+                    }
+                }
+            }
+        }
+
+        // Gives symbols that don't occur a count, so that there are at least
+        // two codes and the code is complete
+        void atLeastTwoCodes(std::uint32_t* freqs, int count) {
+            int used = 0;
+            for (int symbol = 0; symbol < count; ++symbol) {
+                used += freqs[symbol] > 0 ? 1 : 0;
+            }
+            for (int symbol = 0; used < 2 && symbol < count; ++symbol) {
+                if (freqs[symbol] == 0) {
+                    freqs[symbol] = 1;
+                    ++used;
+                }
+            }
+        }
+
+        // Canonical codes for the lengths, bit reversed as deflate sends them
+        void huffmanCodes(const unsigned char* lengths, int count, std::uint16_t* codes) {
+            int length_count[MAX_BITS + 1] = {};
+            for (int symbol = 0; symbol < count; ++symbol) {
+                length_count[lengths[symbol]]++;
+            }
+            length_count[0] = 0;
+            int next_code[MAX_BITS + 1] = {};
+            int code = 0;
+            for (int bits = 1; bits <= MAX_BITS; ++bits) {
+                code = (code + length_count[bits - 1]) << 1;
+                next_code[bits] = code;
+            }
+            for (int symbol = 0; symbol < count; ++symbol) {
+                int length = lengths[symbol];
+                if (length == 0) {
+                    codes[symbol] = 0;
+                    continue;
+                }
+                int value = next_code[length]++;
+                int reversed = 0;
+                for (int bit = 0; bit < length; ++bit) {
+                    reversed = (reversed << 1) | ((value >> bit) & 1);
+                }
+                codes[symbol] = static_cast<std::uint16_t>(reversed);
+            }
+        }
+    }
+
+    struct GzipCompressor::State {
+        unsigned char window[2 * WINDOW_SIZE];
+        int head[HASH_SIZE];
+        int prev[WINDOW_SIZE];
+        size_t window_length = 0;   // bytes in the window
+        size_t pos = 0;             // next to compress
+        size_t match_length = MIN_MATCH - 1;
+        int match_start = 0;
+        bool match_available = false;
+
+        std::uint16_t symbols[SYMBOLS_PER_BLOCK];      // literal, or match length - 3 + 256
+        std::uint16_t distances[SYMBOLS_PER_BLOCK];    // 0 for a literal
+        size_t symbol_count = 0;
+        std::uint32_t literal_freqs[LITERAL_LENGTH_CODES];
+        std::uint32_t distance_freqs[DISTANCE_CODES];
+
+        std::uint64_t bit_buffer = 0;
+        int bit_count = 0;
+        std::uint32_t crc = 0;
+        std::uint32_t input_size = 0;
+    };
+
+    GzipCompressor::GzipCompressor(int level)
+        : level_((std::min)((std::max)(level, MIN_LEVEL), MAX_LEVEL)),
+        state_(new State()) {
+        tables();
+    }
+
+    GzipCompressor::~GzipCompressor() {
+    }
+
+    std::uint32_t GzipCompressor::crc32(std::uint32_t crc, const char* data, size_t length) {
+        const auto& table = tables().crc;
+        crc = ~crc;
+        for (size_t i = 0; i < length; ++i) {
+            crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void GzipCompressor::begin(std::vector<char>& out) {
+        State& s = *state_;
+        out_ = &out;
+        member_start_ = out.size();
+        std::fill(s.head, s.head + HASH_SIZE, NIL);
+        s.window_length = 0;
+        s.pos = 0;
+        s.match_length = MIN_MATCH - 1;
+        s.match_start = 0;
+        s.match_available = false;
+        s.symbol_count = 0;
+        std::fill(s.literal_freqs, s.literal_freqs + LITERAL_LENGTH_CODES, 0u);
+        std::fill(s.distance_freqs, s.distance_freqs + DISTANCE_CODES, 0u);
+        s.bit_buffer = 0;
+        s.bit_count = 0;
+        s.crc = 0;
+        s.input_size = 0;
+
+        // magic, deflate, no flags, no time, how hard it tried, NTFS
+        const unsigned char header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0,
+            static_cast<unsigned char>(level_ == MAX_LEVEL ? 2 : level_ == MIN_LEVEL ? 4 : 0), 11 };
+        out.insert(out.end(), header, header + sizeof(header));
+    }
+
+    void GzipCompressor::write(const char* data, size_t length) {
+        State& s = *state_;
+        s.crc = crc32(s.crc, data, length);
+        s.input_size += static_cast<std::uint32_t>(length);
+        while (length > 0) {
+            if (s.window_length == sizeof(s.window)) {
+                slide();
+            }
+            size_t part = (std::min)(length, sizeof(s.window) - s.window_length);
+            memcpy(s.window + s.window_length, data, part);
+            s.window_length += part;
+            data += part;
+            length -= part;
+            process(false);
+        }
+    }
+
+    size_t GzipCompressor::finish() {
+        State& s = *state_;
+        process(true);
+        emitBlock(true);
+        flushBits();
+        for (int i = 0; i < 4; ++i) {
+            out_->push_back(static_cast<char>((s.crc >> (8 * i)) & 0xFF));
+        }
+        for (int i = 0; i < 4; ++i) {
+            out_->push_back(static_cast<char>((s.input_size >> (8 * i)) & 0xFF));
+        }
+        return out_->size() - member_start_;
+    }
+
+    size_t GzipCompressor::compress(const char* data, size_t length, std::vector<char>& out) {
+        out.clear();
+        begin(out);
+        write(data, length);
+        return finish();
+    }
+
+    void GzipCompressor::slide() {
+        // only called once everything more than MIN_LOOKAHEAD from the end
+        // is compressed, so the current position is in the upper half
+        State& s = *state_;
+        memmove(s.window, s.window + WINDOW_SIZE, WINDOW_SIZE);
+        s.window_length -= WINDOW_SIZE;
+        s.pos -= WINDOW_SIZE;
+        s.match_start -= static_cast<int>(WINDOW_SIZE);
+        for (auto& entry : s.head) {
+            entry = entry >= static_cast<int>(WINDOW_SIZE) ? entry - static_cast<int>(WINDOW_SIZE) : NIL;
+        }
+        for (auto& entry : s.prev) {
+            entry = entry >= static_cast<int>(WINDOW_SIZE) ? entry - static_cast<int>(WINDOW_SIZE) : NIL;
+        }
+    }
+
+    int GzipCompressor::insertString(size_t pos) {
+        State& s = *state_;
+        const unsigned char* p = s.window + pos;
+        size_t hash = ((size_t(p[0]) << 10) ^ (size_t(p[1]) << 5) ^ p[2]) & (HASH_SIZE - 1);
+        int match_head = s.head[hash];
+        s.prev[pos & WINDOW_MASK] = match_head;
+        s.head[hash] = static_cast<int>(pos);
+        return match_head;
+    }
+
+    size_t GzipCompressor::longestMatch(int cur_match, size_t prev_length, size_t ahead) {
+        State& s = *state_;
+        const LevelConfig& config = LEVELS[level_];
+        int chain = config.max_chain;
+        if (prev_length >= config.good_length) {
+            chain >>= 2;
+        }
+        const int limit = s.pos > MAX_DISTANCE ? static_cast<int>(s.pos - MAX_DISTANCE) : 0;
+        const size_t max_length = (std::min)(MAX_MATCH, ahead);
+        const size_t nice_length = (std::min)(config.nice_length, max_length);
+        const unsigned char* scan = s.window + s.pos;
+        size_t best_length = prev_length;
+        if (best_length >= max_length) {
+            return best_length;
+        }
+
+        do {
+            const unsigned char* candidate = s.window + cur_match;
+            if (candidate[best_length] != scan[best_length] || candidate[0] != scan[0] || candidate[1] != scan[1]) {
+                continue;
+            }
+            size_t length = 2;
+            while (length < max_length && candidate[length] == scan[length]) {
+                ++length;
+            }
+            if (length > best_length) {
+                s.match_start = cur_match;
+                best_length = length;
+                if (length >= nice_length) {
+                    break;
+                }
+            }
+        } while ((cur_match = s.prev[cur_match & WINDOW_MASK]) >= limit && --chain != 0);
+        return best_length;
+    }
+
+    void GzipCompressor::process(bool flush) {
+        // zlib's lazy evaluation: a match is only taken if the one starting
+        // at the next byte isn't longer
+        State& s = *state_;
+        const LevelConfig& config = LEVELS[level_];
+        while (true) {
+            size_t ahead = s.window_length - s.pos;
+            if (ahead == 0 || (ahead < MIN_LOOKAHEAD && !flush)) {
+                break;
+            }
+            int hash_head = NIL;
+            if (ahead >= MIN_MATCH) {
+                hash_head = insertString(s.pos);
+            }
+            size_t prev_length = s.match_length;
+            int prev_match = s.match_start;
+            s.match_length = MIN_MATCH - 1;
+            if (hash_head != NIL && prev_length < config.max_lazy && s.pos - hash_head <= MAX_DISTANCE) {
+                s.match_length = longestMatch(hash_head, prev_length, ahead);
+                if (s.match_length <= prev_length) {
+                    s.match_length = MIN_MATCH - 1;
+                }
+                else if (s.match_length == MIN_MATCH && s.pos - s.match_start > TOO_FAR) {
+                    s.match_length = MIN_MATCH - 1;
+                }
+            }
+            if (prev_length >= MIN_MATCH && s.match_length <= prev_length) {
+                // the match at the previous byte is the better one
+                size_t start = s.pos - 1;
+                match(start - prev_match, prev_length);
+                size_t end = start + prev_length;
+                for (size_t p = s.pos + 1; p < end; ++p) {
+                    if (s.window_length - p >= MIN_MATCH) {
+                        insertString(p);
+                    }
+                }
+                s.pos = end;
+                s.match_available = false;
+                s.match_length = MIN_MATCH - 1;
+            }
+            else if (s.match_available) {
+                literal(s.window[s.pos - 1]);
+                ++s.pos;
+            }
+            else {
+                s.match_available = true;
+                ++s.pos;
+            }
+        }
+        if (flush && s.match_available) {
+            literal(s.window[s.pos - 1]);
+            s.match_available = false;
+        }
+    }
+
+    void GzipCompressor::literal(unsigned char c) {
+        State& s = *state_;
+        s.symbols[s.symbol_count] = c;
+        s.distances[s.symbol_count] = 0;
+        s.literal_freqs[c]++;
+        if (++s.symbol_count == SYMBOLS_PER_BLOCK) {
+            emitBlock(false);
+        }
+    }
+
+    void GzipCompressor::match(size_t distance, size_t length) {
+        State& s = *state_;
+        s.symbols[s.symbol_count] = static_cast<std::uint16_t>(length - MIN_MATCH + LITERALS);
+        s.distances[s.symbol_count] = static_cast<std::uint16_t>(distance);
+        s.literal_freqs[LITERALS + 1 + tables().length_code[length]]++;
+        s.distance_freqs[distanceCode(distance)]++;
+        if (++s.symbol_count == SYMBOLS_PER_BLOCK) {
+            emitBlock(false);
+        }
+    }
+
+    void GzipCompressor::emitBlock(bool last) {
+        State& s = *state_;
+        s.literal_freqs[END_OF_BLOCK]++;
+
+        // this block's own codes; at least two distance codes, as zlib sends
+        std::uint32_t distance_freqs[DISTANCE_CODES];
+        std::copy(s.distance_freqs, s.distance_freqs + DISTANCE_CODES, distance_freqs);
+        atLeastTwoCodes(distance_freqs, DISTANCE_CODES);
+        unsigned char literal_lengths[LITERAL_LENGTH_CODES];
+        unsigned char distance_lengths[DISTANCE_CODES];
+        huffmanLengths(s.literal_freqs, LITERAL_LENGTH_CODES, MAX_BITS, literal_lengths);
+        huffmanLengths(distance_freqs, DISTANCE_CODES, MAX_BITS, distance_lengths);
+
+        int literal_count = LITERAL_LENGTH_CODES;
+        while (literal_count > 257 && literal_lengths[literal_count - 1] == 0) {
+            --literal_count;
+        }
+        int distance_count = DISTANCE_CODES;
+        while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) {
+            --distance_count;
+        }
+
+        // the code lengths, run length coded: 16 repeats the last, 17 and 18 zeroes
+        unsigned char all_lengths[LITERAL_LENGTH_CODES + DISTANCE_CODES];
+        std::copy(literal_lengths, literal_lengths + literal_count, all_lengths);
+        std::copy(distance_lengths, distance_lengths + distance_count, all_lengths + literal_count);
+        const int length_count = literal_count + distance_count;
+        std::vector<std::pair<int, int>> runs;   // code length symbol, extra bits value
+        std::uint32_t run_freqs[CODE_LENGTH_CODES] = {};
+        for (int i = 0; i < length_count;) {
+            int length = all_lengths[i];
+            int run = 1;
+            while (i + run < length_count && all_lengths[i + run] == length) {
+                ++run;
+            }
+            i += run;
+            if (length == 0) {
+                while (run >= 11) {
+                    int part = (std::min)(run, 138);
+                    runs.push_back({ 18, part - 11 });
+                    run -= part;
+                }
+                if (run >= 3) {
+                    runs.push_back({ 17, run - 3 });
+                    run = 0;
+                }
+            }
+            else {
+                runs.push_back({ length, 0 });
+                --run;
+                while (run >= 3) {
+                    int part = (std::min)(run, 6);
+                    runs.push_back({ 16, part - 3 });
+                    run -= part;
+                }
+            }
+            for (; run > 0; --run) {
+                runs.push_back({ length, 0 });
+            }
+        }
+        for (const auto& run : runs) {
+            run_freqs[run.first]++;
+        }
+        // a decoder refuses a code length code that isn't complete
+        atLeastTwoCodes(run_freqs, CODE_LENGTH_CODES);
+        unsigned char code_lengths[CODE_LENGTH_CODES];
+        huffmanLengths(run_freqs, CODE_LENGTH_CODES, MAX_CODE_LENGTH_BITS, code_lengths);
+        int code_length_count = CODE_LENGTH_CODES;
+        while (code_length_count > 4 && code_lengths[CODE_LENGTH_ORDER[code_length_count - 1]] == 0) {
+            --code_length_count;
+        }
+
+        // the fixed codes
+        unsigned char fixed_literal_lengths[LITERAL_LENGTH_CODES];
+        for (int symbol = 0; symbol < LITERAL_LENGTH_CODES; ++symbol) {
+            fixed_literal_lengths[symbol] = symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+        }
+        unsigned char fixed_distance_lengths[DISTANCE_CODES];
+        std::fill(fixed_distance_lengths, fixed_distance_lengths + DISTANCE_CODES, static_cast<unsigned char>(5));
+
+        // which comes out smaller; the extra bits are the same either way
+        std::uint64_t dynamic_bits = 5 + 5 + 4 + 3 * code_length_count;
+        for (const auto& run : runs) {
+            dynamic_bits += code_lengths[run.first] + (run.first == 16 ? 2 : run.first == 17 ? 3 : run.first == 18 ? 7 : 0);
+        }
+        std::uint64_t fixed_bits = 0;
+        for (int symbol = 0; symbol < LITERAL_LENGTH_CODES; ++symbol) {
+            dynamic_bits += std::uint64_t(s.literal_freqs[symbol]) * literal_lengths[symbol];
+            fixed_bits += std::uint64_t(s.literal_freqs[symbol]) * fixed_literal_lengths[symbol];
+        }
+        for (int code = 0; code < DISTANCE_CODES; ++code) {
+            dynamic_bits += std::uint64_t(s.distance_freqs[code]) * distance_lengths[code];
+            fixed_bits += std::uint64_t(s.distance_freqs[code]) * fixed_distance_lengths[code];
+        }
+        const bool fixed = fixed_bits <= dynamic_bits;
+
+        std::uint16_t literal_codes[LITERAL_LENGTH_CODES];
+        std::uint16_t distance_codes[DISTANCE_CODES];
+        const unsigned char* use_literal_lengths = fixed ? fixed_literal_lengths : literal_lengths;
+        const unsigned char* use_distance_lengths = fixed ? fixed_distance_lengths : distance_lengths;
+        huffmanCodes(use_literal_lengths, LITERAL_LENGTH_CODES, literal_codes);
+        huffmanCodes(use_distance_lengths, DISTANCE_CODES, distance_codes);
+
+        putBits(last ? 1 : 0, 1);
+        putBits(fixed ? 1 : 2, 2);
+        if (!fixed) {
+            std::uint16_t length_codes[CODE_LENGTH_CODES];
+            huffmanCodes(code_lengths, CODE_LENGTH_CODES, length_codes);
+            putBits(literal_count - 257, 5);
+            putBits(distance_count - 1, 5);
+            putBits(code_length_count - 4, 4);
+            for (int i = 0; i < code_length_count; ++i) {
+                putBits(code_lengths[CODE_LENGTH_ORDER[i]], 3);
+            }
+            for (const auto& run : runs) {
+                putBits(length_codes[run.first], code_lengths[run.first]);
+                if (run.first == 16) {
+                    putBits(run.second, 2);
+                }
+                else if (run.first == 17) {
+                    putBits(run.second, 3);
+                }
+                else if (run.first == 18) {
+                    putBits(run.second, 7);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < s.symbol_count; ++i) {
+            int symbol = s.symbols[i];
+            if (s.distances[i] == 0) {
+                putBits(literal_codes[symbol], use_literal_lengths[symbol]);
+                continue;
+            }
+            size_t length = symbol - LITERALS + MIN_MATCH;
+            int length_code = tables().length_code[length];
+            putBits(literal_codes[LITERALS + 1 + length_code], use_literal_lengths[LITERALS + 1 + length_code]);
+            putBits(static_cast<std::uint32_t>(length - LENGTH_BASE[length_code]), LENGTH_EXTRA[length_code]);
+            size_t distance = s.distances[i];
+            int distance_code = distanceCode(distance);
+            putBits(distance_codes[distance_code], use_distance_lengths[distance_code]);
+            putBits(static_cast<std::uint32_t>(distance - DISTANCE_BASE[distance_code]), DISTANCE_EXTRA[distance_code]);
+        }
+        putBits(literal_codes[END_OF_BLOCK], use_literal_lengths[END_OF_BLOCK]);
+
+        s.symbol_count = 0;
+        std::fill(s.literal_freqs, s.literal_freqs + LITERAL_LENGTH_CODES, 0u);
+        std::fill(s.distance_freqs, s.distance_freqs + DISTANCE_CODES, 0u);
+    }
+
+    void GzipCompressor::putBits(std::uint32_t value, int bits) {
+        State& s = *state_;
+        s.bit_buffer |= std::uint64_t(value) << s.bit_count;
+        s.bit_count += bits;
+        while (s.bit_count >= 8) {
+            out_->push_back(static_cast<char>(s.bit_buffer & 0xFF));
+            s.bit_buffer >>= 8;
+            s.bit_count -= 8;
+        }
+    }
+
+    void GzipCompressor::flushBits() {
+        State& s = *state_;
+        if (s.bit_count > 0) {
+            out_->push_back(static_cast<char>(s.bit_buffer & 0xFF));
+        }
+        s.bit_buffer = 0;
+        s.bit_count = 0;
+    }
+}
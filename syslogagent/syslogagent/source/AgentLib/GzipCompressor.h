@@ -0,0 +1,81 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "framework.h"
+
+// GzipCompressor writes gzip (RFC 1952) data, for request bodies sent with
+// "Content-Encoding: gzip".  The deflate (RFC 1951) stream inside is built
+// the way zlib builds it: LZ77 matches found through hash chains over a 32KB
+// window, with lazy matching, then each block of up to SYMBOLS_PER_BLOCK
+// literals and matches coded with its own Huffman codes, or the fixed ones
+// when those come out smaller.
+//
+// Input is fed in pieces, with write(), as it becomes available, and the
+// compressed data is appended to the caller's vector as blocks fill; only
+// the window is copied.  finish() ends the member with the CRC and length.
+// A compressor is reused for one body after another, keeping its tables.
+//
+// The level, 1 to 9 as for gzip, trades speed for size: it sets how long a
+// match is looked for (how far down the hash chain, and when a match is long
+// enough to stop), as zlib's levels do.  Batches of JSON events compress
+// about ten times at the default level.
+//
+// Not thread safe: one compressor per sender.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API GzipCompressor {
+    public:
+        static constexpr int MIN_LEVEL = 1;
+        static constexpr int MAX_LEVEL = 9;
+        static constexpr int DEFAULT_LEVEL = 6;
+        static constexpr size_t SYMBOLS_PER_BLOCK = 16384;
+
+        explicit GzipCompressor(int level = DEFAULT_LEVEL);
+        ~GzipCompressor();
+
+        GzipCompressor(const GzipCompressor&) = delete;
+        GzipCompressor& operator=(const GzipCompressor&) = delete;
+
+        // Starts a gzip member, appending it to `out`
+        void begin(std::vector<char>& out);
+        // Compresses the next `length` bytes of input
+        void write(const char* data, size_t length);
+        // Compresses what is left and writes the trailer; returns the
+        // member's length
+        size_t finish();
+
+        // All of `data` as one gzip member, replacing what was in `out`
+        size_t compress(const char* data, size_t length, std::vector<char>& out);
+
+        int level() const { return level_; }
+
+        static std::uint32_t crc32(std::uint32_t crc, const char* data, size_t length);
+
+    private:
+        struct State;
+
+        void process(bool flush);
+        int insertString(size_t pos);
+        size_t longestMatch(int cur_match, size_t prev_length, size_t ahead);
+        void slide();
+        void literal(unsigned char c);
+        void match(size_t distance, size_t length);
+        void emitBlock(bool last);
+        void putBits(std::uint32_t value, int bits);
+        void flushBits();
+
+        const int level_;
+        std::unique_ptr<State> state_;
+        std::vector<char>* out_ = nullptr;
+        size_t member_start_ = 0;
+    };
+}
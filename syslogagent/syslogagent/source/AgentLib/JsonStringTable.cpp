@@ -0,0 +1,96 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "JsonStringTable.h"
+#include "AgentStatistics.h"
+#include "FastHash.h"
+
+namespace Syslog_agent {
+
+    JsonStringTable::JsonStringTable(Escaper escaper, size_t capacity)
+        : escaper_(escaper),
+        capacity_(capacity) {
+        size_t slot_count = 16;
+        while (slot_count < capacity_ * 2) {
+            slot_count *= 2;
+        }
+        slot_mask_ = slot_count - 1;
+        slots_.reset(new std::atomic<const Node*>[slot_count]);
+        for (size_t i = 0; i < slot_count; ++i) {
+            slots_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    const JsonStringTable::Node* JsonStringTable::lookup(std::string_view text, std::uint64_t hash,
+        size_t& slot_out) const {
+        for (size_t slot = static_cast<size_t>(hash) & slot_mask_; ; slot = (slot + 1) & slot_mask_) {
+            auto node = slots_[slot].load(std::memory_order_acquire);
+            if (node == nullptr) {
+                slot_out = slot;
+                return nullptr;
+            }
+            if (node->hash == hash && node->raw == text) {
+                slot_out = slot;
+                return node;
+            }
+        }
+    }
+
+    const JsonStringTable::Entry* JsonStringTable::find(std::string_view text) const {
+        size_t slot;
+        auto node = lookup(text, fastHash(text), slot);
+        return node ? &node->entry : nullptr;
+    }
+
+    const JsonStringTable::Entry* JsonStringTable::intern(std::string_view text) {
+        auto& stats = AgentStatistics::instance();
+        auto hash = fastHash(text);
+        size_t slot;
+        auto node = lookup(text, hash, slot);
+        if (node != nullptr) {
+            stats.increment(AgentStatistics::StringTableHits);
+            return &node->entry;
+        }
+        if (text.size() > MAX_STRING_LENGTH || size_.load(std::memory_order_relaxed) >= capacity_) {
+            stats.increment(AgentStatistics::StringTableRejected);
+            return nullptr;
+        }
+
+        // escape before taking the lock
+        std::string escaped;
+        escaped.reserve(text.size() + 8);
+        escaper_(text, escaped);
+
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        node = lookup(text, hash, slot);
+        if (node != nullptr) {
+            // another thread added it meanwhile
+            stats.increment(AgentStatistics::StringTableHits);
+            return &node->entry;
+        }
+        auto id = size_.load(std::memory_order_relaxed);
+        if (id >= capacity_) {
+            stats.increment(AgentStatistics::StringTableRejected);
+            return nullptr;
+        }
+        nodes_.emplace_back();
+        auto& added = nodes_.back();
+        added.hash = hash;
+        added.raw.assign(text);
+        added.escaped = std::move(escaped);
+        added.entry = Entry{ id, added.escaped.data(), added.escaped.size() };
+        // publish only once the node is complete
+        slots_[slot].store(&added, std::memory_order_release);
+        size_.store(id + 1, std::memory_order_relaxed);
+        stats.increment(AgentStatistics::StringTableMisses);
+        stats.set(AgentStatistics::StringTableSize, id + 1);
+        return &added.entry;
+    }
+
+    size_t JsonStringTable::size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "framework.h"
+
+// JsonStringTable interns strings that repeat across events (provider
+// names, EventData key names, channel names, the host name) together with
+// their JSON-escaped form, so that serializing one is a single copy of
+// bytes that were escaped once, instead of a strlen and an escape pass per
+// event.
+//
+// Each distinct string gets a stable id and an Entry that stays valid for
+// the lifetime of the table.  Nothing is ever removed, which lets lookups
+// run without any lock: the index is a fixed-size open-addressing array of
+// atomic pointers that writers only ever fill in.  Inserts (the first time
+// a string is seen) escape the string and take a writer mutex.
+//
+// The table is bounded: strings longer than MAX_STRING_LENGTH and anything
+// arriving once `capacity` strings are stored are not interned, and the
+// caller escapes them the ordinary way.  Only low-cardinality fields should
+// be interned; unique values would just fill it up.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API JsonStringTable {
+    public:
+        struct Entry {
+            std::uint32_t id;
+            const char* escaped;        // not null terminated
+            size_t escaped_length;
+        };
+        // Appends the JSON-escaped form of raw (without quotes) to escaped_out.
+        typedef std::function<void(std::string_view raw, std::string& escaped_out)> Escaper;
+
+        static constexpr size_t DEFAULT_CAPACITY = 16384;
+        static constexpr size_t MAX_STRING_LENGTH = 256;
+
+        explicit JsonStringTable(Escaper escaper, size_t capacity = DEFAULT_CAPACITY);
+
+        JsonStringTable(const JsonStringTable&) = delete;
+        JsonStringTable& operator=(const JsonStringTable&) = delete;
+
+        // Returns the entry for text, adding it if there's room, or nullptr.
+        const Entry* intern(std::string_view text);
+        // Returns the entry for text only if it's already in the table.
+        const Entry* find(std::string_view text) const;
+
+        size_t size() const;
+        size_t capacity() const { return capacity_; }
+
+    private:
+        struct Node {
+            std::uint64_t hash;
+            std::string raw;
+            std::string escaped;
+            Entry entry;
+        };
+
+        const Node* lookup(std::string_view text, std::uint64_t hash, size_t& slot_out) const;
+
+        Escaper escaper_;
+        size_t capacity_;
+        size_t slot_mask_;          // slot count is a power of two, at least twice capacity
+        std::unique_ptr<std::atomic<const Node*>[]> slots_;
+        std::deque<Node> nodes_;    // deque never moves existing nodes
+        std::atomic<std::uint32_t> size_{ 0 };
+        std::mutex write_mutex_;
+    };
+}
@@ -2,6 +2,9 @@
 #include "MessageBatcher.h"
 #include "MessageQueue.h"
 #include "../Infrastructure/Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
 #include <typeinfo>
 
 namespace Syslog_agent {
@@ -16,18 +19,81 @@ namespace Syslog_agent {
     MessageBatcher::BatchResult MessageBatcher::BatchEvents(
         shared_ptr<MessageQueue> msg_queue,
         char* batch_buffer,
-        size_t buffer_size) const {
+        size_t buffer_size,
+        std::uint32_t max_messages,
+        size_t max_bytes) const {
         if (!msg_queue || !batch_buffer || buffer_size == 0) {
             return BatchResult(BatchResult::Status::InvalidBuffer);
         }
 
-        return BatchEventsInternal(msg_queue, batch_buffer, buffer_size);
+        return BatchEventsInternal(msg_queue, batch_buffer, buffer_size, max_messages, max_bytes);
+    }
+
+    size_t MessageBatcher::GetTargetBatchBytes() const {
+        // a batch buffer also holds the terminating null
+        size_t largest = GetMaxBatchSizeBytes() > 0 ? GetMaxBatchSizeBytes() - 1 : 0;
+        return target_batch_bytes_ == 0 ? largest : (std::min)(target_batch_bytes_, largest);
+    }
+
+    MessageBatcher::BatchResult MessageBatcher::BatchOversizedMessage(
+        shared_ptr<MessageQueue> message_queue,
+        std::vector<char>& batch) const {
+        auto logger = LOG_THIS;
+        if (!message_queue) {
+            return BatchResult(BatchResult::Status::InvalidBuffer);
+        }
+        uint32_t message_length;
+        {
+            std::lock_guard<std::mutex> lock(message_queue->queue_mutex_);
+            if (message_queue->first_message_ == nullptr) {
+                return BatchResult(BatchResult::Status::NoMessages);
+            }
+            message_length = message_queue->first_message_->data_length;
+        }
+        std::string header = GetMessageHeader();
+        std::string trailer = GetMessageTrailer();
+        size_t length = header.size() + message_length + trailer.size();
+        batch.resize(length + 1);
+        memcpy(batch.data(), header.data(), header.size());
+        // only the sender removes messages, so it is still the one at the front
+        if (message_queue->peek(nullptr, batch.data() + header.size(), message_length)
+            != static_cast<int>(message_length)) {
+            logger->recoverable_error("MessageBatcher::BatchOversizedMessage()> Failed to read message of %u bytes\n",
+                message_length);
+            return BatchResult(BatchResult::Status::InvalidBuffer);
+        }
+        memcpy(batch.data() + header.size() + message_length, trailer.data(), trailer.size());
+        batch[length] = '\0';
+        return BatchResult(BatchResult::Status::Success, 1, length);
+    }
+
+    std::string MessageBatcher::GetMessageHeader() const {
+        char text[1024];
+        size_t size = 0;
+        GetMessageHeader_(text, sizeof(text), size);
+        return std::string(text, size);
+    }
+
+    std::string MessageBatcher::GetMessageSeparator() const {
+        char text[1024];
+        size_t size = 0;
+        GetMessageSeparator_(text, sizeof(text), size);
+        return std::string(text, size);
+    }
+
+    std::string MessageBatcher::GetMessageTrailer() const {
+        char text[1024];
+        size_t size = 0;
+        GetMessageTrailer_(text, sizeof(text), size);
+        return std::string(text, size);
     }
 
     MessageBatcher::BatchResult MessageBatcher::BatchEventsInternal(
         shared_ptr<MessageQueue> message_queue,
         char* batch_buffer,
-        size_t buffer_size) const {
+        size_t buffer_size,
+        std::uint32_t max_messages,
+        size_t max_bytes) const {
         auto logger = LOG_THIS;
         size_t queue_length = message_queue->length();
         logger->debug3("MessageBatcher::BatchEventsInternal() Initial queue length: %d\n", queue_length);
@@ -60,14 +126,19 @@ namespace Syslog_agent {
             logger->debug2("MessageBatcher::BatchEventsInternal()> Sizes - Header: %zu, Separator: %zu, Trailer: %zu\n",
                 header_size, separator_size, trailer_size);
 
-            // Check if buffer is large enough for minimal batch (header + smallest possible message + trailer)
-            if (buffer_size < (header_size + trailer_size + 1)) {
+            // Check if buffer is large enough for minimal batch (header + smallest possible message + trailer + null)
+            if (buffer_size < (header_size + trailer_size + 2)) {
                 logger->recoverable_error("MessageBatcher::BatchEventsInternal()> Buffer size %zu too small for minimal batch (need %zu)\n",
-                    buffer_size, header_size + trailer_size + 1);
+                    buffer_size, header_size + trailer_size + 2);
                 return BatchResult(BatchResult::Status::BufferTooSmall, 0, 0);
             }
 
-            std::uint32_t max_batch = (std::min)(max_batch_size_, static_cast<std::uint32_t>(queue_length));
+            // What the buffer holds besides the terminating null, and where the batch is closed
+            const size_t capacity = buffer_size - 1;
+            const size_t budget = (std::min)((std::min)(capacity, max_bytes), GetTargetBatchBytes());
+
+            std::uint32_t max_batch = (std::min)((std::min)(max_batch_size_, max_messages),
+                static_cast<std::uint32_t>(queue_length));
             logger->debug3("MessageBatcher::BatchEventsInternal()> Will process max %d messages\n", max_batch);
 
             // Header is already written, start after it
@@ -75,44 +146,34 @@ namespace Syslog_agent {
             std::uint32_t messages_batched = 0;
             bool found_valid_message = false;  // Track if we found any valid messages to process
 
-            char* peek_buffer = this->GetBatchBuffer("peek_buffer");
             // Process messages
             for (const auto& msg : message_queue->traverseQueue()) {
                 if (!msg) continue;
 
-                // Get message length
-                int msg_len = message_queue->peek(msg, peek_buffer, GetMaxBatchSizeBytes());
-
+                size_t msg_len = msg->data_length;
                 if (msg_len == 0) {
                     logger->recoverable_error("MessageBatcher::BatchEventsInternal()> Message with zero length, discarding\n");
                     continue;
                 }
 
-                if (msg_len < 0 || static_cast<size_t>(msg_len) > GetMaxBatchSizeBytes_()) {
-                    logger->recoverable_error("MessageBatcher::BatchEventsInternal()> Message too large\n");
-                    found_valid_message = true;  // We found a message, even though it was too large
-                    continue;  // Skip this message but continue processing
-                }
-
-                // Calculate space needed for this message
-                size_t space_needed = msg_len;
-                if (messages_batched > 0) {
-                    space_needed += separator_size;  // Need separator if not first message
-                }
-                space_needed += trailer_size + 16;  // MUST reserve space for trailer with safety margin
-
-                if (messages_batched == 0 && space_needed + header_size > buffer_size) {
-                    // First message won't fit even with just header and trailer
-                    logger->recoverable_error("MessageBatcher::BatchEventsInternal()> Buffer too small for even one message (needs %zu, have %zu)\n",
-                        space_needed + header_size, buffer_size);
-                    this->ReleaseBatchBuffer(peek_buffer);
-                    return BatchResult(BatchResult::Status::BufferTooSmall, 0, 0);
-                }
-                else if (current_pos + space_needed > buffer_size) {
-                    // Not enough space for message + separator (if needed) + trailer
-                    logger->debug2("MessageBatcher::BatchEventsInternal()> Not enough space for next message (needs %zu, have %zu), ending batch\n",
-                        space_needed, buffer_size - current_pos);
-                    break;
+                // Exactly what the batch would be with this message and the trailer
+                size_t separator_needed = messages_batched > 0 ? separator_size : 0;
+                size_t batch_length = current_pos + separator_needed + msg_len + trailer_size;
+                bool alone = false;
+                if (batch_length > budget) {
+                    if (messages_batched > 0) {
+                        logger->debug2("MessageBatcher::BatchEventsInternal()> Next message of %zu bytes would make the batch %zu bytes, over %zu, ending batch\n",
+                            msg_len, batch_length, budget);
+                        break;
+                    }
+                    if (batch_length > capacity) {
+                        // Left at the front of the queue, for BatchOversizedMessage()
+                        logger->warning("MessageBatcher::BatchEventsInternal()> Message of %zu bytes too large for a %zu byte batch buffer\n",
+                            msg_len, buffer_size);
+                        return BatchResult(BatchResult::Status::MessageTooLarge, 0, 0);
+                    }
+                    // Larger than a batch should be on its own, so it goes alone
+                    alone = true;
                 }
 
                 found_valid_message = true;  // We found at least one valid message
@@ -127,22 +188,25 @@ namespace Syslog_agent {
                     current_pos += separator_size;
                 }
 
-                // Copy message content
-                memcpy(batch_buffer + current_pos, peek_buffer, msg_len);
+                // Copy message content straight into place
+                if (message_queue->peek(msg, batch_buffer + current_pos, static_cast<uint32_t>(msg_len))
+                    != static_cast<int>(msg_len)) {
+                    logger->recoverable_error("MessageBatcher::BatchEventsInternal()> Failed to read message, ending batch\n");
+                    current_pos -= separator_needed;
+                    break;
+                }
                 current_pos += msg_len;
                 messages_batched++;
 
                 // Stop if we've reached max batch size
-                if (messages_batched >= max_batch) {
-                    logger->debug3("MessageBatcher::BatchEventsInternal()> Reached max batch size of %d messages\n", max_batch);
+                if (messages_batched >= max_batch || alone) {
+                    logger->debug3("MessageBatcher::BatchEventsInternal()> Batch complete with %d messages\n", messages_batched);
                     break;
                 }
             }
 
-            this->ReleaseBatchBuffer(peek_buffer);
-
             // If we haven't batched any messages but found valid ones to process,
-            // return Success with 0 messages (they were all too large)
+            // return Success with 0 messages (none could be read)
             if (messages_batched == 0) {
                 if (!found_valid_message) {
                     logger->debug("MessageBatcher::BatchEventsInternal()> No messages were found\n");
@@ -167,9 +231,7 @@ namespace Syslog_agent {
             }
 
             // Null terminate the batch but don't include it in bytes_written
-            if (current_pos < buffer_size) {
-                batch_buffer[current_pos] = '\0';
-            }
+            batch_buffer[current_pos] = '\0';
 
             return BatchResult(BatchResult::Status::Success, messages_batched, current_pos);
         }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 #include "MessageQueue.h"
 #include "framework.h"
 
@@ -31,8 +34,30 @@ namespace Syslog_agent {
         MessageBatcher(std::uint32_t max_batch_size, std::uint32_t max_batch_age);
         ~MessageBatcher();
 
-        // Returns both status and number of messages batched
-        BatchResult BatchEvents(shared_ptr<MessageQueue> message_queue, char* batch_buffer, size_t buffer_size) const;
+        // Returns both status and number of messages batched; at most max_messages are taken,
+        // and the batch is at most max_bytes long, or the target batch size if that is smaller.
+        // A message that is larger than that on its own is batched alone, if the buffer holds
+        // it; if it doesn't, MessageTooLarge is returned and BatchOversizedMessage() frames it.
+        // The batch is always followed by a terminating null, not counted in bytes_written.
+        BatchResult BatchEvents(shared_ptr<MessageQueue> message_queue, char* batch_buffer, size_t buffer_size,
+            std::uint32_t max_messages = UINT32_MAX, size_t max_bytes = SIZE_MAX) const;
+
+        // Frames the message at the front of the queue as a batch on its own, in `batch`,
+        // however large it is; for one too large for a batch buffer
+        BatchResult BatchOversizedMessage(shared_ptr<MessageQueue> message_queue, std::vector<char>& batch) const;
+
+        // The size batches are closed at, header, separators and trailer included; 0,
+        // the default, is as large as a batch buffer holds.  It is the size before
+        // any compression: HTTP bodies sent gzipped go out about a tenth of it
+        void SetTargetBatchBytes(size_t target_bytes) { target_batch_bytes_ = target_bytes; }
+        size_t GetTargetBatchBytes() const;
+
+        // What BatchEvents writes around and between the messages, for building
+        // batches elsewhere (BatchAssembler)
+        std::string GetMessageHeader() const;
+        std::string GetMessageSeparator() const;
+        std::string GetMessageTrailer() const;
+        std::uint32_t GetMaxBatchCount() const { return max_batch_size_; }
 
         virtual char* GetBatchBuffer(const char* debug_identifier = nullptr) const = 0;
         virtual bool ReleaseBatchBuffer(char* buffer) const = 0;
@@ -41,6 +66,7 @@ namespace Syslog_agent {
     protected:
         std::uint32_t max_batch_size_;
         std::uint32_t max_batch_age_;
+        size_t target_batch_bytes_ = 0;
 
         virtual std::uint32_t GetMaxBatchSizeBytes_() const = 0;
 
@@ -50,6 +76,7 @@ namespace Syslog_agent {
         virtual void GetMessageTrailer_(char* dest, size_t max_size, size_t& size_out) const = 0;
 
     private:
-        BatchResult BatchEventsInternal(shared_ptr<MessageQueue> message_queue, char* batch_buffer, size_t buffer_size) const;
+        BatchResult BatchEventsInternal(shared_ptr<MessageQueue> message_queue, char* batch_buffer, size_t buffer_size,
+            std::uint32_t max_messages, size_t max_bytes) const;
     };
 };
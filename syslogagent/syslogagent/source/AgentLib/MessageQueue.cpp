@@ -109,7 +109,7 @@ bool MessageQueue::enqueue(const char* message_content, const uint32_t message_l
         return false;
     }
 
-    if (enqueue_hook_ && !enqueue_hook_(length_,msg, false)) {
+    if (enqueue_hook_ && !enqueue_hook_(length_, msg, true)) {
             return false; // Handler cancelled the enqueue
     }
 
@@ -124,7 +124,7 @@ bool MessageQueue::enqueue(const char* message_content, const uint32_t message_l
     
     // Post-enqueue handler
     if (enqueue_hook_) {
-        enqueue_hook_(length_, msg, true);
+        enqueue_hook_(length_, msg, false);
     }
 
     items_sem_.release();
@@ -132,6 +132,60 @@ bool MessageQueue::enqueue(const char* message_content, const uint32_t message_l
     return true;
 }
 
+size_t MessageQueue::enqueueBatch(const char* contents, const uint32_t* lengths, size_t count) {
+    auto logger = LOG_THIS;
+    if (!contents || !lengths || count == 0) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    size_t enqueued = 0;
+    const char* message_content = contents;
+    for (size_t i = 0; i < count; message_content += lengths[i], ++i) {
+        const uint32_t message_len = lengths[i];
+        if (message_len == 0 || message_len >= MESSAGE_BUFFER_SIZE * MAX_BUFFERS_PER_MESSAGE) {
+            logger->recoverable_error("MessageQueue::enqueueBatch() : invalid message length %u\n", message_len);
+            continue;
+        }
+
+        Message* msg = createMessage(message_content, message_len, timestamp);
+        if (!msg) {
+            break;
+        }
+
+        if (enqueue_hook_ && !enqueue_hook_(length_, msg, true)) {
+            // Handler cancelled the enqueue
+            releaseMessageBuffers(*msg);
+            messages_pool_->markAsUnused(msg);
+            continue;
+        }
+
+        if (!first_message_) {
+            first_message_ = msg;
+            last_message_ = msg;
+        } else {
+            last_message_->next = msg;
+            last_message_ = msg;
+        }
+        length_++;
+
+        if (enqueue_hook_) {
+            enqueue_hook_(length_, msg, false);
+        }
+        ++enqueued;
+    }
+
+    if (enqueued > 0) {
+        items_sem_.release(static_cast<std::ptrdiff_t>(enqueued));
+        items_cv_.notify_all();
+    }
+    return enqueued;
+}
+
 int MessageQueue::peek(Message* msg, char* message_content, const uint32_t max_len) const {
     auto logger = LOG_THIS;
     if (!message_content || max_len == 0) {
@@ -76,6 +76,13 @@ public:
     // Returns true if successful, false if message is invalid or queue is full.
     bool enqueue(const char* message_content, const uint32_t message_len);
 
+    // Enqueue `count` messages under one lock.  The messages are stored end
+    // to end in `contents`, message i being lengths[i] bytes long.
+    // Thread-safe: Yes
+    // Returns the number enqueued; an invalid message is skipped, and the
+    // first that can't be stored ends the batch.
+    size_t enqueueBatch(const char* contents, const uint32_t* lengths, size_t count);
+
     // Dequeue the oldest message.
     // Thread-safe: Yes
     // Blocks until a message is available.
@@ -137,9 +144,13 @@ public:
     // Set a hook function to be called before/after each enqueue operation.
     // The hook function should return true to proceed with the enqueue, or false to cancel it.
     // The hook is called with the queue length, the message being enqueued, and a boolean indicating
-    // whether the enqueue is pre- or post- enqueue.
-    void setEnqueueHook(std::function<bool(size_t queue_length, Message* message, bool is_pre_enqueue)> hook) {
+    // whether the enqueue is pre- or post- enqueue.  Both calls are made under the queue's lock, so
+    // the post-enqueue calls see the messages in queue order.
+    // Returns the queue length when the hook was set: the messages it will never be called for.
+    size_t setEnqueueHook(std::function<bool(size_t queue_length, Message* message, bool is_pre_enqueue)> hook) {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
         enqueue_hook_ = std::move(hook);
+        return length_;
     }
 
     void beginShutdown();
@@ -0,0 +1,287 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "MessageTemplateCache.h"
+#include <chrono>
+#include <cstring>
+#include <initializer_list>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    namespace {
+        // insert format specifiers whose output is the same as the value as
+        // it appears in the event XML
+        bool isPlainInsertFormat(std::string_view spec) {
+            static const char* const PLAIN_FORMATS[] = {
+                "s", "S", "ls", "ws", "hs", "d", "i", "u", "ld", "li", "lu"
+            };
+            for (auto format : PLAIN_FORMATS) {
+                if (spec == format) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool isOneOf(std::string_view value, std::initializer_list<std::string_view> values) {
+            for (auto candidate : values) {
+                if (value == candidate) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool isParameterReference(std::string_view value) {
+            return value.size() > 2 && value[0] == '%' && value[1] == '%'
+                && value[2] >= '0' && value[2] <= '9';
+        }
+    }
+
+    std::shared_ptr<const MessageTemplate> MessageTemplate::compile(
+        const char* utf8_template, size_t length) {
+        std::shared_ptr<MessageTemplate> compiled(new MessageTemplate());
+        compiled->literals_.reserve(length);
+        std::uint32_t literal_start = 0;
+
+        auto emit = [&](int insert) {
+            compiled->tokens_.push_back(Token{ literal_start,
+                static_cast<std::uint32_t>(compiled->literals_.size()) - literal_start, insert });
+            literal_start = static_cast<std::uint32_t>(compiled->literals_.size());
+        };
+
+        size_t pos = 0;
+        while (pos < length) {
+            char c = utf8_template[pos++];
+            if (c != '%') {
+                compiled->literals_.push_back(c);
+                continue;
+            }
+            if (pos >= length) {
+                compiled->literals_.push_back('%');
+                break;
+            }
+            char escape = utf8_template[pos++];
+            if (escape >= '1' && escape <= '9') {
+                int insert = escape - '0';
+                if (pos < length && utf8_template[pos] >= '0' && utf8_template[pos] <= '9') {
+                    insert = insert * 10 + (utf8_template[pos++] - '0');
+                }
+                if (pos < length && utf8_template[pos] == '!') {
+                    const char* spec_end = static_cast<const char*>(
+                        memchr(utf8_template + pos + 1, '!', length - pos - 1));
+                    if (spec_end == nullptr) {
+                        compiled->supported_ = false;
+                        break;
+                    }
+                    std::string_view spec(utf8_template + pos + 1, spec_end - (utf8_template + pos + 1));
+                    if (!isPlainInsertFormat(spec)) {
+                        compiled->supported_ = false;
+                    }
+                    pos = spec_end - utf8_template + 1;
+                }
+                if (insert > compiled->highest_insert_) {
+                    compiled->highest_insert_ = insert;
+                }
+                emit(insert);
+                continue;
+            }
+            switch (escape) {
+            case '0':
+                // ends the message without a trailing newline
+                pos = length;
+                break;
+            case 'n':
+                compiled->literals_.append("\r\n");
+                break;
+            case 'r':
+                compiled->literals_.push_back('\r');
+                break;
+            case 't':
+                compiled->literals_.push_back('\t');
+                break;
+            case '%':
+            case ' ':
+            case '.':
+            case '!':
+                compiled->literals_.push_back(escape);
+                break;
+            default:
+                compiled->literals_.push_back('%');
+                compiled->literals_.push_back(escape);
+                compiled->supported_ = false;
+                break;
+            }
+        }
+        if (literal_start < compiled->literals_.size()) {
+            emit(0);
+        }
+        return compiled;
+    }
+
+    bool MessageTemplate::usesInsert(int insert) const {
+        for (const auto& token : tokens_) {
+            if (token.insert == insert) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool MessageTemplate::isVerbatimInsert(std::string_view in_type, std::string_view out_type,
+        bool has_value_map) {
+        if (has_value_map) {
+            return false;
+        }
+        if (isOneOf(in_type, { "win:UnicodeString", "win:AnsiString", "win:SID" })) {
+            return out_type.empty() || out_type == "xs:string";
+        }
+        if (isOneOf(in_type, { "win:Int8", "win:UInt8", "win:Int16", "win:UInt16",
+            "win:Int32", "win:UInt32", "win:Int64", "win:UInt64" })) {
+            return out_type.empty() || isOneOf(out_type, { "xs:string", "xs:byte", "xs:unsignedByte",
+                "xs:short", "xs:unsignedShort", "xs:int", "xs:unsignedInt", "xs:long", "xs:unsignedLong" });
+        }
+        return false;
+    }
+
+    bool MessageTemplate::render(const std::string_view* inserts, size_t insert_count,
+        char* dest, size_t max_size, size_t& size_out) const {
+        size_out = 0;
+        if (!supported_ || dest == nullptr || max_size == 0
+            || static_cast<size_t>(highest_insert_) > insert_count) {
+            return false;
+        }
+        size_t remaining = max_size - 1;
+        char* out = dest;
+        auto append = [&](const char* src, size_t len) {
+            if (len > remaining) {
+                len = remaining;
+            }
+            memcpy(out, src, len);
+            out += len;
+            remaining -= len;
+        };
+        for (const auto& token : tokens_) {
+            append(literals_.data() + token.literal_offset, token.literal_length);
+            if (token.insert > 0) {
+                const auto& value = inserts[token.insert - 1];
+                if (isParameterReference(value)) {
+                    return false;
+                }
+                append(value.data(), value.size());
+            }
+        }
+        *out = 0;
+        size_out = out - dest;
+        return true;
+    }
+
+
+    MessageTemplateCache::MessageTemplateCache(
+        std::shared_ptr<IMessageTemplateSource> source,
+        size_t capacity,
+        std::int64_t ttl_ms,
+        Clock clock)
+        : source_(source),
+        capacity_(capacity > 0 ? capacity : 1),
+        ttl_ms_(ttl_ms),
+        clock_(clock) {
+    }
+
+    size_t MessageTemplateCache::KeyHash::operator()(const KeyView& key) const {
+        size_t hash = std::hash<std::string_view>()(key.provider);
+        hash ^= (static_cast<size_t>(key.event_id) << 16) + key.version + (hash << 6) + (hash >> 2);
+        hash ^= key.locale + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    std::int64_t MessageTemplateCache::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    MessageTemplateCache::TemplateRef MessageTemplateCache::acquire(std::string_view provider,
+        std::uint32_t event_id, std::uint32_t version, std::uint32_t locale) {
+        auto& stats = AgentStatistics::instance();
+        KeyView key_view{ provider, event_id, version, locale };
+        auto current_time = now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(key_view);
+            if (found != index_.end()) {
+                auto it = found->second;
+                if (it->expires_at > current_time) {
+                    lru_.splice(lru_.begin(), lru_, it);
+                    stats.increment(AgentStatistics::MessageTemplateHits);
+                    return it->compiled;
+                }
+                removeLocked(it);
+            }
+        }
+
+        // load without holding the lock, it goes to the publisher's message table
+        stats.increment(AgentStatistics::MessageTemplateMisses);
+        Entry entry;
+        entry.key = MessageTemplateKey{ std::string(provider), event_id, version, locale };
+        entry.expires_at = current_time + ttl_ms_;
+        std::string utf8_template;
+        std::vector<int> unverbatim_inserts;
+        if (source_->loadTemplate(entry.key, utf8_template, unverbatim_inserts)) {
+            auto compiled = MessageTemplate::compile(utf8_template.data(), utf8_template.size());
+            bool supported = compiled->isSupported();
+            for (int insert : unverbatim_inserts) {
+                supported = supported && !compiled->usesInsert(insert);
+            }
+            if (supported) {
+                entry.compiled = compiled;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(key_view);
+        if (found != index_.end()) {
+            removeLocked(found->second);
+        }
+        while (!lru_.empty() && lru_.size() >= capacity_) {
+            removeLocked(std::prev(lru_.end()));
+        }
+        TemplateRef result = entry.compiled;
+        lru_.push_front(std::move(entry));
+        index_.emplace(lru_.front().key, lru_.begin());
+        return result;
+    }
+
+    void MessageTemplateCache::removeLocked(EntryList::iterator it) {
+        index_.erase(it->key);
+        lru_.erase(it);
+    }
+
+    void MessageTemplateCache::invalidateProvider(std::string_view provider) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = lru_.begin(); it != lru_.end(); ) {
+            auto next = std::next(it);
+            if (it->key.provider == provider) {
+                removeLocked(it);
+            }
+            it = next;
+        }
+    }
+
+    void MessageTemplateCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index_.clear();
+        lru_.clear();
+    }
+
+    size_t MessageTemplateCache::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+}
@@ -0,0 +1,171 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "framework.h"
+
+// Event message rendering without EvtFormatMessage.
+//
+// MessageTemplate is a FormatMessage-style message (e.g. "An account was
+// successfully logged on.%n%nSubject:%n%tSecurity ID:%t%t%1%n...") parsed
+// once into UTF-8 literal runs and insert positions, so rendering an event
+// is just copying literals and the event's own EventData values into the
+// output buffer.
+//
+// MessageTemplateCache keeps compiled templates keyed by provider, event
+// ID, version and locale.  Templates are fetched from an
+// IMessageTemplateSource (the publisher's message table on Windows) only on
+// a cache miss.  Anything the engine can't reproduce exactly -- insert
+// format specifiers other than plain strings/decimals, inserts the event's
+// template gives a value map or a type whose XML form isn't what the
+// message shows (dates, hex, booleans...), parameter-message references in
+// insert values, missing inserts -- is reported back so the caller can
+// fall back to the OS renderer.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API MessageTemplate {
+    public:
+        static constexpr int MAX_INSERTS = 99;    // same limit as FormatMessage
+
+        // Compiles a UTF-8 FormatMessage-style template.  Never fails; check
+        // isSupported() to see whether render() can be used with it.
+        static std::shared_ptr<const MessageTemplate> compile(const char* utf8_template, size_t length);
+
+        bool isSupported() const { return supported_; }
+        int highestInsert() const { return highest_insert_; }
+        bool usesInsert(int insert) const;
+
+        // Whether an insert declared in an event template with these inType
+        // and outType attributes (outType may be empty) reads the same in
+        // the event XML as in the formatted message: strings, decimal
+        // integers and SIDs, with no value map.
+        static bool isVerbatimInsert(std::string_view in_type, std::string_view out_type, bool has_value_map);
+
+        // Writes the message with %1..%n replaced by inserts[0..n-1] and
+        // null-terminates it, truncating if needed.  Returns false if the OS
+        // renderer should be used instead (an insert it refers to is missing
+        // or is itself a "%%nnnn" parameter-message reference).
+        bool render(const std::string_view* inserts, size_t insert_count,
+            char* dest, size_t max_size, size_t& size_out) const;
+
+    private:
+        struct Token {
+            std::uint32_t literal_offset;   // into literals_
+            std::uint32_t literal_length;
+            int insert;                     // 1-based insert that follows the literal, 0 for none
+        };
+
+        MessageTemplate() : supported_(true), highest_insert_(0) {}
+
+        std::string literals_;
+        std::vector<Token> tokens_;
+        bool supported_;
+        int highest_insert_;
+    };
+
+    struct AGENTLIB_API MessageTemplateKey {
+        std::string provider;
+        std::uint32_t event_id;     // classic events include the qualifiers in the high word
+        std::uint32_t version;
+        std::uint32_t locale;
+    };
+
+    class AGENTLIB_API IMessageTemplateSource {
+    public:
+        virtual ~IMessageTemplateSource() = default;
+        // Fetches the raw UTF-8 message template (inserts not filled in),
+        // and the 1-based inserts whose XML values the message doesn't show
+        // as they are (see MessageTemplate::isVerbatimInsert).  Returns false
+        // if the provider has no message for the event.
+        virtual bool loadTemplate(const MessageTemplateKey& key, std::string& utf8_template_out,
+            std::vector<int>& unverbatim_inserts_out) = 0;
+    };
+
+    class AGENTLIB_API MessageTemplateCache {
+    public:
+        typedef std::shared_ptr<const MessageTemplate> TemplateRef;
+        typedef std::function<std::int64_t()> Clock;   // milliseconds, monotonic
+
+        static constexpr size_t DEFAULT_CAPACITY = 4096;
+        static constexpr std::int64_t DEFAULT_TTL_MS = 15 * 60 * 1000;
+
+        MessageTemplateCache(
+            std::shared_ptr<IMessageTemplateSource> source,
+            size_t capacity = DEFAULT_CAPACITY,
+            std::int64_t ttl_ms = DEFAULT_TTL_MS,
+            Clock clock = nullptr);
+
+        MessageTemplateCache(const MessageTemplateCache&) = delete;
+        MessageTemplateCache& operator=(const MessageTemplateCache&) = delete;
+
+        // Returns the compiled template, or an empty TemplateRef if the
+        // source has none or it can't be rendered locally.  Either result
+        // is cached.
+        TemplateRef acquire(std::string_view provider, std::uint32_t event_id,
+            std::uint32_t version, std::uint32_t locale);
+
+        void invalidateProvider(std::string_view provider);
+        void clear();
+        size_t size() const;
+
+    private:
+        struct KeyView {
+            std::string_view provider;
+            std::uint32_t event_id;
+            std::uint32_t version;
+            std::uint32_t locale;
+        };
+        struct Entry {
+            MessageTemplateKey key;
+            TemplateRef compiled;       // empty if not available locally
+            std::int64_t expires_at;
+        };
+        typedef std::list<Entry> EntryList;
+
+        struct KeyHash {
+            using is_transparent = void;
+            size_t operator()(const KeyView& key) const;
+            size_t operator()(const MessageTemplateKey& key) const {
+                return (*this)(KeyView{ key.provider, key.event_id, key.version, key.locale });
+            }
+        };
+        struct KeyEqual {
+            using is_transparent = void;
+            static KeyView view(const MessageTemplateKey& key) {
+                return KeyView{ key.provider, key.event_id, key.version, key.locale };
+            }
+            static const KeyView& view(const KeyView& key) { return key; }
+            template <class A, class B>
+            bool operator()(const A& a, const B& b) const {
+                const KeyView& x = view(a);
+                const KeyView& y = view(b);
+                return x.event_id == y.event_id && x.version == y.version
+                    && x.locale == y.locale && x.provider == y.provider;
+            }
+        };
+
+        void removeLocked(EntryList::iterator it);
+        std::int64_t now() const;
+
+        std::shared_ptr<IMessageTemplateSource> source_;
+        size_t capacity_;
+        std::int64_t ttl_ms_;
+        Clock clock_;
+        EntryList lru_;             // most recently used at the front
+        std::unordered_map<MessageTemplateKey, EntryList::iterator, KeyHash, KeyEqual> index_;
+        mutable std::mutex mutex_;
+    };
+}
@@ -0,0 +1,82 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "MessageTextPolicy.h"
+#include <cctype>
+#include <chrono>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    MessageTextPolicy::MessageTextPolicy(
+        bool skip_channel,
+        std::string_view skip_providers,
+        std::uint32_t sample_interval,
+        Clock clock)
+        : skip_channel_(skip_channel),
+        sample_interval_(sample_interval),
+        clock_(clock) {
+        size_t pos = 0;
+        while (pos <= skip_providers.size()) {
+            size_t end = skip_providers.find_first_of(",;", pos);
+            if (end == std::string_view::npos) {
+                end = skip_providers.size();
+            }
+            auto name = skip_providers.substr(pos, end - pos);
+            while (!name.empty() && isspace(static_cast<unsigned char>(name.front()))) {
+                name.remove_prefix(1);
+            }
+            while (!name.empty() && isspace(static_cast<unsigned char>(name.back()))) {
+                name.remove_suffix(1);
+            }
+            if (!name.empty() && name.size() <= MAX_PROVIDER_LENGTH) {
+                std::string lower(name);
+                for (auto& c : lower) {
+                    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+                }
+                skip_providers_.insert(std::move(lower));
+            }
+            pos = end + 1;
+        }
+    }
+
+    std::int64_t MessageTextPolicy::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    MessageTextPolicy::Decision MessageTextPolicy::decide(std::string_view provider) {
+        bool skip = skip_channel_;
+        if (!skip && !skip_providers_.empty() && provider.size() <= MAX_PROVIDER_LENGTH) {
+            char lower[MAX_PROVIDER_LENGTH];
+            for (size_t i = 0; i < provider.size(); ++i) {
+                lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(provider[i])));
+            }
+            skip = skip_providers_.find(std::string_view(lower, provider.size())) != skip_providers_.end();
+        }
+        if (!skip) {
+            return Decision::Render;
+        }
+        std::uint64_t count = skipped_.fetch_add(1, std::memory_order_relaxed);
+        if (sample_interval_ > 0 && count % sample_interval_ == 0) {
+            AgentStatistics::instance().increment(AgentStatistics::MessageTextSampled);
+            return Decision::Sample;
+        }
+        AgentStatistics::instance().increment(AgentStatistics::MessageTextSkipped);
+        return Decision::Skip;
+    }
+
+    void MessageTextPolicy::renderDone(std::int64_t started) {
+        std::int64_t elapsed = now() - started;
+        if (elapsed > 0) {
+            AgentStatistics::instance().increment(AgentStatistics::MessageTextSampleMicroseconds,
+                static_cast<std::uint64_t>(elapsed));
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include "framework.h"
+
+// MessageTextPolicy decides, per event, whether its message text is
+// rendered at all.  Rendering (EvtFormatMessage against the publisher's
+// metadata) usually costs more than everything else done with an event,
+// and for many providers the receiver only needs the EventData fields.
+//
+// Text is skipped for every event of a channel with skip_channel set, and
+// for the listed providers on any channel (a list separated by commas or
+// semicolons, compared case-insensitively).  One skipped event in
+// `sample_interval` is rendered anyway, sent with its text, and timed, so
+// the cost of rendering stays visible in the statistics; 0 renders none.
+//
+// decide() is lock free and the policy can be shared between
+// threads.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API MessageTextPolicy {
+    public:
+        typedef std::function<std::int64_t()> Clock;   // microseconds, monotonic
+
+        static constexpr std::uint32_t DEFAULT_SAMPLE_INTERVAL = 100;
+        static constexpr size_t MAX_PROVIDER_LENGTH = 256;
+
+        enum class Decision {
+            Render,         // not skipped
+            Skip,
+            Sample,         // would be skipped, but is rendered (and sent) to keep the cost measured
+        };
+
+        MessageTextPolicy(
+            bool skip_channel,
+            std::string_view skip_providers,
+            std::uint32_t sample_interval = DEFAULT_SAMPLE_INTERVAL,
+            Clock clock = nullptr);
+
+        MessageTextPolicy(const MessageTextPolicy&) = delete;
+        MessageTextPolicy& operator=(const MessageTextPolicy&) = delete;
+
+        // Whether anything is skipped at all
+        bool skipsAny() const { return skip_channel_ || !skip_providers_.empty(); }
+
+        Decision decide(std::string_view provider);
+
+        // Times a Sample's rendering: pass renderDone() what now() returned
+        // before it
+        std::int64_t now() const;
+        void renderDone(std::int64_t started);
+
+        size_t providerCount() const { return skip_providers_.size(); }
+
+    private:
+        bool skip_channel_;
+        std::set<std::string, std::less<>> skip_providers_;     // lower case
+        std::uint32_t sample_interval_;
+        Clock clock_;
+        std::atomic<std::uint64_t> skipped_{ 0 };
+    };
+}
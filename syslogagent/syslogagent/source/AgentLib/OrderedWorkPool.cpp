@@ -0,0 +1,142 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "OrderedWorkPool.h"
+#include "AgentStatistics.h"
+#include "EventSource.h"
+
+namespace Syslog_agent {
+
+    OrderedWorkPool::Channel::Channel(size_t max_in_flight)
+        : slots_(max_in_flight > 0 ? max_in_flight : 1) {
+    }
+
+    OrderedWorkPool::OrderedWorkPool(size_t worker_count) {
+        if (worker_count == 0) {
+            worker_count = 1;
+        }
+        workers_.reserve(worker_count);
+        for (size_t i = 0; i < worker_count; ++i) {
+            workers_.emplace_back(&OrderedWorkPool::workerLoop, this);
+        }
+    }
+
+    OrderedWorkPool::~OrderedWorkPool() {
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            stopping_ = true;
+        }
+        jobs_cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    std::shared_ptr<OrderedWorkPool::Channel> OrderedWorkPool::createChannel(size_t max_in_flight) {
+        return std::make_shared<Channel>(max_in_flight);
+    }
+
+    void OrderedWorkPool::submit(Channel& channel, std::unique_ptr<Task> task) {
+        std::uint64_t sequence;
+        {
+            std::unique_lock<std::mutex> lock(channel.mutex_);
+            channel.progress_cv_.wait(lock, [&channel]() {
+                return channel.next_submit_ - channel.next_complete_ < channel.slots_.size();
+            });
+            sequence = channel.next_submit_++;
+            auto& slot = channel.slots_[sequence % channel.slots_.size()];
+            slot.task = std::move(task);
+            slot.worked = false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex_);
+            jobs_.push_back(Job{ &channel, sequence });
+        }
+        jobs_cv_.notify_one();
+        AgentStatistics::instance().increment(AgentStatistics::WorkPoolTasks);
+    }
+
+    void OrderedWorkPool::drain(Channel& channel) {
+        std::unique_lock<std::mutex> lock(channel.mutex_);
+        channel.progress_cv_.wait(lock, [&channel]() {
+            return channel.next_complete_ == channel.next_submit_;
+        });
+    }
+
+    size_t OrderedWorkPool::pump(EventSource& source, Channel& channel) {
+        std::unique_ptr<Task> tasks[PUMP_BATCH_SIZE];
+        size_t submitted = 0;
+        for (;;) {
+            size_t count = source.next(tasks, PUMP_BATCH_SIZE);
+            if (count == 0) {
+                return submitted;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                submit(channel, std::move(tasks[i]));
+            }
+            submitted += count;
+        }
+    }
+
+    void OrderedWorkPool::workerLoop() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mutex_);
+                jobs_cv_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                job = jobs_.front();
+                jobs_.pop_front();
+            }
+            Task* task;
+            {
+                // the slot can't be reused until this sequence completes
+                std::lock_guard<std::mutex> lock(job.channel->mutex_);
+                task = job.channel->slots_[job.sequence % job.channel->slots_.size()].task.get();
+            }
+            try {
+                task->work();
+            }
+            catch (...) {
+            }
+            finish(*job.channel, job.sequence);
+        }
+    }
+
+    void OrderedWorkPool::finish(Channel& channel, std::uint64_t sequence) {
+        std::unique_lock<std::mutex> lock(channel.mutex_);
+        channel.slots_[sequence % channel.slots_.size()].worked = true;
+        if (sequence != channel.next_complete_) {
+            AgentStatistics::instance().increment(AgentStatistics::WorkPoolReordered);
+        }
+        if (channel.completing_) {
+            // the thread completing this channel picks it up in turn
+            return;
+        }
+        channel.completing_ = true;
+        for (;;) {
+            auto& slot = channel.slots_[channel.next_complete_ % channel.slots_.size()];
+            if (channel.next_complete_ == channel.next_submit_ || !slot.worked) {
+                break;
+            }
+            auto task = std::move(slot.task);
+            slot.worked = false;
+            lock.unlock();
+            try {
+                task->complete();
+            }
+            catch (...) {
+            }
+            task.reset();
+            lock.lock();
+            ++channel.next_complete_;
+            channel.progress_cv_.notify_all();
+        }
+        channel.completing_ = false;
+    }
+}
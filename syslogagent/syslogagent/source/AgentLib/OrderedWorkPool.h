@@ -0,0 +1,103 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "framework.h"
+
+// OrderedWorkPool spreads the expensive part of handling events (rendering,
+// parsing, serializing) over a fixed set of threads, while each channel's
+// results still go out in the order its events were logged.
+//
+// Each event is a Task in two parts.  work() runs on any pool thread, in
+// parallel with everything else, including later events of the same
+// channel.  complete() runs in submission order within the channel and
+// never concurrently with another complete() for that channel; it's where
+// the messages are enqueued and the bookmark advanced.  Whichever worker
+// finishes the event a channel is waiting on completes it, and any later
+// ones already finished, so no thread is spent just on reordering.
+//
+// A channel holds at most max_in_flight tasks between submit() and
+// complete(); submit() blocks beyond that, so memory stays bounded however
+// far ahead the source is.  Channels are independent: a slow event only
+// holds back its own channel.
+//
+// Tasks must not throw; anything thrown is dropped so the pool and the
+// channel's ordering carry on.  A channel must be drained before it is
+// destroyed, and channels before the pool.
+
+namespace Syslog_agent {
+
+    class EventSource;
+
+    class AGENTLIB_API OrderedWorkPool {
+    public:
+        static constexpr size_t DEFAULT_MAX_IN_FLIGHT = 64;    // per channel
+        static constexpr size_t PUMP_BATCH_SIZE = 64;
+
+        class Task {
+        public:
+            virtual ~Task() = default;
+            virtual void work() = 0;        // any pool thread, in parallel
+            virtual void complete() = 0;    // in order, one at a time per channel
+        };
+
+        class Channel {
+        public:
+            explicit Channel(size_t max_in_flight);
+        private:
+            friend class OrderedWorkPool;
+            struct Slot {
+                std::unique_ptr<Task> task;
+                bool worked = false;
+            };
+            std::mutex mutex_;
+            std::condition_variable progress_cv_;
+            std::vector<Slot> slots_;           // ring, indexed by sequence
+            std::uint64_t next_submit_ = 0;
+            std::uint64_t next_complete_ = 0;
+            bool completing_ = false;
+        };
+
+        explicit OrderedWorkPool(size_t worker_count);
+        ~OrderedWorkPool();
+
+        OrderedWorkPool(const OrderedWorkPool&) = delete;
+        OrderedWorkPool& operator=(const OrderedWorkPool&) = delete;
+
+        std::shared_ptr<Channel> createChannel(size_t max_in_flight = DEFAULT_MAX_IN_FLIGHT);
+
+        // Blocks while the channel has max_in_flight tasks outstanding
+        void submit(Channel& channel, std::unique_ptr<Task> task);
+        // Waits for every task submitted to the channel to complete
+        void drain(Channel& channel);
+        // Submits the source's tasks until it has no more; returns how many
+        size_t pump(EventSource& source, Channel& channel);
+
+        size_t workerCount() const { return workers_.size(); }
+
+    private:
+        struct Job {
+            Channel* channel;
+            std::uint64_t sequence;
+        };
+
+        void workerLoop();
+        void finish(Channel& channel, std::uint64_t sequence);
+
+        std::mutex jobs_mutex_;
+        std::condition_variable jobs_cv_;
+        std::deque<Job> jobs_;
+        bool stopping_ = false;
+        std::vector<std::thread> workers_;
+    };
+}
@@ -0,0 +1,204 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "OverloadController.h"
+#include <chrono>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    namespace {
+        // weight of the newest sample in the smoothed rates
+        const double RATE_SMOOTHING = 0.3;
+    }
+
+    OverloadController::OverloadController(
+        size_t high_water,
+        std::int64_t sustain_ms,
+        size_t max_keys,
+        Clock clock,
+        std::uint64_t seed)
+        : high_water_(high_water > 0 ? high_water : 1),
+        sustain_ms_(sustain_ms),
+        max_keys_(max_keys),
+        clock_(clock),
+        random_state_(seed != 0 ? seed : 1) {
+    }
+
+    std::int64_t OverloadController::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void OverloadController::update(size_t queue_depth) {
+        auto& stats = AgentStatistics::instance();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto current_time = now();
+        std::uint64_t events_in = events_in_.load(std::memory_order_relaxed);
+        std::uint64_t events_forwarded = events_forwarded_.load(std::memory_order_relaxed);
+        if (!started_) {
+            started_ = true;
+            last_update_ = current_time;
+            last_step_ = current_time - STEP_INTERVAL_MS;
+            last_roll_ = current_time;
+            last_depth_ = queue_depth;
+            last_events_in_ = events_in;
+            last_events_forwarded_ = events_forwarded;
+            return;
+        }
+        std::int64_t elapsed = current_time - last_update_;
+        if (elapsed <= 0) {
+            return;
+        }
+
+        // what left the queue is what was put in, less what the queue grew by
+        double forwarded = static_cast<double>(events_forwarded - last_events_forwarded_);
+        double drained = forwarded - (static_cast<double>(queue_depth) - static_cast<double>(last_depth_));
+        if (drained < 0) {
+            drained = 0;
+        }
+        double per_second = 1000.0 / static_cast<double>(elapsed);
+        in_rate_ += RATE_SMOOTHING * (static_cast<double>(events_in - last_events_in_) * per_second - in_rate_);
+        forward_rate_ += RATE_SMOOTHING * (forwarded * per_second - forward_rate_);
+        out_rate_ += RATE_SMOOTHING * (drained * per_second - out_rate_);
+        last_update_ = current_time;
+        last_depth_ = queue_depth;
+        last_events_in_ = events_in;
+        last_events_forwarded_ = events_forwarded;
+
+        if (current_time - last_roll_ >= COUNT_INTERVAL_MS) {
+            rollCountsLocked();
+            last_roll_ = current_time;
+        }
+
+        unsigned level = level_.load(std::memory_order_relaxed);
+        bool pressure = queue_depth > high_water_ / 2 && forward_rate_ > out_rate_;
+        if (pressure) {
+            if (pressure_since_ < 0) {
+                pressure_since_ = current_time;
+            }
+            drained_since_ = -1;
+            counting_.store(true, std::memory_order_relaxed);
+            bool sustained = current_time - pressure_since_ >= sustain_ms_ || queue_depth > high_water_;
+            if (sustained && level < MAX_LEVEL && current_time - last_step_ >= STEP_INTERVAL_MS) {
+                level_.store(++level, std::memory_order_relaxed);
+                last_step_ = current_time;
+            }
+        }
+        else {
+            pressure_since_ = -1;
+            if (queue_depth < high_water_ / 4) {
+                if (drained_since_ < 0) {
+                    drained_since_ = current_time;
+                }
+                if (level > 0 && current_time - drained_since_ >= STEP_INTERVAL_MS
+                    && current_time - last_step_ >= STEP_INTERVAL_MS) {
+                    level_.store(--level, std::memory_order_relaxed);
+                    last_step_ = current_time;
+                }
+            }
+            else {
+                drained_since_ = -1;
+            }
+            if (level == 0 && queue_depth <= high_water_ / 2) {
+                counting_.store(false, std::memory_order_relaxed);
+                keys_.clear();
+            }
+        }
+        stats.set(AgentStatistics::OverloadSampleRate, 1u << level);
+    }
+
+    void OverloadController::rollCountsLocked() {
+        for (auto it = keys_.begin(); it != keys_.end(); ) {
+            it->second.previous = it->second.current;
+            it->second.current = 0;
+            if (it->second.previous == 0) {
+                it = keys_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    std::uint64_t OverloadController::nextRandomLocked() {
+        // xorshift64*
+        random_state_ ^= random_state_ >> 12;
+        random_state_ ^= random_state_ << 25;
+        random_state_ ^= random_state_ >> 27;
+        return random_state_ * 0x2545F4914F6CDD1Dull;
+    }
+
+    std::uint32_t OverloadController::sampleRateLocked(const KeyCounts& counts) const {
+        // as much as the level allows, as long as the key still gets
+        // MIN_KEEP_PER_INTERVAL events through
+        std::uint32_t volume = counts.previous > counts.current ? counts.previous : counts.current;
+        std::uint32_t base_rate = 1u << level_.load(std::memory_order_relaxed);
+        std::uint32_t rate = 1;
+        while (rate < base_rate && volume / (rate * 2) >= MIN_KEEP_PER_INTERVAL) {
+            rate *= 2;
+        }
+        return rate;
+    }
+
+    std::uint32_t OverloadController::admit(std::uint64_t key, int severity) {
+        events_in_.fetch_add(1, std::memory_order_relaxed);
+        if (!counting_.load(std::memory_order_relaxed)) {
+            events_forwarded_.fetch_add(1, std::memory_order_relaxed);
+            return 1;
+        }
+
+        std::uint32_t rate = 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = keys_.find(key);
+            if (found == keys_.end() && keys_.size() < max_keys_) {
+                found = keys_.emplace(key, KeyCounts{ 0, 0 }).first;
+            }
+            if (found != keys_.end()) {
+                ++found->second.current;
+                if (severity > MAX_PROTECTED_SEVERITY && level_.load(std::memory_order_relaxed) > 0) {
+                    rate = sampleRateLocked(found->second);
+                    if (rate > 1 && (nextRandomLocked() & (rate - 1)) != 0) {
+                        AgentStatistics::instance().increment(AgentStatistics::OverloadSampledOut);
+                        return 0;
+                    }
+                }
+            }
+        }
+        events_forwarded_.fetch_add(1, std::memory_order_relaxed);
+        return rate;
+    }
+
+    int OverloadController::severityOfWindowsLevel(int windows_level) {
+        switch (windows_level) {
+        case 1: return 2;       // critical
+        case 2: return 3;       // error
+        case 3: return 4;       // warning
+        case 0:                 // LogAlways
+        case 4: return 5;       // information, sent as notice
+        default: return 7;      // verbose, debug
+        }
+    }
+
+    double OverloadController::incomingRate() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return in_rate_;
+    }
+
+    double OverloadController::outgoingRate() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return out_rate_;
+    }
+
+    size_t OverloadController::trackedKeys() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return keys_.size();
+    }
+}
@@ -0,0 +1,121 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include "framework.h"
+
+// OverloadController sheds load when events come in faster than the
+// destination takes them for long enough that the queue would otherwise
+// grow without bound.
+//
+// The service calls update() periodically with the send queue's depth.
+// The controller estimates the in and out rates from that and from the
+// events it has seen, and when the queue is past half its high water mark
+// and still growing for `sustain_ms` it starts sampling, doubling the base
+// sample rate every STEP_INTERVAL_MS while that continues (straight away
+// if the queue is past the high water mark itself), and halving it again
+// once the queue has drained below a quarter.
+//
+// Sampling is per (provider, event ID) key and only ever applies to events
+// less severe than warning.  Each key keeps at least MIN_KEEP_PER_INTERVAL
+// events a second, so low-volume events pass untouched and the sampling
+// lands on the few noisy keys that are causing the overload.  An event that
+// is kept while its key is being sampled 1 in N stands for N events, and
+// the caller sends N along with it.
+//
+// Memory is bounded by `max_keys`; keys beyond that aren't sampled.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API OverloadController {
+    public:
+        typedef std::function<std::int64_t()> Clock;   // milliseconds, monotonic
+
+        static constexpr std::int64_t DEFAULT_SUSTAIN_MS = 60 * 1000;
+        static constexpr std::int64_t STEP_INTERVAL_MS = 10 * 1000;
+        static constexpr std::int64_t COUNT_INTERVAL_MS = 1000;
+        static constexpr size_t DEFAULT_MAX_KEYS = 8192;
+        static constexpr unsigned MAX_LEVEL = 10;                   // at most 1 in 1024
+        static constexpr std::uint32_t MIN_KEEP_PER_INTERVAL = 10;
+        static constexpr int MAX_PROTECTED_SEVERITY = 4;            // syslog warning
+
+        OverloadController(
+            size_t high_water,
+            std::int64_t sustain_ms = DEFAULT_SUSTAIN_MS,
+            size_t max_keys = DEFAULT_MAX_KEYS,
+            Clock clock = nullptr,
+            std::uint64_t seed = 0x9E3779B97F4A7C15ull);
+
+        OverloadController(const OverloadController&) = delete;
+        OverloadController& operator=(const OverloadController&) = delete;
+
+        // Feeds the controller the current queue depth; call about every
+        // 100ms to a second.
+        void update(size_t queue_depth);
+
+        // Decides on one event.  Returns 0 if it should be dropped, else the
+        // number of events it stands for: 1 normally, N if its key is
+        // being sampled 1 in N.  severity is the syslog severity of the
+        // event's own level.
+        std::uint32_t admit(std::uint64_t key, int severity);
+
+        // The syslog severity admit() is given for an event's Windows level.
+        // Level 0 (LogAlways), which the Security log's audit events all
+        // have, counts as information, as it does in the event query.
+        static int severityOfWindowsLevel(int windows_level);
+
+        unsigned level() const { return level_.load(std::memory_order_relaxed); }
+        std::uint32_t baseSampleRate() const { return 1u << level(); }
+        bool isShedding() const { return level() > 0; }
+        double incomingRate() const;
+        double outgoingRate() const;
+        size_t trackedKeys() const;
+
+    private:
+        struct KeyCounts {
+            std::uint32_t current;      // events in this count interval
+            std::uint32_t previous;     // events in the last one
+        };
+
+        std::uint32_t sampleRateLocked(const KeyCounts& counts) const;
+        void rollCountsLocked();
+        std::uint64_t nextRandomLocked();
+        std::int64_t now() const;
+
+        size_t high_water_;
+        std::int64_t sustain_ms_;
+        size_t max_keys_;
+        Clock clock_;
+
+        std::atomic<unsigned> level_{ 0 };
+        std::atomic<bool> counting_{ false };      // keys are only tracked while under pressure
+        std::atomic<std::uint64_t> events_in_{ 0 };
+        std::atomic<std::uint64_t> events_forwarded_{ 0 };
+
+        // update() state
+        bool started_ = false;
+        std::int64_t last_update_ = 0;
+        size_t last_depth_ = 0;
+        std::uint64_t last_events_in_ = 0;
+        std::uint64_t last_events_forwarded_ = 0;
+        double in_rate_ = 0.0;          // events seen
+        double forward_rate_ = 0.0;     // events let through
+        double out_rate_ = 0.0;         // events drained from the queue
+        std::int64_t pressure_since_ = -1;      // -1 when not under pressure
+        std::int64_t drained_since_ = -1;
+        std::int64_t last_step_ = -STEP_INTERVAL_MS;
+        std::int64_t last_roll_ = 0;
+
+        std::unordered_map<std::uint64_t, KeyCounts> keys_;
+        std::uint64_t random_state_;
+        mutable std::mutex mutex_;
+    };
+}
@@ -0,0 +1,448 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "PiiRedactor.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <deque>
+
+namespace Syslog_agent {
+
+    namespace {
+        void skipSpaces(std::string_view& text) {
+            while (!text.empty() && isspace(static_cast<unsigned char>(text.front()))) {
+                text.remove_prefix(1);
+            }
+        }
+
+        // A bare word, or a double-quoted string; in quotes \" is a quote
+        // and any other backslash is kept, so regular expressions read as written
+        bool readToken(std::string_view& text, std::string& token, std::string& error) {
+            token.clear();
+            skipSpaces(text);
+            if (!text.empty() && text.front() == '"') {
+                text.remove_prefix(1);
+                while (!text.empty()) {
+                    char c = text.front();
+                    text.remove_prefix(1);
+                    if (c == '\\' && !text.empty() && text.front() == '"') {
+                        token.push_back('"');
+                        text.remove_prefix(1);
+                    }
+                    else if (c == '"') {
+                        return true;
+                    }
+                    else {
+                        token.push_back(c);
+                    }
+                }
+                error = "unterminated string";
+                return false;
+            }
+            while (!text.empty() && !isspace(static_cast<unsigned char>(text.front()))) {
+                token.push_back(text.front());
+                text.remove_prefix(1);
+            }
+            return true;
+        }
+
+        bool isWordByte(char c) {
+            return isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        bool isDigit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        // The literal a regular expression starts with, up to the first
+        // character that means anything to the regex engine
+        std::string leadingLiteral(const std::string& expression) {
+            static const char* const SPECIAL = "\\^$.|?*+()[]{}";
+            // with a top-level alternative the start isn't required at all
+            int depth = 0;
+            for (size_t i = 0; i < expression.size(); ++i) {
+                char c = expression[i];
+                if (c == '\\') {
+                    ++i;
+                }
+                else if (c == '(') {
+                    ++depth;
+                }
+                else if (c == ')') {
+                    --depth;
+                }
+                else if (c == '|' && depth == 0) {
+                    return std::string();
+                }
+            }
+            std::string literal;
+            for (size_t i = 0; i < expression.size(); ++i) {
+                char c = expression[i];
+                if (strchr(SPECIAL, c) == nullptr) {
+                    literal.push_back(c);
+                    continue;
+                }
+                // a quantifier applies to the character before it
+                if ((c == '?' || c == '*' || c == '{') && !literal.empty()) {
+                    literal.pop_back();
+                }
+                break;
+            }
+            return literal;
+        }
+
+        bool luhnValid(const char* digits, size_t count) {
+            int sum = 0;
+            for (size_t i = 0; i < count; ++i) {
+                int digit = digits[count - 1 - i] - '0';
+                if (i % 2 == 1) {
+                    digit *= 2;
+                    if (digit > 9) {
+                        digit -= 9;
+                    }
+                }
+                sum += digit;
+            }
+            return sum % 10 == 0;
+        }
+    }
+
+    void PiiRedactor::addPattern(std::string_view anchor, Verifier verifier) {
+        std::string lower(anchor);
+        for (auto& c : lower) {
+            c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        }
+        anchors_.push_back(std::move(lower));
+        patterns_.push_back(Pattern{ anchor.size(), verifier });
+    }
+
+    std::shared_ptr<const PiiRedactor> PiiRedactor::compile(std::string_view text,
+        std::vector<CompileError>* errors, const std::vector<CustomPattern>& custom) {
+        std::shared_ptr<PiiRedactor> redactor(new PiiRedactor());
+        int line_number = 0;
+        while (!text.empty()) {
+            auto newline = text.find('\n');
+            auto line = text.substr(0, newline);
+            text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+            ++line_number;
+
+            skipSpaces(line);
+            while (!line.empty() && isspace(static_cast<unsigned char>(line.back()))) {
+                line.remove_suffix(1);
+            }
+            if (line.empty() || line.front() == '#') {
+                continue;
+            }
+
+            std::string kind;
+            std::string argument;
+            std::string error;
+            readToken(line, kind, error);
+            for (auto& c : kind) {
+                c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            }
+            bool needs_argument = kind == "word" || kind == "regex";
+            bool read = !needs_argument || readToken(line, argument, error);
+            skipSpaces(line);
+            if (!read) {
+                // error already set
+            }
+            else if (kind != "card" && kind != "ssn" && !needs_argument) {
+                error = "unknown pattern kind \"" + kind + "\"";
+            }
+            else if (needs_argument && argument.empty()) {
+                error = kind + " needs a value";
+            }
+            else if (!line.empty()) {
+                error = "unexpected \"" + std::string(line) + "\" after the pattern";
+            }
+            else if (kind == "card") {
+                redactor->cards_ = true;
+            }
+            else if (kind == "ssn") {
+                redactor->ssns_ = true;
+            }
+            else if (kind == "word") {
+                if (argument.size() < MIN_ANCHOR_LENGTH) {
+                    error = "word \"" + argument + "\" is too short to match safely";
+                }
+                else {
+                    redactor->addPattern(argument, [](std::string_view value, size_t begin, size_t end, Spans& spans) {
+                        bool starts_word = begin == 0 || !isWordByte(value[begin - 1]) || !isWordByte(value[begin]);
+                        bool ends_word = end == value.size() || !isWordByte(value[end]) || !isWordByte(value[end - 1]);
+                        if (starts_word && ends_word) {
+                            spans.push_back(Span{ begin, end });
+                        }
+                    });
+                }
+            }
+            else {
+                auto anchor = leadingLiteral(argument);
+                std::shared_ptr<const std::regex> regex;
+                try {
+                    regex = std::make_shared<const std::regex>(argument,
+                        std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+                }
+                catch (const std::regex_error& e) {
+                    error = "bad regular expression \"" + argument + "\": " + e.what();
+                }
+                if (!regex) {
+                    // error already set
+                }
+                else if (anchor.size() < MIN_ANCHOR_LENGTH) {
+                    error = "regular expression \"" + argument + "\" must start with at least "
+                        + std::to_string(MIN_ANCHOR_LENGTH) + " literal characters";
+                }
+                else {
+                    redactor->addPattern(anchor, [regex](std::string_view value, size_t begin, size_t, Spans& spans) {
+                        auto first = value.begin() + begin;
+                        auto last = value.begin() + std::min(value.size(), begin + MAX_REGEX_SPAN);
+                        auto flags = std::regex_constants::match_continuous;
+                        if (begin > 0) {
+                            flags |= std::regex_constants::match_prev_avail;
+                        }
+                        std::match_results<std::string_view::const_iterator> match;
+                        if (!std::regex_search(first, last, match, *regex, flags)) {
+                            return;
+                        }
+                        size_t group = match.size() > 1 && match[1].matched ? 1 : 0;
+                        size_t match_begin = static_cast<size_t>(match[group].first - value.begin());
+                        size_t match_end = static_cast<size_t>(match[group].second - value.begin());
+                        if (match_end > match_begin) {
+                            spans.push_back(Span{ match_begin, match_end });
+                        }
+                    });
+                }
+            }
+
+            if (!error.empty() && errors) {
+                errors->push_back(CompileError{ line_number, error });
+            }
+        }
+
+        for (const auto& pattern : custom) {
+            if (!pattern.anchor.empty() && pattern.verifier) {
+                redactor->addPattern(pattern.anchor, pattern.verifier);
+            }
+        }
+        redactor->build();
+        return redactor;
+    }
+
+    void PiiRedactor::build() {
+        // byte classes: one per distinct (case-folded) byte the anchors use,
+        // 0 for everything else
+        class_count_ = 1;
+        for (const auto& anchor : anchors_) {
+            for (char c : anchor) {
+                auto byte = static_cast<unsigned char>(c);
+                if (class_of_[byte] == 0) {
+                    class_of_[byte] = static_cast<std::uint8_t>(class_count_++);
+                }
+            }
+        }
+        for (int byte = 'A'; byte <= 'Z'; ++byte) {
+            class_of_[byte] = class_of_[tolower(byte)];
+        }
+
+        // the trie, with -1 for no edge yet
+        std::vector<std::vector<std::int64_t>> edges(1, std::vector<std::int64_t>(class_count_, -1));
+        std::vector<std::vector<std::uint32_t>> matches(1);
+        for (size_t p = 0; p < anchors_.size(); ++p) {
+            size_t state = 0;
+            for (char c : anchors_[p]) {
+                auto cls = class_of_[static_cast<unsigned char>(c)];
+                if (edges[state][cls] < 0) {
+                    edges[state][cls] = static_cast<std::int64_t>(edges.size());
+                    edges.emplace_back(class_count_, -1);
+                    matches.emplace_back();
+                }
+                state = static_cast<size_t>(edges[state][cls]);
+            }
+            matches[state].push_back(static_cast<std::uint32_t>(p));
+        }
+
+        // failure links breadth first, filling in every missing edge so the
+        // scan never has to follow them
+        std::vector<std::uint32_t> failure(edges.size(), 0);
+        std::deque<std::uint32_t> queue;
+        for (size_t cls = 0; cls < class_count_; ++cls) {
+            if (edges[0][cls] < 0) {
+                edges[0][cls] = 0;
+            }
+            else {
+                queue.push_back(static_cast<std::uint32_t>(edges[0][cls]));
+            }
+        }
+        while (!queue.empty()) {
+            auto state = queue.front();
+            queue.pop_front();
+            // everything that ends at the failure state ends here too
+            const auto& inherited = matches[failure[state]];
+            matches[state].insert(matches[state].end(), inherited.begin(), inherited.end());
+            for (size_t cls = 0; cls < class_count_; ++cls) {
+                auto next = edges[state][cls];
+                auto fallback = edges[failure[state]][cls];
+                if (next < 0) {
+                    edges[state][cls] = fallback;
+                }
+                else {
+                    failure[next] = static_cast<std::uint32_t>(fallback);
+                    queue.push_back(static_cast<std::uint32_t>(next));
+                }
+            }
+        }
+
+        transitions_.resize(edges.size() * class_count_);
+        output_begin_.assign(edges.size() + 1, 0);
+        outputs_.clear();
+        for (size_t state = 0; state < edges.size(); ++state) {
+            for (size_t cls = 0; cls < class_count_; ++cls) {
+                transitions_[state * class_count_ + cls] = static_cast<std::uint32_t>(edges[state][cls]);
+            }
+            output_begin_[state] = static_cast<std::uint32_t>(outputs_.size());
+            outputs_.insert(outputs_.end(), matches[state].begin(), matches[state].end());
+        }
+        output_begin_[edges.size()] = static_cast<std::uint32_t>(outputs_.size());
+        anchors_.clear();
+        anchors_.shrink_to_fit();
+    }
+
+    void PiiRedactor::checkDigitRun(std::string_view text, size_t begin, size_t end, Spans& spans) const {
+        // a number glued to a word is an identifier, not a card or an SSN
+        if ((begin > 0 && isalpha(static_cast<unsigned char>(text[begin - 1])))
+            || (end < text.size() && isalpha(static_cast<unsigned char>(text[end])))) {
+            return;
+        }
+        char digits[20];
+        size_t digit_count = 0;
+        for (size_t i = begin; i < end; ++i) {
+            if (isDigit(text[i])) {
+                if (digit_count == sizeof(digits)) {
+                    return;
+                }
+                digits[digit_count++] = text[i];
+            }
+        }
+        if (cards_ && digit_count >= 13 && digit_count <= 19 && luhnValid(digits, digit_count)) {
+            spans.push_back(Span{ begin, end });
+            return;
+        }
+        if (ssns_ && end - begin == 11 && digit_count == 9 && text[begin + 3] == '-' && text[begin + 6] == '-') {
+            // never issued: area 000, 666 or 9xx, group 00, serial 0000
+            bool area_ok = memcmp(digits, "000", 3) != 0 && memcmp(digits, "666", 3) != 0 && digits[0] != '9';
+            if (area_ok && memcmp(digits + 3, "00", 2) != 0 && memcmp(digits + 5, "0000", 4) != 0) {
+                spans.push_back(Span{ begin, end });
+            }
+        }
+    }
+
+    void PiiRedactor::scan(std::string_view text, Spans& spans) const {
+        spans.clear();
+        bool track_digits = cards_ || ssns_;
+        bool automaton = !patterns_.empty();
+        std::uint32_t state = 0;
+        size_t run_begin = 0;
+        size_t run_end = 0;         // one past the run's last digit
+        bool in_run = false;
+
+        for (size_t i = 0; i < text.size(); ++i) {
+            char c = text[i];
+            if (automaton) {
+                state = transitions_[state * class_count_ + class_of_[static_cast<unsigned char>(c)]];
+                for (auto o = output_begin_[state]; o < output_begin_[state + 1]; ++o) {
+                    const auto& pattern = patterns_[outputs_[o]];
+                    pattern.verifier(text, i + 1 - pattern.anchor_length, i + 1, spans);
+                }
+            }
+            if (track_digits) {
+                if (isDigit(c)) {
+                    if (!in_run) {
+                        in_run = true;
+                        run_begin = i;
+                    }
+                    run_end = i + 1;
+                }
+                else if (in_run && !((c == ' ' || c == '-') && run_end == i)) {
+                    // anything but a single separator ends the run
+                    checkDigitRun(text, run_begin, run_end, spans);
+                    in_run = false;
+                }
+            }
+        }
+        if (in_run) {
+            checkDigitRun(text, run_begin, run_end, spans);
+        }
+
+        // verifiers add spans as their anchors end, so sort by where they start
+        std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.begin < b.begin; });
+    }
+
+    void PiiRedactor::mask(char* text, size_t length, const Spans& spans, bool json) {
+        if (!json) {
+            for (const auto& span : spans) {
+                for (size_t i = span.begin; i < span.end; ++i) {
+                    auto byte = static_cast<unsigned char>(text[i]);
+                    if (isalnum(byte) || byte >= 0x80) {
+                        text[i] = MASK;
+                    }
+                }
+            }
+            return;
+        }
+        // from the start, since a span can begin inside an escape sequence,
+        // which has to be left whole: \n, \", \u00e9.  A span also stops at
+        // the end of the string it began in; a greedy regex would otherwise
+        // run on through the keys that follow.
+        size_t next_span = 0;
+        size_t masked_to = 0;
+        for (size_t i = 0; i < length; ++i) {
+            while (next_span < spans.size() && spans[next_span].begin <= i) {
+                masked_to = std::max(masked_to, spans[next_span].end);
+                ++next_span;
+            }
+            auto byte = static_cast<unsigned char>(text[i]);
+            if (byte == '\\') {
+                i += i + 1 < length && text[i + 1] == 'u' ? 5 : 1;
+            }
+            else if (byte == '"') {
+                masked_to = std::min(masked_to, i);
+                if (next_span == spans.size()) {
+                    break;
+                }
+            }
+            else if (i < masked_to && (isalnum(byte) || byte >= 0x80)) {
+                text[i] = MASK;
+            }
+            else if (i >= masked_to && next_span == spans.size()) {
+                break;
+            }
+        }
+    }
+
+    size_t PiiRedactor::redact(std::string_view text, char* out, size_t out_size) const {
+        Spans spans;
+        scan(text, spans);
+        if (spans.size() == 0) {
+            return 0;
+        }
+        if (text.size() + 1 > out_size) {
+            return NO_ROOM;
+        }
+        memcpy(out, text.data(), text.size());
+        out[text.size()] = 0;
+        mask(out, text.size(), spans, false);
+        return text.size();
+    }
+
+    size_t PiiRedactor::redactJsonInPlace(char* text, size_t length) const {
+        Spans spans;
+        scan(std::string_view(text, length), spans);
+        mask(text, length, spans, true);
+        return spans.size();
+    }
+}
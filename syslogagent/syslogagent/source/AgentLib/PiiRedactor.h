@@ -0,0 +1,121 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "framework.h"
+#include "SmallVector.h"
+
+// PiiRedactor masks sensitive values (card numbers, national IDs, named
+// accounts, anything a regular expression can describe) in event text
+// before it's escaped and sent.
+//
+// The patterns are plain text, one per line:
+//
+//   # payment card numbers that pass the Luhn check, and US SSNs
+//   card
+//   ssn
+//   # these accounts, as whole words, in any case
+//   word jsmith
+//   word "svc_payroll"
+//   # the first group if there is one, else the whole match
+//   regex "password=(\S+)"
+//
+// Scanning a value is one pass however many patterns there are.  Every
+// word, and the literal each regular expression starts with (its anchor,
+// at least MIN_ANCHOR_LENGTH characters), goes into one Aho-Corasick
+// automaton, compiled to a table over the byte classes the literals use,
+// so each byte costs one lookup.  Only where an anchor matches is the
+// pattern's verifier called: the word-boundary check for words, the
+// regular expression from that point for regexes.  card and ssn have no
+// literal to anchor on; the same pass tracks runs of digits (grouped by
+// single spaces or dashes) and verifies each run as it ends.  Anchors and
+// regular expressions are case-insensitive.
+//
+// Masking replaces letters, digits and non-ASCII bytes with '*' and keeps
+// punctuation, so a value keeps its length and shape (a card number comes
+// out as "****-****-****-****") and masking JSON text in place can never
+// break its structure.  A compiled redactor is immutable and can be
+// shared between threads.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API PiiRedactor {
+    public:
+        struct Span {
+            size_t begin;
+            size_t end;
+        };
+        typedef SmallVector<Span, 8> Spans;
+        // Called where a pattern's anchor matched text at [anchor_begin,
+        // anchor_end); adds what should be masked, if anything, to spans.
+        typedef std::function<void(std::string_view text, size_t anchor_begin, size_t anchor_end,
+            Spans& spans)> Verifier;
+        // A pattern supplied in code rather than in the text
+        struct CustomPattern {
+            std::string anchor;
+            Verifier verifier;
+        };
+
+        struct CompileError {
+            int line;
+            std::string message;
+        };
+
+        static constexpr size_t MIN_ANCHOR_LENGTH = 3;
+        static constexpr size_t MAX_REGEX_SPAN = 1024;     // longest text a regex is run over
+        static constexpr size_t NO_ROOM = static_cast<size_t>(-1);
+        static constexpr char MASK = '*';
+
+        // Compiles the patterns; lines with errors are skipped and reported in errors.
+        static std::shared_ptr<const PiiRedactor> compile(std::string_view text,
+            std::vector<CompileError>* errors = nullptr,
+            const std::vector<CustomPattern>& custom = std::vector<CustomPattern>());
+
+        // Finds everything to mask in text, in order of where it starts.
+        void scan(std::string_view text, Spans& spans) const;
+        // Writes text to out with its sensitive parts masked, null terminated.
+        // Returns the length written, 0 if there was nothing to mask (and
+        // nothing was written), or NO_ROOM if there was but out is too small.
+        size_t redact(std::string_view text, char* out, size_t out_size) const;
+        // Masks text where it is, skipping over JSON escape sequences, for
+        // text that's already JSON.  Returns the number of spans masked.
+        size_t redactJsonInPlace(char* text, size_t length) const;
+
+        size_t patternCount() const { return patterns_.size() + (cards_ ? 1 : 0) + (ssns_ ? 1 : 0); }
+
+    private:
+        struct Pattern {
+            size_t anchor_length;
+            Verifier verifier;
+        };
+
+        PiiRedactor() = default;
+
+        void addPattern(std::string_view anchor, Verifier verifier);
+        void build();
+        void checkDigitRun(std::string_view text, size_t begin, size_t end, Spans& spans) const;
+        static void mask(char* text, size_t length, const Spans& spans, bool json);
+
+        std::vector<Pattern> patterns_;
+        std::vector<std::string> anchors_;          // lower case, while compiling
+        bool cards_ = false;
+        bool ssns_ = false;
+
+        // the automaton: transitions_[state * class_count_ + class_of_[byte]]
+        std::uint8_t class_of_[256] = {};
+        size_t class_count_ = 1;
+        std::vector<std::uint32_t> transitions_;
+        std::vector<std::uint32_t> output_begin_;   // per state, into outputs_; one past the end at state + 1
+        std::vector<std::uint32_t> outputs_;        // pattern indexes
+    };
+}
@@ -0,0 +1,150 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "PublisherMetadataCache.h"
+#include <chrono>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    PublisherMetadataCache::PublisherMetadataCache(
+        std::shared_ptr<IPublisherMetadataOpener> opener,
+        size_t capacity,
+        std::int64_t ttl_ms,
+        std::int64_t negative_ttl_ms,
+        Clock clock)
+        : opener_(opener),
+        capacity_(capacity > 0 ? capacity : 1),
+        ttl_ms_(ttl_ms),
+        negative_ttl_ms_(negative_ttl_ms),
+        clock_(clock) {
+    }
+
+    PublisherMetadataCache::~PublisherMetadataCache() {
+        clear();
+    }
+
+    std::int64_t PublisherMetadataCache::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    PublisherMetadataCache::HandleRef PublisherMetadataCache::wrapHandle(
+        IPublisherMetadataOpener::Handle handle) {
+        // the opener is captured so it outlives any handle still held by a caller
+        auto opener = opener_;
+        return HandleRef(handle, [opener](void* h) { opener->close(h); });
+    }
+
+    PublisherMetadataCache::HandleRef PublisherMetadataCache::acquire(
+        const wchar_t* publisher_name, std::uint32_t* error_out) {
+        auto& stats = AgentStatistics::instance();
+        if (error_out) {
+            *error_out = 0;
+        }
+        if (publisher_name == nullptr || publisher_name[0] == 0) {
+            return HandleRef();
+        }
+        std::wstring_view name(publisher_name);
+        auto current_time = now();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = index_.find(name);
+            if (found != index_.end()) {
+                auto it = found->second;
+                if (it->expires_at > current_time) {
+                    lru_.splice(lru_.begin(), lru_, it);
+                    if (it->handle) {
+                        stats.increment(AgentStatistics::PublisherCacheHits);
+                        return it->handle;
+                    }
+                    stats.increment(AgentStatistics::PublisherCacheUnavailable);
+                    if (error_out) {
+                        *error_out = it->error;
+                    }
+                    return HandleRef();
+                }
+                // expired, reopen it below
+                removeLocked(it);
+            }
+        }
+
+        // open without holding the lock, it can take a while
+        stats.increment(AgentStatistics::PublisherCacheMisses);
+        std::uint32_t error = 0;
+        auto raw_handle = opener_->open(publisher_name, error);
+        Entry entry;
+        entry.name.assign(name);
+        entry.error = error;
+        if (raw_handle != nullptr) {
+            entry.handle = wrapHandle(raw_handle);
+            entry.expires_at = current_time + ttl_ms_;
+        }
+        else {
+            entry.expires_at = current_time + (opener_->isPublisherMissingError(error)
+                ? negative_ttl_ms_ : TRANSIENT_ERROR_TTL_MS);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(name);
+        if (found != index_.end()) {
+            auto it = found->second;
+            if (it->handle && it->expires_at > current_time) {
+                // someone else opened it while we were; keep theirs and let
+                // ours close, once the lock is released
+                lru_.splice(lru_.begin(), lru_, it);
+                return it->handle;
+            }
+            removeLocked(it);
+        }
+        HandleRef result = entry.handle;
+        if (error_out) {
+            *error_out = entry.error;
+        }
+        insertLocked(std::move(entry));
+        return result;
+    }
+
+    void PublisherMetadataCache::insertLocked(Entry&& entry) {
+        while (!lru_.empty() && lru_.size() >= capacity_) {
+            AgentStatistics::instance().increment(AgentStatistics::PublisherCacheEvictions);
+            removeLocked(std::prev(lru_.end()));
+        }
+        lru_.push_front(std::move(entry));
+        index_.emplace(lru_.front().name, lru_.begin());
+    }
+
+    void PublisherMetadataCache::removeLocked(EntryList::iterator it) {
+        index_.erase(it->name);
+        lru_.erase(it);
+    }
+
+    void PublisherMetadataCache::invalidate(const wchar_t* publisher_name) {
+        if (publisher_name == nullptr) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(std::wstring_view(publisher_name));
+        if (found != index_.end()) {
+            removeLocked(found->second);
+        }
+    }
+
+    void PublisherMetadataCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index_.clear();
+        lru_.clear();
+    }
+
+    size_t PublisherMetadataCache::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+}
@@ -0,0 +1,115 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "framework.h"
+
+// PublisherMetadataCache keeps publisher metadata handles open between events
+// so that message formatting doesn't have to open and close the publisher's
+// metadata for every single event (EvtOpenPublisherMetadata is one of the
+// most expensive calls in the event log API).
+//
+// - Bounded: at most `capacity` publishers are kept, least recently used first out
+// - Entries expire after `ttl_ms` so that reinstalled/updated publishers get
+//   their new message tables picked up
+// - Publishers that can't be opened (uninstalled, no metadata) are remembered
+//   as negative entries for `negative_ttl_ms` so they aren't retried per event
+// - Handles are reference counted; an evicted handle is only closed once the
+//   last caller using it lets go of its HandleRef
+//
+// The actual opening/closing is done through IPublisherMetadataOpener so the
+// cache itself doesn't depend on the Windows event log API.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API IPublisherMetadataOpener {
+    public:
+        typedef void* Handle;
+        virtual ~IPublisherMetadataOpener() = default;
+        // Returns nullptr on failure, with the OS error code in error_out.
+        virtual Handle open(const wchar_t* publisher_name, std::uint32_t& error_out) = 0;
+        virtual void close(Handle handle) = 0;
+        // True if the error means the publisher doesn't exist (anymore), as
+        // opposed to a transient failure that is worth retrying soon.
+        virtual bool isPublisherMissingError(std::uint32_t error) const = 0;
+    };
+
+    class AGENTLIB_API PublisherMetadataCache {
+    public:
+        typedef std::shared_ptr<void> HandleRef;
+        typedef std::function<std::int64_t()> Clock;   // milliseconds, monotonic
+
+        static constexpr size_t DEFAULT_CAPACITY = 256;
+        static constexpr std::int64_t DEFAULT_TTL_MS = 15 * 60 * 1000;
+        static constexpr std::int64_t DEFAULT_NEGATIVE_TTL_MS = 60 * 1000;
+        static constexpr std::int64_t TRANSIENT_ERROR_TTL_MS = 1000;
+
+        PublisherMetadataCache(
+            std::shared_ptr<IPublisherMetadataOpener> opener,
+            size_t capacity = DEFAULT_CAPACITY,
+            std::int64_t ttl_ms = DEFAULT_TTL_MS,
+            std::int64_t negative_ttl_ms = DEFAULT_NEGATIVE_TTL_MS,
+            Clock clock = nullptr);
+        ~PublisherMetadataCache();
+
+        PublisherMetadataCache(const PublisherMetadataCache&) = delete;
+        PublisherMetadataCache& operator=(const PublisherMetadataCache&) = delete;
+
+        // Returns the metadata handle for the publisher, or an empty HandleRef
+        // if it can't be opened (in which case error_out, if given, gets the
+        // error that was returned when it was last tried).
+        HandleRef acquire(const wchar_t* publisher_name, std::uint32_t* error_out = nullptr);
+
+        // Drops the publisher's entry, e.g. when formatting with its handle
+        // fails in a way that suggests the handle has gone stale.
+        void invalidate(const wchar_t* publisher_name);
+        void clear();
+        size_t size() const;
+        size_t capacity() const { return capacity_; }
+
+    private:
+        struct Entry {
+            std::wstring name;
+            HandleRef handle;           // empty for negative entries
+            std::uint32_t error;
+            std::int64_t expires_at;
+        };
+        typedef std::list<Entry> EntryList;
+
+        struct NameHash {
+            using is_transparent = void;
+            size_t operator()(std::wstring_view name) const {
+                return std::hash<std::wstring_view>()(name);
+            }
+        };
+        struct NameEqual {
+            using is_transparent = void;
+            bool operator()(std::wstring_view a, std::wstring_view b) const { return a == b; }
+        };
+
+        HandleRef wrapHandle(IPublisherMetadataOpener::Handle handle);
+        void insertLocked(Entry&& entry);
+        void removeLocked(EntryList::iterator it);
+        std::int64_t now() const;
+
+        std::shared_ptr<IPublisherMetadataOpener> opener_;
+        size_t capacity_;
+        std::int64_t ttl_ms_;
+        std::int64_t negative_ttl_ms_;
+        Clock clock_;
+        EntryList lru_;             // most recently used at the front
+        std::unordered_map<std::wstring, EntryList::iterator, NameHash, NameEqual> index_;
+        mutable std::mutex mutex_;
+    };
+}
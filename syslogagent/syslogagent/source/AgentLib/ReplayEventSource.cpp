@@ -0,0 +1,40 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "ReplayEventSource.h"
+
+namespace Syslog_agent {
+
+    ReplayEventSource::ReplayEventSource(std::vector<std::string> events, size_t repeat, TaskFactory factory)
+        : events_(std::move(events)),
+        repeat_(repeat),
+        factory_(std::move(factory)) {
+    }
+
+    std::vector<std::string> ReplayEventSource::readRecording(std::istream& recording) {
+        std::vector<std::string> events;
+        std::string line;
+        while (std::getline(recording, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.find_first_not_of(" \t") != std::string::npos) {
+                events.push_back(std::move(line));
+            }
+        }
+        return events;
+    }
+
+    size_t ReplayEventSource::next(std::unique_ptr<OrderedWorkPool::Task>* tasks, size_t max) {
+        const std::uint64_t total = static_cast<std::uint64_t>(events_.size()) * repeat_;
+        size_t count = 0;
+        while (count < max && position_ < total) {
+            tasks[count++] = factory_(events_[position_ % events_.size()], position_);
+            ++position_;
+        }
+        return count;
+    }
+}
@@ -0,0 +1,42 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+#include "EventSource.h"
+#include "framework.h"
+
+// ReplayEventSource plays back recorded events, one event's XML per line
+// of the recording, `repeat` times over.  What is done with each is up to
+// the task factory, which gets the event and its position in the replay.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API ReplayEventSource : public EventSource {
+    public:
+        typedef std::function<std::unique_ptr<OrderedWorkPool::Task>(const std::string& event_xml,
+            std::uint64_t sequence)> TaskFactory;
+
+        ReplayEventSource(std::vector<std::string> events, size_t repeat, TaskFactory factory);
+
+        // One event per line; blank lines are skipped
+        static std::vector<std::string> readRecording(std::istream& recording);
+
+        size_t next(std::unique_ptr<OrderedWorkPool::Task>* tasks, size_t max) override;
+
+        size_t eventCount() const { return events_.size(); }
+
+    private:
+        std::vector<std::string> events_;
+        size_t repeat_;
+        TaskFactory factory_;
+        std::uint64_t position_ = 0;
+    };
+}
@@ -0,0 +1,96 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "SentRecordTracker.h"
+
+namespace Syslog_agent {
+
+    bool SentRecordTracker::alreadySent(std::uint64_t record_id) const {
+        if (empty() || record_id > high_) {
+            return false;
+        }
+        std::uint64_t offset = high_ - record_id;
+        return offset < WINDOW && bit(offset);
+    }
+
+    void SentRecordTracker::markSent(std::uint64_t record_id) {
+        if (record_id == 0) {
+            return;
+        }
+        if (empty() || record_id > high_) {
+            shift(empty() ? WINDOW : record_id - high_);
+            high_ = record_id;
+            setBit(0);
+            return;
+        }
+        std::uint64_t offset = high_ - record_id;
+        if (offset < WINDOW) {
+            setBit(offset);
+            return;
+        }
+        // the IDs started over
+        bits_.fill(0);
+        high_ = record_id;
+        setBit(0);
+    }
+
+    void SentRecordTracker::shift(std::uint64_t distance) {
+        if (distance >= WINDOW) {
+            bits_.fill(0);
+            return;
+        }
+        const size_t word_shift = static_cast<size_t>(distance / 64);
+        const unsigned bit_shift = static_cast<unsigned>(distance % 64);
+        for (size_t i = WORDS; i-- > 0;) {
+            std::uint64_t word = 0;
+            if (i >= word_shift) {
+                word = bits_[i - word_shift] << bit_shift;
+                if (bit_shift != 0 && i > word_shift) {
+                    word |= bits_[i - word_shift - 1] >> (64 - bit_shift);
+                }
+            }
+            bits_[i] = word;
+        }
+    }
+
+    size_t SentRecordTracker::serialize(unsigned char* out, size_t size) const {
+        if (size < STATE_SIZE) {
+            return 0;
+        }
+        for (size_t i = 0; i < sizeof(high_); ++i) {
+            *out++ = static_cast<unsigned char>(high_ >> (8 * i));
+        }
+        for (auto word : bits_) {
+            for (size_t i = 0; i < sizeof(word); ++i) {
+                *out++ = static_cast<unsigned char>(word >> (8 * i));
+            }
+        }
+        return STATE_SIZE;
+    }
+
+    bool SentRecordTracker::deserialize(const unsigned char* in, size_t size) {
+        high_ = 0;
+        bits_.fill(0);
+        if (in == nullptr || size != STATE_SIZE) {
+            return false;
+        }
+        std::uint64_t high = 0;
+        for (size_t i = 0; i < sizeof(high); ++i) {
+            high |= static_cast<std::uint64_t>(*in++) << (8 * i);
+        }
+        for (auto& word : bits_) {
+            word = 0;
+            for (size_t i = 0; i < sizeof(word); ++i) {
+                word |= static_cast<std::uint64_t>(*in++) << (8 * i);
+            }
+        }
+        high_ = high;
+        if (high_ == 0) {
+            bits_.fill(0);
+        }
+        return true;
+    }
+}
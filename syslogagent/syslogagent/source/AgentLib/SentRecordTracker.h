@@ -0,0 +1,62 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "framework.h"
+
+// SentRecordTracker remembers which of a channel's events (by EventRecordID)
+// have been handled, so that after a restart the events between the last
+// saved bookmark and the last one handled are skipped rather than sent
+// again.  The bookmark is only saved every so many events; this state is
+// small enough to save after every group.
+//
+// It's a high-water mark, the highest record ID handled, and a bitmap of
+// the WINDOW IDs up to it.  Records are handled in order, so in practice
+// everything below the mark is set; the bitmap keeps it exact when a query
+// passes over some.  An ID more than WINDOW below the mark is not known,
+// and isn't skipped; seeing one handled means the IDs started over (the
+// log was cleared), and the mark moves back down to it.
+//
+// serialize() writes STATE_SIZE bytes: the mark, little endian, then the
+// bitmap, bit k being mark - k.  Not thread safe; each subscription has
+// its own.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API SentRecordTracker {
+    public:
+        static constexpr std::uint32_t WINDOW = 1024;
+        static constexpr size_t STATE_SIZE = sizeof(std::uint64_t) + WINDOW / 8;
+
+        bool alreadySent(std::uint64_t record_id) const;
+        void markSent(std::uint64_t record_id);
+
+        bool empty() const { return high_ == 0; }
+        std::uint64_t highWaterMark() const { return high_; }
+
+        // Returns the bytes written, STATE_SIZE, or 0 if `size` is smaller
+        size_t serialize(unsigned char* out, size_t size) const;
+        // False, leaving the tracker empty, if the state isn't STATE_SIZE bytes
+        bool deserialize(const unsigned char* in, size_t size);
+
+    private:
+        static constexpr size_t WORDS = WINDOW / 64;
+
+        bool bit(std::uint64_t offset) const {
+            return (bits_[offset / 64] >> (offset % 64)) & 1;
+        }
+        void setBit(std::uint64_t offset) {
+            bits_[offset / 64] |= std::uint64_t(1) << (offset % 64);
+        }
+        void shift(std::uint64_t distance);
+
+        std::uint64_t high_ = 0;        // record IDs start at 1
+        std::array<std::uint64_t, WORDS> bits_{};
+    };
+}
@@ -0,0 +1,227 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "SidResolverCache.h"
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include "AgentStatistics.h"
+
+namespace Syslog_agent {
+
+    SidResolverCache::SidResolverCache(
+        std::shared_ptr<ISidResolver> resolver,
+        size_t capacity,
+        std::int64_t ttl_ms,
+        std::int64_t negative_ttl_ms,
+        Clock clock,
+        size_t worker_count)
+        : resolver_(resolver),
+        shard_capacity_(capacity > SHARD_COUNT ? (capacity + SHARD_COUNT - 1) / SHARD_COUNT : 1),
+        ttl_ms_(ttl_ms),
+        negative_ttl_ms_(negative_ttl_ms),
+        clock_(clock),
+        worker_count_(worker_count > 0 ? worker_count : 1) {
+    }
+
+    SidResolverCache::~SidResolverCache() {
+        stop();
+    }
+
+    std::int64_t SidResolverCache::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    SidResolverCache::Shard& SidResolverCache::shardFor(std::string_view sid) {
+        // the top bits, since the shard's own hash table uses the bottom ones
+        size_t hash = SidHash()(sid);
+        return shards_[(hash >> (sizeof(size_t) * 8 - SHARD_BITS)) & (SHARD_COUNT - 1)];
+    }
+
+    size_t SidResolverCache::lookup(std::string_view sid, char* account_out, size_t account_size) {
+        auto& stats = AgentStatistics::instance();
+        if (account_out == nullptr || account_size == 0) {
+            return 0;
+        }
+        account_out[0] = 0;
+        if (sid.size() < 3 || sid.size() > MAX_SID_LENGTH || sid[0] != 'S' || sid[1] != '-') {
+            return 0;
+        }
+        auto current_time = now();
+        bool queue = false;
+        size_t length = 0;
+
+        {
+            Shard& shard = shardFor(sid);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto found = shard.index.find(sid);
+            if (found != shard.index.end()) {
+                auto it = found->second;
+                shard.lru.splice(shard.lru.begin(), shard.lru, it);
+                if (it->expires_at <= current_time) {
+                    // due for a refresh; pushing the expiry out keeps every
+                    // other event for this SID from queueing it again
+                    it->expires_at = current_time + TRANSIENT_ERROR_TTL_MS;
+                    queue = true;
+                }
+                if (!it->account.empty() && it->account.size() < account_size) {
+                    stats.increment(AgentStatistics::SidCacheHits);
+                    length = it->account.size();
+                    memcpy(account_out, it->account.data(), length);
+                    account_out[length] = 0;
+                }
+            }
+            else {
+                stats.increment(AgentStatistics::SidCacheMisses);
+                if (shard.lru.size() >= shard_capacity_) {
+                    shard.index.erase(shard.lru.back().sid);
+                    shard.lru.pop_back();
+                }
+                // a placeholder, for the same reason as above
+                shard.lru.push_front({ std::string(sid), std::string(), current_time + TRANSIENT_ERROR_TTL_MS });
+                shard.index.emplace(shard.lru.front().sid, shard.lru.begin());
+                queue = true;
+            }
+        }
+
+        if (queue) {
+            enqueue(sid);
+        }
+        return length;
+    }
+
+    void SidResolverCache::enqueue(std::string_view sid) {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (stopping_) {
+            return;
+        }
+        if (pending_.size() >= MAX_PENDING) {
+            // the entry's expiry has already been pushed out, it'll be tried again then
+            AgentStatistics::instance().increment(AgentStatistics::SidCacheQueueFull);
+            return;
+        }
+        if (workers_.empty()) {
+            for (size_t i = 0; i < worker_count_; ++i) {
+                workers_.emplace_back(&SidResolverCache::workerLoop, this);
+            }
+        }
+        pending_.emplace_back(sid);
+        queue_cv_.notify_one();
+    }
+
+    void SidResolverCache::workerLoop() {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        while (true) {
+            queue_cv_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            std::string sid = std::move(pending_.front());
+            pending_.pop_front();
+            ++busy_workers_;
+            lock.unlock();
+
+            std::string account;
+            std::uint32_t error = 0;
+            bool resolved = false;
+            try {
+                resolved = resolver_->resolve(sid, account, error);
+            }
+            catch (const std::exception&) {
+                resolved = false;
+            }
+            store(sid, resolved, account, error);
+
+            lock.lock();
+            --busy_workers_;
+            if (pending_.empty() && busy_workers_ == 0) {
+                idle_cv_.notify_all();
+            }
+        }
+    }
+
+    void SidResolverCache::store(const std::string& sid, bool resolved, const std::string& account,
+        std::uint32_t error) {
+        auto& stats = AgentStatistics::instance();
+        auto current_time = now();
+        Shard& shard = shardFor(sid);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto found = shard.index.find(sid);
+        EntryList::iterator it;
+        if (found != shard.index.end()) {
+            it = found->second;
+        }
+        else {
+            // evicted while it was being resolved; it was wanted, so put it back
+            if (shard.lru.size() >= shard_capacity_) {
+                shard.index.erase(shard.lru.back().sid);
+                shard.lru.pop_back();
+            }
+            shard.lru.push_front({ sid, std::string(), 0 });
+            it = shard.lru.begin();
+            shard.index.emplace(it->sid, it);
+        }
+
+        if (resolved && !account.empty() && account.size() < MAX_ACCOUNT_LENGTH) {
+            stats.increment(AgentStatistics::SidCacheResolved);
+            it->account = account;
+            it->expires_at = current_time + ttl_ms_;
+        }
+        else if (resolved || resolver_->isUnmappedError(error)) {
+            stats.increment(AgentStatistics::SidCacheFailures);
+            it->account.clear();
+            it->expires_at = current_time + negative_ttl_ms_;
+        }
+        else {
+            // transient: keep serving whatever name it had
+            stats.increment(AgentStatistics::SidCacheFailures);
+            it->expires_at = current_time + TRANSIENT_ERROR_TTL_MS;
+        }
+    }
+
+    bool SidResolverCache::waitIdle(std::int64_t timeout_ms) {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        return idle_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+            [this]() { return pending_.empty() && busy_workers_ == 0; });
+    }
+
+    void SidResolverCache::stop() {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            stopping_ = true;
+            pending_.clear();
+            workers.swap(workers_);
+        }
+        queue_cv_.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        idle_cv_.notify_all();
+    }
+
+    void SidResolverCache::clear() {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.index.clear();
+            shard.lru.clear();
+        }
+    }
+
+    size_t SidResolverCache::size() const {
+        size_t total = 0;
+        for (const auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.lru.size();
+        }
+        return total;
+    }
+}
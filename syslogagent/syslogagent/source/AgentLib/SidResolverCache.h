@@ -0,0 +1,144 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "framework.h"
+
+// SidResolverCache turns SIDs ("S-1-5-21-...") into account names for the
+// lookup_accounts option without ever making an event wait on the lookup.
+// Resolving a domain SID can mean a round trip to a domain controller that
+// takes hundreds of milliseconds, far too long to hold up a subscription
+// callback, so:
+//
+// - lookup() only ever reads the cache.  A SID that isn't there yet is
+//   queued for a background worker and the caller emits just the SID; later
+//   events for it get the name once it's been resolved.
+// - Bounded: at most `capacity` SIDs are kept, least recently used first
+//   out, in shards so concurrent subscriptions rarely contend.
+// - Names are refreshed in the background after `ttl_ms`; until the refresh
+//   finishes the old name keeps being returned.
+// - SIDs that don't map to an account (deleted users, capability SIDs) are
+//   remembered as negative entries for `negative_ttl_ms`, and transient
+//   failures (DC unreachable) for TRANSIENT_ERROR_TTL_MS, so neither is
+//   retried per event.
+//
+// The resolving is done through ISidResolver so the cache can be tested
+// without LookupAccountSid.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API ISidResolver {
+    public:
+        virtual ~ISidResolver() = default;
+        // Resolves the SID to "DOMAIN\name" (or just "name"), returning false
+        // with the OS error code in error_out on failure.  May block.
+        virtual bool resolve(const std::string& sid, std::string& account_out, std::uint32_t& error_out) = 0;
+        // True if the error means the SID has no account, as opposed to a
+        // failure that is worth retrying soon.
+        virtual bool isUnmappedError(std::uint32_t error) const = 0;
+    };
+
+    class AGENTLIB_API SidResolverCache {
+    public:
+        typedef std::function<std::int64_t()> Clock;   // milliseconds, monotonic
+
+        static constexpr size_t DEFAULT_CAPACITY = 4096;
+        static constexpr std::int64_t DEFAULT_TTL_MS = 30 * 60 * 1000;
+        static constexpr std::int64_t DEFAULT_NEGATIVE_TTL_MS = 10 * 60 * 1000;
+        static constexpr std::int64_t TRANSIENT_ERROR_TTL_MS = 30 * 1000;
+        static constexpr size_t DEFAULT_WORKER_COUNT = 2;
+        static constexpr size_t MAX_PENDING = 1024;         // more queued SIDs than this are retried later
+        static constexpr size_t MAX_SID_LENGTH = 184;       // SECURITY_MAX_SID_STRING_CHARACTERS, less the null
+        static constexpr size_t MAX_ACCOUNT_LENGTH = 512;
+
+        SidResolverCache(
+            std::shared_ptr<ISidResolver> resolver,
+            size_t capacity = DEFAULT_CAPACITY,
+            std::int64_t ttl_ms = DEFAULT_TTL_MS,
+            std::int64_t negative_ttl_ms = DEFAULT_NEGATIVE_TTL_MS,
+            Clock clock = nullptr,
+            size_t worker_count = DEFAULT_WORKER_COUNT);
+        ~SidResolverCache();
+
+        SidResolverCache(const SidResolverCache&) = delete;
+        SidResolverCache& operator=(const SidResolverCache&) = delete;
+
+        // Copies the SID's account name, null-terminated, into account_out and
+        // returns its length, or returns 0 if the name isn't known (yet).
+        // Never waits on the resolver.
+        size_t lookup(std::string_view sid, char* account_out, size_t account_size);
+
+        // Waits up to timeout_ms for the queued lookups to finish; true if they did
+        bool waitIdle(std::int64_t timeout_ms);
+        // Stops the workers; anything still queued is dropped
+        void stop();
+        void clear();
+        size_t size() const;
+        size_t capacity() const { return shard_capacity_ * SHARD_COUNT; }
+
+    private:
+        static constexpr size_t SHARD_BITS = 4;
+        static constexpr size_t SHARD_COUNT = 1 << SHARD_BITS;
+
+        struct Entry {
+            std::string sid;
+            std::string account;        // empty until resolved, and for negative entries
+            std::int64_t expires_at;
+        };
+        typedef std::list<Entry> EntryList;
+
+        struct SidHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view sid) const {
+                return std::hash<std::string_view>()(sid);
+            }
+        };
+        struct SidEqual {
+            using is_transparent = void;
+            bool operator()(std::string_view a, std::string_view b) const { return a == b; }
+        };
+
+        struct Shard {
+            EntryList lru;              // most recently used at the front
+            std::unordered_map<std::string, EntryList::iterator, SidHash, SidEqual> index;
+            mutable std::mutex mutex;
+        };
+
+        Shard& shardFor(std::string_view sid);
+        void enqueue(std::string_view sid);
+        void workerLoop();
+        void store(const std::string& sid, bool resolved, const std::string& account, std::uint32_t error);
+        std::int64_t now() const;
+
+        std::shared_ptr<ISidResolver> resolver_;
+        size_t shard_capacity_;
+        std::int64_t ttl_ms_;
+        std::int64_t negative_ttl_ms_;
+        Clock clock_;
+        size_t worker_count_;
+        Shard shards_[SHARD_COUNT];
+
+        std::deque<std::string> pending_;
+        size_t busy_workers_ = 0;
+        bool stopping_ = false;
+        std::vector<std::thread> workers_;     // started on the first miss
+        std::mutex queue_mutex_;
+        std::condition_variable queue_cv_;
+        std::condition_variable idle_cv_;
+    };
+}
@@ -0,0 +1,68 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// SmallVector keeps its first N elements inline (on the stack when the
+// vector is a local) and only allocates once more than N are added, at
+// which point everything moves to a std::vector.  It's meant for short
+// per-event lists, such as an event's EventData pairs, where nearly every
+// event fits inline but there must be no fixed upper limit.
+//
+// Only what the agent needs is provided.  T must be default constructible
+// and copyable; the inline slots are default constructed up front, so keep
+// T small and cheap (views, ints).
+
+namespace Syslog_agent {
+
+    template <typename T, size_t N>
+    class SmallVector {
+    public:
+        SmallVector() = default;
+
+        void push_back(const T& value) {
+            if (!on_heap_) {
+                if (size_ < N) {
+                    inline_[size_++] = value;
+                    return;
+                }
+                heap_.reserve(N * 2);
+                heap_.assign(inline_, inline_ + size_);
+                on_heap_ = true;
+            }
+            heap_.push_back(value);
+            ++size_;
+        }
+
+        void clear() {
+            heap_.clear();
+            on_heap_ = false;
+            size_ = 0;
+        }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        bool isInline() const { return !on_heap_; }
+        static constexpr size_t inlineCapacity() { return N; }
+
+        T* data() { return on_heap_ ? heap_.data() : inline_; }
+        const T* data() const { return on_heap_ ? heap_.data() : inline_; }
+        T& operator[](size_t index) { return data()[index]; }
+        const T& operator[](size_t index) const { return data()[index]; }
+        T* begin() { return data(); }
+        T* end() { return data() + size_; }
+        const T* begin() const { return data(); }
+        const T* end() const { return data() + size_; }
+
+    private:
+        T inline_[N];
+        std::vector<T> heap_;
+        size_t size_ = 0;
+        bool on_heap_ = false;
+    };
+}
@@ -0,0 +1,219 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "TemplateMiner.h"
+#include <chrono>
+#include <cstring>
+
+namespace Syslog_agent {
+
+    namespace {
+        bool isSpace(char c) {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+
+        bool hasDigit(std::string_view word) {
+            for (char c : word) {
+                if (c >= '0' && c <= '9') {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    TemplateMiner::TemplateMiner(
+        size_t max_templates,
+        double similarity,
+        std::int64_t announce_interval_ms,
+        Clock clock)
+        : max_templates_(max_templates),
+        similarity_(similarity),
+        announce_interval_ms_(announce_interval_ms),
+        clock_(clock) {
+    }
+
+    std::int64_t TemplateMiner::now() const {
+        if (clock_) {
+            return clock_();
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool TemplateMiner::tokenize(std::string_view message, Tokens& tokens) {
+        tokens.clear();
+        size_t i = 0;
+        while (i < message.size()) {
+            if (tokens.size() >= MAX_TOKENS) {
+                return false;
+            }
+            size_t start = i;
+            bool space = isSpace(message[i]);
+            while (i < message.size() && isSpace(message[i]) == space) {
+                ++i;
+            }
+            if (!space && message.substr(start, i - start).find(WILDCARD) != std::string_view::npos) {
+                return false;
+            }
+            tokens.push_back({ static_cast<std::uint32_t>(start), static_cast<std::uint32_t>(i - start), space });
+        }
+        return !tokens.empty();
+    }
+
+    TemplateMiner::Node& TemplateMiner::leafFor(std::string_view message, const Tokens& tokens) {
+        Node* node = &roots_[tokens.size()];
+        size_t depth = 0;
+        for (const auto& token : tokens) {
+            if (depth >= PREFIX_DEPTH) {
+                break;
+            }
+            if (token.space) {
+                continue;
+            }
+            ++depth;
+            std::string word(hasDigit(message.substr(token.offset, token.length))
+                ? std::string_view(WILDCARD) : message.substr(token.offset, token.length));
+            auto found = node->children.find(word);
+            if (found == node->children.end()) {
+                // one slot is kept for the wildcard branch the rest share
+                if (node->children.size() + 1 >= MAX_CHILDREN) {
+                    word = WILDCARD;
+                    found = node->children.find(word);
+                }
+                if (found == node->children.end()) {
+                    found = node->children.emplace(word, std::make_unique<Node>()).first;
+                }
+            }
+            node = found->second.get();
+        }
+        return *node;
+    }
+
+    bool TemplateMiner::mine(std::string_view message, Match& out) {
+        out.announce = false;
+        out.template_text.clear();
+        out.params.clear();
+        Tokens tokens;
+        if (!tokenize(message, tokens)) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        Node& leaf = leafFor(message, tokens);
+
+        // the template sharing the most words; on a tie, the more general one
+        Template* best = nullptr;
+        double best_similarity = -1.0;
+        size_t best_wildcards = 0;
+        for (size_t index : leaf.templates) {
+            Template& candidate = templates_[index];
+            size_t same = 0;
+            size_t wildcards = 0;
+            bool fits = true;
+            for (size_t i = 0; i < tokens.size(); ++i) {
+                std::string_view token = message.substr(tokens[i].offset, tokens[i].length);
+                if (candidate.wildcard[i]) {
+                    ++wildcards;
+                }
+                else if (candidate.tokens[i] == token) {
+                    same += tokens[i].space ? 0 : 1;
+                }
+                else if (tokens[i].space) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (!fits) {
+                continue;
+            }
+            double similarity = candidate.word_count > 0
+                ? static_cast<double>(same) / static_cast<double>(candidate.word_count) : 1.0;
+            if (similarity > best_similarity || (similarity == best_similarity && wildcards > best_wildcards)) {
+                best = &candidate;
+                best_similarity = similarity;
+                best_wildcards = wildcards;
+            }
+        }
+
+        if (best == nullptr || best_similarity < similarity_) {
+            if (templates_.size() >= max_templates_) {
+                return false;
+            }
+            Template learned;
+            learned.id = next_id_++;
+            learned.tokens.reserve(tokens.size());
+            learned.wildcard.assign(tokens.size(), false);
+            learned.word_count = 0;
+            learned.announced_at = -1;
+            for (const auto& token : tokens) {
+                learned.tokens.emplace_back(message.substr(token.offset, token.length));
+                learned.word_count += token.space ? 0 : 1;
+            }
+            leaf.templates.push_back(templates_.size());
+            templates_.push_back(std::move(learned));
+            best = &templates_.back();
+        }
+        else {
+            // words that differ become wildcards, and the template a new ID
+            bool widened = false;
+            for (size_t i = 0; i < tokens.size(); ++i) {
+                if (!best->wildcard[i] && best->tokens[i] != message.substr(tokens[i].offset, tokens[i].length)) {
+                    best->wildcard[i] = true;
+                    best->tokens[i].clear();
+                    widened = true;
+                }
+            }
+            if (widened) {
+                best->id = next_id_++;
+                best->announced_at = -1;
+            }
+        }
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (best->wildcard[i]) {
+                out.params.push_back(message.substr(tokens[i].offset, tokens[i].length));
+            }
+        }
+        out.template_id = best->id;
+        auto current_time = now();
+        if (best->announced_at < 0 || current_time - best->announced_at >= announce_interval_ms_) {
+            best->announced_at = current_time;
+            out.announce = true;
+            for (size_t i = 0; i < best->tokens.size(); ++i) {
+                out.template_text += best->wildcard[i] ? std::string_view(WILDCARD) : std::string_view(best->tokens[i]);
+            }
+        }
+        return true;
+    }
+
+    std::string TemplateMiner::expand(std::string_view template_text, const std::string_view* params,
+        size_t param_count) {
+        std::string message;
+        message.reserve(template_text.size() * 2);
+        size_t wildcard_length = strlen(WILDCARD);
+        size_t next_param = 0;
+        size_t pos = 0;
+        while (pos < template_text.size()) {
+            size_t found = template_text.find(WILDCARD, pos);
+            if (found == std::string_view::npos) {
+                message.append(template_text.substr(pos));
+                break;
+            }
+            message.append(template_text.substr(pos, found - pos));
+            if (next_param < param_count) {
+                message.append(params[next_param++]);
+            }
+            pos = found + wildcard_length;
+        }
+        return message;
+    }
+
+    size_t TemplateMiner::templateCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return templates_.size();
+    }
+}
@@ -0,0 +1,119 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "framework.h"
+#include "SmallVector.h"
+
+// TemplateMiner learns message templates online (the Drain algorithm) so
+// the rendered message can be sent as a template ID and the parameters that
+// vary, rather than the full prose every time.
+//
+// A message is split into alternating word and whitespace tokens.  Messages
+// are grouped by token count and then by their first PREFIX_DEPTH words
+// (words with digits in them are treated as variable and grouped together),
+// and within a group a message joins the template it shares the most words
+// with, if that's at least `similarity` of them.  Words where the message
+// and the template differ become wildcards.  Whitespace has to match
+// exactly, so expand() gives back the original message byte for byte.
+//
+// Template IDs never change meaning: when a template gains a wildcard it
+// gets a new ID.  mine() says when the template text has to go with the
+// message: the first time an ID is used, and again every
+// `announce_interval_ms` so a receiver that restarted picks it up.  IDs are
+// per process; a receiver should treat an ID it hasn't seen the text for
+// as unknown.
+//
+// Memory is bounded by `max_templates`; once that many are known, messages
+// that fit none of them aren't mined.  Messages containing the wildcard
+// itself ("<*>") are never mined, since they couldn't be expanded.
+
+namespace Syslog_agent {
+
+    class AGENTLIB_API TemplateMiner {
+    public:
+        typedef std::function<std::int64_t()> Clock;   // milliseconds, monotonic
+
+        static constexpr size_t DEFAULT_MAX_TEMPLATES = 4096;
+        static constexpr double DEFAULT_SIMILARITY = 0.5;
+        static constexpr std::int64_t DEFAULT_ANNOUNCE_INTERVAL_MS = 10 * 60 * 1000;
+        static constexpr size_t PREFIX_DEPTH = 2;       // leading words the groups branch on
+        static constexpr size_t MAX_CHILDREN = 64;      // branches per word before the rest share one
+        static constexpr size_t MAX_TOKENS = 2048;      // longer messages aren't mined
+        static constexpr const char* WILDCARD = "<*>";
+
+        typedef SmallVector<std::string_view, 16> Params;
+
+        struct Match {
+            std::uint32_t template_id = 0;
+            bool announce = false;          // the template text has to be sent with this message
+            std::string template_text;      // set when announce is
+            Params params;                  // views into the message, in order
+        };
+
+        TemplateMiner(
+            size_t max_templates = DEFAULT_MAX_TEMPLATES,
+            double similarity = DEFAULT_SIMILARITY,
+            std::int64_t announce_interval_ms = DEFAULT_ANNOUNCE_INTERVAL_MS,
+            Clock clock = nullptr);
+
+        TemplateMiner(const TemplateMiner&) = delete;
+        TemplateMiner& operator=(const TemplateMiner&) = delete;
+
+        // Finds or learns the message's template.  Returns false if the
+        // message isn't mined and should be sent as it is.
+        bool mine(std::string_view message, Match& out);
+
+        // The message a template and its parameters stand for
+        static std::string expand(std::string_view template_text, const std::string_view* params,
+            size_t param_count);
+
+        size_t templateCount() const;
+
+    private:
+        struct Token {
+            std::uint32_t offset;
+            std::uint32_t length;
+            bool space;
+        };
+        typedef SmallVector<Token, 64> Tokens;
+
+        struct Template {
+            std::uint32_t id;
+            std::vector<std::string> tokens;
+            std::vector<bool> wildcard;
+            size_t word_count;
+            std::int64_t announced_at;      // -1 until its ID has been sent
+        };
+
+        struct Node {
+            std::unordered_map<std::string, std::unique_ptr<Node>> children;
+            std::vector<size_t> templates;  // into templates_, at the leaves
+        };
+
+        static bool tokenize(std::string_view message, Tokens& tokens);
+        Node& leafFor(std::string_view message, const Tokens& tokens);
+        std::int64_t now() const;
+
+        size_t max_templates_;
+        double similarity_;
+        std::int64_t announce_interval_ms_;
+        Clock clock_;
+
+        std::unordered_map<size_t, Node> roots_;    // by token count
+        std::vector<Template> templates_;
+        std::uint32_t next_id_ = 1;
+        mutable std::mutex mutex_;
+    };
+}
@@ -0,0 +1,183 @@
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
+
+#include "pch.h"
+#include "Utf8Transcoder.h"
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define UTF8_TRANSCODER_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+    const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+    bool isHighSurrogate(uint32_t unit) { return unit >= 0xD800 && unit <= 0xDBFF; }
+    bool isLowSurrogate(uint32_t unit) { return unit >= 0xDC00 && unit <= 0xDFFF; }
+
+    // Decodes the character at input[i], returning its code point and how
+    // many code units it took
+    uint32_t decode(const char16_t* input, size_t i, size_t length, size_t& units) {
+        uint32_t unit = input[i];
+        units = 1;
+        if (isHighSurrogate(unit)) {
+            if (i + 1 < length && isLowSurrogate(input[i + 1])) {
+                units = 2;
+                return 0x10000 + ((unit - 0xD800) << 10) + (static_cast<uint32_t>(input[i + 1]) - 0xDC00);
+            }
+            return REPLACEMENT_CHARACTER;
+        }
+        if (isLowSurrogate(unit)) {
+            return REPLACEMENT_CHARACTER;
+        }
+        return unit;
+    }
+
+    size_t encodedLength(uint32_t code_point) {
+        return code_point < 0x80 ? 1 : code_point < 0x800 ? 2 : code_point < 0x10000 ? 3 : 4;
+    }
+
+    void encode(uint32_t code_point, size_t encoded_length, char* output) {
+        switch (encoded_length) {
+        case 1:
+            output[0] = static_cast<char>(code_point);
+            break;
+        case 2:
+            output[0] = static_cast<char>(0xC0 | (code_point >> 6));
+            output[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+            break;
+        case 3:
+            output[0] = static_cast<char>(0xE0 | (code_point >> 12));
+            output[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            output[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+            break;
+        default:
+            output[0] = static_cast<char>(0xF0 | (code_point >> 18));
+            output[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            output[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            output[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+            break;
+        }
+    }
+
+#ifdef UTF8_TRANSCODER_SSE2
+    unsigned countTrailingZeros(unsigned value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+    }
+
+    // Narrows the 16 code units at input to bytes in output and returns how
+    // many of them, from the start, were ASCII.  All 16 output bytes are
+    // written either way; the ones past the ASCII run get overwritten.
+    size_t asciiBlock(const char16_t* input, char* output) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_packus_epi16(first, second));
+        const __m128i non_ascii_bits = _mm_set1_epi16(static_cast<short>(0xFF80));
+        __m128i first_ascii = _mm_cmpeq_epi16(_mm_and_si128(first, non_ascii_bits), _mm_setzero_si128());
+        __m128i second_ascii = _mm_cmpeq_epi16(_mm_and_si128(second, non_ascii_bits), _mm_setzero_si128());
+        // one bit per code unit, set where it's ASCII
+        unsigned ascii_mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_packs_epi16(first_ascii, second_ascii)));
+        if (ascii_mask == 0xFFFF) {
+            return 16;
+        }
+        return countTrailingZeros(~ascii_mask);
+    }
+#endif
+
+    size_t transcode(const char16_t* input, size_t length, char* output, size_t output_size, bool use_simd) {
+        if (output == nullptr || output_size == 0) {
+            return Utf8Transcoder::utf8Length(input, length);
+        }
+        char* out = output;
+        char* out_end = output + output_size - 1;     // room for the null
+        size_t i = 0;
+        size_t simd_from = 0;       // where to try the SIMD path again
+        while (i < length) {
+#ifdef UTF8_TRANSCODER_SSE2
+            if (use_simd && i >= simd_from) {
+                while (i + 16 <= length && out_end - out >= 16) {
+                    size_t ascii_count = asciiBlock(input + i, out);
+                    i += ascii_count;
+                    out += ascii_count;
+                    if (ascii_count < 16) {
+                        // text that isn't mostly ASCII would otherwise retry on
+                        // every character; give the scalar path the rest of the block
+                        simd_from = ascii_count == 0 ? i + 16 : i + 1;
+                        break;
+                    }
+                }
+                if (i >= length) {
+                    break;
+                }
+            }
+#endif
+            uint32_t unit = input[i];
+            if (unit < 0x80) {
+                if (out >= out_end) {
+                    break;
+                }
+                *out++ = static_cast<char>(unit);
+                ++i;
+                continue;
+            }
+            size_t units;
+            uint32_t code_point = decode(input, i, length, units);
+            size_t encoded_length = encodedLength(code_point);
+            if (static_cast<size_t>(out_end - out) < encoded_length) {
+                break;
+            }
+            encode(code_point, encoded_length, out);
+            out += encoded_length;
+            i += units;
+        }
+        *out = '\0';
+        size_t written = static_cast<size_t>(out - output);
+        return i < length ? written + Utf8Transcoder::utf8Length(input + i, length - i) : written;
+    }
+}
+
+size_t Utf8Transcoder::utf8Length(const char16_t* input, size_t length) {
+    size_t total = 0;
+    for (size_t i = 0; i < length; ) {
+        uint32_t unit = input[i];
+        if (unit < 0x80) {
+            ++total;
+            ++i;
+            continue;
+        }
+        size_t units;
+        total += encodedLength(decode(input, i, length, units));
+        i += units;
+    }
+    return total;
+}
+
+size_t Utf8Transcoder::utf16ToUtf8(const char16_t* input, size_t length, char* output, size_t output_size) {
+    return transcode(input, length, output, output_size, true);
+}
+
+size_t Utf8Transcoder::utf16ToUtf8(const char16_t* input, char* output, size_t output_size) {
+    size_t length = 0;
+    while (input[length] != 0) {
+        ++length;
+    }
+    return transcode(input, length, output, output_size, true);
+}
+
+size_t Utf8Transcoder::utf16ToUtf8Scalar(const char16_t* input, size_t length, char* output, size_t output_size) {
+    return transcode(input, length, output, output_size, false);
+}
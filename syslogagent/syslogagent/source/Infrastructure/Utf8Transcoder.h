@@ -0,0 +1,60 @@
+#pragma once
+
+#ifdef _WIN32
+#ifdef INFRASTRUCTURE_STATIC
+#define TRANSCODER_API
+#else
+#ifdef INFRASTRUCTURE_EXPORTS
+#define TRANSCODER_API __declspec(dllexport)
+#else
+#define TRANSCODER_API __declspec(dllimport)
+#endif
+#endif
+#else
+#define TRANSCODER_API
+#endif
+
+#include <cstddef>
+#include <cwchar>
+
+// Utf8Transcoder converts UTF-16 to UTF-8 in a single pass.  Runs of ASCII,
+// which is nearly all of an event's XML and most message text, are
+// converted 16 code units at a time with SSE2 where it's available (any
+// x86/x64 build); everything else goes through the scalar path.  Unlike
+// WideCharToMultiByte there's no sizing call first: the output is filled
+// directly, and if it's too small the return value says how much was
+// needed, snprintf style.
+//
+// Unpaired surrogates become U+FFFD, as they do with WideCharToMultiByte.
+
+class TRANSCODER_API Utf8Transcoder {
+public:
+    // Converts length code units of input.  Writes as many whole characters
+    // as fit in output_size - 1 bytes and a terminating null, and returns the
+    // UTF-8 length of the entire input (not counting the null); a result
+    // >= output_size means the output was truncated.
+    static size_t utf16ToUtf8(const char16_t* input, size_t length, char* output, size_t output_size);
+    // Same, for null-terminated input
+    static size_t utf16ToUtf8(const char16_t* input, char* output, size_t output_size);
+
+    // UTF-8 length of length code units of input
+    static size_t utf8Length(const char16_t* input, size_t length);
+
+    // Three bytes per code unit always suffices (a surrogate pair's two units become four)
+    static constexpr size_t maxUtf8Length(size_t utf16_length) { return utf16_length * 3; }
+
+    // The same conversion without SIMD, as a reference for tests and benchmarks
+    static size_t utf16ToUtf8Scalar(const char16_t* input, size_t length, char* output, size_t output_size);
+
+#if WCHAR_MAX == 0xFFFF
+    static size_t utf16ToUtf8(const wchar_t* input, size_t length, char* output, size_t output_size) {
+        return utf16ToUtf8(reinterpret_cast<const char16_t*>(input), length, output, output_size);
+    }
+    static size_t utf16ToUtf8(const wchar_t* input, char* output, size_t output_size) {
+        return utf16ToUtf8(reinterpret_cast<const char16_t*>(input), output, output_size);
+    }
+#endif
+
+private:
+    Utf8Transcoder() = delete;
+};
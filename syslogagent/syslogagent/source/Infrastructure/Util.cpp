@@ -24,6 +24,7 @@ Copyright 2021 Logzilla Corp.
 #include <TlHelp32.h>
 #include "Util.h"
 #include "Logger.h"
+#include "Utf8Transcoder.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
@@ -57,24 +58,25 @@ size_t Util::wstr2str(char* dest, size_t dest_size, const wchar_t* src)
 {
     if (!dest || !src || dest_size == 0) return 0;
 
-    size_t converted = 0;
-    if (WideCharToMultiByte(CP_UTF8, 0, src, -1, dest, static_cast<int>(dest_size), NULL, NULL)) {
-        converted = strlen(dest);
+    size_t needed = Utf8Transcoder::utf16ToUtf8(src, wcslen(src), dest, dest_size);
+    if (needed >= dest_size) {
+        // doesn't fit
+        dest[0] = '\0';
+        return 0;
     }
-    dest[dest_size - 1] = '\0';  // Ensure null termination
-    return converted;
+    return needed;
 }
 
 size_t Util::wstr2str_truncate(char* dest, size_t dest_size, const wchar_t* src)
 {
     if (!dest || !src || dest_size == 0) return 0;
 
-    size_t converted = wstr2str(dest, dest_size, src);
-    if (converted >= dest_size - 1) {
-        dest[dest_size - 1] = '\0';
-        return dest_size - 1;
+    size_t needed = Utf8Transcoder::utf16ToUtf8(src, wcslen(src), dest, dest_size);
+    if (needed >= dest_size) {
+        // cut at the last whole character that fit
+        return strlen(dest);
     }
-    return converted;
+    return needed;
 }
 
 size_t Util::toLowercase(wchar_t* str) {
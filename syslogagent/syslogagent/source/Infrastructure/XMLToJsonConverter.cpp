@@ -1,31 +1,646 @@
-#pragma once
+/*
+SyslogAgent: a syslog agent for Windows
+Copyright 2025 Logzilla Corp.
+*/
 
 #include "pch.h"
-#include <string>
-#include <map>
+#include "XMLToJsonConverter.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
 #include <vector>
-#include <cstdint>
-
-class XMLToJSONConverter {
-public:
-    static std::string convert(const std::string& xml);
-    static std::string convert(const char* utf8Xml);  // zero-terminated UTF-8 string
-    static std::string convert(const char* utf8Xml, size_t bufferSize);  // UTF-8 string with explicit size
-    static std::string escapeJSONString(const std::string& input);
-
-private:
-    struct XMLNode {
-        std::string name;
-        std::string text;
-        std::map<std::string, std::string> attributes;
-        std::vector<XMLNode> children;
+
+namespace {
+
+    struct Slice {
+        const char* data;
+        size_t length;
+
+        bool equals(const Slice& other) const {
+            return length == other.length && memcmp(data, other.data, length) == 0;
+        }
+        bool equals(const char* text) const {
+            size_t text_length = strlen(text);
+            return length == text_length && memcmp(data, text, length) == 0;
+        }
+    };
+
+    // Bump allocator whose first block is inline.  Allocations are released
+    // in stack order by rewinding to an earlier mark; blocks are kept for
+    // reuse.  Only trivially destructible things go in here.
+    class Arena {
+    public:
+        struct Mark {
+            size_t block;
+            size_t used;
+        };
+
+        Arena() : block_(0), used_(0) {}
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        template <typename T>
+        T* make() {
+            return new (allocate(sizeof(T))) T();
+        }
+
+        Mark mark() const { return Mark{ block_, used_ }; }
+        void rewind(Mark mark) {
+            block_ = mark.block;
+            used_ = mark.used;
+        }
+
+    private:
+        static constexpr size_t INLINE_SIZE = 2048;
+        static constexpr size_t HEAP_BLOCK_SIZE = 8192;
+        static constexpr size_t ALIGNMENT = alignof(std::max_align_t);
+
+        struct Block {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        char* blockData(size_t block) { return block == 0 ? inline_ : blocks_[block - 1].data.get(); }
+        size_t blockSize(size_t block) const { return block == 0 ? INLINE_SIZE : blocks_[block - 1].size; }
+
+        void* allocate(size_t size) {
+            size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+            if (used_ + size > blockSize(block_)) {
+                ++block_;
+                used_ = 0;
+                if (block_ > blocks_.size()) {
+                    blocks_.push_back(Block{ nullptr, 0 });
+                }
+                // a block past the current one is unused, so a too-small one can be replaced
+                auto& block = blocks_[block_ - 1];
+                if (block.size < size) {
+                    block.size = size > HEAP_BLOCK_SIZE ? size : HEAP_BLOCK_SIZE;
+                    block.data.reset(new char[block.size]);
+                }
+            }
+            void* result = blockData(block_) + used_;
+            used_ += size;
+            return result;
+        }
+
+        alignas(std::max_align_t) char inline_[INLINE_SIZE];
+        std::vector<Block> blocks_;
+        size_t block_;
+        size_t used_;
+    };
+
+    class JsonOutput {
+    public:
+        // leaves room for the terminating null
+        JsonOutput(char* buffer, size_t buffer_size)
+            : start_(buffer), pos_(buffer), end_(buffer + buffer_size - 1), overflow_(false) {}
+
+        void put(char c) {
+            if (pos_ < end_) {
+                *pos_++ = c;
+            }
+            else {
+                overflow_ = true;
+            }
+        }
+
+        void write(const char* text, size_t length) {
+            if (static_cast<size_t>(end_ - pos_) >= length) {
+                memcpy(pos_, text, length);
+                pos_ += length;
+            }
+            else {
+                overflow_ = true;
+            }
+        }
+
+        void escapeChar(unsigned char c) {
+            static const char HEX[] = "0123456789abcdef";
+            switch (c) {
+            case '"': write("\\\"", 2); break;
+            case '\\': write("\\\\", 2); break;
+            case '\n': write("\\n", 2); break;
+            case '\r': write("\\r", 2); break;
+            case '\t': write("\\t", 2); break;
+            case '\b': write("\\b", 2); break;
+            case '\f': write("\\f", 2); break;
+            default:
+                if (c < 0x20) {
+                    char escaped[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0x0F] };
+                    write(escaped, sizeof(escaped));
+                }
+                else {
+                    put(static_cast<char>(c));
+                }
+            }
+        }
+
+        // JSON-escapes text; with decode_entities, XML entity and character
+        // references are decoded first
+        void text(const char* text, size_t length, bool decode_entities) {
+            const char* run = text;
+            const char* stop = text + length;
+            for (const char* c = text; c < stop; ) {
+                unsigned char ch = static_cast<unsigned char>(*c);
+                if (ch == '"' || ch == '\\' || ch < 0x20) {
+                    write(run, c - run);
+                    escapeChar(ch);
+                    run = ++c;
+                }
+                else if (ch == '&' && decode_entities) {
+                    write(run, c - run);
+                    c = entity(c, stop);
+                    run = c;
+                }
+                else {
+                    ++c;
+                }
+            }
+            write(run, stop - run);
+        }
+
+        bool overflowed() const { return overflow_; }
+        size_t finish() {
+            *pos_ = '\0';
+            return static_cast<size_t>(pos_ - start_);
+        }
+
+    private:
+        // Writes the reference starting at amp and returns what follows it.
+        // Anything unrecognized is written literally.
+        const char* entity(const char* amp, const char* stop) {
+            const char* semicolon = static_cast<const char*>(
+                memchr(amp, ';', stop - amp < 12 ? stop - amp : 12));
+            if (semicolon != nullptr) {
+                Slice name{ amp + 1, static_cast<size_t>(semicolon - amp - 1) };
+                char named = 0;
+                if (name.equals("lt")) named = '<';
+                else if (name.equals("gt")) named = '>';
+                else if (name.equals("amp")) named = '&';
+                else if (name.equals("quot")) named = '"';
+                else if (name.equals("apos")) named = '\'';
+                if (named != 0) {
+                    escapeChar(static_cast<unsigned char>(named));
+                    return semicolon + 1;
+                }
+                if (name.length > 1 && name.data[0] == '#') {
+                    unsigned long code_point = 0;
+                    bool hex = name.data[1] == 'x';
+                    bool valid = name.length > (hex ? 2u : 1u);
+                    for (size_t i = hex ? 2 : 1; i < name.length && valid; ++i) {
+                        char d = name.data[i];
+                        int digit = (d >= '0' && d <= '9') ? d - '0'
+                            : (hex && d >= 'a' && d <= 'f') ? d - 'a' + 10
+                            : (hex && d >= 'A' && d <= 'F') ? d - 'A' + 10 : -1;
+                        valid = digit >= 0 && code_point <= 0x10FFFF;
+                        code_point = code_point * (hex ? 16 : 10) + digit;
+                    }
+                    if (valid && code_point > 0 && code_point <= 0x10FFFF) {
+                        // a surrogate isn't a character, and has no UTF-8;
+                        // U+FFFD instead, as Utf8Transcoder writes for one unpaired
+                        if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+                            code_point = 0xFFFD;
+                        }
+                        codePoint(code_point);
+                        return semicolon + 1;
+                    }
+                }
+            }
+            put('&');
+            return amp + 1;
+        }
+
+        void codePoint(unsigned long code_point) {
+            if (code_point < 0x80) {
+                escapeChar(static_cast<unsigned char>(code_point));
+            }
+            else if (code_point < 0x800) {
+                put(static_cast<char>(0xC0 | (code_point >> 6)));
+                put(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else if (code_point < 0x10000) {
+                put(static_cast<char>(0xE0 | (code_point >> 12)));
+                put(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                put(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+            else {
+                put(static_cast<char>(0xF0 | (code_point >> 18)));
+                put(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+                put(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+                put(static_cast<char>(0x80 | (code_point & 0x3F)));
+            }
+        }
+
+        char* start_;
+        char* pos_;
+        char* end_;
+        bool overflow_;
+    };
+
+    class StreamingConverter {
+    public:
+        StreamingConverter(const char* xml, size_t xml_length, char* json_buffer, size_t buffer_size)
+            : pos_(xml), end_(xml + xml_length), out_(json_buffer, buffer_size) {}
+
+        size_t run() {
+            if (!skipMisc() || pos_ >= end_) {
+                return 0;
+            }
+            Object root;
+            out_.put('{');
+            if (!element(root, 0)) {
+                return 0;
+            }
+            out_.put('}');
+            if (!skipMisc() || pos_ != end_ || out_.overflowed()) {
+                return 0;
+            }
+            return out_.finish();
+        }
+
+    private:
+        static constexpr int MAX_DEPTH = 64;
+
+        struct Attribute {
+            Slice name;
+            Slice value;
+            Attribute* next;
+        };
+        // names already used in an open object, to number repeats
+        struct KeyUse {
+            Slice key;
+            unsigned count;
+            KeyUse* next;
+        };
+        struct Object {
+            KeyUse* keys = nullptr;
+            bool has_members = false;
+        };
+
+        static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+        bool startsWith(const char* text) const {
+            size_t length = strlen(text);
+            return static_cast<size_t>(end_ - pos_) >= length && memcmp(pos_, text, length) == 0;
+        }
+
+        static const char* find(const char* from, const char* to, const char* text) {
+            size_t length = strlen(text);
+            while (from + length <= to) {
+                auto candidate = static_cast<const char*>(memchr(from, text[0], to - from));
+                if (candidate == nullptr || candidate + length > to) {
+                    return nullptr;
+                }
+                if (memcmp(candidate, text, length) == 0) {
+                    return candidate;
+                }
+                from = candidate + 1;
+            }
+            return nullptr;
+        }
+
+        void skipSpace() {
+            while (pos_ < end_ && isSpace(*pos_)) {
+                ++pos_;
+            }
+        }
+
+        // Skips markup that carries no content: <!-- -->, <? ?>, <!DOCTYPE >
+        // Returns false if it isn't terminated.
+        bool skipMarkup() {
+            const char* close;
+            if (startsWith("<!--")) {
+                close = find(pos_ + 4, end_, "-->");
+                pos_ = close ? close + 3 : nullptr;
+            }
+            else if (startsWith("<?")) {
+                close = find(pos_ + 2, end_, "?>");
+                pos_ = close ? close + 2 : nullptr;
+            }
+            else {
+                close = static_cast<const char*>(memchr(pos_, '>', end_ - pos_));
+                pos_ = close ? close + 1 : nullptr;
+            }
+            return pos_ != nullptr;
+        }
+
+        // whitespace and markup around the root element
+        bool skipMisc() {
+            while (true) {
+                skipSpace();
+                if (startsWith("<?") || startsWith("<!")) {
+                    if (!skipMarkup()) {
+                        return false;
+                    }
+                }
+                else {
+                    return true;
+                }
+            }
+        }
+
+        Slice readName() {
+            const char* start = pos_;
+            while (pos_ < end_ && !isSpace(*pos_) && *pos_ != '/' && *pos_ != '>' && *pos_ != '=') {
+                ++pos_;
+            }
+            return Slice{ start, static_cast<size_t>(pos_ - start) };
+        }
+
+        // Writes ,"key": with a suffix if the key is already used in object
+        void beginMember(Object& object, Slice key, bool decode_key) {
+            unsigned count = 1;
+            KeyUse* found = nullptr;
+            for (KeyUse* use = object.keys; use != nullptr; use = use->next) {
+                if (use->key.equals(key)) {
+                    found = use;
+                    break;
+                }
+            }
+            if (found != nullptr) {
+                count = ++found->count;
+            }
+            else {
+                auto use = keys_.make<KeyUse>();
+                *use = KeyUse{ key, 1, object.keys };
+                object.keys = use;
+            }
+            if (object.has_members) {
+                out_.put(',');
+            }
+            object.has_members = true;
+            out_.put('"');
+            out_.text(key.data, key.length, decode_key);
+            if (count > 1) {
+                char suffix[16];
+                int length = snprintf(suffix, sizeof(suffix), "_%u", count);
+                out_.write(suffix, static_cast<size_t>(length));
+            }
+            out_.write("\":", 2);
+        }
+
+        // After a start tag: whether child elements come before the end tag.
+        bool hasChildElements() const {
+            const char* scan = pos_;
+            while (scan < end_) {
+                scan = static_cast<const char*>(memchr(scan, '<', end_ - scan));
+                if (scan == nullptr || scan + 1 >= end_ || scan[1] == '/') {
+                    return false;
+                }
+                const char* terminator;
+                if (scan[1] == '?') {
+                    terminator = "?>";
+                }
+                else if (scan[1] == '!') {
+                    terminator = (scan + 2 < end_ && scan[2] == '[') ? "]]>" : "-->";
+                }
+                else {
+                    return true;
+                }
+                const char* close = find(scan + 2, end_, terminator);
+                if (close == nullptr) {
+                    return false;
+                }
+                scan = close + strlen(terminator);
+            }
+            return false;
+        }
+
+        // At "</": reads the end tag, which must close name
+        bool endTag(Slice name) {
+            pos_ += 2;
+            if (!readName().equals(name)) {
+                return false;
+            }
+            skipSpace();
+            if (pos_ >= end_ || *pos_ != '>') {
+                return false;
+            }
+            ++pos_;
+            return true;
+        }
+
+        // At "<![CDATA[": writes its content as text
+        bool cdata() {
+            const char* start = pos_ + 9;
+            const char* close = find(start, end_, "]]>");
+            if (close == nullptr) {
+                return false;
+            }
+            out_.text(start, close - start, false);
+            pos_ = close + 3;
+            return true;
+        }
+
+        // Content of an element with only text, up to and including its end tag
+        bool textContent(Slice name) {
+            while (true) {
+                auto lt = static_cast<const char*>(memchr(pos_, '<', end_ - pos_));
+                if (lt == nullptr) {
+                    return false;
+                }
+                out_.text(pos_, lt - pos_, true);
+                pos_ = lt;
+                if (startsWith("</")) {
+                    return endTag(name);
+                }
+                if (startsWith("<![CDATA[")) {
+                    if (!cdata()) {
+                        return false;
+                    }
+                }
+                else if (startsWith("<!--") || startsWith("<?")) {
+                    if (!skipMarkup()) {
+                        return false;
+                    }
+                }
+                else {
+                    return false;
+                }
+            }
+        }
+
+        // Content of an element written as an object, up to and including its end tag
+        bool objectContent(Object& object, Slice name, int depth) {
+            static const Slice TEXT_KEY{ "#text", 5 };
+            while (true) {
+                auto lt = static_cast<const char*>(memchr(pos_, '<', end_ - pos_));
+                if (lt == nullptr) {
+                    return false;
+                }
+                const char* text_start = pos_;
+                while (text_start < lt && isSpace(*text_start)) {
+                    ++text_start;
+                }
+                if (text_start < lt) {
+                    beginMember(object, TEXT_KEY, false);
+                    out_.put('"');
+                    out_.text(pos_, lt - pos_, true);
+                    out_.put('"');
+                }
+                pos_ = lt;
+                if (startsWith("</")) {
+                    return endTag(name);
+                }
+                if (startsWith("<![CDATA[")) {
+                    beginMember(object, TEXT_KEY, false);
+                    out_.put('"');
+                    if (!cdata()) {
+                        return false;
+                    }
+                    out_.put('"');
+                }
+                else if (startsWith("<!--") || startsWith("<?")) {
+                    if (!skipMarkup()) {
+                        return false;
+                    }
+                }
+                else if (!element(object, depth + 1)) {
+                    return false;
+                }
+                if (out_.overflowed()) {
+                    return false;
+                }
+            }
+        }
+
+        // At '<' of a start tag: writes the element as a member of parent
+        bool element(Object& parent, int depth) {
+            if (depth > MAX_DEPTH) {
+                return false;
+            }
+            ++pos_;
+            Slice name = readName();
+            if (name.length == 0) {
+                return false;
+            }
+
+            // attributes are collected first: a Data element's key is its Name
+            auto attribute_mark = attributes_.mark();
+            Attribute* first_attribute = nullptr;
+            Attribute** next_attribute = &first_attribute;
+            size_t attribute_count = 0;
+            bool self_closing = false;
+            while (true) {
+                skipSpace();
+                if (pos_ >= end_) {
+                    return false;
+                }
+                if (*pos_ == '>') {
+                    ++pos_;
+                    break;
+                }
+                if (*pos_ == '/') {
+                    if (pos_ + 1 >= end_ || pos_[1] != '>') {
+                        return false;
+                    }
+                    pos_ += 2;
+                    self_closing = true;
+                    break;
+                }
+                Slice attribute_name = readName();
+                skipSpace();
+                if (attribute_name.length == 0 || pos_ >= end_ || *pos_ != '=') {
+                    return false;
+                }
+                ++pos_;
+                skipSpace();
+                if (pos_ >= end_ || (*pos_ != '"' && *pos_ != '\'')) {
+                    return false;
+                }
+                auto close = static_cast<const char*>(memchr(pos_ + 1, *pos_, end_ - pos_ - 1));
+                if (close == nullptr) {
+                    return false;
+                }
+                auto attribute = attributes_.make<Attribute>();
+                *attribute = Attribute{ attribute_name, Slice{ pos_ + 1, static_cast<size_t>(close - pos_ - 1) }, nullptr };
+                *next_attribute = attribute;
+                next_attribute = &attribute->next;
+                ++attribute_count;
+                pos_ = close + 1;
+            }
+
+            Slice key = name;
+            bool decode_key = false;
+            if (attribute_count == 1 && name.equals("Data") && first_attribute->name.equals("Name")) {
+                key = first_attribute->value;
+                decode_key = true;
+                first_attribute = nullptr;
+            }
+
+            beginMember(parent, key, decode_key);
+            if (first_attribute == nullptr && (self_closing || !hasChildElements())) {
+                attributes_.rewind(attribute_mark);
+                out_.put('"');
+                if (!self_closing && !textContent(name)) {
+                    return false;
+                }
+                out_.put('"');
+                return true;
+            }
+
+            Object object;
+            auto keys_mark = keys_.mark();
+            out_.put('{');
+            for (auto attribute = first_attribute; attribute != nullptr; attribute = attribute->next) {
+                beginMember(object, attribute->name, false);
+                out_.put('"');
+                out_.text(attribute->value.data, attribute->value.length, true);
+                out_.put('"');
+            }
+            attributes_.rewind(attribute_mark);
+            if (!self_closing && !objectContent(object, name, depth)) {
+                return false;
+            }
+            out_.put('}');
+            keys_.rewind(keys_mark);
+            return true;
+        }
+
+        const char* pos_;
+        const char* end_;
+        JsonOutput out_;
+        Arena attributes_;
+        Arena keys_;
     };
+}
+
+size_t XMLToJSONConverter::convert(const char* xml, size_t xml_length, char* json_buffer, size_t buffer_size) {
+    if (xml == nullptr || json_buffer == nullptr || buffer_size == 0) {
+        return 0;
+    }
+    json_buffer[0] = '\0';
+    StreamingConverter converter(xml, xml_length, json_buffer, buffer_size);
+    size_t length = converter.run();
+    if (length == 0) {
+        json_buffer[0] = '\0';
+    }
+    return length;
+}
+
+std::string XMLToJSONConverter::convert(const char* utf8Xml, size_t bufferSize) {
+    if (utf8Xml == nullptr) {
+        return std::string();
+    }
+    // escaping can grow a character to six; markup never grows that much
+    std::vector<char> buffer(bufferSize * 6 + 16);
+    size_t length = convert(utf8Xml, bufferSize, buffer.data(), buffer.size());
+    return std::string(buffer.data(), length);
+}
+
+std::string XMLToJSONConverter::convert(const char* utf8Xml) {
+    return utf8Xml == nullptr ? std::string() : convert(utf8Xml, strlen(utf8Xml));
+}
 
-    static XMLNode parseXML(const std::string& xml, size_t& pos);
-    static std::string nodeToJSON(const XMLNode& node);
+std::string XMLToJSONConverter::convert(const std::string& xml) {
+    return convert(xml.data(), xml.size());
+}
 
-    XMLToJSONConverter() = delete;
-    ~XMLToJSONConverter() = delete;
-    XMLToJSONConverter(const XMLToJSONConverter&) = delete;
-    XMLToJSONConverter& operator=(const XMLToJSONConverter&) = delete;
-};
+std::string XMLToJSONConverter::escapeJSONString(const std::string& input) {
+    std::vector<char> buffer(input.size() * 6 + 1);
+    JsonOutput out(buffer.data(), buffer.size());
+    out.text(input.data(), input.size(), false);
+    size_t length = out.finish();
+    return std::string(buffer.data(), length);
+}
@@ -1,28 +1,58 @@
 #pragma once
 
+#ifdef _WIN32
+#ifdef INFRASTRUCTURE_STATIC
+#define XMLTOJSON_API
+#else
+#ifdef INFRASTRUCTURE_EXPORTS
+#define XMLTOJSON_API __declspec(dllexport)
+#else
+#define XMLTOJSON_API __declspec(dllimport)
+#endif
+#endif
+#else
+#define XMLTOJSON_API
+#endif
+
+#include <cstddef>
 #include <string>
-#include <map>
-#include <vector>
-#include <cstdint>
 
-class XMLToJSONConverter {
+// XMLToJSONConverter turns a complete event XML document (System, EventData,
+// UserData, RenderingInfo, whatever is there) into JSON in a single pass over
+// the XML text, writing straight into the caller's buffer.  No tree is built;
+// the only allocation is a small arena holding the current start tag's
+// attributes and each open element's child names, and it stays on the stack
+// for any ordinary event.
+//
+// Mapping:
+//   - the document becomes {"<root name>": <root element>}
+//   - an element with no attributes and no child elements becomes its text:
+//     <Level>4</Level>  ->  "Level":"4"
+//   - anything else becomes an object: attributes first, under their own
+//     names, then child elements in document order, with any non-blank text
+//     under "#text"
+//   - <Data Name="X">v</Data> becomes "X":"v", as the agent's EventData
+//     fields always have
+//   - a name repeated within one object gets a numeric suffix on its second
+//     and later uses ("Data", "Data_2", "Data_3"), so nothing is lost to
+//     duplicate keys
+// Entities and character references are decoded, CDATA is taken as text, and
+// comments, processing instructions and the declaration are skipped.  Text is
+// JSON-escaped; UTF-8 passes through unchanged.
+
+class XMLTOJSON_API XMLToJSONConverter {
 public:
+    // Writes the JSON for xml (xml_length bytes, UTF-8) to json_buffer, null
+    // terminated.  Returns the JSON's length, or 0 if the XML is malformed or
+    // the JSON doesn't fit in buffer_size.
+    static size_t convert(const char* xml, size_t xml_length, char* json_buffer, size_t buffer_size);
+
     static std::string convert(const std::string& xml);
     static std::string convert(const char* utf8Xml);  // zero-terminated UTF-8 string
     static std::string convert(const char* utf8Xml, size_t bufferSize);  // UTF-8 string with explicit size
     static std::string escapeJSONString(const std::string& input);
 
 private:
-    struct XMLNode {
-        std::string name;
-        std::string text;
-        std::map<std::string, std::string> attributes;
-        std::vector<XMLNode> children;
-    };
-
-    static XMLNode parseXML(const std::string& xml, size_t& pos);
-    static std::string nodeToJSON(const XMLNode& node);
-
     XMLToJSONConverter() = delete;
     ~XMLToJSONConverter() = delete;
     XMLToJSONConverter(const XMLToJSONConverter&) = delete;